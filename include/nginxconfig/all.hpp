@@ -13,8 +13,27 @@
 #define __NGINXCONFIG_ALL_HPP_INCLUDED__
 
 #include "ast.hpp"
+#include "buffered_output.hpp"
 #include "config.hpp"
+#include "config_builder.hpp"
+#include "config_handle.hpp"
+#include "config_template.hpp"
+#include "crossplane.hpp"
+#include "data_block.hpp"
+#include "effective_config.hpp"
 #include "encode.hpp"
+#include "fingerprint.hpp"
+#include "include_watcher.hpp"
+#include "lint.hpp"
+#include "memory_usage.hpp"
 #include "parse.hpp"
+#include "parse_cache.hpp"
+#include "parse_many.hpp"
+#include "reparse.hpp"
+#include "rewrite.hpp"
+#include "rule_table.hpp"
+#include "schema.hpp"
+#include "select.hpp"
+#include "server_name_index.hpp"
 
 #endif/*__NGINXCONFIG_ALL_HPP_INCLUDED__*/
@@ -14,10 +14,15 @@
 
 #include <nginxconfig/config.hpp>
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <deque>
 #include <iosfwd>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace nginxconfig
 {
@@ -36,6 +41,11 @@ enum class ast_entry_kind : unsigned int
 
 NGINXCONFIG_PUBLIC std::ostream& operator<<(std::ostream& os, const ast_entry_kind& kind);
 
+class ast_entry;
+struct memory_breakdown;
+
+NGINXCONFIG_PUBLIC memory_breakdown memory_usage(const ast_entry& root);
+
 /** Thrown when attempting to perform an operation on an \c ast_entry of the wrong kind. **/
 class NGINXCONFIG_PUBLIC kind_error :
         public std::logic_error
@@ -46,12 +56,34 @@ public:
     virtual ~kind_error() noexcept;
 };
 
+/** Where an entry came from in the text it was parsed from. Offsets are byte offsets into the whole source. Entries
+ *  which were not parsed (such as those created with the \c make_ functions) have all zeros.
+**/
+struct NGINXCONFIG_PUBLIC source_range
+{
+    using size_type = std::size_t;
+    
+    /** The first byte of the entry: the start of its name, the \c # of a comment or the start of a blank line. **/
+    size_type begin      = 0;
+    /** One past the last byte of the entry: its \c ; or \c }, or the end of a comment on the same line. **/
+    size_type end        = 0;
+    /** For \c complex and \c document entries, the first byte after the opening \c {. **/
+    size_type body_begin = 0;
+    /** For \c complex and \c document entries, the first byte of the closing \c }. **/
+    size_type body_end   = 0;
+    /** The line \c begin is on, counting from 1. **/
+    size_type line       = 0;
+};
+
 /** Represents an entry in an nginx configuration file. **/
 class NGINXCONFIG_PUBLIC ast_entry
 {
 public:
     using attribute_list = std::deque<std::string>;
     using child_list     = std::deque<ast_entry>;
+    using size_type      = child_list::size_type;
+    
+    class child_loader;
 
 public:
     /** Create a \c simple AST entry. **/
@@ -106,13 +138,56 @@ public:
     const attribute_list& attributes() const;
     attribute_list&       attributes();
     
-    /** Get the children of a \c complex or \c document entry.
+    /** Get the children of a \c complex or \c document entry. If they were deferred with \c defer_children, the first
+     *  call creates them.
+     *  
+     *  Calling the non-\c const version discards the index used by \c find, \c find_all and \c count, since the
+     *  children might be changed through the returned reference.
      * 
      *  \throws kind_error if \c kind is not \c complex or \c document.
+     *  \throws whatever the \c child_loader throws when loading deferred children (\c parse_error for the ones of
+     *   \c parse_options::lazy_blocks). The children are still deferred and the next call tries again.
     **/
     const child_list& children() const;
     child_list&       children();
     
+    /** Replace the children of a \c complex or \c document entry with the ones \a loader creates the first time anything
+     *  looks at them. Copies of the entry made before that share \a loader and load their own children. Loading is safe
+     *  to do from multiple threads at once, like building the index of \c find.
+     *  
+     *  \throws kind_error if \c kind is not \c complex or \c document.
+    **/
+    void defer_children(std::shared_ptr<const child_loader> loader);
+    
+    /** Check if the children of this entry exist, which is only \c false for deferred children not loaded yet. **/
+    bool children_loaded() const;
+    
+    /** Find the first child of a \c complex or \c document entry with the given \a name. The first lookup on an entry
+     *  builds an index of its children by name, so repeated lookups take constant time. The index is discarded when
+     *  the non-\c const \c children is called; it is safe to call the lookup functions from multiple threads at once.
+     *  
+     *  The children can also change later through a reference kept from \c children. Adding or removing children
+     *  changes their number, and renaming or assigning to any entry (through the non-\c const \c name or
+     *  \c operator=) counts as a change for every index, so the next lookup after either rebuilds the index. Keep
+     *  that in mind when interleaving lookups with renames in a hot loop.
+     *  
+     *  \returns the child or \c nullptr if there is no child named \a name.
+     *  \throws kind_error if \c kind is not \c complex or \c document.
+    **/
+    const ast_entry* find(const std::string& name) const;
+    
+    /** Find all the children of a \c complex or \c document entry with the given \a name, in order.
+     *  
+     *  \throws kind_error if \c kind is not \c complex or \c document.
+    **/
+    std::vector<const ast_entry*> find_all(const std::string& name) const;
+    
+    /** Count the children of a \c complex or \c document entry with the given \a name.
+     *  
+     *  \throws kind_error if \c kind is not \c complex or \c document.
+    **/
+    size_type count(const std::string& name) const;
+    
     /** Get the comment of a \c comment, \c simple or \c complex entry. Comments are appended \e after the closing \c ;
      *  or \c {. For \c document comments, add them as a child.
      *  
@@ -121,19 +196,69 @@ public:
     const std::string& comment() const;
     std::string&       comment();
     
+    /** The number of blank lines before this entry in its source. This is only counted when parsing with
+     *  \c trivia_mode::count, which drops blank lines instead of making comment entries of them; the encoder writes
+     *  these lines back. This is not considered in comparisons.
+    **/
+    std::uint32_t  blank_lines_before() const { return _blank_lines_before; }
+    std::uint32_t& blank_lines_before()       { return _blank_lines_before; }
+    
+    /** Get where this entry came from in its source text. This is not considered in comparisons. **/
+    const source_range& source() const { return _source; }
+    source_range&       source()       { return _source; }
+    
     /** Compare the AST for equality. **/
     bool operator==(const ast_entry& other) const;
     bool operator!=(const ast_entry& other) const;
     
 private:
+    class name_index;
+    class deferred_children;
+    
+    friend memory_breakdown memory_usage(const ast_entry& root);
+    
     explicit ast_entry(ast_entry_kind kind);
     
+    const name_index& index() const;
+    
+    /** The positions of the children named \a name, or \c nullptr if there are none. This checks the index against
+     *  the children and rebuilds it if they were changed without discarding it.
+    **/
+    const std::vector<size_type>* positions_of(const std::string& name) const;
+    
+    void reset_index() noexcept;
+    
+    /** Create the deferred children, if there are any to create. **/
+    void load_children() const;
+    
+    void reset_deferred() noexcept;
+    
+    /** The bytes allocated for the index and the deferred children, for \c memory_usage. **/
+    std::size_t index_bytes() const noexcept;
+    
+    /** Copy the children of \a src, or share its loader if they are still deferred. **/
+    void copy_children(const ast_entry& src);
+    
 private:
-    ast_entry_kind _kind;
-    std::string    _name;
-    attribute_list _attributes;
-    child_list     _children;
-    std::string    _comment;
+    ast_entry_kind                   _kind;
+    std::uint32_t                    _blank_lines_before;
+    std::string                      _name;
+    attribute_list                   _attributes;
+    mutable child_list               _children;
+    std::string                      _comment;
+    source_range                     _source;
+    mutable std::atomic<name_index*> _index;
+    std::atomic<deferred_children*>  _deferred;
+};
+
+/** Creates the children of an entry given to \c ast_entry::defer_children. **/
+class NGINXCONFIG_PUBLIC ast_entry::child_loader
+{
+public:
+    virtual ~child_loader() noexcept;
+    
+    /** Create the children of \a owner. This can be called from multiple threads at once (for different entries). **/
+    virtual child_list load(const ast_entry& owner) const = 0;
 };
 
 NGINXCONFIG_PUBLIC std::ostream& operator<<(std::ostream&, const ast_entry&);
@@ -0,0 +1,91 @@
+/** \file nginxconfig/buffered_output.hpp
+ *  The output buffer behind the writers which format their own text.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_BUFFERED_OUTPUT_HPP_INCLUDED__
+#define __NGINXCONFIG_BUFFERED_OUTPUT_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <iosfwd>
+#include <memory>
+
+namespace nginxconfig
+{
+
+/** A buffer allocated once which is handed to an output stream whenever it fills up. Writing a character or a short
+ *  piece of text is a bounds check and a copy, which is what lets \c config_builder and \c crossplane_encoder write
+ *  without a virtual call or an allocation per piece.
+**/
+class NGINXCONFIG_PUBLIC buffered_output
+{
+public:
+    using size_type = std::size_t;
+
+    /** The smallest buffer: anything written a piece at a time (such as an escape) must fit after a \c drain. **/
+    static constexpr size_type min_buffer_size = 32;
+
+public:
+    /** Write to \a output through a buffer of \a buffer_size bytes (at least \c min_buffer_size). **/
+    buffered_output(std::ostream& output, size_type buffer_size);
+
+    buffered_output(const buffered_output&) = delete;
+    buffered_output& operator=(const buffered_output&) = delete;
+
+    /** Drains whatever is still buffered. Errors from the output are ignored. **/
+    ~buffered_output() noexcept;
+
+    void put(char c)
+    {
+        if (_end == _limit)
+            drain();
+        *_end++ = c;
+    }
+
+    void put(const char* text, size_type length)
+    {
+        if (size_type(_limit - _end) < length)
+            return put_slow(text, length);
+        std::memcpy(_end, text, length);
+        _end += length;
+    }
+
+    template <size_type N>
+    void put_literal(const char (&text)[N])
+    {
+        put(text, N - 1);
+    }
+
+    /** Write \a value in decimal without creating a string, with a \c - in front of it if \a negative. **/
+    void put_integer(unsigned long long value, bool negative = false);
+
+    /** Write the whole buffer to the output and empty it. **/
+    void drain();
+
+    /** Drain the buffer and flush the output stream. **/
+    void flush();
+
+    std::ostream& output() const { return _output; }
+
+private:
+    void put_slow(const char* text, size_type length);
+
+private:
+    std::ostream&           _output;
+    std::unique_ptr<char[]> _buffer;
+    char*                   _end;
+    char*                   _limit;
+};
+
+}
+
+#endif/*__NGINXCONFIG_BUFFERED_OUTPUT_HPP_INCLUDED__*/
@@ -79,6 +79,41 @@
 #   define NGINXCONFIG_LOCAL  NGINXCONFIG_HIDDEN
 #endif
 
+/** \def NGINXCONFIG_PARSE_STATS
+ *  \brief Should the parser be able to collect \c parse_stats and call \c parse_hooks?
+ *  When this is 0, the instrumentation is compiled out of the parser entirely: the types and overloads still exist so
+ *  code using them builds either way, but statistics stay zero and hooks are never called.
+**/
+#ifndef NGINXCONFIG_PARSE_STATS
+#   define NGINXCONFIG_PARSE_STATS 1
+#endif
+
+/** \def NGINXCONFIG_USE_SSE2
+ *  \brief Should SSE2 instructions be used where they help, such as finding the characters JSON strings must escape?
+ *  By default, they are used when the compiler targets a processor which has them. Set this to 0 to always use the
+ *  portable code.
+**/
+#ifndef NGINXCONFIG_USE_SSE2
+#   if defined(__SSE2__)
+#       define NGINXCONFIG_USE_SSE2 1
+#   else
+#       define NGINXCONFIG_USE_SSE2 0
+#   endif
+#endif
+
+/** \def NGINXCONFIG_USE_LIBSTDCXX_INTERNALS
+ *  \brief Should \c memory_usage read the private members of libstdc++ containers to give exact sizes?
+ *  By default, it does when building against libstdc++. Those members are not part of any interface, so set this to 0
+ *  if a version of libstdc++ changes them; sizes are then estimated from what the standard lets callers see.
+**/
+#ifndef NGINXCONFIG_USE_LIBSTDCXX_INTERNALS
+#   if defined(__GLIBCXX__)
+#       define NGINXCONFIG_USE_LIBSTDCXX_INTERNALS 1
+#   else
+#       define NGINXCONFIG_USE_LIBSTDCXX_INTERNALS 0
+#   endif
+#endif
+
 /** \def NGINXCONFIG_NO_RETURN
  *  \brief Mark that a given function will never return control to the caller, either by exiting or throwing an
  *  exception.
@@ -0,0 +1,181 @@
+/** \file nginxconfig/config_builder.hpp
+ *  Writing configuration text directly, without building an AST first.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_CONFIG_BUILDER_HPP_INCLUDED__
+#define __NGINXCONFIG_CONFIG_BUILDER_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+#include <nginxconfig/buffered_output.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <iosfwd>
+#include <string>
+#include <type_traits>
+
+namespace nginxconfig
+{
+
+/** Writes configuration text as it is described, for programs which generate configurations. Building the same thing
+ *  as \c ast_entry objects and then calling \c encode costs several allocations per entry; this writes into a buffer
+ *  allocated once when it is created and hands the buffer to the output stream whenever it fills up:
+ *
+ *  \code
+ *  config_builder out(std::cout);
+ *  out.block("server")
+ *         .directive("listen", 80)
+ *         .directive("server_name", host, "www." + host)
+ *         .block("location", "/")
+ *             .directive("proxy_pass", "http://backend")
+ *         .end()
+ *     .end();
+ *  out.finish();
+ *  \endcode
+ *
+ *  The text is identical to what \c encode writes for the equivalent AST with the same \a indent. The name and the
+ *  arguments of an entry can be <tt>const char*</tt>, \c std::string, \c char, integers (formatted without creating a
+ *  string) and \c bool (written as \c on or \c off).
+ *
+ *  Every \c block must be closed with \c end before \c finish. Calling \c end with no open block throws; in debug
+ *  builds, destroying a builder with blocks still open (other than while an exception unwinds the stack) is an
+ *  assertion failure.
+**/
+class NGINXCONFIG_PUBLIC config_builder
+{
+public:
+    using size_type = std::size_t;
+
+    static constexpr size_type default_buffer_size = 64 * 1024;
+
+public:
+    explicit config_builder(std::ostream& output);
+    config_builder(std::ostream& output, std::string indent, size_type buffer_size = default_buffer_size);
+
+    config_builder(const config_builder&) = delete;
+    config_builder& operator=(const config_builder&) = delete;
+
+    /** Flushes whatever is still buffered. Errors from the output are ignored; call \c finish to see them. **/
+    ~config_builder() noexcept;
+
+    /** Write a simple entry like <tt>name args... ;</tt>. **/
+    template <typename TName, typename... TArgs>
+    config_builder& directive(const TName& name, const TArgs&... args)
+    {
+        write_indent();
+        put(name);
+        put_attributes(args...);
+        put(" ;\n", 3);
+        return *this;
+    }
+
+    /** Write the beginning of a complex entry like <tt>name args... {</tt>. Everything written until the matching
+     *  \c end is inside of it.
+    **/
+    template <typename TName, typename... TArgs>
+    config_builder& block(const TName& name, const TArgs&... args)
+    {
+        write_indent();
+        put(name);
+        put_attributes(args...);
+        put(" {\n", 3);
+        ++_depth;
+        return *this;
+    }
+
+    /** Close the innermost open \c block.
+     *
+     *  \throws std::logic_error if there is no open block.
+    **/
+    config_builder& end();
+
+    /** Write a comment line. The pieces of \a text are written one after the other following the \c #, so a comment
+     *  which should have a space after the \c # needs to start with one.
+    **/
+    template <typename... TText>
+    config_builder& comment(const TText&... text)
+    {
+        write_indent();
+        put('#');
+        put_all(text...);
+        put('\n');
+        return *this;
+    }
+
+    config_builder& blank_line();
+
+    /** The number of blocks which are open. **/
+    size_type depth() const { return _depth; }
+
+    /** Give everything buffered so far to the output stream. **/
+    void flush();
+
+    /** Flush and check that every block was closed.
+     *
+     *  \throws std::logic_error if there are open blocks. Nothing is written to close them.
+     *  \throws std::ios_base::failure if the output stream failed.
+    **/
+    void finish();
+
+private:
+    void write_indent();
+
+    void put(char c)                             { _out.put(c); }
+    void put(const char* text, size_type length) { _out.put(text, length); }
+    void put(const char* text)                   { put(text, std::strlen(text)); }
+    void put(const std::string& text)            { put(text.data(), text.size()); }
+    void put(bool value)                         { value ? put("on", 2) : put("off", 3); }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type put(T value)
+    {
+        // negate as unsigned so the most negative value works too
+        if (value < 0)
+            _out.put_integer(0ULL - static_cast<unsigned long long>(value), true);
+        else
+            _out.put_integer(static_cast<unsigned long long>(value));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type put(T value)
+    {
+        _out.put_integer(static_cast<unsigned long long>(value));
+    }
+
+    void put_attributes()
+    { }
+
+    template <typename T, typename... TRest>
+    void put_attributes(const T& first, const TRest&... rest)
+    {
+        put(' ');
+        put(first);
+        put_attributes(rest...);
+    }
+
+    void put_all()
+    { }
+
+    template <typename T, typename... TRest>
+    void put_all(const T& first, const TRest&... rest)
+    {
+        put(first);
+        put_all(rest...);
+    }
+
+private:
+    buffered_output _out;
+    std::string     _indent;
+    size_type       _depth;
+};
+
+}
+
+#endif/*__NGINXCONFIG_CONFIG_BUILDER_HPP_INCLUDED__*/
@@ -0,0 +1,195 @@
+/** \file nginxconfig/config_handle.hpp
+ *  Publication of immutable documents to many concurrent readers.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_CONFIG_HANDLE_HPP_INCLUDED__
+#define __NGINXCONFIG_CONFIG_HANDLE_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace nginxconfig
+{
+
+class ast_entry;
+
+/** Holds the current generation of a document which many threads read while another thread occasionally replaces it.
+ *  Reclamation of old generations is epoch-based (in the style of RCU): every thread which reads registers a
+ *  \c reader, which owns a slot announcing the epoch it entered at. Pinning a \c snapshot is a couple of atomic loads
+ *  and a store to the reader's own slot, so readers never wait for each other or for writers.
+ *
+ *  \code
+ *  config_handle handle(std::make_shared<const ast_entry>(parse_file("nginx.conf")));
+ *
+ *  // on each reading thread
+ *  config_handle::reader reader(handle);
+ *  {
+ *      config_handle::snapshot snap = reader.pin();
+ *      for (const ast_entry& entry : snap->children())
+ *          ...
+ *  }
+ *
+ *  // on the control thread
+ *  handle.publish(std::make_shared<const ast_entry>(parse_file("nginx.conf")));
+ *  \endcode
+ *
+ *  A replaced generation is retired and released at the next \c publish or \c reclaim call which finds no reader
+ *  pinned at or before the epoch it was retired in. Every \c reader must be destroyed before the handle.
+**/
+class NGINXCONFIG_PUBLIC config_handle
+{
+public:
+    using document_ptr = std::shared_ptr<const ast_entry>;
+    using epoch_type   = std::uint64_t;
+
+    class reader;
+    class snapshot;
+
+public:
+    /** Create a handle publishing \a initial as generation 1.
+     *
+     *  \throws std::invalid_argument if \a initial is \c nullptr.
+    **/
+    explicit config_handle(document_ptr initial);
+
+    config_handle(const config_handle&) = delete;
+    config_handle& operator=(const config_handle&) = delete;
+
+    ~config_handle() noexcept;
+
+    /** Replace the current document with \a next and retire the previous one. Writers are serialized with each other,
+     *  but never wait for readers.
+     *
+     *  \returns the generation number of \a next.
+     *  \throws std::invalid_argument if \a next is \c nullptr.
+    **/
+    epoch_type publish(document_ptr next);
+
+    /** Get a shared reference to the current document. This takes the writer lock, so it is meant for occasional use
+     *  by threads which do not have a \c reader; readers should use \c snapshot::share instead.
+    **/
+    document_ptr load() const;
+
+    /** The generation number of the current document. **/
+    epoch_type generation() const;
+
+    /** Release the retired generations no reader can still see.
+     *
+     *  \returns the number of generations which are still retired but not released.
+    **/
+    std::size_t reclaim();
+
+private:
+    struct node
+    {
+        document_ptr document;
+        epoch_type   generation;
+        /** The epoch this node was replaced in; readers pinned at this epoch or earlier might still see it. **/
+        epoch_type   retired;
+    };
+
+    /** The blocks of a deque are not aligned to cache lines, so a slot can start anywhere in one. With a full line of
+     *  padding on each side of the epoch, the epochs of slots next to each other are at least 128 bytes apart and can
+     *  not share a 64-byte line wherever the block starts, so readers do not contend through false sharing.
+    **/
+    struct slot
+    {
+        char                    padding_before[64];
+        /** The epoch the owning reader pinned at or \c 0 if it is not pinned. **/
+        std::atomic<epoch_type> epoch;
+        bool                    in_use;
+        char                    padding_after[64 - sizeof(std::atomic<epoch_type>) - sizeof(bool)];
+    };
+
+    slot* acquire_slot();
+
+    void release_slot(slot* s);
+
+    std::size_t reclaim_locked();
+
+private:
+    std::atomic<node*>      _current;
+    std::atomic<epoch_type> _epoch;
+    mutable std::mutex      _protect;
+    std::deque<slot>        _slots;
+    std::vector<node*>      _retired;
+};
+
+/** A registration of one thread as a reader of a \c config_handle. A reader is not thread-safe itself: each thread
+ *  should have its own. Registration and destruction take the handle's lock; pinning does not.
+**/
+class NGINXCONFIG_PUBLIC config_handle::reader
+{
+public:
+    explicit reader(config_handle& handle);
+
+    reader(const reader&) = delete;
+    reader& operator=(const reader&) = delete;
+
+    ~reader() noexcept;
+
+    /** Pin the current generation. It stays alive until the returned \c snapshot (and any other snapshots taken from
+     *  this reader while it is alive) are destroyed.
+    **/
+    snapshot pin();
+
+private:
+    friend class snapshot;
+
+    void unpin() noexcept;
+
+private:
+    config_handle&       _handle;
+    config_handle::slot* _slot;
+    std::size_t          _pins;
+};
+
+/** A consistent view of one generation of the document. Snapshots are movable but not copyable; use \c share to keep
+ *  the document beyond the life of the snapshot.
+**/
+class NGINXCONFIG_PUBLIC config_handle::snapshot
+{
+public:
+    snapshot(snapshot&& src) noexcept;
+
+    snapshot(const snapshot&) = delete;
+    snapshot& operator=(const snapshot&) = delete;
+
+    ~snapshot() noexcept;
+
+    const ast_entry& operator*() const  { return *_node->document; }
+    const ast_entry* operator->() const { return _node->document.get(); }
+    const ast_entry& get() const        { return *_node->document; }
+
+    /** The generation number of the document, which is incremented by every \c publish. **/
+    epoch_type generation() const { return _node->generation; }
+
+    /** Get a shared reference to the document which outlives this snapshot. **/
+    document_ptr share() const { return _node->document; }
+
+private:
+    friend class reader;
+
+    snapshot(reader& owner, const node* n);
+
+private:
+    reader*     _owner;
+    const node* _node;
+};
+
+}
+
+#endif/*__NGINXCONFIG_CONFIG_HANDLE_HPP_INCLUDED__*/
@@ -0,0 +1,151 @@
+/** \file nginxconfig/config_template.hpp
+ *  Mass instantiation of configuration fragments with placeholders.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_CONFIG_TEMPLATE_HPP_INCLUDED__
+#define __NGINXCONFIG_CONFIG_TEMPLATE_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+#include <nginxconfig/ast.hpp>
+
+#include <cstddef>
+#include <initializer_list>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nginxconfig
+{
+
+class encoder;
+
+/** The values of the parameters of a \c config_template: one row per instance and one column per parameter, all kept in
+ *  a single list.
+**/
+class NGINXCONFIG_PUBLIC parameter_table
+{
+public:
+    using size_type = std::size_t;
+
+public:
+    explicit parameter_table(size_type columns);
+
+    /** Add a row of values, one for each column.
+     *
+     *  \throws std::invalid_argument if there is not exactly one value per column.
+    **/
+    void add_row(const std::vector<std::string>& values);
+    void add_row(std::initializer_list<std::string> values);
+
+    size_type columns() const { return _columns; }
+
+    size_type rows() const { return _rows; }
+
+    const std::string& at(size_type row, size_type column) const { return _values.at(row * _columns + column); }
+
+    void reserve(size_type rows) { _values.reserve(rows * _columns); }
+
+private:
+    template <typename TIter>
+    void add_row(TIter first, TIter last);
+
+private:
+    size_type                _columns;
+    size_type                _rows;
+    std::vector<std::string> _values;
+};
+
+/** A configuration fragment (such as a \c server block) with placeholders in its attributes, to be instantiated many
+ *  times with different values. A placeholder is a name of letters, digits and underscores between two \c @ signs, and
+ *  can be all of an attribute or part of one:
+ *
+ *  \code
+ *  server {
+ *      listen      80;
+ *      server_name @host@ www.@host@;
+ *      root        /srv/@host@;
+ *      location / {
+ *          proxy_pass http://@upstream@;
+ *      }
+ *      location /static {
+ *          expires 30d;
+ *      }
+ *  }
+ *  \endcode
+ *
+ *  Only the entries with a placeholder in them or somewhere inside of them are built for each instance. The children of
+ *  other \c complex entries (the \c /static location above) are deferred (see \c ast_entry::defer_children) and copied
+ *  from the pattern only if someone looks at them, so until then every instance shares them. When the instances are
+ *  only going to be written out, \c encode skips building them at all.
+ *
+ *  A template is immutable once created, so it can be used from multiple threads at once.
+**/
+class NGINXCONFIG_PUBLIC config_template
+{
+public:
+    using size_type = std::size_t;
+
+public:
+    /** Create a template from \a pattern, which is usually a \c complex entry, but can be a \c document to create
+     *  several entries per instance.
+     *
+     *  \throws kind_error if \a pattern is a \c simple or \c comment entry.
+    **/
+    explicit config_template(ast_entry pattern);
+
+    ~config_template() noexcept;
+
+    /** The entry instances are made from. **/
+    const ast_entry& pattern() const;
+
+    /** The names of the placeholders in the order they first appear in the pattern, which is the order of the columns
+     *  of the \c parameter_table used to instantiate it.
+    **/
+    const std::vector<std::string>& parameters() const;
+
+    /** Get the column of the parameter named \a name.
+     *
+     *  \throws std::out_of_range if there is no such parameter.
+    **/
+    size_type parameter_index(const std::string& name) const;
+
+    /** Create the instance for \a row of \a values. It has the same kind as the \c pattern.
+     *
+     *  \throws std::invalid_argument if \a values does not have a column for each parameter.
+     *  \throws std::out_of_range if \a row is not in \a values.
+    **/
+    ast_entry instantiate(const parameter_table& values, size_type row) const;
+
+    /** Create a \c document with an instance for each row of \a values. When the \c pattern is a \c document, the
+     *  children of each instance are added instead.
+     *
+     *  \throws std::invalid_argument if \a values does not have a column for each parameter.
+    **/
+    ast_entry instantiate(const parameter_table& values) const;
+
+    /** Write an instance for each row of \a values with \a output, as if encoding the \c document \c instantiate would
+     *  create, but without creating it. A single copy of the \c pattern is made and only its placeholders are replaced
+     *  for each row, so after the first row, writing an instance allocates close to nothing.
+     *
+     *  \throws std::invalid_argument if \a values does not have a column for each parameter.
+    **/
+    void encode(const parameter_table& values, encoder& output) const;
+    void encode(const parameter_table& values, std::ostream& output) const;
+
+private:
+    class compiled;
+
+    std::shared_ptr<const compiled> _compiled;
+};
+
+}
+
+#endif/*__NGINXCONFIG_CONFIG_TEMPLATE_HPP_INCLUDED__*/
@@ -0,0 +1,144 @@
+/** \file nginxconfig/crossplane.hpp
+ *  Converting configurations to and from the JSON format of crossplane (https://github.com/nginxinc/crossplane).
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_CROSSPLANE_HPP_INCLUDED__
+#define __NGINXCONFIG_CROSSPLANE_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+#include <nginxconfig/ast.hpp>
+#include <nginxconfig/buffered_output.hpp>
+#include <nginxconfig/encode.hpp>
+
+#include <cstddef>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nginxconfig
+{
+
+/** Writes entries as crossplane JSON. A document becomes a whole payload like the one <tt>crossplane parse</tt> prints
+ *  for a single file:
+ *
+ *  \code
+ *  {"status":"ok","errors":[],"config":[{"file":"nginx.conf","status":"ok","errors":[],"parsed":[
+ *      {"directive":"listen","line":1,"args":["80"]}, ...
+ *  ]}]}
+ *  \endcode
+ *
+ *  while any other entry becomes just its directive object (so a lone \c simple entry loses its comment). The \c args
+ *  are the values of the attributes (see \c attribute_value), without the parentheses around the condition of an
+ *  \c if, and \c line is from \c source, so it is 0 for entries which were not parsed. Comments are \c # directives
+ *  with a \c comment; the comment after a \c simple entry follows it with the same \c line and the comment after the
+ *  \c { of a \c complex one is the first entry of its \c block, which is where crossplane puts them. Blank lines are
+ *  not written.
+ *
+ *  Output goes through a buffer allocated once, so encoding costs no allocations per entry.
+**/
+class NGINXCONFIG_PUBLIC crossplane_encoder :
+        public encoder
+{
+public:
+    using size_type = std::size_t;
+
+    static constexpr size_type default_buffer_size = 64 * 1024;
+
+public:
+    explicit crossplane_encoder(std::ostream& output);
+    crossplane_encoder(std::ostream& output, std::string file, size_type buffer_size = default_buffer_size);
+
+    crossplane_encoder(const crossplane_encoder&) = delete;
+    crossplane_encoder& operator=(const crossplane_encoder&) = delete;
+
+    /** Flushes whatever is still buffered. Errors from the output are ignored; call \c flush to see them. **/
+    virtual ~crossplane_encoder() noexcept;
+
+    /** Give everything buffered so far to the output stream.
+     *
+     *  \throws std::ios_base::failure if the output stream failed.
+    **/
+    void flush();
+
+protected:
+    virtual void write_simple(const context& cxt, const ast_entry& ast) override;
+
+    virtual void write_complex_begin(const context& cxt, const ast_entry& ast) override;
+
+    virtual void write_complex_end(const context& cxt, const ast_entry& ast) override;
+
+    virtual void write_document_begin(const context& cxt, const ast_entry& ast) override;
+
+    virtual void write_document_end(const context& cxt, const ast_entry& ast) override;
+
+    virtual void write_comment(const context& cxt, const ast_entry& ast) override;
+
+private:
+    /** Write the directive object of \a ast up to (not including) its closing \c } or its \c block. **/
+    void write_directive(const context& cxt, const ast_entry& ast);
+
+    void write_comment_object(const context& cxt, const std::string& text, source_range::size_type line);
+
+    /** Write \a text as a JSON string, quotes included. **/
+    void write_string(const std::string& text);
+
+    void write_string_part(const char* first, const char* last);
+
+    /** Write the \c , before an object if it is not the first in its list. **/
+    void put_separator(const context& cxt);
+
+private:
+    buffered_output _out;
+    std::string     _file;
+    /** Does the next object in the current list need a \c , before it? **/
+    bool            _separate;
+    /** Where the values of attributes are unescaped, kept so its memory is reused. **/
+    std::string     _scratch;
+};
+
+/** Write \a ast to \a output as crossplane JSON (see \c crossplane_encoder). **/
+NGINXCONFIG_PUBLIC void encode_crossplane(const ast_entry& ast, std::ostream& output);
+NGINXCONFIG_PUBLIC void encode_crossplane(const ast_entry& ast, std::ostream& output, const std::string& file);
+
+/** One of the files in a crossplane payload. **/
+struct NGINXCONFIG_PUBLIC crossplane_file
+{
+    crossplane_file();
+
+    std::string file;
+    ast_entry   document;
+};
+
+/** Read crossplane JSON from \a input straight into entries, without building a JSON tree first. The input can be a
+ *  whole payload (every file in its \c config is returned, in order) or just the list of directives of one file. The
+ *  \c status and \c errors are not looked at and members this does not know about are skipped, so payloads from
+ *  <tt>crossplane parse</tt> with any of its options are fine.
+ *
+ *  This undoes \c crossplane_encoder: each entry gets its \c line in \c source, arguments are quoted if they need to
+ *  be (see \c quote_attribute), the parentheses of \c if conditions are put back and \c # directives on the same line
+ *  as the entry before them (or as the \c complex entry they are the first child of) become its comment again.
+ *  Encoding the result gives text which parses to what was encoded, apart from blank lines and quoting.
+ *
+ *  \throws parse_error if \a input is not valid JSON, does not have the structure of crossplane output or nests
+ *   blocks or skipped values deeper than \c parse_options::default_max_depth. The line and column are those of the
+ *   JSON text.
+**/
+NGINXCONFIG_PUBLIC std::vector<crossplane_file> decode_crossplane_payload(std::istream& input);
+
+/** Like \c decode_crossplane_payload, but for input with a single file, which is returned as a document.
+ *
+ *  \throws parse_error if \a input is not valid crossplane JSON or a payload with a number of files other than one.
+**/
+NGINXCONFIG_PUBLIC ast_entry decode_crossplane(std::istream& input);
+
+}
+
+#endif/*__NGINXCONFIG_CROSSPLANE_HPP_INCLUDED__*/
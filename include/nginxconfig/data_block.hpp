@@ -0,0 +1,244 @@
+/** \file nginxconfig/data_block.hpp
+ *  Compact storage and fast lookup for blocks which hold data instead of directives: \c map, \c geo and
+ *  \c split_clients.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_DATA_BLOCK_HPP_INCLUDED__
+#define __NGINXCONFIG_DATA_BLOCK_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nginxconfig
+{
+
+class ast_entry;
+
+/** Is \a entry a \c map, \c geo or \c split_clients block? **/
+NGINXCONFIG_PUBLIC bool is_data_block(const ast_entry& entry);
+
+/** Find every data block (see \c is_data_block) in \a document, in document order. **/
+NGINXCONFIG_PUBLIC std::vector<const ast_entry*> find_data_blocks(const ast_entry& document);
+
+/** The rows of a data block, packed into a single string pool. Each row of a large \c map costs a handful of integers
+ *  instead of a full \c ast_entry, while still remembering enough to rebuild the original entry with \c to_entry, so
+ *  encoding the result produces the identical text.
+**/
+class NGINXCONFIG_PUBLIC packed_block
+{
+public:
+    using size_type = std::size_t;
+
+public:
+    /** Pack the children of the \c complex entry \a block.
+     *
+     *  \throws kind_error if \a block is not \c complex.
+     *  \throws std::invalid_argument if \a block has a \c complex child.
+    **/
+    explicit packed_block(const ast_entry& block);
+
+    virtual ~packed_block() noexcept;
+
+    /** The name of the block, such as \c "map". **/
+    const std::string& name() const { return _name; }
+
+    /** The attributes of the block, such as \c { "$http_host", "$backend" }. **/
+    const std::vector<std::string>& attributes() const { return _attributes; }
+
+    /** The number of rows (children) in this block, including comments. **/
+    size_type size() const { return _rows.size(); }
+
+    /** Rebuild the \c ast_entry this block was packed from. **/
+    ast_entry to_entry() const;
+
+protected:
+    struct span
+    {
+        std::uint32_t offset;
+        std::uint32_t length;
+    };
+
+    struct row
+    {
+        std::uint32_t first_token;
+        std::uint32_t token_count;
+        span          comment;
+        bool          is_comment;
+        /** Was the first token the \c name of the original entry? If not, it was an attribute of an unnamed entry. **/
+        bool          named;
+    };
+
+    /** Get the \a idx token of the row \a r. Tokens are the name (if any) followed by the attributes. **/
+    std::string token(const row& r, size_type idx) const;
+
+    /** Get the \a idx token of the row \a r with surrounding quotes removed. **/
+    std::string value(const row& r, size_type idx) const;
+
+    const span& token_span(const row& r, size_type idx) const { return _tokens[r.first_token + idx]; }
+
+    const char* data(const span& s) const { return _pool.data() + s.offset; }
+
+protected:
+    std::string              _name;
+    std::vector<std::string> _attributes;
+    std::string              _comment;
+    std::string              _pool;
+    std::vector<span>        _tokens;
+    std::vector<row>         _rows;
+};
+
+/** A packed \c map block. Lookups follow nginx: exact keys (compared ignoring case) by binary search over a sorted
+ *  array, then wildcard names if the block has the \c hostnames parameter, then regular expressions in order and
+ *  finally the \c default value. Values are returned verbatim, without substituting regular expression captures.
+ *  Regular expression keys may use PCRE named groups and a leading \c (?i); other PCRE-only syntax is rejected.
+**/
+class NGINXCONFIG_PUBLIC map_table :
+        public packed_block
+{
+public:
+    /** \throws std::invalid_argument if \a block is not a well-formed \c map or has a regular expression key which
+     *          cannot be compiled.
+    **/
+    explicit map_table(const ast_entry& block);
+
+    virtual ~map_table() noexcept;
+
+    /** The source expression, such as \c "$http_host". **/
+    const std::string& source() const { return _attributes.at(0); }
+
+    /** The variable being defined, such as \c "$backend". **/
+    const std::string& variable() const { return _attributes.at(1); }
+
+    /** Does this map match host names (the \c hostnames parameter)? **/
+    bool hostnames() const { return _hostnames; }
+
+    /** The value used when nothing matches. **/
+    std::string default_value() const;
+
+    /** Find the value for the evaluated source \a key. **/
+    std::string lookup(const std::string& key) const;
+
+private:
+    class regex_list;
+
+    struct keyed_row
+    {
+        span          key;
+        std::uint32_t row;
+        /** For head wildcards, does the key also match the name without the leading dot? **/
+        bool          self;
+    };
+
+    const keyed_row* find_sorted(const std::vector<keyed_row>& sorted, const char* key, size_type length) const;
+
+private:
+    bool                              _hostnames;
+    std::uint32_t                     _default_row;
+    std::vector<keyed_row>            _exact;
+    std::vector<keyed_row>            _head_wildcards;
+    std::vector<keyed_row>            _tail_wildcards;
+    std::shared_ptr<const regex_list> _regexes;
+};
+
+/** A packed \c geo block. Without the \c ranges parameter, networks are stored in binary radix trees (one for IPv4 and
+ *  one for IPv6) and looked up by longest prefix. With \c ranges, IPv4 ranges are flattened into a sorted array of
+ *  disjoint intervals and looked up by binary search.
+**/
+class NGINXCONFIG_PUBLIC geo_table :
+        public packed_block
+{
+public:
+    /** \throws std::invalid_argument if \a block is not a well-formed \c geo. **/
+    explicit geo_table(const ast_entry& block);
+
+    virtual ~geo_table() noexcept;
+
+    /** The variable being defined, such as \c "$geo". **/
+    const std::string& variable() const { return _attributes.back(); }
+
+    /** Does this block use the \c ranges form? **/
+    bool ranges() const { return _ranges; }
+
+    /** The value used when nothing matches. **/
+    std::string default_value() const;
+
+    /** Find the value for the textual IPv4 or IPv6 \a address.
+     *
+     *  \throws std::invalid_argument if \a address can not be parsed.
+    **/
+    std::string lookup(const std::string& address) const;
+
+private:
+    struct radix_node
+    {
+        std::uint32_t child[2];
+        std::int32_t  row;
+    };
+
+    struct interval
+    {
+        std::uint32_t first;
+        std::int32_t  row;
+    };
+
+    void insert_network(const std::string& network, std::int32_t row);
+
+    std::int32_t find_network(const unsigned char* address, size_type bits) const;
+
+private:
+    bool                    _ranges;
+    std::int32_t            _default_row;
+    std::vector<radix_node> _nodes;
+    std::uint32_t           _root4;
+    std::uint32_t           _root6;
+    std::vector<interval>   _intervals;
+};
+
+/** A packed \c split_clients block. Lookups hash the key with MurmurHash2 exactly like nginx does, so the same key is
+ *  assigned the same bucket.
+**/
+class NGINXCONFIG_PUBLIC split_clients_table :
+        public packed_block
+{
+public:
+    /** \throws std::invalid_argument if \a block is not a well-formed \c split_clients or the percentages add up to
+     *  more than 100%.
+    **/
+    explicit split_clients_table(const ast_entry& block);
+
+    virtual ~split_clients_table() noexcept;
+
+    /** The variable being defined, such as \c "$variant". **/
+    const std::string& variable() const { return _attributes.at(1); }
+
+    /** Find the value for the evaluated \a key (the first attribute of the block with variables substituted). **/
+    std::string lookup(const std::string& key) const;
+
+    /** The 32-bit MurmurHash2 variant nginx uses for \c split_clients. **/
+    static std::uint32_t murmur_hash2(const char* data, size_type length);
+
+private:
+    struct part
+    {
+        std::uint32_t upper;
+        std::uint32_t row;
+        bool          rest;
+    };
+
+    std::vector<part> _parts;
+};
+
+}
+
+#endif/*__NGINXCONFIG_DATA_BLOCK_HPP_INCLUDED__*/
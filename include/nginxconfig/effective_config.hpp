@@ -0,0 +1,128 @@
+/** \file nginxconfig/effective_config.hpp
+ *  Resolution of the directives in effect for a block, taking inheritance from enclosing blocks into account.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_EFFECTIVE_CONFIG_HPP_INCLUDED__
+#define __NGINXCONFIG_EFFECTIVE_CONFIG_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nginxconfig
+{
+
+class ast_entry;
+
+/** Computes the effective directives of blocks in a document. nginx lets most directives specified in an enclosing
+ *  block (such as \c http) apply to the blocks inside of it (such as \c server and \c location) unless the inner block
+ *  specifies the directive itself. When an inner block specifies a directive, \e all the entries with that name from
+ *  the enclosing blocks are replaced, which is how array-like directives such as \c proxy_set_header behave.
+ *
+ *  Effective sets are computed lazily and memoized for each block. Each block only stores the directives it specifies
+ *  itself, layered on top of those of its parent, and \c find and \c find_all walk the layers from the inside out, so
+ *  resolving a deep tree does not copy what every block inherits. A block which does not override anything shares the
+ *  layer of its parent, so sibling \c location blocks with no overrides of their own all refer to the same set. The
+ *  full map returned by \c resolve is only built when asked for and is memoized with its layer.
+ *
+ *  The resolver holds pointers into the document it was built from. If the document is modified, call \c invalidate
+ *  with the block whose children changed; only the memoized sets of that block and the blocks inside of it are
+ *  discarded. Note that inserting or erasing children from the middle of a \c child_list moves the other children in
+ *  memory, in which case the parent of the moved children must be invalidated.
+ *
+ *  This class is not thread-safe, since even the \c const-looking queries fill the memo.
+**/
+class NGINXCONFIG_PUBLIC effective_config_resolver
+{
+public:
+    using entry_list    = std::vector<const ast_entry*>;
+    using directive_map = std::map<std::string, entry_list>;
+    using directive_set = std::shared_ptr<const directive_map>;
+    using name_set      = std::set<std::string>;
+
+public:
+    /** Create a resolver for \a document using the \c default_non_inherited set of names. **/
+    explicit effective_config_resolver(const ast_entry& document);
+
+    /** Create a resolver for \a document where the directives named in \a non_inherited only apply to the block they
+     *  are specified in.
+    **/
+    effective_config_resolver(const ast_entry& document, name_set non_inherited);
+
+    ~effective_config_resolver() noexcept;
+
+    /** Get the effective directives of \a block, which must be the document or a \c complex entry inside of it.
+     *
+     *  \throws std::invalid_argument if \a block is not a part of the document.
+    **/
+    directive_set resolve(const ast_entry& block);
+
+    /** Get the effective entry for the directive \a name in \a block. If there are multiple entries, this is the last
+     *  one, which is the one nginx uses for directives which can only be specified once.
+     *
+     *  \returns the entry or \c nullptr if \a name is not in effect.
+    **/
+    const ast_entry* find(const ast_entry& block, const std::string& name);
+
+    /** Get all the effective entries for the directive \a name in \a block. **/
+    entry_list find_all(const ast_entry& block, const std::string& name);
+
+    /** Get the block enclosing \a block or \c nullptr if \a block is the document (or is unknown). **/
+    const ast_entry* parent(const ast_entry& block) const;
+
+    /** Discard the memoized sets of \a block and every block inside of it and re-discover the blocks inside of it.
+     *  Call this after changing the children of \a block.
+    **/
+    void invalidate(const ast_entry& block);
+
+    /** The default set of names which are not inherited: \c listen, \c server_name, the \c *_pass handlers and the
+     *  directives of the rewrite module, among others.
+    **/
+    static const name_set& default_non_inherited();
+
+private:
+    struct layer;
+    using layer_ptr = std::shared_ptr<const layer>;
+
+    struct level
+    {
+        /** The directives which blocks inside of this one inherit. **/
+        layer_ptr inherited;
+        /** The directives in effect for this block, which can differ from \c inherited by non-inherited ones. **/
+        layer_ptr effective;
+    };
+
+    static const entry_list* lookup(const layer_ptr& top, const std::string& name);
+
+    static directive_set flatten(const layer_ptr& top);
+
+    void index_blocks(const ast_entry& root);
+
+    const level& resolve_level(const ast_entry& block);
+
+    level compute_level(const ast_entry& block, const level* parent_level) const;
+
+    void forget_blocks(const ast_entry& root);
+
+private:
+    name_set                                                _non_inherited;
+    std::unordered_map<const ast_entry*, const ast_entry*> _parents;
+    std::unordered_map<const ast_entry*, entry_list>       _children;
+    std::unordered_map<const ast_entry*, level>            _levels;
+};
+
+}
+
+#endif/*__NGINXCONFIG_EFFECTIVE_CONFIG_HPP_INCLUDED__*/
@@ -17,6 +17,7 @@
 #include <deque>
 #include <iosfwd>
 #include <string>
+#include <vector>
 
 namespace nginxconfig
 {
@@ -52,7 +53,9 @@ protected:
     private:
         friend class encoder;
         
-        path_type _path;
+        path_type              _path;
+        /** For each entry in \c _path, the index of the next child to encode. **/
+        std::vector<size_type> _positions;
     };
     
     virtual void write_simple(const context& cxt, const ast_entry& ast) = 0;
@@ -69,6 +72,18 @@ protected:
     
 private:
     void encode_impl(context& cxt, const ast_entry& ast);
+    
+    /** Write the beginning of \a ast. If it has children, it is pushed onto the path of \a cxt and this returns
+     *  \c true.
+    **/
+    bool encode_begin(context& cxt, const ast_entry& ast);
+    
+    /** Pop the last entry off of the path of \a cxt and write its end. **/
+    void encode_end(context& cxt);
+    
+private:
+    /** Kept between calls to \c encode so the frames are only allocated once. **/
+    context _context;
 };
 
 class NGINXCONFIG_PUBLIC ostream_encoder :
@@ -92,6 +107,9 @@ protected:
 private:
     void write_indent(const context& cxt);
     
+    /** Write the blank lines \a ast had before it in its source. **/
+    void write_blank_lines(const ast_entry& ast);
+    
     void write_attributes(const ast_entry& ast);
     
 private:
@@ -0,0 +1,118 @@
+/** \file nginxconfig/fingerprint.hpp
+ *  Canonical forms of configurations and stable fingerprints of them, for telling whether two configurations mean the
+ *  same thing.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_FINGERPRINT_HPP_INCLUDED__
+#define __NGINXCONFIG_FINGERPRINT_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace nginxconfig
+{
+
+class ast_entry;
+
+/** A 128-bit hash value. **/
+struct NGINXCONFIG_PUBLIC fingerprint128
+{
+    std::uint64_t low  = 0;
+    std::uint64_t high = 0;
+
+    bool operator==(const fingerprint128& other) const { return low == other.low && high == other.high; }
+    bool operator!=(const fingerprint128& other) const { return !(*this == other); }
+    bool operator<(const fingerprint128& other) const
+    {
+        return high < other.high || (high == other.high && low < other.low);
+    }
+
+    /** The 32 hexadecimal digits of the value, \c high first. **/
+    std::string to_string() const;
+};
+
+NGINXCONFIG_PUBLIC std::ostream& operator<<(std::ostream&, const fingerprint128&);
+
+/** MurmurHash3 (the x64 128-bit variant) over a stream of bytes given in any number of pieces. The result only depends
+ *  on the bytes and the seed, not on how they were split up, and is the same on every platform.
+**/
+class NGINXCONFIG_PUBLIC fingerprint_hasher
+{
+public:
+    explicit fingerprint_hasher(std::uint32_t seed = 0);
+
+    void update(const void* data, std::size_t length);
+
+    /** The hash of everything given to \c update so far. This does not change the state, so more can be added. **/
+    fingerprint128 finish() const;
+
+private:
+    void mix(const unsigned char* block);
+
+private:
+    std::uint64_t _h1;
+    std::uint64_t _h2;
+    std::uint64_t _length;
+    unsigned char _tail[16];
+};
+
+/** Controls what \c canonicalize and \c fingerprint consider a difference. Whitespace, blank lines, where the source
+ *  came from, how attributes are quoted or escaped and whether the parentheses around the condition of an \c if are
+ *  attributes of their own never are.
+**/
+struct NGINXCONFIG_PUBLIC canonical_options
+{
+    /** Leave out comments, both on lines of their own and after entries. **/
+    bool                     ignore_comments = true;
+    /** Sort the children of the blocks in \c unordered_blocks, since their order does not change what they mean. **/
+    bool                     sort_unordered  = false;
+    /** The names of blocks whose children can be in any order. This is not \c geo: its \c ranges must come first and a
+     *  \c delete only takes out what came before it.
+    **/
+    std::vector<std::string> unordered_blocks = { "events", "types" };
+};
+
+/** The value nginx sees for \a attribute: without the quotes around it and with escapes such as \c \" replaced by the
+ *  character. So \c foo, \c "foo" and \c 'foo' all have the value \c foo.
+**/
+NGINXCONFIG_PUBLIC std::string attribute_value(const std::string& attribute);
+
+/** Append the value of \a attribute to \a out. This is \c attribute_value for callers which reuse one string for many
+ *  values instead of allocating a new one for each.
+**/
+NGINXCONFIG_PUBLIC void append_attribute_value(const std::string& attribute, std::string& out);
+
+/** The reverse of \c attribute_value: spell \a value as an attribute which has that value, with \c " quotes only if
+ *  they are needed.
+**/
+NGINXCONFIG_PUBLIC std::string quote_attribute(const std::string& value);
+
+/** Create the canonical form of \a root: a copy with each attribute quoted only if it needs to be (with \c "), with no
+ *  blank lines or source ranges and, depending on \a options, without comments and with the children of unordered
+ *  blocks sorted. Two trees which mean the same thing have equal canonical forms and encode to the same text.
+**/
+NGINXCONFIG_PUBLIC ast_entry canonicalize(const ast_entry& root, const canonical_options& options = canonical_options());
+
+/** Compute a fingerprint of the canonical form of \a root without building it. Equal canonical forms have equal
+ *  fingerprints, and the fingerprint of a tree is the same in every process, on every platform and in every version of
+ *  this library (the format hashed is described in fingerprint.cpp and changing it is a breaking change).
+**/
+NGINXCONFIG_PUBLIC fingerprint128 fingerprint(const ast_entry&         root,
+                                              const canonical_options& options = canonical_options()
+                                             );
+
+}
+
+#endif/*__NGINXCONFIG_FINGERPRINT_HPP_INCLUDED__*/
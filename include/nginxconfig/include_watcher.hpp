@@ -0,0 +1,106 @@
+/** \file nginxconfig/include_watcher.hpp
+ *  Live reloading of an include tree when its files change. This is only available on Linux, since it uses inotify.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_INCLUDE_WATCHER_HPP_INCLUDED__
+#define __NGINXCONFIG_INCLUDE_WATCHER_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+#include <nginxconfig/parse_cache.hpp>
+
+#if defined(__linux__)
+
+#include <map>
+#include <string>
+
+namespace nginxconfig
+{
+
+/** Watches every file of an \c include_tree and re-parses the tree when any of them change. Only the files which
+ *  changed are parsed again; every other file keeps its existing document, so the new tree shares everything which was
+ *  untouched with the old one.
+ *
+ *  The watcher subscribes to the directories holding the files and include patterns rather than to the files
+ *  themselves, so files which are replaced by renaming a new file over them (as most editors and deployment tools do)
+ *  and new files matching an include pattern are noticed, too. Wildcards in the directory part of an include pattern
+ *  are not watched.
+ *
+ *  \code
+ *  parse_cache   cache;
+ *  include_watcher watcher("/etc/nginx/nginx.conf", cache);
+ *  while (running)
+ *  {
+ *      include_tree::path_list changed = watcher.wait(1000);
+ *      if (!changed.empty())
+ *          handle.publish(std::make_shared<const ast_entry>(watcher.tree().flatten()));
+ *  }
+ *  \endcode
+ *
+ *  A watcher is not thread-safe.
+**/
+class NGINXCONFIG_PUBLIC include_watcher
+{
+public:
+    using path_list = include_tree::path_list;
+
+public:
+    /** Parse the tree rooted at \a root using \a cache and start watching it. The cache must outlive the watcher.
+     *
+     *  \throws std::system_error if inotify can not be initialized.
+     *  \throws std::runtime_error or \c parse_error if the tree can not be parsed.
+    **/
+    include_watcher(const std::string& root, parse_cache& cache);
+
+    include_watcher(const include_watcher&) = delete;
+    include_watcher& operator=(const include_watcher&) = delete;
+
+    ~include_watcher() noexcept;
+
+    /** The most recently parsed tree. **/
+    const include_tree& tree() const { return _tree; }
+
+    /** The inotify file descriptor, which becomes readable when there are changes. Use this to wait for changes in your
+     *  own \c poll or \c epoll loop, then call \c wait with a timeout of \c 0.
+    **/
+    int native_handle() const { return _fd; }
+
+    /** Wait up to \a timeout_ms milliseconds (or forever if negative) for changes to the tree. If any file changed, the
+     *  tree is parsed again and \c tree refers to the new one.
+     *
+     *  \returns the paths of the files which were changed, added to or removed from the tree. This is empty if the
+     *   timeout expired or the only events were for unrelated files.
+     *  \throws std::runtime_error or \c parse_error if the new tree can not be parsed. The previous tree is kept and
+     *   the files which changed are re-parsed again on the next change.
+    **/
+    path_list wait(int timeout_ms);
+
+private:
+    /** Read all the pending events and collect the paths of those which might affect the tree. **/
+    bool read_events(path_list& candidates);
+
+    bool is_relevant(const std::string& path) const;
+
+    /** Add watches for directories the current tree uses which are not watched yet. **/
+    void update_watches();
+
+private:
+    parse_cache&               _cache;
+    include_tree               _tree;
+    int                        _fd;
+    std::map<int, std::string> _watches;
+    /** Changed files which have not been parsed successfully yet. **/
+    path_list                  _unresolved;
+};
+
+}
+
+#endif
+
+#endif/*__NGINXCONFIG_INCLUDE_WATCHER_HPP_INCLUDED__*/
@@ -0,0 +1,210 @@
+/** \file nginxconfig/lint.hpp
+ *  Running many checks over an AST in a single traversal.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_LINT_HPP_INCLUDED__
+#define __NGINXCONFIG_LINT_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+#include <nginxconfig/rule_table.hpp>
+#include <nginxconfig/schema.hpp>
+
+#include <cstddef>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nginxconfig
+{
+
+class ast_entry;
+class lint_rule;
+
+enum class lint_severity : unsigned char
+{
+    warning,
+    error,
+};
+
+NGINXCONFIG_PUBLIC std::ostream& operator<<(std::ostream&, const lint_severity&);
+
+/** A problem a \c lint_rule found. **/
+struct lint_diagnostic
+{
+    const ast_entry* entry;
+    /** The \c lint_rule::name of the rule which reported this. **/
+    std::string      rule;
+    lint_severity    severity;
+    std::string      message;
+};
+
+using lint_diagnostic_list = std::vector<lint_diagnostic>;
+
+/** What a \c lint_rule is checking: an entry and where it is. **/
+class NGINXCONFIG_PUBLIC lint_context
+{
+public:
+    using path_type = std::vector<const ast_entry*>;
+
+public:
+    /** The entry being checked, which is never a \c comment. **/
+    const ast_entry& entry() const { return *_entry; }
+
+    /** The entries enclosing \c entry, starting with the root the linter was run on. **/
+    const path_type& path() const { return _path; }
+
+    /** The entry \c entry is a child of. **/
+    const ast_entry& parent() const { return *_path.back(); }
+
+    /** The \c directive_context \c entry is in, or \c context_opaque if it is inside a block the schema does not know or
+     *  which holds data (such as \c map).
+    **/
+    unsigned int context() const { return _context; }
+
+    /** Report a problem with \c entry. **/
+    void report(std::string message);
+
+    /** Report a problem with \a entry, which should be \c entry or inside of it. **/
+    void report(const ast_entry& entry, std::string message);
+
+private:
+    friend class linter;
+
+    lint_context(lint_diagnostic_list& out) :
+            _out(out)
+    { }
+
+private:
+    const ast_entry*      _entry   = nullptr;
+    path_type             _path;
+    unsigned int          _context = 0;
+    const lint_rule*      _rule    = nullptr;
+    lint_diagnostic_list& _out;
+};
+
+/** A single check. A rule says which entries it is interested in when it is created: entries with one of the names in
+ *  \a directives (or all of them if that is empty) which are in one of the \a contexts. The linter only calls \c check
+ *  for those, so a rule about \c alias costs nothing on the other entries.
+ *
+ *  Rules are shared by every thread of a run, so \c check must not change the rule.
+**/
+class NGINXCONFIG_PUBLIC lint_rule
+{
+public:
+    virtual ~lint_rule() noexcept;
+
+    const std::string& name() const { return _name; }
+
+    const std::vector<std::string>& directives() const { return _directives; }
+
+    unsigned int contexts() const { return _contexts; }
+
+    lint_severity severity() const { return _severity; }
+
+    /** Check \c lint_context::entry, reporting problems with \c lint_context::report. **/
+    virtual void check(lint_context& cxt) const = 0;
+
+protected:
+    lint_rule(std::string              name,
+              std::vector<std::string> directives,
+              unsigned int             contexts = context_any,
+              lint_severity            severity = lint_severity::warning
+             );
+
+private:
+    std::string              _name;
+    std::vector<std::string> _directives;
+    unsigned int             _contexts;
+    lint_severity            _severity;
+};
+
+/** Runs a set of \c lint_rule instances over an AST. Each entry is visited once and given only to the rules which are
+ *  interested in it. The schema is used to know which context the children of a block are in.
+ *
+ *  Large trees are split into independent subtrees (by default, the children of top-level blocks such as the \c server
+ *  blocks in \c http) which are checked in parallel. Each thread keeps its own diagnostics, which are merged in document
+ *  order at the end, so the result is the same no matter how many threads are used.
+**/
+class NGINXCONFIG_PUBLIC linter
+{
+public:
+    using size_type = std::size_t;
+
+    /** The default for \c split_depth. **/
+    static constexpr size_type default_split_depth = 2;
+
+public:
+    /** Create a linter with no rules. \a schema must outlive it. **/
+    explicit linter(const schema_registry& schema = schema_registry::standard());
+
+    ~linter() noexcept;
+
+    /** Add \a rule. Rules interested in the same entry are called in the order they were added. **/
+    void add(std::shared_ptr<const lint_rule> rule);
+
+    /** The number of rules added. **/
+    size_type size() const { return _rules.size(); }
+
+    /** Blocks less than this many levels deep are split into their children for parallel checking. **/
+    size_type split_depth() const { return _split_depth; }
+    void      split_depth(size_type depth) { _split_depth = depth; }
+
+    /** Check everything inside \a root (not \a root itself), whose children are in \a context, using up to \a threads
+     *  threads (or one per core if \a threads is 0), or fewer if the system will not start that many. If a rule throws,
+     *  the exception is rethrown from here once every thread has stopped.
+     *
+     *  \returns every diagnostic, in document order and, for the same entry, in the order the rules were added.
+    **/
+    lint_diagnostic_list run(const ast_entry& root, size_type threads = 0, unsigned int context = context_main) const;
+
+private:
+    class job;
+
+    /** Call the rules interested in the \c entry of \a cxt. **/
+    void dispatch(lint_context& cxt) const;
+
+    /** The context of the children of \a entry, which is in \a context. **/
+    unsigned int child_context(const ast_entry& entry, unsigned int context) const;
+
+    /** Check \a entry and everything inside of it. **/
+    void check_subtree(lint_context& cxt, const ast_entry& entry, unsigned int context) const;
+
+    /** Check \a entry, which is inside of the entries in \a path, and if \a whole is set, everything inside of it. **/
+    void check_unit(lint_context&                  cxt,
+                    const ast_entry&               entry,
+                    const lint_context::path_type& path,
+                    unsigned int                   context,
+                    bool                           whole
+                   ) const;
+
+    lint_context make_context(lint_diagnostic_list& out) const { return lint_context(out); }
+
+private:
+    const schema_registry*                        _schema;
+    std::vector<std::shared_ptr<const lint_rule>> _rules;
+    rule_table                                    _dispatch;
+    size_type                                     _split_depth;
+};
+
+/** Add the rules which come with the library to \a out:
+ *
+ *   - \c alias_traversal: \c alias in a prefix \c location whose path does not end in \c / while the alias does, which
+ *     lets requests such as \c /static../secret escape the aliased directory.
+ *   - \c proxy_host_header: \c proxy_pass where no \c proxy_set_header \c Host is in effect, so the upstream sees the
+ *     name of the upstream instead of the host the client asked for.
+ *   - \c duplicate_directive: a directive which may only appear once per block (such as \c root or \c proxy_pass)
+ *     appearing again in the same block.
+**/
+NGINXCONFIG_PUBLIC void add_standard_lint_rules(linter& out);
+
+}
+
+#endif/*__NGINXCONFIG_LINT_HPP_INCLUDED__*/
@@ -0,0 +1,88 @@
+/** \file nginxconfig/memory_usage.hpp
+ *  Accounting for the memory an AST uses.
+ *  
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_MEMORY_USAGE_HPP_INCLUDED__
+#define __NGINXCONFIG_MEMORY_USAGE_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+#include <nginxconfig/ast.hpp>
+
+#include <cstddef>
+#include <iosfwd>
+
+namespace nginxconfig
+{
+
+/** Where the memory of an AST goes, as measured by \c memory_usage. Byte counts are what was asked of
+ *  \c operator \c new, so they do not include the bookkeeping of the heap itself.
+**/
+struct NGINXCONFIG_PUBLIC memory_breakdown
+{
+    using size_type = std::size_t;
+    
+    /** The number of entries of each kind, including the root. **/
+    size_type simple_nodes   = 0;
+    size_type complex_nodes  = 0;
+    size_type document_nodes = 0;
+    size_type comment_nodes  = 0;
+    
+    /** Complex and document entries whose children were deferred and are not loaded yet. They are counted as having no
+     *  children; the source text their loader keeps is shared, so it is not counted at all.
+    **/
+    size_type deferred_nodes = 0;
+    
+    /** Names, attributes and comments short enough to be kept inside of the \c std::string object itself, and the
+     *  characters in them. These bytes are part of \c container_bytes (or the root entry), not extra.
+    **/
+    size_type inline_strings      = 0;
+    size_type inline_string_bytes = 0;
+    
+    /** Names, attributes and comments with their characters on the heap, and the bytes allocated for them. **/
+    size_type heap_strings        = 0;
+    size_type heap_string_bytes   = 0;
+    
+    /** Bytes allocated by the containers holding attributes and children: their blocks of elements (which hold the
+     *  entries and \c std::string objects) and the maps of those blocks.
+    **/
+    size_type container_bytes     = 0;
+    
+    /** The part of \c container_bytes not holding an element: maps and the unused ends of blocks. Every entry has two
+     *  containers, even when they are empty, so this is most of the memory of a tree of small entries.
+    **/
+    size_type container_overhead_bytes = 0;
+    
+    /** Bytes allocated for the indexes built by \c ast_entry::find and the state of deferred children. **/
+    size_type index_bytes         = 0;
+    
+    /** Every byte allocated for the tree. This does not include the root \c ast_entry object itself, which lives
+     *  wherever its owner put it.
+    **/
+    size_type total_bytes         = 0;
+    
+    /** The total number of entries. **/
+    size_type nodes() const
+    {
+        return simple_nodes + complex_nodes + document_nodes + comment_nodes;
+    }
+};
+
+NGINXCONFIG_PUBLIC std::ostream& operator<<(std::ostream& os, const memory_breakdown& usage);
+
+/** Measure the heap memory used by \a root and everything inside of it. This only looks at each entry once and does not
+ *  load deferred children, so it is cheap enough to call regularly (such as to export as a metric). With libstdc++ (and
+ *  \c NGINXCONFIG_USE_LIBSTDCXX_INTERNALS), the result is exact; otherwise the sizes of containers are estimated from
+ *  what they show of themselves and will usually be somewhat low.
+**/
+NGINXCONFIG_PUBLIC memory_breakdown memory_usage(const ast_entry& root);
+
+}
+
+#endif/*__NGINXCONFIG_MEMORY_USAGE_HPP_INCLUDED__*/
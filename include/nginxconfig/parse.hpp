@@ -14,6 +14,7 @@
 
 #include <nginxconfig/config.hpp>
 
+#include <cstdint>
 #include <iosfwd>
 #include <string>
 #include <stdexcept>
@@ -58,11 +59,128 @@ private:
     std::string _message;
 };
 
+/** Measurements of a single call to \c parse, for finding out where the time of a slow parse went. These are only
+ *  collected when \c NGINXCONFIG_PARSE_STATS is enabled (the default); otherwise every field stays zero.
+**/
+struct NGINXCONFIG_PUBLIC parse_stats
+{
+    using size_type = std::size_t;
+    
+    /** Is the library built to collect statistics? **/
+    static constexpr bool enabled = NGINXCONFIG_PARSE_STATS;
+    
+    size_type bytes         = 0;
+    size_type lines         = 0;
+    size_type simple_nodes  = 0;
+    size_type complex_nodes = 0;
+    size_type comment_nodes = 0;
+    /** The deepest nesting of complex entries which was reached (0 if there were none). **/
+    size_type max_depth     = 0;
+    
+    /** Heap allocations made by the parsing thread while parsing. The library does not replace \c operator \c new, so
+     *  these only count allocations reported to \c note_allocation (from an application's own \c operator \c new).
+    **/
+    size_type allocations     = 0;
+    size_type allocated_bytes = 0;
+    
+    /** Wall time spent reading from the input stream. **/
+    std::uint64_t read_ns     = 0;
+    /** Wall time spent splitting the input into tokens (not counting reading). **/
+    std::uint64_t tokenize_ns = 0;
+    /** Wall time spent creating entries and adding them to the tree. **/
+    std::uint64_t build_ns    = 0;
+    /** Wall time of the whole parse. **/
+    std::uint64_t total_ns    = 0;
+    
+    /** The total number of entries, not counting the document. **/
+    size_type nodes() const { return simple_nodes + complex_nodes + comment_nodes; }
+};
+
+/** Callbacks for tracing the parser. All of them do nothing by default, so a tracer only overrides what it needs. When
+ *  \c parse_many parses files on several threads, the same hooks are called from all of them.
+**/
+class NGINXCONFIG_PUBLIC parse_hooks
+{
+public:
+    using size_type = std::size_t;
+    
+public:
+    virtual ~parse_hooks() noexcept;
+    
+    /** Called before any input is read. **/
+    virtual void parse_begin();
+    
+    /** Called for each entry added to the tree, with the number of complex entries enclosing it as \a depth. The
+     *  children of a complex entry are not there yet when it is added.
+    **/
+    virtual void entry_added(const ast_entry& entry, size_type depth);
+    
+    /** Called when parsing completed successfully. **/
+    virtual void parse_end(const parse_stats& stats);
+};
+
+/** Record an allocation of \a bytes on the calling thread, to be counted in the \c parse_stats of a parse running on
+ *  it. Call this from a replacement \c operator \c new to get allocation counts; it is only a pair of increments.
+**/
+NGINXCONFIG_PUBLIC void note_allocation(std::size_t bytes) noexcept;
+
+/** What \c parse does with comments and blank lines, which make up a large part of most configuration files but mean
+ *  nothing to a program only reading the configuration.
+**/
+enum class trivia_mode : unsigned char
+{
+    /** Comments and blank lines become \c comment entries, so encoding the document reproduces them. **/
+    keep,
+    /** Comments and blank lines are dropped entirely. **/
+    drop,
+    /** Comments are dropped and each entry counts the blank lines before it in \c ast_entry::blank_lines_before, so
+     *  the encoder can restore the spacing without an entry for each line.
+    **/
+    count,
+};
+
+/** Options which control the behavior of \c parse. **/
+struct NGINXCONFIG_PUBLIC parse_options
+{
+    using size_type = std::size_t;
+    
+    /** The default for \c max_depth, which is far deeper than any hand-written configuration. **/
+    static constexpr size_type default_max_depth = 256;
+    
+    /** The deepest nesting of complex entries to allow. Input which nests deeper than this is rejected with a
+     *  \c parse_error instead of building an arbitrarily deep tree, which other recursive code might not survive.
+    **/
+    size_type max_depth = default_max_depth;
+    
+    /** What to do with comments and blank lines. **/
+    trivia_mode trivia = trivia_mode::keep;
+    
+    /** If set, the body of each complex entry is only scanned for its closing \c } and the children are parsed the first
+     *  time they are asked for (see \c ast_entry::defer_children), so the cost of parsing is proportional to the part
+     *  of the configuration which is actually used. The whole input is kept in memory until every block is loaded or
+     *  gone. Errors inside of a block other than unbalanced braces and quotes or nesting too deep are only found when
+     *  loading it, so they are thrown by \c ast_entry::children instead of \c parse. The \c hooks and \c parse_stats
+     *  only see the entries created by \c parse itself.
+    **/
+    bool lazy_blocks = false;
+    
+    /** If set, these are called while parsing. They must outlive every parse using these options. **/
+    parse_hooks* hooks = nullptr;
+};
+
 /** Parse the given input. The root entry will always be have \c ast_entry_kind::document. **/
 ast_entry parse(std::istream& input);
+ast_entry parse(std::istream& input, const parse_options& options);
+
+/** Parse the given input, filling \a stats with measurements of the parse. Collecting the measurements makes parsing a
+ *  little slower, so only use this when they are actually wanted.
+**/
+ast_entry parse(std::istream& input, const parse_options& options, parse_stats& stats);
 
 /** Convenience function to parse a given file. **/
 ast_entry parse_file(const std::string& filename);
+ast_entry parse_file(const std::string& filename, const parse_options& options);
+ast_entry parse_file(const std::string& filename, const parse_options& options, parse_stats& stats);
 
 }
 
@@ -0,0 +1,286 @@
+/** \file nginxconfig/parse_cache.hpp
+ *  Caching of parsed files and parsing of whole include trees.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_PARSE_CACHE_HPP_INCLUDED__
+#define __NGINXCONFIG_PARSE_CACHE_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+#include <nginxconfig/parse.hpp>
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nginxconfig
+{
+
+class ast_entry;
+
+/** A cache of parsed files. A file is identified by its device, inode, size and modification time, so a file which has
+ *  not changed costs a single \c stat call. When the identity of a file changes (it was touched, copied or replaced by a
+ *  deployment tool), its contents are hashed and a document with the same contents is reused if the cache has one. The
+ *  text of each document is kept and compared, so contents which only share a hash never get each other's documents.
+ *
+ *  Documents are shared and immutable, so the same document can be handed to any number of callers. When the estimated
+ *  size of the cached documents exceeds the memory budget, the least recently used ones are dropped from the cache
+ *  (callers still holding them keep them alive).
+ *
+ *  The cache can be written to and read from disk with \c save and \c load. Loaded entries are still checked against
+ *  the file system before they are used.
+ *
+ *  All member functions are thread-safe. Files are parsed outside of the lock, so two threads asking for the same
+ *  changed file at the same time might both parse it.
+**/
+class NGINXCONFIG_PUBLIC parse_cache
+{
+public:
+    using document_ptr = std::shared_ptr<const ast_entry>;
+    using size_type    = std::size_t;
+
+    /** The default for \c memory_budget: 64 MiB. **/
+    static constexpr size_type default_memory_budget = size_type(64) << 20;
+
+    /** Counters of how requests were satisfied. **/
+    struct statistics
+    {
+        /** Requests where the identity of the file was unchanged. **/
+        size_type identity_hits = 0;
+        /** Requests where the identity changed, but the contents matched a cached document. **/
+        size_type content_hits  = 0;
+        /** Requests which required parsing. **/
+        size_type misses        = 0;
+        /** Documents dropped to stay under the memory budget. **/
+        size_type evictions     = 0;
+    };
+
+public:
+    explicit parse_cache(size_type memory_budget = default_memory_budget, parse_options options = parse_options());
+
+    ~parse_cache() noexcept;
+
+    /** Get the parsed document for the file at \a path.
+     *
+     *  \throws std::runtime_error if the file can not be read.
+     *  \throws parse_error if the file can not be parsed.
+    **/
+    document_ptr parse_file(const std::string& path);
+
+    /** Like \c parse_file, but always compare the contents of the file instead of trusting an unchanged identity. Use
+     *  this for files known to have been written to, since a quick rewrite which does not change the size can leave the
+     *  modification time the same on file systems with coarse timestamps.
+    **/
+    document_ptr reload_file(const std::string& path);
+
+    /** The number of documents in the cache. **/
+    size_type size() const;
+
+    /** The estimated memory used by the documents in the cache. **/
+    size_type memory_usage() const;
+
+    size_type memory_budget() const { return _memory_budget; }
+
+    const parse_options& options() const { return _options; }
+
+    statistics stats() const;
+
+    /** Drop every document. **/
+    void clear();
+
+    /** Write the contents of the cache to \a path in a compact binary form.
+     *
+     *  \throws std::runtime_error if the file can not be written.
+    **/
+    void save(const std::string& path) const;
+
+    /** Add the contents written by \c save to this cache. Entries for files which have changed since they were saved are
+     *  discarded the first time they are requested.
+     *
+     *  \throws std::runtime_error if the file can not be read or is not a saved cache.
+    **/
+    void load(const std::string& path);
+
+    /** A fast, non-cryptographic 64-bit hash of \a length bytes at \a data, as used for finding contents. Collisions are
+     *  easy to make on purpose, which is why the contents themselves are compared as well.
+    **/
+    static std::uint64_t content_hash(const char* data, size_type length);
+
+private:
+    struct file_identity
+    {
+        std::uint64_t device;
+        std::uint64_t inode;
+        std::uint64_t size;
+        std::uint64_t mtime_ns;
+
+        bool operator==(const file_identity& other) const;
+    };
+
+    struct path_record
+    {
+        file_identity identity;
+        std::uint64_t hash;
+    };
+
+    struct content_record
+    {
+        document_ptr                       document;
+        /** The text the document was parsed from. **/
+        std::string                        source;
+        /** The paths whose records refer to this, which are dropped along with it. **/
+        std::vector<std::string>           paths;
+        /** The estimated memory used by the document, its text and the records of its paths. **/
+        size_type                          cost;
+        std::list<std::uint64_t>::iterator lru_position;
+    };
+
+    document_ptr lookup(const std::string& path, bool trust_identity);
+
+    /** Find the cached document with the given content \a hash, marking it as recently used. If \a source is not null,
+     *  the document must have been parsed from exactly that text. Call with the lock held.
+    **/
+    document_ptr find_content(std::uint64_t hash, const std::string* source);
+
+    /** Record that the file at \a path has \a identity and the contents cached under \a hash, which must exist. Call
+     *  with the lock held.
+    **/
+    void link_path(const std::string& path, const file_identity& identity, std::uint64_t hash);
+
+    /** Forget the record of \a path, if there is one. Call with the lock held. **/
+    void unlink_path(const std::string& path);
+
+    /** Add a document to the cache and evict others to fit it. Call with the lock held. **/
+    void insert(const std::string&   path,
+                const file_identity& identity,
+                std::uint64_t        hash,
+                std::string          source,
+                document_ptr         doc
+               );
+
+    /** Drop the least recently used documents (and the records of their paths) until the cache is within its budget
+     *  or only \a keep documents are left. Call with the lock held.
+    **/
+    void evict(size_type keep);
+
+private:
+    size_type                                         _memory_budget;
+    parse_options                                     _options;
+    mutable std::mutex                                _protect;
+    std::unordered_map<std::string, path_record>      _paths;
+    std::unordered_map<std::uint64_t, content_record> _contents;
+    /** Content hashes from most to least recently used. **/
+    std::list<std::uint64_t>                          _lru;
+    size_type                                         _memory_usage;
+    statistics                                        _stats;
+};
+
+/** The files making up a configuration: a root file and everything it includes (transitively) with the \c include
+ *  directive. Each file is parsed into its own document, so the tree can share documents with a \c parse_cache and
+ *  with other trees. Relative include patterns are resolved against the directory of the root file, like nginx resolves
+ *  them against its configuration prefix. Every file is known by its absolute path, even if the root was given as a
+ *  relative one.
+**/
+class NGINXCONFIG_PUBLIC include_tree
+{
+public:
+    using document_ptr = parse_cache::document_ptr;
+    using document_map = std::map<std::string, document_ptr>;
+    using path_list    = std::vector<std::string>;
+    using pattern_map  = std::map<std::string, path_list>;
+
+public:
+    include_tree();
+    include_tree(const include_tree&);
+    include_tree(include_tree&&);
+    include_tree& operator=(const include_tree&);
+    include_tree& operator=(include_tree&&);
+
+    ~include_tree() noexcept;
+
+    /** The absolute path of the root file. **/
+    const std::string& root() const { return _root; }
+
+    /** The directory relative include patterns are resolved against: the directory of the root file. **/
+    const std::string& base_directory() const { return _base_directory; }
+
+    /** Get the path \a pattern is matched against, which is \a pattern itself if it is absolute. **/
+    std::string pattern_path(const std::string& pattern) const;
+
+    /** The documents of every file in the tree, by path. **/
+    const document_map& documents() const { return _documents; }
+
+    /** Get the document for the file at \a path, which is made absolute first if it is relative.
+     *
+     *  \throws std::out_of_range if \a path is not a part of this tree.
+    **/
+    const document_ptr& document(const std::string& path) const;
+
+    /** Every \c include pattern used in the tree, as written, with the files it matched. **/
+    const pattern_map& patterns() const { return _patterns; }
+
+    /** Get the files the \c include pattern \a pattern matched, in the order nginx would include them.
+     *
+     *  \throws std::out_of_range if \a pattern was not used in this tree.
+    **/
+    const path_list& resolve(const std::string& pattern) const;
+
+    /** Build a single document with every \c include directive replaced by the contents of the files it matched.
+     *
+     *  \throws std::runtime_error if the files include each other in a cycle.
+    **/
+    ast_entry flatten() const;
+
+private:
+    friend include_tree parse_include_tree(const std::string&, parse_cache&);
+    friend include_tree parse_include_tree(const include_tree&, const path_list&, parse_cache&);
+
+    static include_tree build(const std::string&  path,
+                              parse_cache&        cache,
+                              const include_tree* previous,
+                              const path_list&    changed
+                             );
+
+private:
+    std::string                      _root;
+    std::string                      _base_directory;
+    document_map                     _documents;
+    pattern_map                      _patterns;
+};
+
+/** Parse the file at \a path and every file it includes, getting each document from \a cache. An \c include of a file
+ *  without wildcards which does not exist is an error, while a pattern with wildcards may match nothing.
+ *
+ *  \throws std::runtime_error if a file can not be read.
+ *  \throws parse_error if a file can not be parsed.
+**/
+NGINXCONFIG_PUBLIC include_tree parse_include_tree(const std::string& path, parse_cache& cache);
+
+/** Parse the tree \a previous was parsed from again, assuming only the files in \a changed might be different. The
+ *  documents of all other files are taken from \a previous without even checking the file system, while include
+ *  patterns are always expanded again so added and removed files are found.
+**/
+NGINXCONFIG_PUBLIC include_tree parse_include_tree(const include_tree&            previous,
+                                                   const include_tree::path_list& changed,
+                                                   parse_cache&                   cache
+                                                  );
+
+/** Parse the file at \a path and every file it includes without keeping a cache around. **/
+NGINXCONFIG_PUBLIC include_tree parse_include_tree(const std::string& path,
+                                                   const parse_options& options = parse_options()
+                                                  );
+
+}
+
+#endif/*__NGINXCONFIG_PARSE_CACHE_HPP_INCLUDED__*/
@@ -0,0 +1,76 @@
+/** \file nginxconfig/parse_many.hpp
+ *  Parsing large batches of independent files across all cores.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_PARSE_MANY_HPP_INCLUDED__
+#define __NGINXCONFIG_PARSE_MANY_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+#include <nginxconfig/ast.hpp>
+#include <nginxconfig/parse.hpp>
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nginxconfig
+{
+
+/** The outcome of parsing a single file with \c parse_many: either the document or the exception parsing it threw. **/
+class NGINXCONFIG_PUBLIC parse_result
+{
+public:
+    parse_result() = default;
+
+    parse_result(parse_result&&) noexcept = default;
+    parse_result& operator=(parse_result&&) noexcept = default;
+
+    ~parse_result() noexcept;
+
+    /** The path this result is for. **/
+    const std::string& path() const { return _path; }
+
+    /** Was the file parsed successfully? **/
+    bool ok() const { return !_error; }
+
+    /** Get the parsed document.
+     *
+     *  \throws whatever parsing the file threw if it was not successful.
+    **/
+    const ast_entry& document() const;
+    ast_entry&       document();
+
+    /** The exception parsing the file threw or \c nullptr if it was successful. **/
+    const std::exception_ptr& error() const { return _error; }
+
+private:
+    friend class parse_many_job;
+
+    std::string        _path;
+    ast_entry          _document = ast_entry::make_document({});
+    std::exception_ptr _error;
+};
+
+/** Parse each file in \a paths, spreading the work over \a threads threads (or one per core if \a threads is 0). Files
+ *  are scheduled largest first so one big file does not end up last, and idle threads steal work from busy ones. A
+ *  file which can not be opened or fails to parse produces a result with an \c error instead of stopping the batch. If
+ *  the system will not start as many threads as asked for, the files are parsed by those it did start.
+ *
+ *  \returns the results in the same order as \a paths.
+**/
+NGINXCONFIG_PUBLIC std::vector<parse_result> parse_many(const std::vector<std::string>& paths,
+                                                        const parse_options&            options = parse_options(),
+                                                        std::size_t                     threads = 0
+                                                       );
+
+}
+
+#endif/*__NGINXCONFIG_PARSE_MANY_HPP_INCLUDED__*/
@@ -0,0 +1,81 @@
+/** \file nginxconfig/reparse.hpp
+ *  Incremental parsing of edited source text.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_REPARSE_HPP_INCLUDED__
+#define __NGINXCONFIG_REPARSE_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+#include <nginxconfig/ast.hpp>
+#include <nginxconfig/parse.hpp>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace nginxconfig
+{
+
+/** A change to source text: the \c old_length bytes at \c offset are replaced with \c new_text. **/
+struct NGINXCONFIG_PUBLIC text_edit
+{
+    using size_type = std::size_t;
+
+    size_type   offset;
+    size_type   old_length;
+    std::string new_text;
+};
+
+/** The outcome of \c reparse. **/
+struct NGINXCONFIG_PUBLIC reparse_result
+{
+    using size_type = std::size_t;
+
+    /** The document for the edited source. **/
+    ast_entry              document = ast_entry::make_document({});
+
+    /** The edited source text. **/
+    std::string            source;
+
+    /** The child indices leading from \c document to the block whose children were parsed again (empty if it was the
+     *  document itself).
+    **/
+    std::vector<size_type> block_path;
+
+    /** The children of the block in <tt>[first_changed, last_changed)</tt> are new. All others were kept from the
+     *  previous document.
+    **/
+    size_type              first_changed = 0;
+    size_type              last_changed  = 0;
+
+    /** Get the block the \c block_path leads to. **/
+    const ast_entry& block() const;
+};
+
+/** Apply \a edit to \a source and parse the result, reusing as much of \a previous (the document parsed from
+ *  \a source) as possible. Only the body of the smallest block which encloses the edited lines and is still balanced
+ *  after the edit is parsed again; children of that block the edit did not touch are moved from \a previous, as are all
+ *  entries outside of it, with their source ranges shifted.
+ *
+ *  \a previous must have been parsed from \a source (with \c parse or an earlier \c reparse) and not modified since, as
+ *  the source ranges of its entries are what locate the edit.
+ *
+ *  \throws std::out_of_range if \a edit does not fit in \a source.
+ *  \throws parse_error if the edited source can not be parsed.
+**/
+NGINXCONFIG_PUBLIC reparse_result reparse(ast_entry&&          previous,
+                                          const std::string&   source,
+                                          const text_edit&     edit,
+                                          const parse_options& options = parse_options()
+                                         );
+
+}
+
+#endif/*__NGINXCONFIG_REPARSE_HPP_INCLUDED__*/
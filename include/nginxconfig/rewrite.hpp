@@ -0,0 +1,169 @@
+/** \file nginxconfig/rewrite.hpp
+ *  Applying many rewrite rules to an AST in a single traversal.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_REWRITE_HPP_INCLUDED__
+#define __NGINXCONFIG_REWRITE_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+#include <nginxconfig/ast.hpp>
+#include <nginxconfig/rule_table.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nginxconfig
+{
+
+/** Which entries a rewrite rule applies to. **/
+struct NGINXCONFIG_PUBLIC rewrite_pattern
+{
+    /** The name of the entry, or empty to match any name. **/
+    std::string              name;
+    /** If not empty, the entry must have exactly this many attributes, each equal to the one here; \c "*" matches any
+     *  attribute.
+    **/
+    std::vector<std::string> attributes;
+    /** If not empty, the entry must be directly inside of a block with this name. **/
+    std::string              parent;
+
+    bool matches(const ast_entry& entry, const ast_entry& owner) const;
+};
+
+/** What a \c rewrite_action sees and how it changes things. The entry can be changed in place; the other changes are
+ *  recorded and only made to the list of children once every child of the block has been visited, so \c parent and
+ *  the siblings of the entry still look the way they did before the traversal reached this block.
+**/
+class NGINXCONFIG_PUBLIC rewrite_context
+{
+public:
+    using path_type = std::vector<const ast_entry*>;
+
+public:
+    /** The entry the rule matched. **/
+    ast_entry& entry() { return *_entry; }
+
+    /** The block \c entry is in. **/
+    const ast_entry& parent() const { return *_path.back(); }
+
+    /** The entries enclosing \c entry, starting with the root. **/
+    const path_type& path() const { return _path; }
+
+    /** Take \c entry out of its block. Rules added after this one are not given it. **/
+    void remove();
+
+    /** Has \c entry been removed? **/
+    bool removed() const { return _removed; }
+
+    /** Put \a replacement where \c entry is and remove \c entry. Calling this again adds another entry after the first
+     *  replacement.
+    **/
+    void replace(ast_entry replacement);
+
+    /** Add \a added to the block right before \c entry. **/
+    void insert_before(ast_entry added);
+
+    /** Add \a added to the block right after \c entry (and after anything which replaces it). **/
+    void insert_after(ast_entry added);
+
+private:
+    friend class rewriter;
+
+    rewrite_context() = default;
+
+private:
+    ast_entry*             _entry   = nullptr;
+    path_type              _path;
+    bool                   _removed = false;
+    /** Vectors instead of \c child_list, since an empty deque still allocates and most entries add nothing. **/
+    std::vector<ast_entry> _before;
+    std::vector<ast_entry> _after;
+};
+
+/** Something to do to each entry a \c rewrite_pattern matches. Actions are shared by everything using the
+ *  \c rewriter, so \c rewrite must not change the action.
+**/
+class NGINXCONFIG_PUBLIC rewrite_action
+{
+public:
+    virtual ~rewrite_action() noexcept;
+
+    virtual void rewrite(rewrite_context& cxt) const = 0;
+};
+
+/** A set of rewrite rules applied to a tree in a single pass:
+ *
+ *  \code
+ *  rewriter rules;
+ *  rules.remove({ "ssl", { "on" }, "server" });
+ *  rules.replace({ "proxy_read_timeout", { "*" }, "location" },
+ *                ast_entry::make_simple("proxy_read_timeout", { "90s" })
+ *               );
+ *  rules.add({ "listen", {}, "server" }, std::make_shared<add_ssl_flag>());
+ *  rules.apply(document);
+ *  \endcode
+ *
+ *  The rules are kept in a table by name, so each entry costs one lookup no matter how many rules there are. Entries
+ *  are visited parent before children; for each one, the rules matching it are applied in the order they were added.
+ *  Entries added by a rule are not rewritten themselves. When a rule adds or removes entries, the list of children of
+ *  that block is rebuilt once after all of its children were visited instead of erasing from the middle of it for
+ *  each change.
+**/
+class NGINXCONFIG_PUBLIC rewriter
+{
+public:
+    using size_type = std::size_t;
+
+public:
+    rewriter();
+
+    ~rewriter() noexcept;
+
+    /** Apply \a action to every entry matching \a pattern. **/
+    void add(rewrite_pattern pattern, std::shared_ptr<const rewrite_action> action);
+
+    /** Remove every entry matching \a pattern. **/
+    void remove(rewrite_pattern pattern);
+
+    /** Replace every entry matching \a pattern with a copy of \a replacement. **/
+    void replace(rewrite_pattern pattern, ast_entry replacement);
+
+    /** The number of rules added. **/
+    size_type size() const { return _rules.size(); }
+
+    /** Apply the rules to everything inside of \a root (not to \a root itself).
+     *
+     *  \returns the number of times a rule was applied.
+    **/
+    size_type apply(ast_entry& root) const;
+
+private:
+    struct rule
+    {
+        rewrite_pattern                       pattern;
+        std::shared_ptr<const rewrite_action> action;
+    };
+
+    /** Apply the rules matching the \c entry of \a cxt, which is a child of \a owner. **/
+    size_type dispatch(rewrite_context& cxt, const ast_entry& owner) const;
+
+    /** Rewrite the children of \a owner and everything inside of them. **/
+    size_type apply_children(rewrite_context& cxt, ast_entry& owner) const;
+
+private:
+    std::vector<rule> _rules;
+    rule_table        _dispatch;
+};
+
+}
+
+#endif/*__NGINXCONFIG_REWRITE_HPP_INCLUDED__*/
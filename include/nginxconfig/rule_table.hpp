@@ -0,0 +1,79 @@
+/** \file nginxconfig/rule_table.hpp
+ *  Finding the rules interested in a directive by its name.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_RULE_TABLE_HPP_INCLUDED__
+#define __NGINXCONFIG_RULE_TABLE_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nginxconfig
+{
+
+/** The dispatch table behind \c linter and \c rewriter. Rules are numbered in the order they were added and each is
+ *  registered either for some directive names or for every name. Finding the candidates for an entry is one hash
+ *  lookup, no matter how many rules there are, and they are visited in the order they were added.
+**/
+class NGINXCONFIG_PUBLIC rule_table
+{
+public:
+    using size_type = std::size_t;
+
+public:
+    /** Register the rule \a idx for directives named \a name. Rules must be added in increasing order of \a idx;
+     *  registering the same rule for the same name again does nothing.
+    **/
+    void add(size_type idx, const std::string& name);
+
+    /** Register the rule \a idx for every directive. **/
+    void add_any(size_type idx);
+
+    /** Call \a visit with the index of every rule registered for \a name or for every name, in the order they were
+     *  added, until it returns \c false.
+    **/
+    template <typename FVisit>
+    void for_each(const std::string& name, FVisit&& visit) const
+    {
+        const std::vector<size_type>& named = find(name);
+
+        // both lists are in the order the rules were added, so merging them keeps that order
+        auto named_iter = named.begin();
+        auto any_iter   = _any_name.begin();
+        while (named_iter != named.end() || any_iter != _any_name.end())
+        {
+            size_type idx;
+            if (any_iter == _any_name.end() || (named_iter != named.end() && *named_iter < *any_iter))
+                idx = *named_iter++;
+            else
+                idx = *any_iter++;
+
+            if (!visit(idx))
+                return;
+        }
+    }
+
+private:
+    /** Get the rules registered for \a name alone. **/
+    const std::vector<size_type>& find(const std::string& name) const;
+
+private:
+    std::unordered_map<std::string, std::vector<size_type>> _by_name;
+    /** Rules interested in every name. **/
+    std::vector<size_type>                                  _any_name;
+};
+
+}
+
+#endif/*__NGINXCONFIG_RULE_TABLE_HPP_INCLUDED__*/
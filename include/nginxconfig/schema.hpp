@@ -0,0 +1,170 @@
+/** \file nginxconfig/schema.hpp
+ *  Knowledge of which directives are valid where and validation of an AST against that knowledge.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_SCHEMA_HPP_INCLUDED__
+#define __NGINXCONFIG_SCHEMA_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nginxconfig
+{
+
+class ast_entry;
+
+/** The contexts a directive can appear in. These mirror the \c NGX_*_CONF flags from the nginx source and are combined
+ *  as a bit mask.
+**/
+enum directive_context : unsigned int
+{
+    context_main             = 1U << 0,
+    context_events           = 1U << 1,
+    context_http             = 1U << 2,
+    context_http_server      = 1U << 3,
+    context_http_location    = 1U << 4,
+    context_http_upstream    = 1U << 5,
+    context_http_server_if   = 1U << 6,
+    context_http_location_if = 1U << 7,
+    context_limit_except     = 1U << 8,
+    context_mail             = 1U << 9,
+    context_mail_server      = 1U << 10,
+    context_stream           = 1U << 11,
+    context_stream_server    = 1U << 12,
+    context_stream_upstream  = 1U << 13,
+    /** Every context -- used by directives such as \c include. **/
+    context_any              = (1U << 14) - 1,
+    /** The body of a block whose children are data instead of directives (\c map, \c types, \c geo...). **/
+    context_opaque           = 0,
+};
+
+/** The number of arguments a directive accepts. These mirror the \c NGX_CONF_* argument flags from the nginx source
+ *  and are combined as a bit mask, so \c args_take1|args_take2 accepts either one or two arguments.
+**/
+enum directive_args : unsigned int
+{
+    args_none    = 1U << 0,
+    args_take1   = 1U << 1,
+    args_take2   = 1U << 2,
+    args_take3   = 1U << 3,
+    args_take4   = 1U << 4,
+    args_take5   = 1U << 5,
+    args_take6   = 1U << 6,
+    args_take7   = 1U << 7,
+    /** Exactly one argument, which must be \c on or \c off. **/
+    args_flag    = 1U << 8,
+    /** Any number of arguments, including none. **/
+    args_any     = 1U << 9,
+    args_1more   = 1U << 10,
+    args_2more   = 1U << 11,
+    /** The directive is a block (a \c complex entry) instead of a \c simple one. **/
+    args_block   = 1U << 12,
+
+    args_take12   = args_take1 | args_take2,
+    args_take13   = args_take1 | args_take3,
+    args_take23   = args_take2 | args_take3,
+    args_take34   = args_take3 | args_take4,
+    args_take123  = args_take1 | args_take2 | args_take3,
+    args_take1234 = args_take1 | args_take2 | args_take3 | args_take4,
+};
+
+/** Describes a single directive. Multiple schemas can share a name if the directive means different things in
+ *  different contexts (such as \c server in \c http versus \c upstream).
+**/
+struct directive_schema
+{
+    /** The name of the directive. **/
+    const char*  name;
+    /** The \c directive_context mask of where this directive can appear. **/
+    unsigned int contexts;
+    /** The \c directive_args mask for this directive. **/
+    unsigned int args;
+    /** For blocks, the \c directive_context the children of this block are in. **/
+    unsigned int block_context;
+};
+
+/** A violation found by \c validate. **/
+struct schema_violation
+{
+    const ast_entry* entry;
+    std::string      message;
+};
+
+using schema_violation_list = std::vector<schema_violation>;
+
+/** A collection of \c directive_schema definitions, keyed by name. **/
+class NGINXCONFIG_PUBLIC schema_registry
+{
+public:
+    using size_type = std::size_t;
+
+public:
+    /** Create an empty registry. **/
+    schema_registry();
+
+    schema_registry(const schema_registry&);
+    schema_registry& operator=(const schema_registry&);
+
+    ~schema_registry() noexcept;
+
+    /** Get the registry containing the directives of the standard nginx modules. To add modules of your own, copy
+     *  this and call \c add_module on the copy.
+    **/
+    static const schema_registry& standard();
+
+    /** Register the directives in [\a first, \a last) as belonging to \a module_name. The names are copied, so the
+     *  table does not need to outlive the registry.
+    **/
+    void add_module(const std::string& module_name, const directive_schema* first, const directive_schema* last);
+
+    template <size_type N>
+    void add_module(const std::string& module_name, const directive_schema (&table)[N])
+    {
+        add_module(module_name, table, table + N);
+    }
+
+    /** Get the names of all registered modules in the order they were added. **/
+    const std::vector<std::string>& modules() const;
+
+    /** Is there any directive named \a name? **/
+    bool contains(const std::string& name) const;
+
+    /** Find the schema for \a name which is allowed in \a context.
+     *
+     *  \returns the schema or \c nullptr if \a name is not allowed in \a context (or is not known at all).
+    **/
+    const directive_schema* find(const std::string& name, unsigned int context) const;
+
+private:
+    void reset_names();
+
+private:
+    std::unordered_map<std::string, std::vector<directive_schema>> _directives;
+    std::vector<std::string>                                      _modules;
+};
+
+/** Validate the children of \a root against \a schema in a single pass. \a root is usually a \c document, in which
+ *  case \a context should be \c context_main; when validating a fragment such as a \c server block by itself, provide
+ *  the context its children are in.
+ *
+ *  \returns every violation found, in document order.
+**/
+NGINXCONFIG_PUBLIC schema_violation_list validate(const ast_entry&       root,
+                                                  const schema_registry& schema  = schema_registry::standard(),
+                                                  unsigned int           context = context_main
+                                                 );
+
+}
+
+#endif/*__NGINXCONFIG_SCHEMA_HPP_INCLUDED__*/
@@ -0,0 +1,166 @@
+/** \file nginxconfig/select.hpp
+ *  A small selector language for finding entries in a document, such as \c "http > server[listen=443] > location".
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_SELECT_HPP_INCLUDED__
+#define __NGINXCONFIG_SELECT_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nginxconfig
+{
+
+class ast_entry;
+
+/** Thrown when a selector expression can not be compiled. **/
+class NGINXCONFIG_PUBLIC selector_error :
+        public std::invalid_argument
+{
+public:
+    using size_type = std::size_t;
+
+public:
+    explicit selector_error(size_type position, const std::string& message);
+
+    virtual ~selector_error() noexcept;
+
+    /** The character index into the expression where the problem was found. **/
+    size_type position() const { return _position; }
+
+private:
+    size_type _position;
+};
+
+/** An index of every \c simple and \c complex entry of a document by name, built in a single pass. Selectors run
+ *  against an index start from the entries named by their last step instead of walking the whole tree.
+ *
+ *  The index holds pointers into the document, so the document must outlive it and must not be modified while it is
+ *  in use.
+**/
+class NGINXCONFIG_PUBLIC document_index
+{
+public:
+    using entry_list = std::vector<const ast_entry*>;
+
+public:
+    explicit document_index(const ast_entry& document);
+
+    ~document_index() noexcept;
+
+    /** The document this index was built from. **/
+    const ast_entry& document() const { return *_document; }
+
+    /** Get all the entries named \a name in document order. **/
+    const entry_list& find(const std::string& name) const;
+
+    /** Get all the named entries in document order. **/
+    const entry_list& all() const { return _all; }
+
+    /** Get the entry enclosing \a entry or \c nullptr for the document itself (or entries not in the document). **/
+    const ast_entry* parent(const ast_entry& entry) const;
+
+private:
+    const ast_entry*                                      _document;
+    entry_list                                            _all;
+    std::unordered_map<std::string, entry_list>           _by_name;
+    std::unordered_map<const ast_entry*, const ast_entry*> _parents;
+};
+
+/** A compiled selector. The language is a sequence of steps separated by combinators:
+ *
+ *   - A step is either a name (such as \c server) or \c * for any \c simple or \c complex entry, followed by any number
+ *     of predicates in square brackets.
+ *   - <tt>a > b</tt> selects \c b entries which are direct children of an \c a entry.
+ *   - <tt>a b</tt> selects \c b entries anywhere inside of an \c a entry.
+ *   - A leading \c > anchors the first step to the top level of the document; otherwise it can match at any depth.
+ *
+ *  Predicates test the entry a step matched:
+ *
+ *   - <tt>[=value]</tt> matches if any of the entry's own attributes is \c value (as in <tt>location[=/api]</tt>).
+ *   - <tt>[name]</tt> matches if the entry has a direct child named \c name.
+ *   - <tt>[name=value]</tt> matches if the entry has a direct child named \c name with an attribute equal to \c value
+ *     (as in <tt>server[listen=443]</tt>).
+ *
+ *  Values can be quoted with \c " or \c ' if they contain spaces or brackets.
+**/
+class NGINXCONFIG_PUBLIC selector
+{
+public:
+    using entry_list = std::vector<const ast_entry*>;
+
+public:
+    /** Compile the \a expression.
+     *
+     *  \throws selector_error if \a expression is not a valid selector.
+    **/
+    explicit selector(const std::string& expression);
+
+    ~selector() noexcept;
+
+    /** The expression this selector was compiled from. **/
+    const std::string& expression() const { return _expression; }
+
+    /** Find every entry matching this selector by walking \a document. Results are in document order. **/
+    entry_list select(const ast_entry& document) const;
+
+    /** Find every entry matching this selector using \a index. Results are in document order. **/
+    entry_list select(const document_index& index) const;
+
+private:
+    struct predicate
+    {
+        /** The child name to look for; if empty, the entry's own attributes are tested. **/
+        std::string child;
+        bool        has_value;
+        std::string value;
+    };
+
+    struct step
+    {
+        /** The name to match or empty for the \c * wildcard. **/
+        std::string            name;
+        std::vector<predicate> predicates;
+        /** Must the entry this step matches be a direct child of the entry the previous step matched? **/
+        bool                   direct_child;
+    };
+
+    bool step_matches(const step& s, const ast_entry& entry) const;
+
+    /** Does the selector match the last entry of \a path? \a path is the chain of entries from the document down.
+     *  \a memo is scratch space kept by the caller so it can be reused from one path to the next.
+    **/
+    bool path_matches(const entry_list& path, std::vector<unsigned char>& memo) const;
+
+    /** Can the steps up to \a step_idx match with that step on <tt>path[path_idx]</tt>? The answer for each pair is
+     *  kept in \a memo, so descendant steps which try every ancestor take time proportional to the length of the path
+     *  times the number of steps for each ancestor instead of growing exponentially with the number of steps.
+    **/
+    bool path_matches(const entry_list&          path,
+                      std::size_t                step_idx,
+                      std::size_t                path_idx,
+                      std::vector<unsigned char>& memo
+                     ) const;
+
+private:
+    std::string       _expression;
+    std::vector<step> _steps;
+    /** Was the first step anchored to the top level of the document with a leading \c >? **/
+    bool              _anchored;
+};
+
+}
+
+#endif/*__NGINXCONFIG_SELECT_HPP_INCLUDED__*/
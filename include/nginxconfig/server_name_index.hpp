@@ -0,0 +1,125 @@
+/** \file nginxconfig/server_name_index.hpp
+ *  Fast lookup of the \c server block responsible for a given host name.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_SERVER_NAME_INDEX_HPP_INCLUDED__
+#define __NGINXCONFIG_SERVER_NAME_INDEX_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nginxconfig
+{
+
+class ast_entry;
+
+/** A compiled index of every \c server_name in the \c http blocks of a document. Lookups follow the same resolution
+ *  order as nginx itself:
+ *
+ *   1. The exact name (stored in an open-addressing hash table).
+ *   2. The longest wildcard name starting with an asterisk, such as \c *.example.org or \c .example.org.
+ *   3. The longest wildcard name ending with an asterisk, such as \c mail.*.
+ *   4. The first regular expression (a name starting with \c ~), in the order they appear in the configuration.
+ *
+ *  Names are grouped by the address and port of their \c listen directives, since nginx only considers \c server blocks
+ *  listening on the socket a request arrived on. Listen addresses are normalized to the form \c "address:port" (see
+ *  \c normalize_listen), with \c server blocks lacking a \c listen directive falling into \c "*:80".
+ *
+ *  The index holds pointers into the document it was built from, so the document must outlive it and must not be
+ *  modified while the index is in use.
+**/
+class NGINXCONFIG_PUBLIC server_name_index
+{
+public:
+    using size_type = std::size_t;
+
+    /** Describes a name which was specified more than once in the same listen group. nginx will warn about these and
+     *  use the \c first server, which is what this index does, too.
+    **/
+    struct conflict
+    {
+        std::string      listen;
+        std::string      name;
+        const ast_entry* first;
+        const ast_entry* second;
+    };
+
+    using conflict_list = std::vector<conflict>;
+
+    /** Describes a regular expression name which could not be compiled. Named groups and a leading \c (?i) are
+     *  translated from PCRE, but other PCRE-only syntax is not understood. The rest of the \c server is still indexed,
+     *  but this name will never match.
+    **/
+    struct unindexable
+    {
+        std::string      name;
+        const ast_entry* server;
+        std::string      message;
+    };
+
+    using unindexable_list = std::vector<unindexable>;
+
+public:
+    /** Build the index from the \c server blocks of the given \a document. This takes time linear in the total number
+     *  of names.
+    **/
+    explicit server_name_index(const ast_entry& document);
+
+    server_name_index(server_name_index&&) noexcept;
+    server_name_index& operator=(server_name_index&&) noexcept;
+
+    ~server_name_index() noexcept;
+
+    /** Find the \c server block which would handle a request for \a host, regardless of which socket it arrived on.
+     *  When the same name is used in multiple listen groups, the first \c server in the document wins.
+     *
+     *  \returns the matching \c server entry or \c nullptr if no name matches.
+    **/
+    const ast_entry* find(const std::string& host) const;
+
+    /** Find the \c server block which would handle a request for \a host arriving on \a listen. Unlike nginx, this does
+     *  not fall back to the default server when no name matches -- use \c default_server for that.
+     *
+     *  \param listen The listen address in normalized form (such as \c "*:80" or \c "127.0.0.1:8080").
+     *  \returns the matching \c server entry or \c nullptr if no name matches.
+    **/
+    const ast_entry* find(const std::string& listen, const std::string& host) const;
+
+    /** Get the default server for the \a listen group. This is the \c server with a \c default_server (or \c default)
+     *  flag on its \c listen directive or the first \c server in the group if there is no such flag.
+     *
+     *  \returns the default server or \c nullptr if nothing listens on \a listen.
+    **/
+    const ast_entry* default_server(const std::string& listen) const;
+
+    /** Get the normalized addresses of all listen groups, in the order they were first seen. **/
+    std::vector<std::string> listen_groups() const;
+
+    /** Get the list of names which were defined more than once in the same listen group. **/
+    const conflict_list& conflicts() const;
+
+    /** Get the list of regular expression names which could not be compiled. **/
+    const unindexable_list& unindexables() const;
+
+    /** Normalize the first attribute of a \c listen directive to the form \c "address:port". **/
+    static std::string normalize_listen(const ast_entry& listen_directive);
+
+private:
+    class impl;
+
+    std::unique_ptr<impl> _impl;
+};
+
+}
+
+#endif/*__NGINXCONFIG_SERVER_NAME_INDEX_HPP_INCLUDED__*/
@@ -0,0 +1,282 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include "generator.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+namespace nginxconfig_bench
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// config_shape                                                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+const char* to_string(config_shape shape)
+{
+    switch (shape)
+    {
+    case config_shape::servers:  return "servers";
+    case config_shape::maps:     return "maps";
+    case config_shape::comments: return "comments";
+    case config_shape::deep:     return "deep";
+    default:                     return "unknown";
+    }
+}
+
+config_shape shape_from_string(const std::string& name)
+{
+    for (config_shape shape : all_shapes())
+        if (name == to_string(shape))
+            return shape;
+    throw std::invalid_argument("Unknown config shape \"" + name + "\"");
+}
+
+const std::vector<config_shape>& all_shapes()
+{
+    static const std::vector<config_shape> instance = { config_shape::servers,
+                                                        config_shape::maps,
+                                                        config_shape::comments,
+                                                        config_shape::deep,
+                                                      };
+    return instance;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// generate_config                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+/** SplitMix64: tiny, fast and the same everywhere, unlike the distributions in \c <random>. **/
+class random_source
+{
+public:
+    explicit random_source(std::uint64_t seed) :
+            _state(seed)
+    { }
+
+    std::uint64_t next()
+    {
+        std::uint64_t z = (_state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    /** A value in <tt>[low, high]</tt>. **/
+    std::size_t between(std::size_t low, std::size_t high)
+    {
+        return low + static_cast<std::size_t>(next() % (high - low + 1));
+    }
+
+    template <typename T, std::size_t N>
+    const T& pick(const T (&choices)[N])
+    {
+        return choices[next() % N];
+    }
+
+private:
+    std::uint64_t _state;
+};
+
+const char* const words[] = { "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel", "india",
+                              "juliet", "kilo", "lima", "mike", "november", "oscar", "papa", "quebec", "romeo",
+                            };
+
+const char* const header_names[] = { "Host", "X-Real-IP", "X-Forwarded-For", "X-Forwarded-Proto", "Upgrade" };
+
+const char* const header_values[] = { "$host", "$remote_addr", "$proxy_add_x_forwarded_for", "$scheme",
+                                      "$http_upgrade",
+                                    };
+
+class config_writer
+{
+public:
+    explicit config_writer(std::uint64_t seed) :
+            _random(seed),
+            _depth(0)
+    { }
+
+    std::string& text() { return _text; }
+
+    void begin(const std::string& line)
+    {
+        indent();
+        _text += line;
+        _text += " {\n";
+        ++_depth;
+    }
+
+    void end()
+    {
+        --_depth;
+        indent();
+        _text += "}\n";
+    }
+
+    void line(const std::string& content)
+    {
+        indent();
+        _text += content;
+        _text += '\n';
+    }
+
+    void comment_run(std::size_t min_lines, std::size_t max_lines)
+    {
+        std::size_t count = _random.between(min_lines, max_lines);
+        for (std::size_t idx = 0; idx < count; ++idx)
+        {
+            std::string content = "#";
+            std::size_t word_count = _random.between(0, 12);
+            for (std::size_t word = 0; word < word_count; ++word)
+            {
+                content += ' ';
+                content += _random.pick(words);
+            }
+            line(content);
+        }
+    }
+
+    random_source& random() { return _random; }
+
+private:
+    void indent()
+    {
+        _text.append(_depth * 4, ' ');
+    }
+
+private:
+    std::string   _text;
+    random_source _random;
+    std::size_t   _depth;
+};
+
+void write_location(config_writer& out, std::size_t server, std::size_t location)
+{
+    random_source& random = out.random();
+    out.begin("location /" + std::string(random.pick(words)) + "_" + std::to_string(location));
+    out.line("proxy_pass http://backend_" + std::to_string(server % 64) + ";");
+    std::size_t headers = random.between(1, 5);
+    for (std::size_t idx = 0; idx < headers; ++idx)
+        out.line("proxy_set_header " + std::string(header_names[idx]) + " " + header_values[idx] + ";");
+    if (random.between(0, 3) == 0)
+        out.line("proxy_read_timeout " + std::to_string(random.between(5, 300)) + "s;");
+    out.end();
+}
+
+void write_servers(config_writer& out, std::size_t target_bytes)
+{
+    random_source& random = out.random();
+    out.begin("http");
+    out.line("include mime.types;");
+    out.line("sendfile on;");
+    for (std::size_t idx = 0; idx < 64; ++idx)
+    {
+        out.begin("upstream backend_" + std::to_string(idx));
+        std::size_t servers = random.between(1, 4);
+        for (std::size_t server = 0; server < servers; ++server)
+            out.line("server 10.0." + std::to_string(idx) + "." + std::to_string(server + 1) + ":8080;");
+        out.end();
+    }
+
+    for (std::size_t server = 0; out.text().size() < target_bytes; ++server)
+    {
+        std::string host = std::string(random.pick(words)) + std::to_string(server) + ".example.com";
+        out.begin("server");
+        out.line("listen 80;");
+        if (random.between(0, 1) == 0)
+            out.line("listen 443 ssl;");
+        out.line("server_name " + host + " www." + host + ";");
+        out.line("root /srv/www/" + host + ";");
+        out.line("access_log /var/log/nginx/" + host + ".log combined;");
+        std::size_t locations = random.between(1, 6);
+        for (std::size_t location = 0; location < locations; ++location)
+            write_location(out, server, location);
+        out.end();
+    }
+    out.end();
+}
+
+void write_maps(config_writer& out, std::size_t target_bytes)
+{
+    random_source& random = out.random();
+    out.begin("http");
+    for (std::size_t map = 0; out.text().size() < target_bytes; ++map)
+    {
+        out.begin("map $host $backend_" + std::to_string(map));
+        out.line("default backend_0;");
+        for (std::size_t entry = 0; entry < 4096 && out.text().size() < target_bytes; ++entry)
+        {
+            out.line(std::string(random.pick(words)) + "_" + std::to_string(entry) + "_example_com backend_"
+                     + std::to_string(random.between(0, 63)) + ";"
+                    );
+        }
+        out.end();
+    }
+    out.end();
+}
+
+void write_comments(config_writer& out, std::size_t target_bytes)
+{
+    random_source& random = out.random();
+    out.begin("http");
+    for (std::size_t idx = 0; out.text().size() < target_bytes; ++idx)
+    {
+        out.comment_run(20, 60);
+        out.line(std::string(random.pick(words)) + "_timeout " + std::to_string(random.between(1, 120)) + "s;");
+        if (random.between(0, 7) == 0)
+            out.line("");
+    }
+    out.end();
+}
+
+void write_deep(config_writer& out, std::size_t target_bytes)
+{
+    random_source& random = out.random();
+    out.begin("http");
+    out.begin("server");
+    for (std::size_t tree = 0; out.text().size() < target_bytes; ++tree)
+    {
+        // well below parse_options::default_max_depth, so the default options can parse it
+        std::size_t depth = random.between(16, 96);
+        for (std::size_t level = 0; level < depth; ++level)
+        {
+            out.begin("location /" + std::string(random.pick(words)) + "_" + std::to_string(level));
+            out.line("add_header X-Level " + std::to_string(level) + ";");
+        }
+        for (std::size_t level = 0; level < depth; ++level)
+            out.end();
+    }
+    out.end();
+    out.end();
+}
+
+}
+
+std::string generate_config(config_shape shape, std::size_t target_bytes, std::uint64_t seed)
+{
+    config_writer out(seed);
+    out.text().reserve(target_bytes + target_bytes / 8 + 4096);
+    out.line("# generated by nginxconfig-bench: " + std::string(to_string(shape)) + ", seed " + std::to_string(seed));
+    out.line("worker_processes auto;");
+    switch (shape)
+    {
+    case config_shape::servers:  write_servers(out, target_bytes);  break;
+    case config_shape::maps:     write_maps(out, target_bytes);     break;
+    case config_shape::comments: write_comments(out, target_bytes); break;
+    case config_shape::deep:     write_deep(out, target_bytes);     break;
+    }
+    return std::move(out.text());
+}
+
+}
@@ -0,0 +1,54 @@
+/** \file
+ *  Deterministic generation of synthetic configurations for benchmarking.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_BENCH_GENERATOR_HPP_INCLUDED__
+#define __NGINXCONFIG_BENCH_GENERATOR_HPP_INCLUDED__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nginxconfig_bench
+{
+
+/** The overall structure of a generated configuration. **/
+enum class config_shape
+{
+    /** An \c http block with upstreams and many \c server blocks, each with a few \c location blocks. **/
+    servers,
+    /** A handful of \c map blocks with thousands of entries each. **/
+    maps,
+    /** Directives separated by long runs of comment lines. **/
+    comments,
+    /** \c location blocks nested dozens of levels deep. **/
+    deep,
+};
+
+const char* to_string(config_shape shape);
+
+/** Get the shape named \a name.
+ *
+ *  \throws std::invalid_argument if there is no such shape.
+**/
+config_shape shape_from_string(const std::string& name);
+
+/** Every shape, in declaration order. **/
+const std::vector<config_shape>& all_shapes();
+
+/** Generate a configuration of the given \a shape which is at least \a target_bytes long (it stops at the first
+ *  complete unit past that size). The same \a shape, \a target_bytes and \a seed always produce the same text.
+**/
+std::string generate_config(config_shape shape, std::size_t target_bytes, std::uint64_t seed = 1);
+
+}
+
+#endif/*__NGINXCONFIG_BENCH_GENERATOR_HPP_INCLUDED__*/
@@ -0,0 +1,582 @@
+/** \file
+ *  Entry point for the benchmarks of nginxconfig. Every combination of shape and size is generated, then parsing,
+ *  encoding, copying, comparing and traversing the document are each timed. Results are written as JSON so they can
+ *  be tracked over time; progress goes to \c stderr.
+ *
+ *  \code
+ *  $> make nginxconfig-bench ARGS='--sizes=1K,1M,64M --shapes=servers,deep --output=bench.json'
+ *  \endcode
+ *
+ *  \c parse_many is timed at 1, 2, 4 and so on up to \c --threads threads (one per core by default) over a batch of
+ *  links to the same generated file, to show how parsing many files scales.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include "generator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Allocation Counting                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+std::atomic<std::uint64_t> allocation_count(0);
+std::atomic<std::uint64_t> allocation_bytes(0);
+
+void* counted_allocate(std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+}
+
+void* operator new(std::size_t size)
+{
+    return counted_allocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return counted_allocate(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+namespace nginxconfig_bench
+{
+
+using namespace nginxconfig;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Measurement                                                                                                        //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct options
+{
+    std::vector<std::size_t>  sizes  = { std::size_t(1) << 10, std::size_t(64) << 10, std::size_t(1) << 20,
+                                         std::size_t(16) << 20,
+                                       };
+    std::vector<config_shape> shapes = all_shapes();
+    std::uint64_t             seed   = 1;
+    /** Each operation is repeated until it has run for at least this long (but at least once). **/
+    double                    min_seconds = 0.5;
+    /** The most threads \c parse_many is timed with. **/
+    std::size_t               max_threads = std::max(1U, std::thread::hardware_concurrency());
+    std::string               output;
+};
+
+struct measurement
+{
+    std::string   name;
+    std::uint64_t iterations      = 0;
+    std::uint64_t best_ns         = 0;
+    std::uint64_t mean_ns         = 0;
+    /** Allocations made by a single iteration. **/
+    std::uint64_t allocations     = 0;
+    std::uint64_t allocated_bytes = 0;
+    /** The bytes of input a single iteration goes through, if it is not the size of the case. **/
+    std::size_t   bytes           = 0;
+};
+
+struct case_result
+{
+    config_shape             shape;
+    std::size_t              target_bytes;
+    std::size_t              bytes;
+    std::size_t              lines;
+    std::size_t              nodes;
+    std::vector<measurement> measurements;
+    /** The high-water mark of the whole process after this case. **/
+    std::uint64_t            peak_rss_bytes;
+};
+
+std::uint64_t peak_rss_bytes()
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return std::uint64_t(usage.ru_maxrss) * 1024;
+}
+
+measurement measure(const std::string& name, double min_seconds, const std::function<void ()>& action)
+{
+    using clock = std::chrono::steady_clock;
+
+    measurement out;
+    out.name = name;
+    std::uint64_t total_ns = 0;
+    do
+    {
+        std::uint64_t count_before = allocation_count.load();
+        std::uint64_t bytes_before = allocation_bytes.load();
+        auto start = clock::now();
+        action();
+        auto elapsed = std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+        if (out.iterations == 0)
+        {
+            out.allocations     = allocation_count.load() - count_before;
+            out.allocated_bytes = allocation_bytes.load() - bytes_before;
+            out.best_ns         = elapsed;
+        }
+        out.best_ns = std::min(out.best_ns, elapsed);
+        total_ns += elapsed;
+        ++out.iterations;
+    } while (total_ns < std::uint64_t(min_seconds * 1e9));
+    out.mean_ns = total_ns / out.iterations;
+    return out;
+}
+
+/** A read-only stream over text someone else owns, so parsing does not include copying the input. **/
+class view_buffer :
+        public std::streambuf
+{
+public:
+    explicit view_buffer(const std::string& text)
+    {
+        char* begin = const_cast<char*>(text.data());
+        setg(begin, begin, begin + text.size());
+    }
+};
+
+/** An output stream which only counts what is written to it, so encoding does not include growing a string. **/
+class counting_buffer :
+        public std::streambuf
+{
+public:
+    counting_buffer() :
+            _count(0)
+    {
+        setp(_buffer, _buffer + sizeof _buffer);
+    }
+
+    std::size_t count() const { return _count + (pptr() - pbase()); }
+
+protected:
+    virtual int_type overflow(int_type ch) override
+    {
+        _count += pptr() - pbase();
+        setp(_buffer, _buffer + sizeof _buffer);
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+private:
+    char        _buffer[16 * 1024];
+    std::size_t _count;
+};
+
+/** A temporary directory holding \a count names for a file with the contents \a text. They are hard links, so the batch
+ *  costs the disk space (and page cache) of a single file however many threads it is meant to keep busy.
+**/
+class file_batch
+{
+public:
+    file_batch(const std::string& text, std::size_t count)
+    {
+        char directory[] = "/tmp/nginxconfig-bench-XXXXXX";
+        if (!::mkdtemp(directory))
+            throw std::runtime_error("Could not create a temporary directory");
+        _directory = directory;
+
+        try
+        {
+            for (std::size_t idx = 0; idx < count; ++idx)
+            {
+                std::string path = _directory + "/" + std::to_string(idx) + ".conf";
+                if (idx == 0)
+                {
+                    std::ofstream file(path.c_str(), std::ios::out | std::ios::binary);
+                    file << text;
+                    if (!file.flush())
+                        throw std::runtime_error("Could not write \"" + path + "\"");
+                }
+                else if (::link(_paths.front().c_str(), path.c_str()) != 0)
+                {
+                    throw std::runtime_error("Could not link \"" + path + "\"");
+                }
+                _paths.push_back(path);
+            }
+        }
+        catch (...)
+        {
+            remove();
+            throw;
+        }
+    }
+
+    ~file_batch() noexcept
+    {
+        remove();
+    }
+
+    file_batch(const file_batch&) = delete;
+    file_batch& operator=(const file_batch&) = delete;
+
+    const std::vector<std::string>& paths() const { return _paths; }
+
+private:
+    void remove() noexcept
+    {
+        for (const std::string& path : _paths)
+            ::unlink(path.c_str());
+        ::rmdir(_directory.c_str());
+    }
+
+private:
+    std::string              _directory;
+    std::vector<std::string> _paths;
+};
+
+/** The thread counts to time \c parse_many with: powers of two up to \a max_threads, then \a max_threads itself. **/
+std::vector<std::size_t> thread_counts(std::size_t max_threads)
+{
+    std::vector<std::size_t> out;
+    for (std::size_t threads = 1; threads < max_threads; threads *= 2)
+        out.push_back(threads);
+    out.push_back(max_threads);
+    return out;
+}
+
+std::size_t count_nodes(const ast_entry& root)
+{
+    std::size_t count = 0;
+    std::vector<const ast_entry*> pending = { &root };
+    while (!pending.empty())
+    {
+        const ast_entry* entry = pending.back();
+        pending.pop_back();
+        ++count;
+        if (entry->kind() == ast_entry_kind::complex || entry->kind() == ast_entry_kind::document)
+            for (const ast_entry& child : entry->children())
+                pending.push_back(&child);
+    }
+    return count;
+}
+
+/** Visit every entry and touch every string, which is what most queries over a whole document end up doing. **/
+std::size_t traverse(const ast_entry& root)
+{
+    std::size_t bytes = 0;
+    std::vector<const ast_entry*> pending = { &root };
+    while (!pending.empty())
+    {
+        const ast_entry* entry = pending.back();
+        pending.pop_back();
+        switch (entry->kind())
+        {
+        case ast_entry_kind::complex:
+        case ast_entry_kind::simple:
+            bytes += entry->name().size();
+            for (const std::string& attribute : entry->attributes())
+                bytes += attribute.size();
+            if (entry->kind() == ast_entry_kind::simple)
+                break;
+            // fall through
+        case ast_entry_kind::document:
+            for (const ast_entry& child : entry->children())
+                pending.push_back(&child);
+            break;
+        default:
+            bytes += entry->comment().size();
+            break;
+        }
+    }
+    return bytes;
+}
+
+case_result run_case(config_shape shape, std::size_t target_bytes, const options& opts)
+{
+    case_result out;
+    out.shape        = shape;
+    out.target_bytes = target_bytes;
+
+    std::string text = generate_config(shape, target_bytes, opts.seed);
+    out.bytes = text.size();
+    out.lines = std::size_t(std::count(text.begin(), text.end(), '\n'));
+
+    ast_entry document = ast_entry::make_document();
+    out.measurements.push_back(measure("parse", opts.min_seconds, [&]
+    {
+        view_buffer   buffer(text);
+        std::istream  input(&buffer);
+        document = parse(input);
+    }));
+    out.nodes = count_nodes(document);
+
+    // only the outermost entries, which is what a query touching a few blocks pays for before it starts
+    out.measurements.push_back(measure("parse_lazy", opts.min_seconds, [&]
+    {
+        view_buffer   buffer(text);
+        std::istream  input(&buffer);
+        parse_options lazy;
+        lazy.lazy_blocks = true;
+        ast_entry lazy_document = parse(input, lazy);
+    }));
+
+    out.measurements.push_back(measure("encode", opts.min_seconds, [&]
+    {
+        counting_buffer buffer;
+        std::ostream    output(&buffer);
+        encode(document, output);
+        output.flush();
+        if (buffer.count() == 0)
+            throw std::logic_error("Encoding wrote nothing");
+    }));
+
+    out.measurements.push_back(measure("crossplane_encode", opts.min_seconds, [&]
+    {
+        counting_buffer buffer;
+        std::ostream    output(&buffer);
+        encode_crossplane(document, output);
+        if (buffer.count() == 0)
+            throw std::logic_error("Encoding wrote nothing");
+    }));
+
+    std::ostringstream json;
+    encode_crossplane(document, json);
+    std::string json_text = json.str();
+    out.measurements.push_back(measure("crossplane_decode", opts.min_seconds, [&]
+    {
+        view_buffer  buffer(json_text);
+        std::istream input(&buffer);
+        ast_entry decoded = decode_crossplane(input);
+    }));
+
+    ast_entry copy = ast_entry::make_document();
+    out.measurements.push_back(measure("copy", opts.min_seconds, [&] { copy = document; }));
+
+    out.measurements.push_back(measure("equal", opts.min_seconds, [&]
+    {
+        if (!(copy == document))
+            throw std::logic_error("Copy does not compare equal");
+    }));
+
+    volatile std::size_t sink = 0;
+    out.measurements.push_back(measure("traverse", opts.min_seconds, [&] { sink = traverse(document); }));
+    out.measurements.push_back(measure("fingerprint", opts.min_seconds, [&]
+    {
+        sink = std::size_t(fingerprint(document).low);
+    }));
+    (void) sink;
+
+    // enough files that every thread count splits them evenly and the largest still has a few files per thread
+    file_batch batch(text, 4 * opts.max_threads);
+    for (std::size_t threads : thread_counts(opts.max_threads))
+    {
+        out.measurements.push_back(measure("parse_many_" + std::to_string(threads), opts.min_seconds, [&]
+        {
+            std::vector<parse_result> results = parse_many(batch.paths(), parse_options(), threads);
+            for (const parse_result& result : results)
+                if (!result.ok())
+                    std::rethrow_exception(result.error());
+        }));
+        out.measurements.back().bytes = text.size() * batch.paths().size();
+    }
+
+    out.peak_rss_bytes = peak_rss_bytes();
+    return out;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Output                                                                                                             //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void write_json(std::ostream& os, const options& opts, const std::vector<case_result>& results)
+{
+    os << "{\n";
+    os << "  \"seed\": " << opts.seed << ",\n";
+    os << "  \"min_seconds\": " << opts.min_seconds << ",\n";
+    os << "  \"results\": [";
+    for (std::size_t idx = 0; idx < results.size(); ++idx)
+    {
+        const case_result& result = results[idx];
+        os << (idx == 0 ? "\n" : ",\n");
+        os << "    {\n";
+        os << "      \"shape\": \"" << to_string(result.shape) << "\",\n";
+        os << "      \"target_bytes\": " << result.target_bytes << ",\n";
+        os << "      \"bytes\": " << result.bytes << ",\n";
+        os << "      \"lines\": " << result.lines << ",\n";
+        os << "      \"nodes\": " << result.nodes << ",\n";
+        os << "      \"peak_rss_bytes\": " << result.peak_rss_bytes << ",\n";
+        os << "      \"operations\": {";
+        for (std::size_t op = 0; op < result.measurements.size(); ++op)
+        {
+            const measurement& m = result.measurements[op];
+            std::size_t bytes = m.bytes == 0 ? result.bytes : m.bytes;
+            double mib_per_second = m.best_ns == 0 ? 0.0 : (double(bytes) / (1 << 20)) / (m.best_ns / 1e9);
+            os << (op == 0 ? "\n" : ",\n");
+            os << "        \"" << m.name << "\": { "
+               << "\"iterations\": "      << m.iterations      << ", "
+               << "\"best_ns\": "         << m.best_ns         << ", "
+               << "\"mean_ns\": "         << m.mean_ns         << ", "
+               << "\"mib_per_second\": "  << mib_per_second    << ", "
+               << "\"allocations\": "     << m.allocations     << ", "
+               << "\"allocated_bytes\": " << m.allocated_bytes << " }";
+        }
+        os << "\n      }\n";
+        os << "    }";
+    }
+    os << "\n  ]\n";
+    os << "}\n";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Arguments                                                                                                          //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::vector<std::string> split(const std::string& list)
+{
+    std::vector<std::string> out;
+    std::string::size_type start = 0;
+    while (start <= list.size())
+    {
+        std::string::size_type end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.size();
+        if (end > start)
+            out.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+    return out;
+}
+
+/** Parse a size like \c "512", \c "64K", \c "16M" or \c "1G" (powers of 1024). **/
+std::size_t parse_size(const std::string& text)
+{
+    std::size_t used = 0;
+    unsigned long long value = std::stoull(text, &used);
+    std::string suffix = text.substr(used);
+    if (suffix == "K" || suffix == "k")
+        value <<= 10;
+    else if (suffix == "M" || suffix == "m")
+        value <<= 20;
+    else if (suffix == "G" || suffix == "g")
+        value <<= 30;
+    else if (!suffix.empty())
+        throw std::invalid_argument("Invalid size \"" + text + "\"");
+    return std::size_t(value);
+}
+
+options parse_arguments(int argc, char** argv)
+{
+    options out;
+    for (int idx = 1; idx < argc; ++idx)
+    {
+        std::string arg = argv[idx];
+        std::string::size_type eq = arg.find('=');
+        std::string key   = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? std::string() : arg.substr(eq + 1);
+        if (key == "--sizes")
+        {
+            out.sizes.clear();
+            for (const std::string& size : split(value))
+                out.sizes.push_back(parse_size(size));
+        }
+        else if (key == "--shapes")
+        {
+            out.shapes.clear();
+            for (const std::string& shape : split(value))
+                out.shapes.push_back(shape_from_string(shape));
+        }
+        else if (key == "--seed")
+            out.seed = std::stoull(value);
+        else if (key == "--min-time")
+            out.min_seconds = std::stod(value);
+        else if (key == "--threads")
+            out.max_threads = std::max<std::size_t>(1, std::stoull(value));
+        else if (key == "--output")
+            out.output = value;
+        else
+            throw std::invalid_argument("Unknown argument \"" + arg + "\" (expected --sizes=, --shapes=, --seed=, "
+                                        "--min-time=, --threads= or --output=)"
+                                       );
+    }
+    // The RSS high-water mark only goes up, so it is only meaningful per case when sizes grow
+    std::sort(out.sizes.begin(), out.sizes.end());
+    return out;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    using namespace nginxconfig_bench;
+
+    try
+    {
+        options opts = parse_arguments(argc, argv);
+
+        std::vector<case_result> results;
+        for (std::size_t size : opts.sizes)
+        {
+            for (config_shape shape : opts.shapes)
+            {
+                std::cerr << "BENCH: " << to_string(shape) << " " << size << " bytes ...";
+                results.push_back(run_case(shape, size, opts));
+                const measurement& parse = results.back().measurements.front();
+                std::cerr << " parse " << (parse.best_ns / 1000) << " us" << std::endl;
+            }
+        }
+
+        if (opts.output.empty())
+        {
+            write_json(std::cout, opts, results);
+        }
+        else
+        {
+            std::ofstream file(opts.output.c_str());
+            write_json(file, opts, results);
+            if (!file)
+                throw std::runtime_error("Could not write \"" + opts.output + "\"");
+        }
+        return 0;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "nginxconfig-bench: " << ex.what() << std::endl;
+        return 1;
+    }
+}
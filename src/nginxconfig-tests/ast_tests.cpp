@@ -10,6 +10,9 @@
 **/
 #include <nginxconfig/all.hpp>
 
+#include <string>
+#include <vector>
+
 #include "test.hpp"
 
 using namespace nginxconfig;
@@ -30,3 +33,107 @@ TEST(ast_equality)
     ensure_ne(x, y);
     ensure_eq(y.children().at(0), x);
 }
+
+TEST(ast_find_children)
+{
+    ast_entry x = ast_entry::make_complex("server", {},
+                                          {
+                                              ast_entry::make_simple("listen", { "80" }),
+                                              ast_entry::make_comment("listen on a second port"),
+                                              ast_entry::make_simple("listen", { "8080" }),
+                                              ast_entry::make_complex("location", { "/" }, {}),
+                                          }
+                                         );
+    const ast_entry& cx = x;
+    ensure_eq(cx.count("listen"), 2U);
+    ensure_eq(cx.find("listen")->attributes().at(0), "80");
+    ensure_eq(cx.find_all("listen").at(1)->attributes().at(0), "8080");
+    ensure_eq(cx.find("location"), &cx.children().at(3));
+    ensure(cx.find("root") == nullptr);
+    ensure(cx.find_all("root").empty());
+    ensure_throws(kind_error, cx.find_all("listen").at(0)->find("x"));
+    
+    // mutable access to the children discards the index
+    x.children().emplace_front(ast_entry::make_simple("root", { "/srv" }));
+    ensure_eq(cx.count("root"), 1U);
+    ensure_eq(cx.find("listen"), &cx.children().at(1));
+    
+    // copies get their own index
+    ast_entry y = x;
+    ensure_eq(y.find("location"), &y.children().at(4));
+    ensure_eq(x, y);
+}
+
+TEST(ast_find_after_changes_through_kept_reference)
+{
+    ast_entry x = ast_entry::make_complex("server", {},
+                                          {
+                                              ast_entry::make_simple("listen", { "80" }),
+                                              ast_entry::make_simple("root", { "/srv" }),
+                                              ast_entry::make_simple("index", { "index.html" }),
+                                          }
+                                         );
+    ast_entry::child_list& children = x.children();
+    const ast_entry&       cx       = x;
+    ensure(cx.find("index") == &children.at(2));
+    
+    // the index was built after the reference was taken, so it is stale after each of these
+    children.pop_front();
+    ensure_eq(cx.find("index"), &children.at(1));
+    ensure(cx.find("listen") == nullptr);
+    
+    children.front().name() = "alias";
+    ensure(cx.find("root") == nullptr);
+    ensure_eq(cx.find("alias"), &children.at(0));
+    
+    children.clear();
+    ensure(cx.find("index") == nullptr);
+    ensure_eq(cx.count("alias"), 0U);
+    ensure(cx.find_all("alias").empty());
+    
+    // renaming a child to the name being looked up, which the index had no positions for
+    children.emplace_back(ast_entry::make_simple("b"));
+    children.emplace_back(ast_entry::make_simple("c"));
+    ensure(cx.find("a") == nullptr);
+    children[0].name() = "a";
+    ensure_eq(cx.find("a"), &children.at(0));
+}
+
+TEST(ast_find_rebuilds_keep_memory_bounded)
+{
+    ast_entry x = ast_entry::make_complex("http");
+    ast_entry::child_list& children = x.children();
+    const ast_entry&       cx       = x;
+    for (std::size_t idx = 0; idx < 2000; ++idx)
+    {
+        children.emplace_back(ast_entry::make_simple("listen", { std::to_string(idx) }));
+        ensure_eq(cx.count("listen"), idx + 1);
+    }
+    
+    // only the current index and the one it replaced are kept, so this is about two indexes of 2000 positions
+    ensure_le(memory_usage(x).index_bytes, 4 * 2000 * sizeof(std::size_t) + 4096);
+}
+
+TEST(ast_find_is_indexed)
+{
+    const std::size_t count = 20000;
+    std::vector<std::string> names;
+    ast_entry x = ast_entry::make_complex("http");
+    for (std::size_t idx = 0; idx < count; ++idx)
+    {
+        names.push_back("directive_" + std::to_string(idx));
+        x.children().emplace_back(ast_entry::make_simple(names.back(), { std::to_string(idx) }));
+    }
+    const ast_entry& cx = x;
+    ensure(cx.find(names.front()) != nullptr);
+    
+    // with the index built, lookups are a hash away: no allocations and nowhere near quadratic time
+    std::size_t found = 0;
+    ensure_time_le(1000,
+                   ensure_allocs_le(0,
+                                    for (const std::string& name : names)
+                                        found += cx.find(name) ? 1 : 0
+                                   )
+                  );
+    ensure_eq(found, count);
+}
@@ -0,0 +1,126 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include <climits>
+#include <sstream>
+#include <streambuf>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+
+namespace
+{
+
+/** Counts what is written to it and throws it away. **/
+class discard_buffer :
+        public std::streambuf
+{
+public:
+    std::size_t count = 0;
+
+protected:
+    virtual int_type overflow(int_type c) override
+    {
+        ++count;
+        return traits_type::not_eof(c);
+    }
+
+    virtual std::streamsize xsputn(const char*, std::streamsize length) override
+    {
+        count += std::size_t(length);
+        return length;
+    }
+};
+
+}
+
+TEST(config_builder_matches_encode)
+{
+    std::ostringstream built;
+    {
+        config_builder out(built, "    ", 16);
+        std::string host = "a.example.com";
+        out.comment(" generated")
+           .directive("worker_processes", 4)
+           .blank_line()
+           .block("http")
+               .block("server")
+                   .directive("listen", 443, "ssl")
+                   .directive("server_name", host, "www." + host)
+                   .directive("sendfile", true)
+                   .block("location", "/")
+                       .directive("proxy_pass", std::string("http://backend_") + '7')
+                   .end()
+               .end()
+           .end();
+        out.finish();
+    }
+
+    std::istringstream source(built.str());
+    ast_entry parsed = parse(source);
+    ensure_eq(parsed.children().at(3).children().at(0).children().at(2).attributes().at(0), "on");
+
+    std::ostringstream encoded;
+    encode(parsed, encoded, "    ");
+    ensure_eq(built.str(), encoded.str());
+}
+
+TEST(config_builder_integers)
+{
+    std::ostringstream built;
+    config_builder out(built);
+    out.directive("values", 0, -1, 25U, LLONG_MIN, ULLONG_MAX, false, 'x');
+    out.comment(" line ", 12);
+    out.finish();
+    ensure_eq(built.str(),
+              "values 0 -1 25 -9223372036854775808 18446744073709551615 off x ;\n"
+              "# line 12\n"
+             );
+}
+
+TEST(config_builder_balance)
+{
+    std::ostringstream built;
+    config_builder out(built);
+    ensure_throws(std::logic_error, out.end());
+    out.block("events");
+    ensure_eq(out.depth(), 1U);
+    ensure_throws(std::logic_error, out.finish());
+    out.end();
+    out.finish();
+    ensure_eq(built.str(), "events {\n}\n");
+}
+
+TEST(config_builder_no_allocations)
+{
+    discard_buffer buffer;
+    std::ostream   output(&buffer);
+    std::string    host = "a.example.com";
+    std::string    long_path(200, 'x');
+    config_builder out(output, "    ", 128);
+    ensure_allocs_le(0,
+        for (int server = 0; server < 1000; ++server)
+        {
+            out.block("server")
+                   .directive("listen", 80)
+                   .directive("server_name", host, "server", server)
+                   .directive("root", long_path)
+                   .block("location", "/")
+                       .directive("proxy_pass", "http://backend")
+                   .end()
+               .end();
+        }
+        out.finish();
+    );
+    ensure_gt(buffer.count, 1000U * 200U);
+}
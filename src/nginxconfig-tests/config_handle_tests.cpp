@@ -0,0 +1,95 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+
+static config_handle::document_ptr make_generation(int value)
+{
+    return std::make_shared<const ast_entry>(
+               ast_entry::make_document({ ast_entry::make_simple("generation", { std::to_string(value) }) })
+           );
+}
+
+TEST(config_handle_snapshots)
+{
+    config_handle handle(make_generation(1));
+    ensure_eq(handle.generation(), 1U);
+    
+    std::weak_ptr<const ast_entry> first = handle.load();
+    config_handle::reader reader(handle);
+    {
+        config_handle::snapshot snap = reader.pin();
+        ensure_eq(snap->children().at(0).attributes().at(0), "1");
+        
+        ensure_eq(handle.publish(make_generation(2)), 2U);
+        // the pinned generation stays alive and unchanged
+        ensure_eq(snap.generation(), 1U);
+        ensure_eq(snap->children().at(0).attributes().at(0), "1");
+        ensure_eq(handle.reclaim(), 1U);
+        ensure(!first.expired());
+        
+        // a nested pin sees the latest generation
+        config_handle::snapshot inner = reader.pin();
+        ensure_eq(inner.generation(), 2U);
+    }
+    ensure_eq(handle.reclaim(), 0U);
+    ensure(first.expired());
+    
+    // shared references outlive the snapshot
+    config_handle::document_ptr kept = reader.pin().share();
+    handle.publish(make_generation(3));
+    ensure_eq(handle.reclaim(), 0U);
+    ensure_eq(kept->children().at(0).attributes().at(0), "2");
+    ensure_throws(std::invalid_argument, handle.publish(nullptr));
+}
+
+TEST(config_handle_concurrent_readers)
+{
+    config_handle handle(make_generation(0));
+    std::atomic<bool> done(false);
+    std::atomic<int>  inconsistent(0);
+    
+    std::vector<std::thread> readers;
+    for (int thread_no = 0; thread_no < 4; ++thread_no)
+    {
+        readers.emplace_back([&]
+                             {
+                                 config_handle::reader reader(handle);
+                                 config_handle::epoch_type last = 0;
+                                 while (!done.load())
+                                 {
+                                     config_handle::snapshot snap = reader.pin();
+                                     auto value = std::stoull(snap->children().at(0).attributes().at(0));
+                                     if (value + 1 != snap.generation() || snap.generation() < last)
+                                         ++inconsistent;
+                                     last = snap.generation();
+                                 }
+                             }
+                            );
+    }
+    
+    for (int value = 1; value <= 2000; ++value)
+        handle.publish(make_generation(value));
+    done = true;
+    for (std::thread& t : readers)
+        t.join();
+    
+    ensure_eq(inconsistent.load(), 0);
+    ensure_eq(handle.generation(), 2001U);
+    ensure_eq(handle.reclaim(), 0U);
+}
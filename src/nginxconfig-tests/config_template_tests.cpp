@@ -0,0 +1,122 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include <sstream>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+using nginxconfig_test::parse_string;
+
+static const char server_pattern[] =
+    "server {\n"
+    "    listen 80;\n"
+    "    server_name @host@ www.@host@;\n"
+    "    root /srv/@host@;\n"
+    "    location / {\n"
+    "        proxy_pass http://@upstream@;\n"
+    "        try_files $uri @fallback;\n"
+    "    }\n"
+    "    location /static {\n"
+    "        expires 30d;\n"
+    "    }\n"
+    "}\n";
+
+static config_template server_template()
+{
+    return config_template(parse_string(server_pattern).children().at(0));
+}
+
+TEST(config_template_parameters)
+{
+    config_template tmpl = server_template();
+    ensure_eq(tmpl.parameters().size(), 2U);
+    ensure_eq(tmpl.parameters().at(0), "host");
+    ensure_eq(tmpl.parameters().at(1), "upstream");
+    ensure_eq(tmpl.parameter_index("upstream"), 1U);
+    ensure_throws(std::out_of_range, tmpl.parameter_index("fallback"));
+    
+    ensure_throws(kind_error, config_template(ast_entry::make_simple("listen", { "@port@" })));
+    parameter_table wrong(1);
+    wrong.add_row({ "a.example.com" });
+    ensure_throws(std::invalid_argument, tmpl.instantiate(wrong));
+    ensure_throws(std::invalid_argument, wrong.add_row({ "a", "b" }));
+}
+
+TEST(config_template_instantiate)
+{
+    config_template tmpl = server_template();
+    parameter_table values(2);
+    values.add_row({ "a.example.com", "backend_a" });
+    values.add_row({ "b.example.com", "backend_b" });
+    
+    ast_entry second = tmpl.instantiate(values, 1);
+    ensure_eq(second.attributes().size(), 0U);
+    ensure_eq(second.children().at(1).attributes().at(1), "www.b.example.com");
+    
+    // the location without placeholders shares the children of the pattern until they are looked at
+    const ast_entry& static_location = second.children().at(4);
+    ensure(!static_location.children_loaded());
+    
+    ast_entry expected = parse_string(
+        "server {\n"
+        "    listen 80;\n"
+        "    server_name b.example.com www.b.example.com;\n"
+        "    root /srv/b.example.com;\n"
+        "    location / {\n"
+        "        proxy_pass http://backend_b;\n"
+        "        try_files $uri @fallback;\n"
+        "    }\n"
+        "    location /static {\n"
+        "        expires 30d;\n"
+        "    }\n"
+        "}\n"
+    );
+    ensure_eq(second, expected.children().at(0));
+    ensure(static_location.children_loaded());
+    ensure_throws(std::out_of_range, tmpl.instantiate(values, 2));
+    
+    ast_entry all = tmpl.instantiate(values);
+    ensure_eq(all.children().size(), 2U);
+    ensure_eq(all.children().at(1), second);
+    ensure_eq(all.children().at(0).children().at(2).attributes().at(0), "/srv/a.example.com");
+}
+
+TEST(config_template_encode_matches_instantiate)
+{
+    config_template tmpl = server_template();
+    parameter_table values(2);
+    for (int idx = 0; idx < 200; ++idx)
+        values.add_row({ "host" + std::to_string(idx) + ".example.com", "backend_" + std::to_string(idx % 7) });
+    
+    std::ostringstream expected;
+    encode(tmpl.instantiate(values), expected);
+    
+    std::string reserved(expected.str().size() + 1, '\0');
+    std::ostringstream streamed(reserved);
+    ostream_encoder encoder(streamed);
+    // only the first copy of the pattern allocates; every row after that reuses it
+    ensure_allocs_le(150, tmpl.encode(values, encoder));
+    ensure_eq(streamed.str().substr(0, expected.str().size()), expected.str());
+    
+    // a document pattern writes all of its entries per row
+    config_template upstreams(parse_string("upstream @name@ {\n    server @address@;\n}\n# @name@ done\n"));
+    parameter_table addresses(2);
+    addresses.add_row({ "a", "10.0.0.1" });
+    addresses.add_row({ "b", "10.0.0.2" });
+    std::ostringstream doc_expected;
+    encode(upstreams.instantiate(addresses), doc_expected);
+    std::ostringstream doc_streamed;
+    upstreams.encode(addresses, doc_streamed);
+    ensure_eq(doc_streamed.str(), doc_expected.str());
+    ensure_eq(upstreams.instantiate(addresses).children().size(), 4U);
+}
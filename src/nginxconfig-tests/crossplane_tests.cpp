@@ -0,0 +1,188 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include <sstream>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+using nginxconfig_test::parse_string;
+
+static std::string encode_json(const ast_entry& ast)
+{
+    std::ostringstream out;
+    encode_crossplane(ast, out);
+    return out.str();
+}
+
+static ast_entry decode_json(const std::string& json)
+{
+    std::istringstream stream(json);
+    return decode_crossplane(stream);
+}
+
+static const char round_trip_config[] = R"(# main configuration
+user www-data;
+worker_processes 4; # one per core
+
+events { worker_connections 1024; }
+
+http { # the web server
+    log_format main '$remote_addr - "$request"' "tab\there" escaped\\ "";
+    server {
+        listen 80; server_name example.com "www.example.com";
+        location ~ ^/(a|b)\d+$ {
+            if ($http_user_agent ~* "bad bot") { return 403; }
+            if ($request_method = POST) { return 405; }
+            return 200 "x;y {z}";
+        }
+    }
+}
+)";
+
+TEST(crossplane_round_trip)
+{
+    ast_entry original = parse_string(round_trip_config);
+    ast_entry decoded  = decode_json(encode_json(original));
+
+    canonical_options with_comments;
+    with_comments.ignore_comments = false;
+    ensure(fingerprint(decoded, with_comments) == fingerprint(original, with_comments));
+    ensure(canonicalize(decoded, with_comments) == canonicalize(original, with_comments));
+
+    // the line numbers come along, too
+    const ast_entry& http = decoded.children().at(4);
+    ensure_eq(http.name(), "http");
+    ensure_eq(http.source().line, 7U);
+    ensure_eq(http.comment(), " the web server");
+    ensure_eq(decoded.children().at(2).comment(), " one per core");
+
+    // and the text of the decoded configuration parses back to it
+    std::ostringstream text;
+    encode(decoded, text);
+    ensure(canonicalize(parse_string(text.str()), with_comments) == canonicalize(decoded, with_comments));
+}
+
+TEST(crossplane_round_trip_if_spacing)
+{
+    ast_entry original = parse_string("if ( $request_method = POST ) { return 405; }\n"
+                                      "if ( $http_user_agent ~* \"bad bot\" ) { return 403; }\n"
+                                     );
+    ast_entry decoded  = decode_json(encode_json(original));
+    ensure(fingerprint(decoded) == fingerprint(original));
+    ensure(canonicalize(decoded) == canonicalize(original));
+}
+
+TEST(crossplane_format)
+{
+    ast_entry doc = parse_string("listen 80; # plain\nserver { # main\n    if ($a = \"b c\") { return 404; }\n}\n");
+    ensure_eq(encode_json(doc),
+              "{\"status\":\"ok\",\"errors\":[],\"config\":[{\"file\":\"nginx.conf\",\"status\":\"ok\",\"errors\":[],"
+              "\"parsed\":["
+              "{\"directive\":\"listen\",\"line\":1,\"args\":[\"80\"]},"
+              "{\"directive\":\"#\",\"line\":1,\"args\":[],\"comment\":\" plain\"},"
+              "{\"directive\":\"server\",\"line\":2,\"args\":[],\"block\":["
+              "{\"directive\":\"#\",\"line\":2,\"args\":[],\"comment\":\" main\"},"
+              "{\"directive\":\"if\",\"line\":3,\"args\":[\"$a\",\"=\",\"b c\"],\"block\":["
+              "{\"directive\":\"return\",\"line\":3,\"args\":[\"404\"]}]}]}]}]}"
+             );
+
+    // anything other than a document is only its directive object
+    ensure_eq(encode_json(ast_entry::make_simple("root", { "/var/www" })),
+              "{\"directive\":\"root\",\"line\":0,\"args\":[\"/var/www\"]}"
+             );
+}
+
+TEST(crossplane_escaping)
+{
+    std::string long_value = std::string(40, 'a') + "\"" + std::string(17, 'b') + "\\" + "\x01\x1f" + "\xc3\xa9"
+                           + std::string(33, 'c') + "\n";
+    ast_entry doc = ast_entry::make_document();
+    doc.children().push_back(ast_entry::make_simple("add_header", { "X", quote_attribute(long_value) }));
+    doc.children().push_back(ast_entry::make_simple("set", { "$v", quote_attribute("tab\there \"quoted\"") }));
+
+    std::string json = encode_json(doc);
+    ensure(json.find(std::string(40, 'a') + "\\\"" + std::string(17, 'b') + "\\\\\\u0001\\u001f\xc3\xa9"
+                     + std::string(33, 'c') + "\\n\""
+                    ) != std::string::npos
+          );
+    ensure(json.find("\"tab\\there \\\"quoted\\\"\"") != std::string::npos);
+
+    ast_entry decoded = decode_json(json);
+    ensure_eq(attribute_value(decoded.children().at(0).attributes().at(1)), long_value);
+    ensure_eq(attribute_value(decoded.children().at(1).attributes().at(1)), "tab\there \"quoted\"");
+}
+
+TEST(crossplane_decode_from_crossplane)
+{
+    // as crossplane prints it, with members in another order and some this does not use
+    ast_entry doc = decode_json(R"({
+    "status": "ok", "errors": [],
+    "config": [{
+        "file": "/etc/nginx/nginx.conf", "status": "ok", "errors": [],
+        "parsed": [
+            {"line": 1, "directive": "events", "args": [], "block": []},
+            {"directive": "include", "line": 2, "args": ["mime.types"], "includes": [1]},
+            {"directive": "http", "line": 3, "args": [], "block": [
+                {"directive": "#", "line": 4, "args": [], "comment": " caf\u00e9 \ud83d\ude00"},
+                {"directive": "add_header", "line": 5, "args": ["X-Empty", ""], "extra": {"a": [true, null, -1.5e3]}}
+            ]}
+        ]
+    }]
+})");
+    ensure_eq(doc.children().size(), 3U);
+    ensure_eq(doc.children().at(0).kind(), ast_entry_kind::complex);
+    ensure_eq(doc.children().at(1).source().line, 2U);
+    const ast_entry& http = doc.children().at(2);
+    ensure_eq(http.children().at(0).comment(), " caf\xc3\xa9 \xf0\x9f\x98\x80");
+    ensure(http.children().at(1) == ast_entry::make_simple("add_header", { "X-Empty", "\"\"" }));
+
+    // just the list of directives works, too
+    ast_entry bare = decode_json(R"([{"directive":"listen","line":1,"args":["80"]}])");
+    ensure(bare == parse_string("listen 80;"));
+
+    std::istringstream two_files(R"({"config":[{"file":"a.conf","parsed":[]},{"file":"b.conf","parsed":[]}]})");
+    std::vector<crossplane_file> files = decode_crossplane_payload(two_files);
+    ensure_eq(files.size(), 2U);
+    ensure_eq(files[1].file, "b.conf");
+    ensure_throws(parse_error, decode_json(R"({"config":[{"file":"a.conf","parsed":[]},{"file":"b.conf"}]})"));
+}
+
+TEST(crossplane_decode_errors)
+{
+    ensure_throws(parse_error, decode_json(""));
+    ensure_throws(parse_error, decode_json("[{\"directive\":\"listen\",\"args\":[\"80\"]"));
+    ensure_throws(parse_error, decode_json("[{\"directive\":\"listen\",\"args\":[\"80\",]}]"));
+    ensure_throws(parse_error, decode_json("[{\"args\":[\"80\"]}]"));
+    ensure_throws(parse_error, decode_json("[{\"directive\":\"listen\",\"line\":\"1\"}]"));
+    ensure_throws(parse_error, decode_json("[{\"directive\":\"x\",\"args\":[\"\\ud800\"]}]"));
+    ensure_throws(parse_error, decode_json("[{\"directive\":\"x\",\"args\":[\"\\q\"]}]"));
+    ensure_throws(parse_error, decode_json("[] []"));
+
+    // nesting is limited, both for members which are skipped and for blocks
+    ensure_throws(parse_error, decode_json("{\"x\":" + std::string(1000000, '[')));
+    std::string deep;
+    for (int depth = 0; depth < 300; ++depth)
+        deep += "[{\"directive\":\"a\",\"args\":[],\"block\":";
+    ensure_throws(parse_error, decode_json(deep + "[]"));
+    
+    try
+    {
+        decode_json("[\n  {\"directive\": }\n]");
+        ensure(false);
+    }
+    catch (const parse_error& ex)
+    {
+        ensure_eq(ex.line(), 2U);
+        ensure_eq(ex.column(), 16U);
+    }
+}
@@ -0,0 +1,183 @@
+/** \file
+ *  
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include <sstream>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+
+static std::string encode_string(const ast_entry& entry)
+{
+    std::ostringstream stream;
+    encode(entry, stream);
+    return stream.str();
+}
+
+TEST(data_block_map_lookup)
+{
+    auto row = [] (std::string key, std::string value) { return ast_entry::make_simple("", { key, value }); };
+    ast_entry block = ast_entry::make_complex("map", { "$http_host", "$backend" },
+                                              {
+                                                  ast_entry::make_simple("hostnames"),
+                                                  ast_entry::make_simple("default", { "fallback" }),
+                                                  ast_entry::make_comment(" exact names"),
+                                                  row("example.com",   "a"),
+                                                  row("*.example.com", "b"),
+                                                  row(".example.net",  "c"),
+                                                  row("www.example.*", "d"),
+                                                  row("~^api\\d+$",    "e"),
+                                                  row("~*^CASE",       "f"),
+                                                  row("\\default",     "g"),
+                                                  row("\"\"",          "\"empty\""),
+                                              }
+                                             );
+    map_table table(block);
+    ensure(table.hostnames());
+    ensure_eq(table.variable(), "$backend");
+    ensure_eq(table.lookup("EXAMPLE.com"), "a");
+    ensure_eq(table.lookup("x.y.example.com"), "b");
+    ensure_eq(table.lookup("example.net"), "c");
+    ensure_eq(table.lookup("a.example.net"), "c");
+    ensure_eq(table.lookup("www.example.org"), "d");
+    ensure_eq(table.lookup("api7"), "e");
+    ensure_eq(table.lookup("case-insensitive"), "f");
+    ensure_eq(table.lookup("default"), "g");
+    ensure_eq(table.lookup(""), "empty");
+    ensure_eq(table.lookup("nothing"), "fallback");
+    ensure(table.to_entry() == block);
+}
+
+TEST(data_block_map_pcre_keys)
+{
+    auto row = [] (std::string key, std::string value) { return ast_entry::make_simple("", { key, value }); };
+    ast_entry block = ast_entry::make_complex("map", { "$uri", "$section" },
+                                              {
+                                                  row("~^/user/(?<name>[a-z]+)$", "user"),
+                                                  row("~^/item/(?P<id>\\d+)$",    "item"),
+                                                  row("~(?i)^/ADMIN",             "admin"),
+                                                  row("~^/[(?<]x$",               "class"),
+                                              }
+                                             );
+    map_table table(block);
+    ensure_eq(table.lookup("/user/bob"), "user");
+    ensure_eq(table.lookup("/item/42"), "item");
+    ensure_eq(table.lookup("/admin/panel"), "admin");
+    ensure_eq(table.lookup("/<x"), "class");
+    ensure_eq(table.lookup("/user/BOB1"), "");
+
+    ast_entry bad = ast_entry::make_complex("map", { "$uri", "$section" }, { row("~^(?<=/)x$", "behind") });
+    ensure_throws(std::invalid_argument, map_table { bad });
+}
+
+TEST(data_block_round_trip)
+{
+    std::istringstream stream(R"(
+http {
+    map $uri $section { # sections
+        default other;
+        ~^/api api;
+        # static files
+        /favicon.ico static;
+    }
+    geo $remote_addr $network {
+        default external;
+        10.0.0.0/8 internal;
+    }
+}
+)");
+    ast_entry doc = parse(stream);
+    auto blocks = find_data_blocks(doc);
+    ensure_eq(blocks.size(), 2U);
+    
+    map_table map(*blocks[0]);
+    ensure_eq(map.size(), 4U);
+    ensure_eq(map.lookup("/api/v1"), "api");
+    ensure_eq(map.lookup("/favicon.ico"), "static");
+    ensure_eq(encode_string(map.to_entry()), encode_string(*blocks[0]));
+    
+    geo_table geo(*blocks[1]);
+    ensure_eq(encode_string(geo.to_entry()), encode_string(*blocks[1]));
+}
+
+TEST(data_block_geo_networks)
+{
+    std::istringstream stream(R"(
+geo $network {
+    default external;
+    10.0.0.0/8 internal;
+    10.1.0.0/16 lab;
+    10.1.2.3 host;
+    delete 10.2.0.0/16;
+    2001:db8::/32 docs;
+}
+)");
+    geo_table geo(parse(stream).children().at(1));
+    ensure(!geo.ranges());
+    ensure_eq(geo.lookup("10.200.0.1"), "internal");
+    ensure_eq(geo.lookup("10.1.9.9"), "lab");
+    ensure_eq(geo.lookup("10.1.2.3"), "host");
+    ensure_eq(geo.lookup("10.2.0.1"), "internal");
+    ensure_eq(geo.lookup("192.168.0.1"), "external");
+    ensure_eq(geo.lookup("2001:db8::1"), "docs");
+    ensure_eq(geo.lookup("2001:db9::1"), "external");
+    ensure_throws(std::invalid_argument, geo.lookup("not-an-address"));
+}
+
+TEST(data_block_geo_ranges)
+{
+    std::istringstream stream(R"(
+geo $range {
+    ranges;
+    default none;
+    10.0.0.0-10.0.0.255 low;
+    10.0.0.100-10.0.1.50 mid;
+    10.0.0.120-10.0.0.130 inner;
+}
+)");
+    geo_table geo(parse(stream).children().at(1));
+    ensure(geo.ranges());
+    ensure_eq(geo.lookup("9.255.255.255"), "none");
+    ensure_eq(geo.lookup("10.0.0.0"), "low");
+    ensure_eq(geo.lookup("10.0.0.99"), "low");
+    ensure_eq(geo.lookup("10.0.0.100"), "mid");
+    ensure_eq(geo.lookup("10.0.0.125"), "inner");
+    ensure_eq(geo.lookup("10.0.0.131"), "mid");
+    ensure_eq(geo.lookup("10.0.1.50"), "mid");
+    ensure_eq(geo.lookup("10.0.1.51"), "none");
+}
+
+TEST(data_block_split_clients)
+{
+    std::istringstream stream(R"(
+split_clients "$remote_addr" $variant {
+    50% a;
+    25.5% b;
+    * c;
+}
+)");
+    split_clients_table split(parse(stream).children().at(1));
+    ensure_eq(split_clients_table::murmur_hash2("", 0), 0U);
+    
+    std::size_t counts[3] = { 0, 0, 0 };
+    for (int idx = 0; idx < 10000; ++idx)
+    {
+        std::string key = "10.0." + std::to_string(idx / 256) + "." + std::to_string(idx % 256) + "AAA";
+        std::string value = split.lookup(key);
+        std::uint32_t hash = split_clients_table::murmur_hash2(key.data(), key.size());
+        ensure_eq(value, hash < 0x7fffffffU ? "a" : hash < 0xc147ae13U ? "b" : "c");
+        ++counts[value[0] - 'a'];
+    }
+    ensure_gt(counts[0], 4500U);
+    ensure_gt(counts[1], 2000U);
+    ensure_gt(counts[2], 2000U);
+}
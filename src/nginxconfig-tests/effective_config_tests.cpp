@@ -0,0 +1,113 @@
+/** \file
+ *  
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include <sstream>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+
+static const char inheritance_file[] = R"(
+http {
+    proxy_read_timeout 30s;
+    proxy_set_header Host $host;
+    proxy_set_header X-Real-IP $remote_addr;
+    server {
+        listen 80;
+        proxy_read_timeout 60s;
+        location /a {
+            proxy_pass http://a;
+        }
+        location /b {
+            proxy_pass http://b;
+        }
+        location /c {
+            proxy_set_header X-Only-This 1;
+        }
+    }
+}
+)";
+
+TEST(effective_config_inheritance)
+{
+    std::istringstream stream(inheritance_file);
+    ast_entry doc = parse(stream);
+    const ast_entry& http   = doc.children().at(1);
+    const ast_entry& server = http.children().at(3);
+    const ast_entry& loc_a  = server.children().at(2);
+    const ast_entry& loc_b  = server.children().at(3);
+    const ast_entry& loc_c  = server.children().at(4);
+    
+    effective_config_resolver resolver(doc);
+    ensure_eq(resolver.find(http, "proxy_read_timeout")->attributes().at(0), "30s");
+    ensure_eq(resolver.find(loc_a, "proxy_read_timeout")->attributes().at(0), "60s");
+    ensure_eq(resolver.find_all(loc_b, "proxy_set_header").size(), 2U);
+    ensure_eq(resolver.find_all(loc_c, "proxy_set_header").size(), 1U);
+    ensure(resolver.find(server, "listen") != nullptr);
+    ensure(resolver.find(loc_a, "listen") == nullptr);
+    ensure_eq(resolver.find(loc_a, "proxy_pass")->attributes().at(0), "http://a");
+    ensure(resolver.find(loc_c, "proxy_pass") == nullptr);
+    ensure(resolver.parent(loc_a) == &server);
+    ensure(resolver.parent(doc) == nullptr);
+}
+
+TEST(effective_config_sharing_and_invalidation)
+{
+    std::istringstream stream(inheritance_file);
+    ast_entry doc = parse(stream);
+    ast_entry& http   = doc.children().at(1);
+    ast_entry& server = http.children().at(3);
+    server.children().push_back(ast_entry::make_complex("location", { "/d" }));
+    server.children().push_back(ast_entry::make_complex("location", { "/e" }));
+    const ast_entry& loc_d = server.children().at(5);
+    const ast_entry& loc_e = server.children().at(6);
+    
+    effective_config_resolver resolver(doc);
+    auto set_d = resolver.resolve(loc_d);
+    ensure(set_d == resolver.resolve(loc_e));
+    ensure(set_d->count("proxy_read_timeout"));
+    
+    auto http_set = resolver.resolve(http);
+    server.children().at(1).attributes().at(0) = "90s";
+    server.children().push_back(ast_entry::make_simple("proxy_connect_timeout", { "5s" }));
+    resolver.invalidate(server);
+    ensure_eq(resolver.find(loc_d, "proxy_read_timeout")->attributes().at(0), "90s");
+    ensure_eq(resolver.find(loc_e, "proxy_connect_timeout")->attributes().at(0), "5s");
+    ensure(http_set == resolver.resolve(http));
+}
+
+TEST(effective_config_layers_do_not_copy_inherited)
+{
+    // every block overrides one directive of its own, so copying what each one inherits would be quadratic
+    const std::size_t depth = 200;
+    ast_entry doc = ast_entry::make_document();
+    ast_entry* block = &doc;
+    for (std::size_t idx = 0; idx < depth; ++idx)
+    {
+        block->children().push_back(ast_entry::make_simple("d" + std::to_string(idx), { std::to_string(idx) }));
+        block->children().push_back(ast_entry::make_complex("location", { "/" + std::to_string(idx) }));
+        block = &block->children().back();
+    }
+    block->children().push_back(ast_entry::make_simple("d0", { "innermost" }));
+    
+    effective_config_resolver resolver(doc);
+    const ast_entry* found = nullptr;
+    ensure_allocs_le(10 * depth, found = resolver.find(*block, "d1"));
+    ensure_eq(found->attributes().at(0), "1");
+    ensure_eq(resolver.find(*block, "d0")->attributes().at(0), "innermost");
+    ensure_eq(resolver.find_all(*resolver.parent(*block), "d0").size(), 1U);
+    
+    auto flattened = resolver.resolve(*block);
+    ensure_eq(flattened->size(), depth);
+    ensure_eq(flattened->at("d0").at(0)->attributes().at(0), "innermost");
+    ensure(flattened == resolver.resolve(*block));
+}
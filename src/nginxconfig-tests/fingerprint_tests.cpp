@@ -0,0 +1,151 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include <cstring>
+#include <sstream>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+using nginxconfig_test::parse_string;
+
+static std::string encode_string(const ast_entry& ast)
+{
+    std::ostringstream out;
+    encode(ast, out);
+    return out.str();
+}
+
+static const char base_config[] = R"(
+http {
+    types {
+        text/html html;
+        image/png png;
+    }
+    server {
+        listen 80;
+        server_name example.com;
+        location ~ \.php$ {
+            fastcgi_param SCRIPT_FILENAME $document_root$fastcgi_script_name;
+        }
+    }
+}
+)";
+
+TEST(fingerprint_hasher_murmur3)
+{
+    // MurmurHash3_x64_128 with seed 0, which fingerprint_hasher must match bit for bit
+    const char text[] = "The quick brown fox jumps over the lazy dog";
+    fingerprint_hasher whole;
+    whole.update(text, std::strlen(text));
+    ensure_eq(whole.finish().to_string(), "7a433ca9c49a9347e34bbc7bbc071b6c");
+
+    fingerprint_hasher pieces;
+    for (std::size_t idx = 0; idx < std::strlen(text); idx += 5)
+        pieces.update(text + idx, std::min<std::size_t>(5, std::strlen(text) - idx));
+    ensure(pieces.finish() == whole.finish());
+
+    ensure_eq(fingerprint_hasher().finish().to_string(), "00000000000000000000000000000000");
+}
+
+TEST(fingerprint_ignores_formatting)
+{
+    ast_entry base = parse_string(base_config);
+    ast_entry reformatted = parse_string(R"(# generated
+http {
+  types { text/html html; image/png "png"; }
+
+  server {
+    listen '80';   # plain HTTP
+    server_name "example.com";
+    location ~ "\.php$" { fastcgi_param SCRIPT_FILENAME $document_root$fastcgi_script_name; }
+  }
+}
+)");
+    ensure(fingerprint(base) == fingerprint(reformatted));
+    ensure_eq(encode_string(canonicalize(base)), encode_string(canonicalize(reformatted)));
+
+    canonical_options with_comments;
+    with_comments.ignore_comments = false;
+    ensure(fingerprint(base, with_comments) != fingerprint(reformatted, with_comments));
+
+    ast_entry different = parse_string(R"(http { server { listen 8080; } })");
+    ensure(fingerprint(base) != fingerprint(different));
+
+    // the attribute values are what count: "a b" is one attribute, while a b is two
+    ensure(fingerprint(parse_string("add_header X \"a b\";")) != fingerprint(parse_string("add_header X a b;")));
+}
+
+TEST(fingerprint_if_condition_parentheses)
+{
+    ast_entry spaced = parse_string("if ( $x ) { return 404; }\nif ( $a = \"b c\" ) { return 403; }\n");
+    ast_entry tight  = parse_string("if ($x) { return 404; }\nif ($a = \"b c\") { return 403; }\n");
+    ensure(fingerprint(spaced) == fingerprint(tight));
+    ensure(canonicalize(spaced) == canonicalize(tight));
+    ensure_eq(encode_string(canonicalize(spaced)), encode_string(canonicalize(tight)));
+
+    // the canonical form keeps its fingerprint when it is written out and parsed again
+    ast_entry canonical = canonicalize(spaced);
+    ensure(fingerprint(canonical) == fingerprint(spaced));
+    ensure(canonicalize(parse_string(encode_string(canonical))) == canonical);
+
+    ensure(fingerprint(parse_string("if ($x) { return 404; }")) != fingerprint(parse_string("if ($y) { return 404; }")));
+}
+
+TEST(fingerprint_sort_unordered)
+{
+    ast_entry base = parse_string(base_config);
+    ast_entry swapped = parse_string(R"(
+http {
+    types {
+        image/png png;
+        text/html html;
+    }
+    server {
+        listen 80;
+        server_name example.com;
+        location ~ \.php$ {
+            fastcgi_param SCRIPT_FILENAME $document_root$fastcgi_script_name;
+        }
+    }
+}
+)");
+    ensure(fingerprint(base) != fingerprint(swapped));
+
+    canonical_options sorted;
+    sorted.sort_unordered = true;
+    ensure(fingerprint(base, sorted) == fingerprint(swapped, sorted));
+    ensure(canonicalize(base, sorted) == canonicalize(swapped, sorted));
+}
+
+TEST(fingerprint_of_canonical_form)
+{
+    ast_entry source = parse_string(R"(log_format main '$remote_addr - "$request"' escaped\\ 'tab\there' "";
+location ~ ^/(a|b)\d+$ { return 200 "x;y"; }
+)");
+    ast_entry canonical = canonicalize(source);
+    ensure(fingerprint(canonical) == fingerprint(source));
+
+    // encoding the canonical form and parsing it again does not change it
+    ensure(parse_string(encode_string(canonical)) == canonical);
+    ensure(canonicalize(canonical) == canonical);
+    ensure_eq(canonical.children().at(0).attributes().at(1), "\"$remote_addr - \\\"$request\\\"\"");
+    ensure_eq(canonical.children().at(0).attributes().at(4), "\"\"");
+    ensure_eq(attribute_value(source.children().at(0).attributes().at(2)), "escaped\\");
+    ensure_eq(attribute_value(source.children().at(0).attributes().at(3)), "tab\there");
+}
+
+TEST(fingerprint_is_stable)
+{
+    // if this changes, every stored fingerprint stops matching: see the format in fingerprint.cpp
+    ensure_eq(fingerprint(parse_string(base_config)).to_string(), "22b529caf5e4818b144428b66933c0a0");
+}
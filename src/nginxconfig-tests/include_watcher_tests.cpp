@@ -0,0 +1,107 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#if defined(__linux__)
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+
+TEST(include_watcher_reloads_changed_files)
+{
+    char dir_template[] = "/tmp/nginxconfig-watch-XXXXXX";
+    std::string dir = ::mkdtemp(dir_template);
+    std::string sites = dir + "/sites";
+    ::mkdir(sites.c_str(), 0700);
+    auto write = [] (const std::string& path, const std::string& contents)
+                 {
+                     std::ofstream(path.c_str()) << contents;
+                 };
+    
+    std::string root = dir + "/nginx.conf";
+    write(root, "worker_processes 1;\nhttp {\n  include sites/*.conf;\n}\n");
+    write(sites + "/a.conf", "server {\n  listen 80;\n}\n");
+    write(sites + "/b.conf", "server {\n  listen 81;\n}\n");
+    
+    parse_cache cache;
+    include_watcher watcher(root, cache);
+    include_tree::document_ptr root_doc = watcher.tree().document(root);
+    include_tree::document_ptr a_doc = watcher.tree().document(sites + "/a.conf");
+    ensure(watcher.wait(0).empty());
+    
+    write(sites + "/b.conf", "server {\n  listen 82;\n}\n");
+    include_watcher::path_list changed = watcher.wait(5000);
+    ensure_eq(changed.size(), 1U);
+    ensure_eq(changed.at(0), sites + "/b.conf");
+    ensure(watcher.tree().document(root) == root_doc);
+    ensure(watcher.tree().document(sites + "/a.conf") == a_doc);
+    ensure_eq(watcher.tree().document(sites + "/b.conf")->children().at(0).find("listen")->attributes().at(0), "82");
+    
+    // a new file matching an include pattern joins the tree
+    write(sites + "/c.conf", "server {\n  listen 83;\n}\n");
+    changed = watcher.wait(5000);
+    ensure_eq(changed.size(), 1U);
+    ensure_eq(changed.at(0), sites + "/c.conf");
+    ensure_eq(watcher.tree().documents().size(), 4U);
+    
+    // unrelated files are ignored
+    write(dir + "/notes.txt", "hello");
+    ensure(watcher.wait(100).empty());
+    
+    // a broken edit keeps the previous tree until it is fixed
+    write(sites + "/a.conf", "server {\n");
+    ensure_throws(parse_error, watcher.wait(5000));
+    ensure(watcher.tree().document(sites + "/a.conf") == a_doc);
+    write(sites + "/a.conf", "server {\n  listen 8080;\n}\n");
+    changed = watcher.wait(5000);
+    ensure_eq(changed.size(), 1U);
+    ensure_eq(changed.at(0), sites + "/a.conf");
+    
+    for (const char* name : { "/sites/a.conf", "/sites/b.conf", "/sites/c.conf", "/sites", "/notes.txt", "/nginx.conf" })
+        std::remove((dir + name).c_str());
+    ::rmdir(dir.c_str());
+}
+
+TEST(include_watcher_relative_root)
+{
+    char dir_template[] = "/tmp/nginxconfig-watch-XXXXXX";
+    std::string dir = ::mkdtemp(dir_template);
+    char previous[4096];
+    ensure(::getcwd(previous, sizeof previous) != nullptr);
+    ensure_eq(::chdir(dir.c_str()), 0);
+    
+    std::ofstream("nginx.conf") << "worker_processes 1;\n";
+    parse_cache cache;
+    include_watcher watcher("nginx.conf", cache);
+    ensure_eq(watcher.tree().root(), dir + "/nginx.conf");
+    ensure(watcher.tree().document("nginx.conf") == watcher.tree().document(dir + "/nginx.conf"));
+    
+    std::ofstream("nginx.conf") << "worker_processes 2;\n";
+    include_watcher::path_list changed = watcher.wait(5000);
+    ensure_eq(changed.size(), 1U);
+    ensure_eq(changed.at(0), dir + "/nginx.conf");
+    ensure_eq(watcher.tree().document("nginx.conf")->children().at(0).attributes().at(0), "2");
+    
+    ensure_eq(::chdir(previous), 0);
+    std::remove((dir + "/nginx.conf").c_str());
+    ::rmdir(dir.c_str());
+}
+
+#endif
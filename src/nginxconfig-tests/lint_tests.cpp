@@ -0,0 +1,180 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include <atomic>
+#include <stdexcept>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+using nginxconfig_test::parse_string;
+
+namespace
+{
+
+/** Reports every entry it is given, along with the context it is in. **/
+class echo_rule :
+        public lint_rule
+{
+public:
+    mutable std::atomic<unsigned> calls;
+
+    echo_rule(std::vector<std::string> directives, unsigned int contexts) :
+            lint_rule("echo", std::move(directives), contexts),
+            calls(0)
+    { }
+
+    virtual void check(lint_context& cxt) const override
+    {
+        ++calls;
+        cxt.report(cxt.entry().name() + " in " + std::to_string(cxt.context()) + " under " + cxt.parent().name());
+    }
+};
+
+class throwing_rule :
+        public lint_rule
+{
+public:
+    throwing_rule() :
+            lint_rule("throwing", { "root" })
+    { }
+
+    virtual void check(lint_context&) const override
+    {
+        throw std::runtime_error("rule failed");
+    }
+};
+
+bool same_diagnostics(const lint_diagnostic_list& a, const lint_diagnostic_list& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (std::size_t idx = 0; idx < a.size(); ++idx)
+    {
+        if (a[idx].entry != b[idx].entry || a[idx].rule != b[idx].rule || a[idx].message != b[idx].message)
+            return false;
+    }
+    return true;
+}
+
+}
+
+TEST(lint_dispatches_by_name_and_context)
+{
+    ast_entry doc = parse_string(R"(
+http {
+    listen_backlog 4;
+    server {
+        listen 80;
+        location / {
+            listen 81;
+        }
+    }
+}
+stream {
+    server {
+        listen 53 udp;
+    }
+}
+)");
+    auto rule = std::make_shared<echo_rule>(std::vector<std::string>{ "listen" }, context_http_server);
+    linter lint;
+    lint.add(rule);
+    lint_diagnostic_list out = lint.run(doc, 1);
+    ensure_eq(rule->calls.load(), 1U);
+    ensure_eq(out.size(), 1U);
+    ensure_eq(out.at(0).rule, "echo");
+    ensure_eq(out.at(0).message, "listen in " + std::to_string(context_http_server) + " under server");
+    ensure_eq(out.at(0).entry->attributes().at(0), "80");
+}
+
+TEST(lint_standard_rules)
+{
+    ast_entry doc = parse_string(R"(
+worker_processes 2;
+http {
+    proxy_set_header Host $host;
+    server {
+        root /srv/www;
+        root /srv/other;
+        location /static {
+            alias /srv/static/;
+        }
+        location ^~ /files/ {
+            alias /srv/files/;
+        }
+        location / {
+            proxy_pass http://backend;
+        }
+        location /api {
+            proxy_set_header X-Real-IP $remote_addr;
+            proxy_pass http://api;
+        }
+    }
+}
+)");
+    linter lint;
+    add_standard_lint_rules(lint);
+    ensure_eq(lint.size(), 3U);
+    lint_diagnostic_list out = lint.run(doc);
+    ensure_eq(out.size(), 3U);
+    ensure_eq(out.at(0).rule, "duplicate_directive");
+    ensure_eq(out.at(0).message, "\"root\" directive is duplicate");
+    ensure_eq(out.at(0).severity, lint_severity::error);
+    ensure_eq(out.at(1).rule, "alias_traversal");
+    ensure_eq(out.at(1).entry->attributes().at(0), "/srv/static/");
+    // inherited from http in "location /", but replaced by the headers of "location /api"
+    ensure_eq(out.at(2).rule, "proxy_host_header");
+    ensure_eq(out.at(2).entry->attributes().at(0), "http://api");
+    ensure_eq(out.at(2).severity, lint_severity::warning);
+}
+
+TEST(lint_parallel_is_deterministic)
+{
+    std::string source = "http {\n";
+    for (int server = 0; server < 400; ++server)
+    {
+        source += "    server {\n"
+                  "        server_name host" + std::to_string(server) + ";\n"
+                  "        root /srv/a;\n";
+        if (server % 3 == 0)
+            source += "        root /srv/b;\n";
+        source += "        location /x" + std::to_string(server) + " {\n"
+                  "            alias /srv/x/;\n"
+                  "            proxy_pass http://backend;\n"
+                  "        }\n"
+                  "    }\n";
+    }
+    source += "}\n";
+    ast_entry doc = parse_string(source);
+
+    linter lint;
+    add_standard_lint_rules(lint);
+    lint.add(std::make_shared<echo_rule>(std::vector<std::string>(), context_http_location));
+    lint_diagnostic_list expected = lint.run(doc, 1);
+    ensure_eq(expected.size(), 400U * 4U + 134U);
+
+    ensure(same_diagnostics(expected, lint.run(doc, 8)));
+    lint.split_depth(3);
+    ensure(same_diagnostics(expected, lint.run(doc, 8)));
+    lint.split_depth(0);
+    ensure(same_diagnostics(expected, lint.run(doc, 8)));
+}
+
+TEST(lint_rule_throws)
+{
+    ast_entry doc = parse_string("http {\n server { root /a; }\n server { root /b; }\n}\n");
+    linter lint;
+    lint.add(std::make_shared<throwing_rule>());
+    ensure_throws(std::runtime_error, lint.run(doc, 2));
+    ensure_throws(kind_error, lint.run(ast_entry::make_simple("root", { "/a" })));
+}
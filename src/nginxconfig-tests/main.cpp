@@ -1,5 +1,11 @@
 /** \file
  *  Entry point for the unit tests of nginxconfig.
+ *
+ *  Usage: <tt>nginxconfig-tests [--jobs=N] [--timings] [FILTER]</tt>
+ *
+ *   - \c FILTER only runs the tests with names containing it.
+ *   - \c --jobs=N runs the tests on \c N threads. Results are printed as tests finish, so their order varies.
+ *   - \c --timings prints a table of the wall time and allocations of each test, slowest first.
  *  
  *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
  *
@@ -11,19 +17,109 @@
 **/
 #include "test.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using nginxconfig_test::unit_test;
+
+static int run_sequential(const std::vector<unit_test*>& tests)
+{
+    int fail_count = 0;
+    for (unit_test* test : tests)
+    {
+        if (!test->run())
+            ++fail_count;
+    }
+    return fail_count;
+}
+
+static int run_parallel(const std::vector<unit_test*>& tests, unsigned jobs)
+{
+    std::atomic<std::size_t> next(0);
+    std::atomic<int>         fail_count(0);
+    std::mutex               output_protect;
+    
+    auto worker = [&]
+    {
+        for (std::size_t idx; (idx = next++) < tests.size(); )
+        {
+            unit_test* test = tests[idx];
+            if (!test->run_quietly())
+                ++fail_count;
+            std::lock_guard<std::mutex> lock(output_protect);
+            std::cout << test->result_line() << std::endl;
+        }
+    };
+    
+    std::vector<std::thread> threads;
+    for (unsigned idx = 0; idx < jobs; ++idx)
+        threads.emplace_back(worker);
+    for (std::thread& thread : threads)
+        thread.join();
+    return fail_count;
+}
+
+static void print_timings(std::vector<unit_test*> tests)
+{
+    std::stable_sort(tests.begin(), tests.end(),
+                     [] (const unit_test* a, const unit_test* b) { return a->elapsed() > b->elapsed(); }
+                    );
+    
+    std::size_t name_width = 4;
+    for (const unit_test* test : tests)
+        name_width = std::max(name_width, test->name().size());
+    
+    std::printf("\n%-*s %12s %12s %14s\n", int(name_width), "TEST", "TIME (ms)", "ALLOCS", "ALLOC BYTES");
+    for (const unit_test* test : tests)
+    {
+        double ms = std::chrono::duration<double, std::milli>(test->elapsed()).count();
+        std::printf("%-*s %12.3f %12llu %14llu\n",
+                    int(name_width),
+                    test->name().c_str(),
+                    ms,
+                    static_cast<unsigned long long>(test->allocations().count),
+                    static_cast<unsigned long long>(test->allocations().bytes)
+                   );
+    }
+    std::fflush(stdout);
+}
+
 int main(int argc, char** argv)
 {
     std::string filter;
-    if (argc == 2)
-        filter = argv[1];
-    int fail_count = 0;
+    unsigned    jobs    = 1;
+    bool        timings = false;
+    for (int idx = 1; idx < argc; ++idx)
+    {
+        std::string arg = argv[idx];
+        if (arg.compare(0, 7, "--jobs=") == 0)
+            jobs = unsigned(std::stoul(arg.substr(7)));
+        else if (arg == "--timings")
+            timings = true;
+        else
+            filter = arg;
+    }
+    if (jobs == 0)
+        jobs = std::max(1U, std::thread::hardware_concurrency());
+    
+    std::vector<unit_test*> tests;
     for (auto test : nginxconfig_test::get_unit_tests())
     {
         bool shouldrun = filter.empty()
                       || test->name().find(filter) != std::string::npos;
-        if (shouldrun && !test->run())
-            ++fail_count;
+        if (shouldrun)
+            tests.push_back(test);
     }
     
+    int fail_count = jobs == 1 ? run_sequential(tests) : run_parallel(tests, jobs);
+    if (timings)
+        print_timings(tests);
+    
     return fail_count;
 }
@@ -0,0 +1,91 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include <sstream>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+
+static const char memory_source[] =
+    "# a comment long enough to need its own allocation\n"
+    "worker_processes 1;\n"
+    "http {\n"
+    "    server {\n"
+    "        listen 80;\n"
+    "        server_name a_server_name_longer_than_fits_inline.example.com;\n"
+    "    }\n"
+    "}\n";
+
+TEST(memory_usage_counts_nodes_and_strings)
+{
+    std::istringstream input(memory_source);
+    ast_entry doc = parse(input);
+    memory_breakdown usage = memory_usage(doc);
+    
+    ensure_eq(usage.document_nodes, 1U);
+    ensure_eq(usage.complex_nodes, 2U);
+    ensure_eq(usage.simple_nodes, 3U);
+    ensure_eq(usage.comment_nodes, 1U);
+    ensure_eq(usage.nodes(), 7U);
+    ensure_eq(usage.deferred_nodes, 0U);
+    // the comment, the server name and "worker_processes" (which is just past what fits inline)
+    ensure_eq(usage.heap_strings, 3U);
+    ensure_gt(usage.inline_strings, 0U);
+    ensure_gt(usage.container_overhead_bytes, 0U);
+    ensure_lt(usage.container_overhead_bytes, usage.container_bytes);
+    ensure_eq(usage.index_bytes, 0U);
+    ensure_eq(usage.total_bytes, usage.heap_string_bytes + usage.container_bytes);
+    
+    // building the index of find is counted, too
+    ensure(doc.find("http"));
+    memory_breakdown indexed = memory_usage(doc);
+    ensure_gt(indexed.index_bytes, 0U);
+    ensure_eq(indexed.total_bytes, usage.total_bytes + indexed.index_bytes);
+}
+
+TEST(memory_usage_matches_allocations)
+{
+    std::istringstream input(memory_source);
+    ast_entry doc = parse(input);
+    
+    auto before = nginxconfig_test::thread_allocations();
+    ast_entry copy(doc);
+    auto after = nginxconfig_test::thread_allocations();
+#if NGINXCONFIG_USE_LIBSTDCXX_INTERNALS
+    ensure_eq(memory_usage(copy).total_bytes, after.bytes - before.bytes);
+#else
+    ensure_le(memory_usage(copy).total_bytes, after.bytes - before.bytes);
+#endif
+    
+    // measuring is a single walk over the tree
+    ensure_allocs_le(8, memory_usage(copy));
+}
+
+TEST(memory_usage_does_not_load_deferred_children)
+{
+    parse_options options;
+    options.lazy_blocks = true;
+    std::istringstream input(memory_source);
+    ast_entry doc = parse(input, options);
+    
+    memory_breakdown usage = memory_usage(doc);
+    ensure_eq(usage.complex_nodes, 1U);
+    ensure_eq(usage.deferred_nodes, 1U);
+    ensure(!doc.children().at(2).children_loaded());
+    
+    doc.children().at(2).children();
+    memory_breakdown loaded = memory_usage(doc);
+    ensure_eq(loaded.complex_nodes, 2U);
+    ensure_eq(loaded.deferred_nodes, 1U);
+    ensure_gt(loaded.total_bytes, usage.total_bytes);
+}
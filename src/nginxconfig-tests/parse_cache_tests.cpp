@@ -0,0 +1,268 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+
+namespace
+{
+
+/** A scratch directory which is removed (along with the files written through it) when the test ends. **/
+class scratch_dir
+{
+public:
+    scratch_dir()
+    {
+        char dir_template[] = "/tmp/nginxconfig-parse-cache-XXXXXX";
+        _path = ::mkdtemp(dir_template);
+    }
+    
+    ~scratch_dir()
+    {
+        for (auto iter = _files.rbegin(); iter != _files.rend(); ++iter)
+            std::remove(iter->c_str());
+        ::rmdir(_path.c_str());
+    }
+    
+    std::string write(const std::string& name, const std::string& contents)
+    {
+        std::string path = _path + "/" + name;
+        if (name.find('/') != std::string::npos)
+        {
+            std::string sub = _path + "/" + name.substr(0, name.find('/'));
+            if (::mkdir(sub.c_str(), 0700) == 0)
+                _files.push_back(sub);
+        }
+        std::ofstream(path.c_str()) << contents;
+        _files.push_back(path);
+        return path;
+    }
+    
+    const std::string& path() const { return _path; }
+    
+private:
+    std::string              _path;
+    std::vector<std::string> _files;
+};
+
+/** Set the modification time of \a path so the cache sees a new identity. **/
+void set_mtime(const std::string& path, long seconds)
+{
+    struct timespec times[2] = { { seconds, 0 }, { seconds, 0 } };
+    ::utimensat(AT_FDCWD, path.c_str(), times, 0);
+}
+
+/** Two different configurations with the same \c parse_cache::content_hash. Both are a comment and then \c x \c 1;,
+ *  with the first two words of the comment chosen to cancel out: the mix of each word can be undone, so the second word
+ *  of \a second is picked to bring the hash back to where \a first has it.
+**/
+bool colliding_texts(std::string& first, std::string& second)
+{
+    const std::uint64_t multiplier = 0x9E3779B97F4A7C15ULL;
+    const std::uint64_t step       = 0xBF58476D1CE4E5B9ULL;
+    std::uint64_t inverse = multiplier;
+    for (int pass = 0; pass < 6; ++pass)
+        inverse *= 2 - multiplier * inverse;
+    
+    auto word_of = [] (const std::string& text, std::size_t pos)
+                   {
+                       std::uint64_t word;
+                       std::memcpy(&word, text.data() + pos, sizeof word);
+                       return word;
+                   };
+    auto mix     = [&] (std::uint64_t word) { word *= multiplier; return word ^ (word >> 29); };
+    auto unmix   = [&] (std::uint64_t word) { return (word ^ (word >> 29) ^ (word >> 58)) * inverse; };
+    
+    first = "# aaaaaabbbbbbbb\nx 1;\n";
+    const std::uint64_t start = 0xCBF29CE484222325ULL ^ (first.size() * multiplier);
+    const std::uint64_t after = (start ^ mix(word_of(first, 0))) * step;
+    for (char c = 'b'; c <= 'z'; ++c)
+    {
+        second = first;
+        second[7] = c;
+        std::uint64_t other = (start ^ mix(word_of(second, 0))) * step;
+        std::uint64_t word  = unmix(after ^ other ^ mix(word_of(first, 8)));
+        std::memcpy(&second[8], &word, sizeof word);
+        if (second.find_first_of(std::string("\n\r\0", 3)) == 16)
+            return true;
+    }
+    return false;
+}
+
+}
+
+TEST(parse_cache_identity_and_content)
+{
+    scratch_dir dir;
+    std::string path = dir.write("a.conf", "worker_processes 4;\nevents {\n  worker_connections 1024;\n}\n");
+    
+    parse_cache cache;
+    parse_cache::document_ptr first = cache.parse_file(path);
+    ensure_eq(first->children().at(1).find("worker_connections")->attributes().at(0), "1024");
+    ensure(cache.parse_file(path) == first);
+    ensure_eq(cache.stats().misses, 1U);
+    ensure_eq(cache.stats().identity_hits, 1U);
+    
+    // touching the file changes its identity, but not its contents
+    set_mtime(path, 1000000);
+    ensure(cache.parse_file(path) == first);
+    ensure_eq(cache.stats().content_hits, 1U);
+    
+    dir.write("a.conf", "worker_processes 8;\n");
+    set_mtime(path, 2000000);
+    parse_cache::document_ptr second = cache.parse_file(path);
+    ensure(second != first);
+    ensure_eq(second->children().at(0).attributes().at(0), "8");
+    ensure_eq(cache.size(), 2U);
+    ensure_gt(cache.memory_usage(), 0U);
+    
+    ensure_throws(std::runtime_error, cache.parse_file(dir.path() + "/missing.conf"));
+}
+
+TEST(parse_cache_budget_and_persistence)
+{
+    scratch_dir dir;
+    std::string a = dir.write("a.conf", "a 1;\n");
+    std::string b = dir.write("b.conf", "b 2;\n");
+    
+    parse_cache small(1);
+    small.parse_file(a);
+    small.parse_file(b);
+    ensure_eq(small.size(), 1U);
+    ensure_eq(small.stats().evictions, 1U);
+    
+    parse_cache cache;
+    parse_cache::document_ptr doc_a = cache.parse_file(a);
+    cache.parse_file(b);
+    std::string saved = dir.write("cache.bin", "");
+    cache.save(saved);
+    
+    parse_cache loaded;
+    loaded.load(saved);
+    ensure_eq(loaded.size(), 2U);
+    ensure_eq(*loaded.parse_file(a), *doc_a);
+    ensure_eq(loaded.stats().identity_hits, 1U);
+    ensure_eq(loaded.stats().misses, 0U);
+    
+    std::string bogus = dir.write("bogus.bin", "not a cache");
+    ensure_throws(std::runtime_error, loaded.load(bogus));
+}
+
+TEST(parse_cache_content_hash_collision)
+{
+    std::string text_a, text_b;
+    ensure(colliding_texts(text_a, text_b));
+    ensure(text_a != text_b);
+    ensure_eq(parse_cache::content_hash(text_a.data(), text_a.size()),
+              parse_cache::content_hash(text_b.data(), text_b.size())
+             );
+    
+    scratch_dir dir;
+    std::string a = dir.write("a.conf", text_a);
+    std::string b = dir.write("b.conf", text_b);
+    
+    parse_cache cache;
+    parse_cache::document_ptr doc_a = cache.parse_file(a);
+    parse_cache::document_ptr doc_b = cache.parse_file(b);
+    std::istringstream expected_b(text_b);
+    ensure(doc_b != doc_a);
+    ensure_eq(*doc_b, parse(expected_b));
+    ensure_eq(cache.stats().content_hits, 0U);
+    ensure(cache.parse_file(a) == doc_a);
+}
+
+TEST(parse_cache_paths_evicted_with_documents)
+{
+    scratch_dir dir;
+    parse_cache cache(1);
+    for (int idx = 0; idx < 20; ++idx)
+        cache.parse_file(dir.write("f" + std::to_string(idx) + ".conf", "x " + std::to_string(idx) + ";\n"));
+    ensure_eq(cache.size(), 1U);
+    
+    // only the last file is left, so a cache with every path still recorded would be far larger than one document
+    parse_cache one;
+    one.parse_file(dir.path() + "/f19.conf");
+    ensure_eq(cache.memory_usage(), one.memory_usage());
+}
+
+TEST(parse_include_tree_shares_documents)
+{
+    scratch_dir dir;
+    std::string root = dir.write("nginx.conf",
+                                 "include common.conf;\n"
+                                 "http {\n"
+                                 "  include sites/*.conf;\n"
+                                 "  include empty/*.conf;\n"
+                                 "}\n"
+                                );
+    dir.write("common.conf", "worker_processes 2;\n");
+    dir.write("sites/b.conf", "server {\n  listen 81;\n}\n");
+    dir.write("sites/a.conf", "server {\n  listen 80;\n}\n");
+    
+    parse_cache cache;
+    include_tree tree = parse_include_tree(root, cache);
+    ensure_eq(tree.documents().size(), 4U);
+    ensure_eq(tree.resolve("sites/*.conf").size(), 2U);
+    ensure_eq(tree.resolve("sites/*.conf").at(0), dir.path() + "/sites/a.conf");
+    ensure(tree.resolve("empty/*.conf").empty());
+    
+    std::istringstream expected_text("worker_processes 2;\n"
+                                     "http {\n"
+                                     "  server {\n  listen 80;\n}\n"
+                                     "  server {\n  listen 81;\n}\n"
+                                     "}\n"
+                                    );
+    ensure_eq(tree.flatten(), parse(expected_text));
+    
+    // only the changed file is parsed again
+    dir.write("sites/b.conf", "server {\n  listen 82;\n}\n");
+    set_mtime(dir.path() + "/sites/b.conf", 3000000);
+    include_tree again = parse_include_tree(root, cache);
+    ensure(again.document(root) == tree.document(root));
+    ensure(again.document(dir.path() + "/sites/a.conf") == tree.document(dir.path() + "/sites/a.conf"));
+    ensure(again.document(dir.path() + "/sites/b.conf") != tree.document(dir.path() + "/sites/b.conf"));
+    ensure_eq(cache.stats().misses, 5U);
+    
+    dir.write("loop.conf", "include loop.conf;\n");
+    ensure_throws(std::runtime_error, parse_include_tree(dir.path() + "/loop.conf").flatten());
+    dir.write("bad.conf", "include nothing.conf;\n");
+    ensure_throws(std::runtime_error, parse_include_tree(dir.path() + "/bad.conf"));
+}
+
+TEST(parse_include_tree_flatten_keeps_layout)
+{
+    scratch_dir dir;
+    std::string root = dir.write("nginx.conf", "include common.conf;\n\n\nhttp {\n\n  server { listen 80; }\n}\n");
+    dir.write("common.conf", "worker_processes 2;\n");
+    
+    parse_options options;
+    options.trivia = trivia_mode::count;
+    ast_entry flat = parse_include_tree(root, options).flatten();
+    const ast_entry& http = flat.children().at(1);
+    ensure_eq(http.name(), "http");
+    ensure_eq(http.blank_lines_before(), 2U);
+    ensure_eq(http.source().line, 4U);
+    ensure_eq(http.children().at(0).blank_lines_before(), 1U);
+    ensure_eq(http.children().at(0).source().line, 6U);
+}
@@ -13,6 +13,10 @@
 
 #include <nginxconfig/parse_types.hpp>
 
+#include <sstream>
+#include <string>
+#include <vector>
+
 #include "test.hpp"
 
 using namespace nginxconfig::parser;
@@ -70,3 +74,42 @@ TEST(line_components_simple_comment)
         ensure_eq(x.comment, " comment");
     }
 }
+
+TEST(tokenizer_quotes_escapes_and_variables)
+{
+    std::istringstream input("a \"x { ; } #\" 'it\\'s' b\\ c ${host}x p#q;# done\n");
+    context cxt(input);
+    std::vector<std::string> words;
+    token tok;
+    for (cxt.next(tok); tok.kind == token_kind::word; cxt.next(tok))
+        words.push_back(tok.text);
+    ensure(token_kind::semicolon == tok.kind);
+    ensure_eq(words.size(), 6U);
+    ensure_eq(words.at(1), "\"x { ; } #\"");
+    ensure_eq(words.at(2), "'it\\'s'");
+    ensure_eq(words.at(3), "b\\ c");
+    ensure_eq(words.at(4), "${host}x");
+    ensure_eq(words.at(5), "p#q");
+    
+    cxt.next(tok);
+    ensure(token_kind::comment == tok.kind);
+    ensure_eq(tok.text, " done");
+    cxt.next(tok);
+    ensure(token_kind::end == tok.kind);
+}
+
+TEST(tokenizer_blank_lines)
+{
+    std::istringstream input("\n  \t\na;\n\n");
+    context cxt(input);
+    token tok;
+    std::vector<token_kind> kinds;
+    for (cxt.next(tok); tok.kind != token_kind::end; cxt.next(tok))
+        kinds.push_back(tok.kind);
+    ensure_eq(kinds.size(), 5U);
+    ensure(kinds.at(0) == token_kind::blank_line);
+    ensure(kinds.at(1) == token_kind::blank_line);
+    ensure(kinds.at(2) == token_kind::word);
+    ensure(kinds.at(3) == token_kind::semicolon);
+    ensure(kinds.at(4) == token_kind::blank_line);
+}
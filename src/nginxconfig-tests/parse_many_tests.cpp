@@ -0,0 +1,69 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <unistd.h>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+
+TEST(parse_many_results_in_order)
+{
+    char dir_template[] = "/tmp/nginxconfig-parse-many-XXXXXX";
+    std::string dir = ::mkdtemp(dir_template);
+    
+    std::vector<std::string> paths;
+    for (int idx = 0; idx < 40; ++idx)
+    {
+        paths.push_back(dir + "/" + std::to_string(idx) + ".conf");
+        std::ofstream file(paths.back().c_str());
+        file << "server {\n";
+        // vary the sizes so the scheduling order differs from the input order
+        for (int line = 0; line < (idx * 7) % 23; ++line)
+            file << "  listen " << line << ";\n";
+        file << "  server_name tenant" << idx << ";\n";
+        file << "}\n";
+    }
+    paths.push_back(dir + "/missing.conf");
+    paths.push_back(dir + "/broken.conf");
+    std::ofstream(paths.back().c_str()) << "server {\n";
+    
+    std::vector<parse_result> results = parse_many(paths, parse_options(), 4);
+    ensure_eq(results.size(), paths.size());
+    for (int idx = 0; idx < 40; ++idx)
+    {
+        ensure(results[idx].ok());
+        ensure_eq(results[idx].path(), paths[idx]);
+        const ast_entry& server = results[idx].document().children().at(0);
+        ensure_eq(server.find("server_name")->attributes().at(0), "tenant" + std::to_string(idx));
+        ensure_eq(server.count("listen"), std::size_t((idx * 7) % 23));
+    }
+    ensure(!results[40].ok());
+    ensure_throws(std::runtime_error, results[40].document());
+    ensure(!results[41].ok());
+    ensure_throws(parse_error, results[41].document());
+    
+    // a single thread gives the same answers
+    std::vector<parse_result> serial = parse_many(paths, parse_options(), 1);
+    for (int idx = 0; idx < 40; ++idx)
+        ensure_eq(serial[idx].document(), results[idx].document());
+    ensure(parse_many({}).empty());
+    
+    for (const std::string& path : paths)
+        std::remove(path.c_str());
+    ::rmdir(dir.c_str());
+}
@@ -11,8 +11,10 @@
 **/
 #include <nginxconfig/all.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
+#include <thread>
 
 #include "test.hpp"
 
@@ -141,3 +143,385 @@ TEST(user_config)
     nginxconfig::ast_entry ast = nginxconfig::parse(stream);
     std::cout << ast;
 }
+
+static std::string nested_blocks(std::size_t depth)
+{
+    std::string out;
+    for (std::size_t x = 0; x < depth; ++x)
+        out += "a {\n";
+    out += "b 1;\n";
+    for (std::size_t x = 0; x < depth; ++x)
+        out += "}\n";
+    return out;
+}
+
+TEST(parse_max_depth)
+{
+    nginxconfig::parse_options options;
+    options.max_depth = 3;
+    
+    std::istringstream ok(nested_blocks(3));
+    nginxconfig::ast_entry ast = nginxconfig::parse(ok, options);
+    ensure_eq(ast.children().at(0).children().at(0).children().at(0).children().at(0).name(), "b");
+    
+    std::istringstream too_deep(nested_blocks(4));
+    ensure_throws(nginxconfig::parse_error, nginxconfig::parse(too_deep, options));
+    
+    std::istringstream unbalanced("a {\nb 1;\n}\n}\n");
+    ensure_throws(nginxconfig::parse_error, nginxconfig::parse(unbalanced));
+    
+    std::istringstream unterminated("a {\nb 1;\n");
+    ensure_throws(nginxconfig::parse_error, nginxconfig::parse(unterminated));
+}
+
+TEST(parse_encode_deep_nesting)
+{
+    nginxconfig::parse_options options;
+    options.max_depth = 5000;
+    
+    std::istringstream input(nested_blocks(options.max_depth));
+    nginxconfig::ast_entry ast = nginxconfig::parse(input, options);
+    
+    std::ostringstream first;
+    std::ostringstream second;
+    nginxconfig::ostream_encoder encoder(first, "");
+    encoder.encode(ast);
+    nginxconfig::encode(ast, second, "");
+    ensure_eq(first.str(), second.str());
+    
+    std::istringstream reparse(first.str());
+    ensure_eq(nginxconfig::parse(reparse, options), ast);
+}
+
+TEST(parse_reuses_frame_stack)
+{
+    // a new thread has no frame stack yet, so its first parse pays for growing one and parsing again must not
+    std::string source = nested_blocks(200);
+    std::thread worker([&]
+    {
+        std::istringstream first_input(source);
+        auto before = nginxconfig_test::thread_allocations().count;
+        nginxconfig::parse(first_input);
+        auto first = nginxconfig_test::thread_allocations().count - before;
+        
+        // doubling the capacity up to 200 frames takes 9 allocations
+        std::istringstream input(source);
+        ensure_allocs_le(first - 9, nginxconfig::parse(input));
+    });
+    worker.join();
+}
+
+class counting_hooks :
+        public nginxconfig::parse_hooks
+{
+public:
+    std::size_t begins    = 0;
+    std::size_t ends      = 0;
+    std::size_t entries   = 0;
+    std::size_t max_depth = 0;
+    std::size_t nodes     = 0;
+    
+    virtual void parse_begin() override
+    {
+        ++begins;
+    }
+    
+    virtual void entry_added(const nginxconfig::ast_entry&, size_type depth) override
+    {
+        ++entries;
+        max_depth = std::max(max_depth, depth);
+    }
+    
+    virtual void parse_end(const nginxconfig::parse_stats& stats) override
+    {
+        ++ends;
+        nodes = stats.nodes();
+    }
+};
+
+TEST(parse_collects_stats)
+{
+    counting_hooks hooks;
+    nginxconfig::parse_options options;
+    options.hooks = &hooks;
+    
+    std::string source = nested_blocks(3) + "# done\n";
+    std::istringstream input(source);
+    nginxconfig::parse_stats stats;
+    nginxconfig::parse(input, options, stats);
+    
+    if (!nginxconfig::parse_stats::enabled)
+    {
+        ensure_eq(stats.nodes(), 0U);
+        ensure_eq(hooks.begins, 0U);
+        return;
+    }
+    
+    ensure_eq(stats.bytes, source.size());
+    ensure_eq(stats.lines, 8U);
+    ensure_eq(stats.complex_nodes, 3U);
+    ensure_eq(stats.simple_nodes, 1U);
+    ensure_eq(stats.comment_nodes, 1U);
+    ensure_eq(stats.max_depth, 3U);
+    ensure_le(stats.read_ns + stats.tokenize_ns + stats.build_ns, stats.total_ns);
+    // the test program reports its allocations to note_allocation
+    ensure_gt(stats.allocations, 0U);
+    ensure_ge(stats.allocated_bytes, stats.allocations);
+    
+    ensure_eq(hooks.begins, 1U);
+    ensure_eq(hooks.ends, 1U);
+    ensure_eq(hooks.entries, 5U);
+    ensure_eq(hooks.max_depth, 3U);
+    ensure_eq(hooks.nodes, 5U);
+}
+
+TEST(parse_trivia_modes)
+{
+    const std::string source = "# leading\n"
+                               "a 1; # about a\n"
+                               "\n"
+                               "\n"
+                               "b {\n"
+                               "    # inside\n"
+                               "\n"
+                               "    c 2;\n"
+                               "}\n";
+    nginxconfig::parse_options options;
+    
+    options.trivia = nginxconfig::trivia_mode::drop;
+    std::istringstream dropped_input(source);
+    nginxconfig::ast_entry dropped = nginxconfig::parse(dropped_input, options);
+    ensure_eq(dropped.children().size(), 2U);
+    ensure(dropped.children().at(0).comment().empty());
+    ensure_eq(dropped.children().at(1).children().size(), 1U);
+    ensure_eq(dropped.children().at(1).children().at(0).blank_lines_before(), 0U);
+    
+    options.trivia = nginxconfig::trivia_mode::count;
+    std::istringstream counted_input(source);
+    nginxconfig::ast_entry counted = nginxconfig::parse(counted_input, options);
+    ensure_eq(counted, dropped);
+    ensure_eq(counted.children().at(0).blank_lines_before(), 0U);
+    ensure_eq(counted.children().at(1).blank_lines_before(), 2U);
+    ensure_eq(counted.children().at(1).children().at(0).blank_lines_before(), 1U);
+    
+    // the encoder puts the blank lines back, so keeping them parses to the same thing as the source without comments
+    std::ostringstream encoded;
+    nginxconfig::encode(counted, encoded);
+    std::istringstream encoded_input(encoded.str());
+    std::istringstream expected_input("a 1;\n\n\nb {\n\n    c 2;\n}\n");
+    ensure_eq(nginxconfig::parse(encoded_input), nginxconfig::parse(expected_input));
+}
+
+static bool same_sources(const nginxconfig::ast_entry& a, const nginxconfig::ast_entry& b)
+{
+    const nginxconfig::source_range& x = a.source();
+    const nginxconfig::source_range& y = b.source();
+    if (x.begin != y.begin || x.end != y.end || x.line != y.line || a.blank_lines_before() != b.blank_lines_before())
+        return false;
+    if (a.kind() != nginxconfig::ast_entry_kind::complex && a.kind() != nginxconfig::ast_entry_kind::document)
+        return true;
+    if (x.body_begin != y.body_begin || x.body_end != y.body_end || a.children().size() != b.children().size())
+        return false;
+    for (std::size_t idx = 0; idx < a.children().size(); ++idx)
+        if (!same_sources(a.children()[idx], b.children()[idx]))
+            return false;
+    return true;
+}
+
+TEST(parse_lazy_blocks)
+{
+    const std::string source = "http { # the http block\n"
+                               "    server {\n"
+                               "        return 200 \"} not the end {\";\n"
+                               "        # nor is this }\n"
+                               "\n"
+                               "        set $x ${host}_suffix;\n"
+                               "        location / { root /srv; }\n"
+                               "    }\n"
+                               "    a\\} 1;\n"
+                               "}\n"
+                               "events { }\n";
+    for (nginxconfig::trivia_mode trivia : { nginxconfig::trivia_mode::keep, nginxconfig::trivia_mode::count })
+    {
+        nginxconfig::parse_options options;
+        options.trivia = trivia;
+        std::istringstream eager_input(source);
+        nginxconfig::ast_entry eager = nginxconfig::parse(eager_input, options);
+        
+        options.lazy_blocks = true;
+        std::istringstream lazy_input(source);
+        nginxconfig::ast_entry lazy = nginxconfig::parse(lazy_input, options);
+        ensure_eq(lazy.children().size(), eager.children().size());
+        const nginxconfig::ast_entry& http = lazy.children().at(0);
+        ensure(!http.children_loaded());
+        ensure_eq(http.comment(), trivia == nginxconfig::trivia_mode::keep ? " the http block" : "");
+        
+        // copies made before loading load on their own
+        nginxconfig::ast_entry copy = http;
+        ensure(!copy.children_loaded());
+        ensure(http.find("server") != nullptr);
+        ensure(http.children_loaded());
+        ensure(!http.find("server")->children_loaded());
+        ensure(!copy.children_loaded());
+        ensure_eq(copy, eager.children().at(0));
+        
+        ensure_eq(lazy, eager);
+        ensure(same_sources(lazy, eager));
+    }
+}
+
+TEST(parse_lazy_blocks_errors)
+{
+    nginxconfig::parse_options options;
+    options.lazy_blocks = true;
+    
+    // the braces and quotes are checked right away
+    for (const char* source : { "a {\n", "a { b \"}; }\n", "a { b { } \n" })
+    {
+        std::istringstream input(source);
+        ensure_throws(nginxconfig::parse_error, nginxconfig::parse(input, options));
+    }
+    options.max_depth = 3;
+    std::istringstream deep_input(nested_blocks(4));
+    ensure_throws(nginxconfig::parse_error, nginxconfig::parse(deep_input, options));
+    std::istringstream shallow_input(nested_blocks(3));
+    nginxconfig::parse(shallow_input, options);
+    
+    // everything else is found when loading
+    std::istringstream input("a {\n    b 1\n}\n");
+    nginxconfig::ast_entry doc = nginxconfig::parse(input, options);
+    const nginxconfig::ast_entry& block = doc.children().at(0);
+    try
+    {
+        block.children();
+        ensure(!"parse_error was not thrown");
+    }
+    catch (const nginxconfig::parse_error& ex)
+    {
+        ensure_eq(ex.line(), 3U);
+    }
+    ensure(!block.children_loaded());
+}
+
+/** Loads the deferred blocks of another document in the middle of a parse. **/
+class loading_hooks :
+        public nginxconfig::parse_hooks
+{
+public:
+    explicit loading_hooks(const nginxconfig::ast_entry& lazy) :
+            lazy(lazy)
+    { }
+    
+    virtual void entry_added(const nginxconfig::ast_entry&, size_type) override
+    {
+        for (const nginxconfig::ast_entry& block : lazy.children())
+            loaded += block.children().size();
+    }
+    
+    const nginxconfig::ast_entry& lazy;
+    std::size_t                   loaded = 0;
+};
+
+TEST(parse_lazy_blocks_load_during_parse)
+{
+    nginxconfig::parse_options lazy_options;
+    lazy_options.lazy_blocks = true;
+    lazy_options.trivia      = nginxconfig::trivia_mode::drop;
+    std::istringstream lazy_input("a { b { c 1; } d 2; }\ne { f 3; }\n");
+    nginxconfig::ast_entry lazy = nginxconfig::parse(lazy_input, lazy_options);
+    
+    loading_hooks hooks(lazy);
+    nginxconfig::parse_options options;
+    options.hooks = &hooks;
+    std::istringstream input(nested_blocks(4) + "x { y { z 1; } }\n");
+    nginxconfig::ast_entry doc = nginxconfig::parse(input, options);
+    
+    std::istringstream expected_input(nested_blocks(4) + "x { y { z 1; } }\n");
+    ensure_eq(doc, nginxconfig::parse(expected_input));
+    if (nginxconfig::parse_stats::enabled)
+        ensure_gt(hooks.loaded, 0U);
+    ensure_eq(lazy.children().at(0).children().size(), 2U);
+}
+
+TEST(parse_tokenizes_like_nginx)
+{
+    std::istringstream input(
+        "events { worker_connections 1024; }\n"
+        "http {\n"
+        "    log_format main '$remote_addr - $remote_user'\n"
+        "                    '\"$request\" $status';  # two lines\n"
+        "    a 1; b 2; # about b\n"
+        "    return 200 \"{ not; a block }\";\n"
+        "    set $x ${host}_suffix;\n"
+        "} # end of http\n"
+    );
+    nginxconfig::ast_entry doc = nginxconfig::parse(input);
+    
+    ensure_eq(doc.children().size(), 3U);
+    const nginxconfig::ast_entry& events = doc.children().at(0);
+    ensure_eq(events.children().at(0).name(), "worker_connections");
+    
+    const nginxconfig::ast_entry& http = doc.children().at(1);
+    ensure_eq(http.children().size(), 5U);
+    const nginxconfig::ast_entry& log_format = http.children().at(0);
+    ensure_eq(log_format.attributes().size(), 3U);
+    ensure_eq(log_format.attributes().at(2), "'\"$request\" $status'");
+    ensure_eq(log_format.comment(), " two lines");
+    ensure_eq(log_format.source().line, 3U);
+    
+    ensure_eq(http.children().at(1).name(), "a");
+    ensure(http.children().at(1).comment().empty());
+    ensure_eq(http.children().at(2).comment(), " about b");
+    ensure_eq(http.children().at(3).attributes().at(1), "\"{ not; a block }\"");
+    ensure_eq(http.children().at(4).attributes().at(1), "${host}_suffix");
+    
+    ensure(doc.children().at(2).kind() == nginxconfig::ast_entry_kind::comment);
+    ensure_eq(doc.children().at(2).comment(), " end of http");
+    
+    // what the encoder writes parses back to the same thing
+    std::ostringstream encoded;
+    nginxconfig::encode(doc, encoded);
+    std::istringstream again(encoded.str());
+    ensure_eq(nginxconfig::parse(again), doc);
+}
+
+TEST(parse_tokenizer_errors)
+{
+    for (const char* source : { "a \"unterminated;\n",
+                                "a \"quoted\"next;\n",
+                                "a 1;\n;\n",
+                                "server {\n    listen 80\n}\n",
+                                "{ a 1; }\n",
+                                "a 1\n",
+                              })
+    {
+        std::istringstream input(source);
+        ensure_throws(nginxconfig::parse_error, nginxconfig::parse(input));
+    }
+    
+    std::istringstream input("a 1;\nserver {\n    listen 80\n}\n");
+    try
+    {
+        nginxconfig::parse(input);
+        ensure(!"parse_error was not thrown");
+    }
+    catch (const nginxconfig::parse_error& ex)
+    {
+        ensure_eq(ex.line(), 4U);
+        ensure_eq(ex.column(), 0U);
+        ensure_eq(ex.character(), 28U);
+    }
+    
+    std::istringstream inside_line("aaaa 1;\nbb 2 }\n");
+    try
+    {
+        nginxconfig::parse(inside_line);
+        ensure(!"parse_error was not thrown");
+    }
+    catch (const nginxconfig::parse_error& ex)
+    {
+        ensure_eq(ex.line(), 2U);
+        ensure_eq(ex.column(), 5U);
+        ensure_eq(ex.character(), 13U);
+    }
+}
@@ -0,0 +1,176 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include <sstream>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+using nginxconfig_test::parse_string;
+
+static const char reparse_source[] =
+    "worker_processes 1;\n"
+    "http {\n"
+    "  server {\n"
+    "    listen 80;\n"
+    "    location / {\n"
+    "      root /srv;\n"
+    "    }\n"
+    "  }\n"
+    "  server {\n"
+    "    listen 81;\n"
+    "  }\n"
+    "}\n"
+    "# trailing comment\n";
+
+/** Do \a a and \a b have the same source ranges everywhere? **/
+static bool same_ranges(const ast_entry& a, const ast_entry& b)
+{
+    const source_range& x = a.source();
+    const source_range& y = b.source();
+    if (x.begin != y.begin || x.end != y.end || x.line != y.line || a.kind() != b.kind())
+        return false;
+    if (a.kind() != ast_entry_kind::complex && a.kind() != ast_entry_kind::document)
+        return true;
+    if (x.body_begin != y.body_begin || x.body_end != y.body_end || a.children().size() != b.children().size())
+        return false;
+    for (std::size_t idx = 0; idx < a.children().size(); ++idx)
+    {
+        if (!same_ranges(a.children()[idx], b.children()[idx]))
+            return false;
+    }
+    return true;
+}
+
+TEST(parse_records_source_ranges)
+{
+    std::string source = reparse_source;
+    ast_entry doc = parse_string(source);
+    ensure_eq(doc.source().end, source.size());
+    
+    const ast_entry& http = doc.children().at(1);
+    ensure_eq(http.source().line, 2U);
+    ensure_eq(source.substr(http.source().begin, 6), "http {");
+    ensure_eq(source.substr(http.source().body_begin - 1, 2), "{\n");
+    ensure_eq(source.substr(http.source().end - 2, 3), "\n}\n");
+    ensure_eq(source.substr(http.source().body_end, 2), "}\n");
+    
+    const ast_entry& root = http.children().at(0).children().at(1).children().at(0);
+    ensure_eq(source.substr(root.source().begin, root.source().end - root.source().begin), "root /srv;");
+    ensure_eq(root.source().line, 6U);
+    
+    const ast_entry& comment = doc.children().back();
+    ensure_eq(source.substr(comment.source().begin, comment.source().end - comment.source().begin),
+              "# trailing comment"
+             );
+}
+
+TEST(reparse_matches_full_parse)
+{
+    std::string source = reparse_source;
+    auto offset_of = [&source] (const char* text) { return source.find(text); };
+    
+    std::vector<text_edit>                edits;
+    std::vector<std::vector<std::size_t>> block_paths;
+    auto add_case = [&] (std::size_t offset, std::size_t old_length, const char* new_text, std::vector<std::size_t> path)
+                    {
+                        text_edit edit;
+                        edit.offset     = offset;
+                        edit.old_length = old_length;
+                        edit.new_text   = new_text;
+                        edits.push_back(edit);
+                        block_paths.push_back(path);
+                    };
+    // inside the innermost location
+    add_case(offset_of("/srv"), 4, "/var/www", { 1, 0, 1 });
+    // add a directive to the second server
+    add_case(offset_of("    listen 81"), 0, "    server_name b;\n", { 1, 1 });
+    // unbalance the location, so the server has to be parsed again
+    add_case(offset_of("      root"), 0, "      root /a;\n    }\n    location /b {\n", { 1, 0 });
+    // a top-level edit
+    add_case(0, 19, "worker_processes 4;\nuser nginx;", { });
+    
+    for (std::size_t idx = 0; idx < edits.size(); ++idx)
+    {
+        const text_edit& edit = edits[idx];
+        reparse_result result = reparse(parse_string(source), source, edit);
+        std::string expected_source = source;
+        expected_source.replace(edit.offset, edit.old_length, edit.new_text);
+        ensure_eq(result.source, expected_source);
+        
+        ast_entry expected = parse_string(expected_source);
+        ensure_eq(result.document, expected);
+        ensure(same_ranges(result.document, expected));
+        ensure(result.block_path == block_paths[idx]);
+        ensure_le(result.first_changed, result.last_changed);
+    }
+}
+
+TEST(reparse_reports_changed_children)
+{
+    std::string source = reparse_source;
+    text_edit edit = { source.find("    listen 81"), 0, "    server_name b;\n    server_name c;\n" };
+    reparse_result result = reparse(parse_string(source), source, edit);
+    ensure_eq(result.first_changed, 0U);
+    ensure_eq(result.last_changed, 2U);
+    ensure_eq(result.block().children().size(), 3U);
+    ensure_eq(result.block().children().at(2).name(), "listen");
+    
+    // a chain of edits, each working from the previous result
+    text_edit second = { result.source.find("server_name c"), 13, "server_name d" };
+    reparse_result next = reparse(std::move(result.document), result.source, second);
+    ensure_eq(next.document, parse_string(next.source));
+    ensure(same_ranges(next.document, parse_string(next.source)));
+    ensure_eq(next.first_changed, 1U);
+    ensure_eq(next.last_changed, 2U);
+    
+    ensure_throws(std::out_of_range, reparse(parse_string(source), source, text_edit{ source.size(), 1, "" }));
+    ensure_throws(parse_error, reparse(parse_string(source), source, text_edit{ 0, 0, "}\n" }));
+}
+
+TEST(reparse_block_on_one_line_with_comment)
+{
+    std::string source = "http { # the http block\n"
+                         "    a 1; b 2;\n"
+                         "    server { listen 80; }\n"
+                         "}\n";
+    text_edit edit = { source.find("b 2"), 3, "b 3" };
+    reparse_result result = reparse(parse_string(source), source, edit);
+    ensure_eq(result.document, parse_string(result.source));
+    ensure(same_ranges(result.document, parse_string(result.source)));
+    ensure(result.block_path == std::vector<std::size_t>({ 0 }));
+    ensure_eq(result.block().comment(), " the http block");
+    ensure_eq(result.first_changed, 0U);
+    ensure_eq(result.last_changed, 2U);
+}
+
+TEST(reparse_lazily_parsed_document)
+{
+    parse_options lazy;
+    lazy.lazy_blocks = true;
+    std::string source = reparse_source;
+    
+    // an edit before the blocks, which moves them while their children are still deferred
+    text_edit edit = { 0, 1, "abc" };
+    std::istringstream stream(source);
+    reparse_result result = reparse(parse(stream, lazy), source, edit, lazy);
+    ast_entry expected = parse_string(result.source);
+    ensure_eq(result.document, expected);
+    ensure(same_ranges(result.document, expected));
+    
+    // and one inside of a block, after a block which is still deferred
+    text_edit inner = { result.source.find("listen 81"), 9, "listen 82" };
+    std::istringstream again(result.source);
+    reparse_result next = reparse(parse(again, lazy), result.source, inner, lazy);
+    ensure_eq(next.document, parse_string(next.source));
+    ensure(same_ranges(next.document, parse_string(next.source)));
+}
@@ -0,0 +1,180 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include <algorithm>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+using nginxconfig_test::parse_string;
+
+namespace
+{
+
+/** Comments and blank lines would only get in the way of comparing rewritten documents. **/
+parse_options without_trivia()
+{
+    parse_options options;
+    options.trivia = trivia_mode::drop;
+    return options;
+}
+
+/** Adds \c ssl to a \c listen in a server with <tt>ssl on</tt>. **/
+class add_ssl_flag :
+        public rewrite_action
+{
+public:
+    virtual void rewrite(rewrite_context& cxt) const override
+    {
+        const ast_entry* ssl = cxt.parent().find("ssl");
+        ast_entry::attribute_list& attributes = cxt.entry().attributes();
+        if (ssl && ssl->attributes().size() == 1 && ssl->attributes()[0] == "on"
+         && std::find(attributes.begin(), attributes.end(), "ssl") == attributes.end()
+           )
+        {
+            attributes.push_back("ssl");
+        }
+    }
+};
+
+class wrap_in_comments :
+        public rewrite_action
+{
+public:
+    virtual void rewrite(rewrite_context& cxt) const override
+    {
+        cxt.insert_before(ast_entry::make_comment(" begin " + cxt.entry().name()));
+        cxt.insert_after(ast_entry::make_comment(" end " + cxt.entry().name()));
+    }
+};
+
+/** Removes the entry, looking at its parent first like a rule deciding what to do would. **/
+class remove_after_lookup :
+        public rewrite_action
+{
+public:
+    virtual void rewrite(rewrite_context& cxt) const override
+    {
+        if (!cxt.parent().find("z"))
+            cxt.remove();
+    }
+};
+
+}
+
+TEST(rewrite_ssl_migration)
+{
+    ast_entry doc = parse_string(R"(
+http {
+    server {
+        listen 443;
+        ssl on;
+        listen [::]:443;
+        server_name a.example.com;
+    }
+    server {
+        listen 80;
+        ssl off;
+    }
+}
+)", without_trivia());
+    rewriter rules;
+    rules.add({ "listen", {}, "server" }, std::make_shared<add_ssl_flag>());
+    rules.remove({ "ssl", { "*" }, "server" });
+    ensure_eq(rules.size(), 2U);
+    ensure_eq(rules.apply(doc), 5U);
+
+    ast_entry expected = parse_string(R"(
+http {
+    server {
+        listen 443 ssl;
+        listen [::]:443 ssl;
+        server_name a.example.com;
+    }
+    server {
+        listen 80;
+    }
+}
+)", without_trivia());
+    ensure(doc == expected);
+}
+
+TEST(rewrite_replace_and_insert)
+{
+    ast_entry doc = parse_string(R"(
+proxy_read_timeout 30s;
+http {
+    location / {
+        proxy_read_timeout 30s;
+        proxy_pass http://backend;
+    }
+    location /slow {
+        proxy_read_timeout 30s;
+        proxy_read_timeout 60s;
+    }
+}
+)", without_trivia());
+    rewriter rules;
+    rules.replace({ "proxy_read_timeout", { "*" }, "location" },
+                  ast_entry::make_simple("proxy_read_timeout", { "90s" })
+                 );
+    // the replacements are not rewritten again, so this does not loop or duplicate them
+    rules.replace({ "proxy_read_timeout", { "90s" }, "" }, ast_entry::make_simple("proxy_read_timeout", { "1s" }));
+    rules.add({ "proxy_pass", {}, "" }, std::make_shared<wrap_in_comments>());
+    ensure_eq(rules.apply(doc), 4U);
+
+    ast_entry expected = ast_entry::make_document();
+    expected.children().push_back(ast_entry::make_simple("proxy_read_timeout", { "30s" }));
+    expected.children().push_back(ast_entry::make_complex("http"));
+    ast_entry& http = expected.children().back();
+    http.children().push_back(ast_entry::make_complex("location", { "/" }));
+    http.children().back().children().push_back(ast_entry::make_simple("proxy_read_timeout", { "90s" }));
+    http.children().back().children().push_back(ast_entry::make_comment(" begin proxy_pass"));
+    http.children().back().children().push_back(ast_entry::make_simple("proxy_pass", { "http://backend" }));
+    http.children().back().children().push_back(ast_entry::make_comment(" end proxy_pass"));
+    http.children().push_back(ast_entry::make_complex("location", { "/slow" }));
+    http.children().back().children().push_back(ast_entry::make_simple("proxy_read_timeout", { "90s" }));
+    http.children().back().children().push_back(ast_entry::make_simple("proxy_read_timeout", { "90s" }));
+    ensure(doc == expected);
+
+    ast_entry simple = ast_entry::make_simple("listen", { "80" });
+    ensure_throws(kind_error, rules.apply(simple));
+}
+
+TEST(rewrite_large_block_is_linear)
+{
+    ast_entry doc = ast_entry::make_document();
+    ast_entry::child_list& children = doc.children();
+    for (int idx = 0; idx < 200000; ++idx)
+        children.push_back(ast_entry::make_simple(idx % 2 == 0 ? "keep" : "drop", { std::to_string(idx) }));
+
+    rewriter rules;
+    rules.remove({ "drop", {}, "" });
+    ensure_time_le(1000, ensure_eq(rules.apply(doc), 100000U));
+    ensure_eq(doc.children().size(), 100000U);
+    ensure_eq(doc.children().back().attributes().at(0), "199998");
+}
+
+TEST(rewrite_parent_lookup_during_apply)
+{
+    ast_entry doc = parse_string("server { a 1; b 2; c 3; z 4; }", without_trivia());
+    rewriter rules;
+    rules.add({ "a", {}, "server" }, std::make_shared<remove_after_lookup>());
+    rules.remove({ "b", {}, "server" });
+    rules.remove({ "c", {}, "server" });
+    ensure_eq(rules.apply(doc), 3U);
+
+    const ast_entry& server = doc.children().at(0);
+    ensure_eq(server.children().size(), 2U);
+    ensure(server.find("z") == &server.children().at(1));
+    ensure(server.find("c") == nullptr);
+}
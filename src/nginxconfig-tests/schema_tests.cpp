@@ -0,0 +1,118 @@
+/** \file
+ *  
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+using nginxconfig_test::parse_string;
+
+TEST(schema_validate_clean)
+{
+    ast_entry doc = parse_string(R"(
+worker_processes 4;
+events {
+    worker_connections 1024;
+}
+http {
+    include mime.types;
+    sendfile on;
+    upstream backend {
+        server 10.0.0.1:8080 weight=2;
+        keepalive 16;
+    }
+    map $http_upgrade $connection_upgrade {
+        default upgrade;
+        '' close;
+    }
+    server {
+        listen 80;
+        server_name example.org;
+        location / {
+            proxy_pass http://backend;
+            proxy_set_header Host $host;
+            if ($request_method = POST) {
+                return 405;
+            }
+        }
+    }
+}
+)");
+    auto violations = validate(doc);
+    for (const auto& v : violations)
+        ensure_eq(v.message, "");
+    ensure_eq(violations.size(), 0U);
+}
+
+TEST(schema_validate_violations)
+{
+    ast_entry doc = parse_string(R"(
+listen 80;
+events {
+    worker_connections;
+}
+http {
+    sendfile maybe;
+    frobnicate 1;
+    server_name example.org;
+    server {
+        location {
+        }
+    }
+}
+)");
+    auto violations = validate(doc);
+    ensure_eq(violations.size(), 6U);
+    ensure_eq(violations.at(0).message, "\"listen\" directive is not allowed here");
+    ensure_eq(violations.at(1).message, "invalid number of arguments in \"worker_connections\" directive");
+    ensure_eq(violations.at(2).message, "invalid value \"maybe\" in \"sendfile\" directive, it must be \"on\" or \"off\"");
+    ensure_eq(violations.at(3).message, "unknown directive \"frobnicate\"");
+    ensure_eq(violations.at(4).message, "\"server_name\" directive is not allowed here");
+    ensure_eq(violations.at(5).message, "invalid number of arguments in \"location\" directive");
+}
+
+TEST(schema_validate_flag_case)
+{
+    ast_entry doc = parse_string("http {\n    sendfile On;\n    tcp_nopush OFF;\n    etag \"off\";\n    gzip 1;\n}\n");
+    auto violations = validate(doc);
+    ensure_eq(violations.size(), 1U);
+    ensure_eq(violations.at(0).message, "invalid value \"1\" in \"gzip\" directive, it must be \"on\" or \"off\"");
+}
+
+TEST(schema_register_module)
+{
+    static constexpr directive_schema lua_module[] =
+    {
+        { "content_by_lua_block", context_http_location, args_block | args_none, context_opaque },
+        { "lua_package_path",     context_http,          args_take1,             0 },
+    };
+    
+    ast_entry doc = parse_string(R"(
+http {
+    lua_package_path "/etc/lua/?.lua";
+    server {
+        location / {
+            content_by_lua_block {
+                ngx.say("hi");
+            }
+        }
+    }
+}
+)");
+    ensure_eq(validate(doc).size(), 2U);
+    
+    schema_registry schema = schema_registry::standard();
+    schema.add_module("lua", lua_module);
+    schema_registry copied = schema;
+    ensure(copied.find("lua_package_path", context_http) != nullptr);
+    ensure_eq(std::string(copied.find("lua_package_path", context_http)->name), "lua_package_path");
+    ensure_eq(validate(doc, copied).size(), 0U);
+}
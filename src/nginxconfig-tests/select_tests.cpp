@@ -0,0 +1,100 @@
+/** \file
+ *  
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include <sstream>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+
+static const char select_file[] = R"(
+http {
+    server {
+        listen 80;
+        location / {
+            root /srv;
+        }
+    }
+    server {
+        listen 443 ssl;
+        location /api {
+            proxy_pass http://api;
+            location /api/v2 {
+                proxy_pass http://api2;
+            }
+        }
+        location = /health {
+            return 200;
+        }
+    }
+}
+)";
+
+static std::size_t count_both(const ast_entry& doc, const document_index& index, const std::string& expression)
+{
+    selector sel(expression);
+    auto walked  = sel.select(doc);
+    auto indexed = sel.select(index);
+    if (walked != indexed)
+        throw std::logic_error("Indexed and walked results differ for " + expression);
+    return walked.size();
+}
+
+TEST(select_steps_and_axes)
+{
+    std::istringstream stream(select_file);
+    ast_entry doc = parse(stream);
+    document_index index(doc);
+    
+    ensure_eq(count_both(doc, index, "server"), 2U);
+    ensure_eq(count_both(doc, index, "http > server > location"), 3U);
+    ensure_eq(count_both(doc, index, "http location"), 4U);
+    ensure_eq(count_both(doc, index, "> server"), 0U);
+    ensure_eq(count_both(doc, index, "> http > *"), 2U);
+    ensure_eq(count_both(doc, index, "server[listen=443] > location"), 2U);
+    ensure_eq(count_both(doc, index, "server[listen=443] location"), 3U);
+    ensure_eq(count_both(doc, index, "location[=/health]"), 1U);
+    ensure_eq(count_both(doc, index, "location[proxy_pass] location"), 1U);
+    ensure_eq(count_both(doc, index, "location > proxy_pass"), 2U);
+    ensure_eq(count_both(doc, index, "server[listen='80'] *"), 3U);
+    
+    auto found = selector("location location > proxy_pass").select(index);
+    ensure_eq(found.size(), 1U);
+    ensure_eq(found.at(0)->attributes().at(0), "http://api2");
+}
+
+TEST(select_errors)
+{
+    ensure_throws(selector_error, selector(""));
+    ensure_throws(selector_error, selector("server >"));
+    ensure_throws(selector_error, selector("server[listen"));
+    ensure_throws(selector_error, selector("server[listen='443]"));
+    ensure_throws(selector_error, selector("server[]"));
+}
+
+TEST(select_deep_descendants)
+{
+    // every "a" can be any of the steps, so trying each way of placing them one after another never finishes
+    std::string text;
+    for (int depth = 0; depth < 40; ++depth)
+        text += "a {\n";
+    text += "x 1;\n";
+    for (int depth = 0; depth < 40; ++depth)
+        text += "}\n";
+    std::istringstream stream(text);
+    ast_entry doc = parse(stream);
+    document_index index(doc);
+    
+    ensure_time_le(1000, ensure_eq(count_both(doc, index, "b a a a a a a a a a a x"), 0U));
+    ensure_eq(count_both(doc, index, "a a a a a a a a a a x"), 1U);
+    ensure_eq(count_both(doc, index, "> a > a a a > a x"), 1U);
+}
@@ -0,0 +1,134 @@
+/** \file
+ *  
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/all.hpp>
+
+#include "test.hpp"
+
+using namespace nginxconfig;
+using nginxconfig_test::parse_string;
+
+static const char server_names_file[] = R"(
+http {
+    server {
+        listen 80 default_server;
+        server_name example.org www.example.org;
+    }
+    server {
+        listen 80;
+        server_name *.example.org;
+    }
+    server {
+        listen 80;
+        server_name .example.net;
+    }
+    server {
+        listen 80;
+        server_name mail.*;
+    }
+    server {
+        listen 127.0.0.1:8080;
+        server_name ~^www\d+\.example\.com$ WWW.Example.org;
+    }
+    server {
+        listen 80;
+        server_name www.example.org;
+    }
+}
+)";
+
+static const ast_entry& server_at(const ast_entry& doc, std::size_t idx)
+{
+    std::size_t seen = 0;
+    for (const ast_entry& child : doc.children().at(1).children())
+    {
+        if (child.kind() == ast_entry_kind::complex && seen++ == idx)
+            return child;
+    }
+    throw std::out_of_range("server_at");
+}
+
+TEST(server_name_index_resolution_order)
+{
+    ast_entry doc = parse_string(server_names_file);
+    server_name_index index(doc);
+    
+    ensure(index.find("*:80", "www.example.org")  == &server_at(doc, 0));
+    ensure(index.find("*:80", "EXAMPLE.ORG.")     == &server_at(doc, 0));
+    ensure(index.find("*:80", "a.b.example.org")  == &server_at(doc, 1));
+    ensure(index.find("*:80", "example.net")      == &server_at(doc, 2));
+    ensure(index.find("*:80", "x.example.net")    == &server_at(doc, 2));
+    ensure(index.find("*:80", "mail.example.com") == &server_at(doc, 3));
+    ensure(index.find("*:80", "www7.example.com") == nullptr);
+    ensure(index.find("127.0.0.1:8080", "www7.example.com") == &server_at(doc, 4));
+    ensure(index.find("127.0.0.1:8080", "www.example.org")  == &server_at(doc, 4));
+    ensure(index.find("www7.example.com") == &server_at(doc, 4));
+    ensure(index.find("nothing.invalid") == nullptr);
+    
+    ensure(index.default_server("*:80") == &server_at(doc, 0));
+    ensure(index.default_server("127.0.0.1:8080") == &server_at(doc, 4));
+    ensure(index.default_server("*:443") == nullptr);
+    ensure_eq(index.listen_groups().size(), 2U);
+}
+
+TEST(server_name_index_conflicts)
+{
+    ast_entry doc = parse_string(server_names_file);
+    server_name_index index(doc);
+    
+    ensure_eq(index.conflicts().size(), 1U);
+    const auto& conflict = index.conflicts().at(0);
+    ensure_eq(conflict.listen, "*:80");
+    ensure_eq(conflict.name, "www.example.org");
+    ensure(conflict.first == &server_at(doc, 0));
+    ensure(conflict.second == &server_at(doc, 5));
+}
+
+static const char pcre_names_file[] = R"(
+http {
+    server {
+        server_name ~^(?<sub>.+)\.example\.io$ ~^(?P<id>\d+)\.example\.net$;
+    }
+    server {
+        server_name "~(?i)^MAIL\.example\.com$";
+    }
+    server {
+        server_name ~^(?<=x)y\.example\.org$ plain.example.org;
+    }
+}
+)";
+
+TEST(server_name_index_pcre_names)
+{
+    ast_entry doc = parse_string(pcre_names_file);
+    server_name_index index(doc);
+
+    ensure(index.find("www.example.io") == &server_at(doc, 0));
+    ensure(index.find("42.example.net") == &server_at(doc, 0));
+    ensure(index.find("x.example.net") == nullptr);
+    ensure(index.find("mail.example.com") == &server_at(doc, 1));
+    ensure(index.find("plain.example.org") == &server_at(doc, 2));
+
+    ensure_eq(index.unindexables().size(), 1U);
+    const auto& bad = index.unindexables().at(0);
+    ensure_eq(bad.name, "~^(?<=x)y\\.example\\.org$");
+    ensure(bad.server == &server_at(doc, 2));
+    ensure(!bad.message.empty());
+}
+
+TEST(server_name_index_normalize_listen)
+{
+    ensure_eq(server_name_index::normalize_listen(ast_entry::make_simple("listen", { "443", "ssl" })), "*:443");
+    ensure_eq(server_name_index::normalize_listen(ast_entry::make_simple("listen", { "10.0.0.1" })), "10.0.0.1:80");
+    ensure_eq(server_name_index::normalize_listen(ast_entry::make_simple("listen", { "[::]:8080" })), "[::]:8080");
+    ensure_eq(server_name_index::normalize_listen(ast_entry::make_simple("listen", { "[::1]" })), "[::1]:80");
+    ensure_eq(server_name_index::normalize_listen(ast_entry::make_simple("listen", { "unix:/tmp/s" })), "unix:/tmp/s");
+    ensure_eq(server_name_index::normalize_listen(ast_entry::make_simple("listen")), "*:80");
+}
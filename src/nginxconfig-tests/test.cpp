@@ -10,11 +10,97 @@
 **/
 #include "test.hpp"
 
+#include <nginxconfig/parse.hpp>
+
+#include <cstdlib>
 #include <iostream>
+#include <new>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Allocation Counting                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Plain integers, so using them from operator new never needs dynamic initialization
+static thread_local std::uint64_t thread_allocation_count = 0;
+static thread_local std::uint64_t thread_allocation_bytes = 0;
+
+static void* counted_allocate(std::size_t size) noexcept
+{
+    ++thread_allocation_count;
+    thread_allocation_bytes += size;
+    nginxconfig::note_allocation(size);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new(std::size_t size)
+{
+    if (void* ptr = counted_allocate(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_allocate(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
 
 namespace nginxconfig_test
 {
 
+allocation_counts thread_allocations()
+{
+    return allocation_counts{ thread_allocation_count, thread_allocation_bytes };
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers                                                                                                            //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+nginxconfig::ast_entry parse_string(const std::string& source)
+{
+    return parse_string(source, nginxconfig::parse_options());
+}
+
+nginxconfig::ast_entry parse_string(const std::string& source, const nginxconfig::parse_options& options)
+{
+    std::istringstream stream(source);
+    return nginxconfig::parse(stream, options);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// unit_test                                                                                                          //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 unit_test_list_type& get_unit_tests()
 {
     static unit_test_list_type instance;
@@ -22,15 +108,29 @@ unit_test_list_type& get_unit_tests()
 }
 
 unit_test::unit_test(const std::string& name) :
-        _name(name)
+        _name(name),
+        _success(false),
+        _elapsed(0),
+        _allocations{ 0, 0 }
 {
     get_unit_tests().push_back(this);
 }
-    
+
 bool unit_test::run()
 {
-    std::cout << "TEST: " << _name << " ...";
+    std::cout << "TEST: " << _name << " ..." << std::flush;
+    run_quietly();
+    std::string line = result_line();
+    std::cout << line.substr(line.find("...") + 3) << std::endl;
+    return _success;
+}
+
+bool unit_test::run_quietly()
+{
     _success = true;
+    _failstring.clear();
+    allocation_counts before = thread_allocations();
+    auto start = std::chrono::steady_clock::now();
     try
     {
         run_impl();
@@ -45,11 +145,18 @@ bool unit_test::run()
         _success = false;
         _failstring = "Threw unknown exception";
     }
+    _elapsed = std::chrono::steady_clock::now() - start;
+    allocation_counts after = thread_allocations();
+    _allocations = allocation_counts{ after.count - before.count, after.bytes - before.bytes };
+    return _success;
+}
+
+std::string unit_test::result_line() const
+{
     if (_success)
-        std::cout << " SUCCESS!" << std::endl;
+        return "TEST: " + _name + " ... SUCCESS!";
     else
-        std::cout << " \x1b[0;31mFAILURE " << _failstring << "\x1b[m" << std::endl;
-    return _success;
+        return "TEST: " + _name + " ... \x1b[0;31mFAILURE " + _failstring + "\x1b[m";
 }
 
 }
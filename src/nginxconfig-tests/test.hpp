@@ -11,7 +11,12 @@
 #ifndef __TEST_NGINXTEST_TEST_HPP_INCLUDED__
 #define __TEST_NGINXTEST_TEST_HPP_INCLUDED__
 
+#include <nginxconfig/ast.hpp>
+#include <nginxconfig/parse.hpp>
+
 #include <cassert>
+#include <chrono>
+#include <cstdint>
 #include <deque>
 #include <sstream>
 #include <string>
@@ -24,6 +29,21 @@ class unit_test;
 typedef std::deque<unit_test*> unit_test_list_type;
 unit_test_list_type& get_unit_tests();
 
+/** Allocations made through \c operator \c new by the calling thread since it started. The test program replaces the
+ *  global \c operator \c new to count them (and also reports them to \c nginxconfig::note_allocation).
+**/
+struct allocation_counts
+{
+    std::uint64_t count;
+    std::uint64_t bytes;
+};
+
+allocation_counts thread_allocations();
+
+/** Parse the configuration in \a source, which is usually a string literal in the test. **/
+nginxconfig::ast_entry parse_string(const std::string& source);
+nginxconfig::ast_entry parse_string(const std::string& source, const nginxconfig::parse_options& options);
+
 #define ASSERT_ON_TEST_FAILURE 0
 #if ASSERT_ON_TEST_FAILURE
 #   define ensure assert
@@ -66,6 +86,67 @@ unit_test_list_type& get_unit_tests();
 #define ensure_gt(a_, b_) ensure_op(a_, > , b_)
 #define ensure_ge(a_, b_) ensure_op(a_, >=, b_)
 
+/** Ensure that performing \a action_ allocates at most \a max_ times on this thread. **/
+#if ASSERT_ON_TEST_FAILURE
+#   define ensure_allocs_le(max_, action_)                                                  \
+        do                                                                                  \
+        {                                                                                   \
+            auto before_ = ::nginxconfig_test::thread_allocations().count;                  \
+            action_;                                                                        \
+            assert(::nginxconfig_test::thread_allocations().count - before_ <= (max_));     \
+        } while (0)
+#else
+#   define ensure_allocs_le(max_, action_)                                                  \
+        do                                                                                  \
+        {                                                                                   \
+            auto before_ = ::nginxconfig_test::thread_allocations().count;                  \
+            action_;                                                                        \
+            auto count_ = ::nginxconfig_test::thread_allocations().count - before_;         \
+            if (count_ > std::uint64_t(max_))                                               \
+            {                                                                               \
+                this->_success = false;                                                     \
+                std::ostringstream ss;                                                      \
+                ss << #action_ << " allocated " << count_ << " times (allowed " << (max_)   \
+                   << ")";                                                                  \
+                this->_failstring = ss.str();                                               \
+                return;                                                                     \
+            }                                                                               \
+        } while (0)
+#endif
+
+/** Ensure that performing \a action_ takes at most \a max_ms_ milliseconds of wall time. Keep the limit generous: it is
+ *  meant to catch an algorithm getting slower by an order of magnitude, not to benchmark.
+**/
+#if ASSERT_ON_TEST_FAILURE
+#   define ensure_time_le(max_ms_, action_)                                                 \
+        do                                                                                  \
+        {                                                                                   \
+            auto start_ = std::chrono::steady_clock::now();                                 \
+            action_;                                                                        \
+            assert(std::chrono::steady_clock::now() - start_                                \
+                   <= std::chrono::milliseconds(max_ms_));                                  \
+        } while (0)
+#else
+#   define ensure_time_le(max_ms_, action_)                                                 \
+        do                                                                                  \
+        {                                                                                   \
+            auto start_ = std::chrono::steady_clock::now();                                 \
+            action_;                                                                        \
+            auto elapsed_ = std::chrono::duration_cast<std::chrono::milliseconds>(          \
+                                std::chrono::steady_clock::now() - start_                   \
+                            ).count();                                                      \
+            if (elapsed_ > (max_ms_))                                                       \
+            {                                                                               \
+                this->_success = false;                                                     \
+                std::ostringstream ss;                                                      \
+                ss << #action_ << " took " << elapsed_ << " ms (allowed " << (max_ms_)      \
+                   << " ms)";                                                               \
+                this->_failstring = ss.str();                                               \
+                return;                                                                     \
+            }                                                                               \
+        } while (0)
+#endif
+
 #define ensure_throws(extype_, action_)                              \
     do                                                               \
     {                                                                \
@@ -80,23 +161,47 @@ unit_test_list_type& get_unit_tests();
 
 class unit_test
 {
+public:
+    using duration = std::chrono::steady_clock::duration;
+    
 public:
     explicit unit_test(const std::string& name);
     
+    /** Run the test, printing its name before and the result after. **/
     bool run();
     
+    /** Run the test without printing anything. Use \c result_line to get what \c run would have printed. **/
+    bool run_quietly();
+    
+    /** The line describing the outcome of the last run, such as <tt>"TEST: name ... SUCCESS!"</tt>. **/
+    std::string result_line() const;
+    
     const std::string& name() const
     {
         return _name;
     }
     
+    /** Wall time of the last run. **/
+    duration elapsed() const
+    {
+        return _elapsed;
+    }
+    
+    /** Allocations made by the thread running the test during the last run. **/
+    const allocation_counts& allocations() const
+    {
+        return _allocations;
+    }
+    
 private:
     virtual void run_impl() = 0;
     
 protected:
-    std::string _name;
-    bool        _success;
-    std::string _failstring;
+    std::string       _name;
+    bool              _success;
+    std::string       _failstring;
+    duration          _elapsed;
+    allocation_counts _allocations;
 };
 
 #define TEST(name_)                                \
@@ -12,8 +12,11 @@
 #include <nginxconfig/encode.hpp>
 
 #include <algorithm>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <tuple>
+#include <unordered_map>
 
 namespace nginxconfig
 {
@@ -72,41 +75,297 @@ kind_error::~kind_error() noexcept = default;
 // ast_entry                                                                                                          //
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+namespace
+{
+
+/** Counts the changes to entries which can make the index of their parent wrong without the parent knowing: renames
+ *  and assignments. An entry does not know its parent, so an index is only trusted while this is still what it was
+ *  when the index was built.
+**/
+std::atomic<std::uint64_t> entry_changes(0);
+
+void note_entry_change() noexcept
+{
+    entry_changes.fetch_add(1, std::memory_order_relaxed);
+}
+
+}
+
+/** The positions of the children of an entry, grouped by name. **/
+class ast_entry::name_index
+{
+public:
+    explicit name_index(const child_list& children) :
+            size(children.size()),
+            generation(entry_changes.load(std::memory_order_relaxed))
+    {
+        for (size_type idx = 0; idx < children.size(); ++idx)
+        {
+            const ast_entry& child = children[idx];
+            if (child.kind() == ast_entry_kind::simple || child.kind() == ast_entry_kind::complex)
+                positions[child.name()].push_back(idx);
+        }
+    }
+    
+    const std::vector<size_type>* find(const std::string& name) const
+    {
+        auto iter = positions.find(name);
+        return iter == positions.end() ? nullptr : &iter->second;
+    }
+    
+    /** Does this still describe \a children? Adding or removing children through a kept reference changes their
+     *  number; renaming or replacing one changes \c entry_changes.
+    **/
+    bool describes(const child_list& children) const
+    {
+        return children.size() == size && generation == entry_changes.load(std::memory_order_relaxed);
+    }
+    
+    /** The bytes allocated for this index and the one it replaced. **/
+    std::size_t memory_usage() const noexcept
+    {
+        return replaced ? own_bytes() + replaced->own_bytes() : own_bytes();
+    }
+    
+    /** The index this one replaced when it was found to be stale. A lookup which read the old index just before that
+     *  might still be reading it, so it is kept until this one is replaced in turn.
+    **/
+    std::unique_ptr<name_index> replaced;
+    
+private:
+    /** The bytes allocated for this index alone. The layout of the nodes of an \c std::unordered_map is not visible,
+     *  so with libstdc++ it is the one it uses (the link to the next node, the value and the cached hash, with a single
+     *  bucket kept inside of the table itself) and elsewhere it is estimated as a link and the value.
+    **/
+    std::size_t own_bytes() const noexcept
+    {
+        std::size_t bytes = sizeof *this;
+#if NGINXCONFIG_USE_LIBSTDCXX_INTERNALS
+        const std::size_t node_bytes = sizeof(void*) + sizeof(decltype(positions)::value_type) + sizeof(std::size_t);
+        if (positions.bucket_count() > 1)
+            bytes += positions.bucket_count() * sizeof(void*);
+#else
+        const std::size_t node_bytes = sizeof(void*) + sizeof(decltype(positions)::value_type);
+        bytes += positions.bucket_count() * sizeof(void*);
+#endif
+        for (const auto& entry : positions)
+        {
+            bytes += node_bytes;
+            // a string keeps short text inside of itself
+            const char* text = entry.first.data();
+            const char* self = reinterpret_cast<const char*>(&entry.first);
+            if (text < self || text >= self + sizeof entry.first)
+                bytes += entry.first.capacity() + 1;
+            bytes += entry.second.capacity() * sizeof(size_type);
+        }
+        return bytes;
+    }
+    
+private:
+    size_type                                               size;
+    std::uint64_t                                           generation;
+    std::unordered_map<std::string, std::vector<size_type>> positions;
+};
+
+/** The loader of children given to \c defer_children and whether it was used yet. **/
+class ast_entry::deferred_children
+{
+public:
+    explicit deferred_children(std::shared_ptr<const child_loader> loader_) :
+            loader(std::move(loader_)),
+            loaded(false)
+    { }
+    
+    std::shared_ptr<const child_loader> loader;
+    std::mutex                          mutex;
+    std::atomic<bool>                   loaded;
+};
+
+ast_entry::child_loader::~child_loader() noexcept = default;
+
 ast_entry::ast_entry(ast_entry_kind kind_) :
-        _kind(kind_)
+        _kind(kind_),
+        _blank_lines_before(0),
+        _index(nullptr),
+        _deferred(nullptr)
 { }
 
-ast_entry::ast_entry(const ast_entry&) = default;
-ast_entry& ast_entry::operator=(const ast_entry&) = default;
+ast_entry::ast_entry(const ast_entry& src) :
+        _kind(src._kind),
+        _blank_lines_before(src._blank_lines_before),
+        _name(src._name),
+        _attributes(src._attributes),
+        _comment(src._comment),
+        _source(src._source),
+        _index(nullptr),
+        _deferred(nullptr)
+{
+    copy_children(src);
+}
+
+ast_entry& ast_entry::operator=(const ast_entry& src)
+{
+    if (this != &src)
+    {
+        note_entry_change();
+        reset_index();
+        reset_deferred();
+        _kind = src._kind;
+        _blank_lines_before = src._blank_lines_before;
+        _name = src._name;
+        _attributes = src._attributes;
+        copy_children(src);
+        _comment = src._comment;
+        _source = src._source;
+    }
+    return *this;
+}
 
 ast_entry::ast_entry(ast_entry&& src) noexcept :
         _kind(src._kind),
+        _blank_lines_before(src._blank_lines_before),
         _name(std::move(src._name)),
         _attributes(std::move(src._attributes)),
         _children(std::move(src._children)),
-        _comment(std::move(src._comment))
+        _comment(std::move(src._comment)),
+        _source(src._source),
+        _index(src._index.exchange(nullptr)),
+        _deferred(src._deferred.exchange(nullptr))
 { }
 
 ast_entry& ast_entry::operator=(ast_entry&& src) noexcept
 {
+    note_entry_change();
+    reset_index();
+    reset_deferred();
     _kind = src._kind;
+    _blank_lines_before = src._blank_lines_before;
     _name = std::move(src._name);
     _attributes = std::move(src._attributes);
     _children = std::move(src._children);
     _comment = std::move(src._comment);
+    _source = src._source;
+    _index.store(src._index.exchange(nullptr));
+    _deferred.store(src._deferred.exchange(nullptr));
     return *this;
 }
 
-ast_entry::~ast_entry() noexcept = default;
+ast_entry::~ast_entry() noexcept
+{
+    reset_index();
+    reset_deferred();
+}
 
 void swap(ast_entry& a, ast_entry& b) noexcept
 {
     using std::swap;
+    note_entry_change();
     swap(a._kind, b._kind);
+    swap(a._blank_lines_before, b._blank_lines_before);
     swap(a._name, b._name);
     swap(a._attributes, b._attributes);
     swap(a._children, b._children);
     swap(a._comment, b._comment);
+    swap(a._source, b._source);
+    a._index.store(b._index.exchange(a._index.load()));
+    a._deferred.store(b._deferred.exchange(a._deferred.load()));
+}
+
+void ast_entry::reset_deferred() noexcept
+{
+    if (_deferred.load(std::memory_order_relaxed))
+        delete _deferred.exchange(nullptr);
+}
+
+std::size_t ast_entry::index_bytes() const noexcept
+{
+    std::size_t bytes = 0;
+    if (const name_index* index = _index.load(std::memory_order_acquire))
+        bytes += index->memory_usage();
+    if (_deferred.load(std::memory_order_acquire))
+        bytes += sizeof(deferred_children);
+    return bytes;
+}
+
+void ast_entry::load_children() const
+{
+    deferred_children* deferred = _deferred.load(std::memory_order_acquire);
+    if (!deferred || deferred->loaded.load(std::memory_order_acquire))
+        return;
+    
+    std::lock_guard<std::mutex> lock(deferred->mutex);
+    if (!deferred->loaded.load(std::memory_order_relaxed))
+    {
+        _children = deferred->loader->load(*this);
+        deferred->loaded.store(true, std::memory_order_release);
+    }
+}
+
+void ast_entry::copy_children(const ast_entry& src)
+{
+    // Another thread might be loading the children of src right now, but they are only read once they are loaded
+    deferred_children* deferred = src._deferred.load(std::memory_order_acquire);
+    if (deferred && !deferred->loaded.load(std::memory_order_acquire))
+    {
+        _children.clear();
+        _deferred.store(new deferred_children(deferred->loader), std::memory_order_release);
+    }
+    else
+    {
+        _children = src._children;
+    }
+}
+
+void ast_entry::reset_index() noexcept
+{
+    if (_index.load(std::memory_order_relaxed))
+        delete _index.exchange(nullptr);
+}
+
+const std::vector<ast_entry::size_type>* ast_entry::positions_of(const std::string& name_) const
+{
+    const name_index* current = &index();
+    if (current->describes(_children))
+        return current->find(name_);
+    
+    // The children were changed through a reference kept from an earlier call to the non-const children, or an entry
+    // somewhere was renamed or assigned to
+    name_index* stale   = const_cast<name_index*>(current);
+    name_index* created = new name_index(_children);
+    created->replaced.reset(stale);
+    if (_index.compare_exchange_strong(stale, created, std::memory_order_acq_rel, std::memory_order_acquire))
+    {
+        // Changing the children while a lookup runs is not allowed, so a lookup still reading an older index than the
+        // one just replaced would have had to start before the change which made that one stale
+        created->replaced->replaced.reset();
+        current = created;
+    }
+    else
+    {
+        created->replaced.release();
+        delete created;
+        current = stale;
+    }
+    return current->find(name_);
+}
+
+const ast_entry::name_index& ast_entry::index() const
+{
+    name_index* current = _index.load(std::memory_order_acquire);
+    if (current)
+        return *current;
+    
+    // Multiple readers might race to build the index -- the loser throws theirs away
+    name_index* created = new name_index(children());
+    if (_index.compare_exchange_strong(current, created, std::memory_order_acq_rel, std::memory_order_acquire))
+    {
+        return *created;
+    }
+    else
+    {
+        delete created;
+        return *current;
+    }
 }
 
 ast_entry ast_entry::make_complex(std::string    name,
@@ -115,7 +374,7 @@ ast_entry ast_entry::make_complex(std::string    name,
                                  )
 {
     ast_entry out(ast_entry_kind::complex);
-    out.name()       = std::move(name);
+    out._name        = std::move(name);
     out.attributes() = std::move(attributes);
     out.children()   = std::move(children);
     return out;
@@ -134,7 +393,7 @@ ast_entry ast_entry::make_simple(std::string    name,
                                 )
 {
     ast_entry out(ast_entry_kind::simple);
-    out.name()       = std::move(name);
+    out._name        = std::move(name);
     out.attributes() = std::move(attributes);
     out.comment()    = std::move(comment_text);
     return out;
@@ -167,15 +426,58 @@ ast_entry::attribute_list& ast_entry::attributes()
 const ast_entry::child_list& ast_entry::children() const
 {
     check_kind({ ast_entry_kind::complex, ast_entry_kind::document }, kind());
+    load_children();
     return _children;
 }
 
 ast_entry::child_list& ast_entry::children()
 {
     check_kind({ ast_entry_kind::complex, ast_entry_kind::document }, kind());
+    load_children();
+    reset_deferred();
+    reset_index();
     return _children;
 }
 
+void ast_entry::defer_children(std::shared_ptr<const child_loader> loader)
+{
+    check_kind({ ast_entry_kind::complex, ast_entry_kind::document }, kind());
+    reset_index();
+    reset_deferred();
+    _children.clear();
+    _deferred.store(new deferred_children(std::move(loader)), std::memory_order_release);
+}
+
+bool ast_entry::children_loaded() const
+{
+    deferred_children* deferred = _deferred.load(std::memory_order_acquire);
+    return !deferred || deferred->loaded.load(std::memory_order_acquire);
+}
+
+const ast_entry* ast_entry::find(const std::string& name_) const
+{
+    const std::vector<size_type>* positions = positions_of(name_);
+    return positions ? &_children[positions->front()] : nullptr;
+}
+
+std::vector<const ast_entry*> ast_entry::find_all(const std::string& name_) const
+{
+    std::vector<const ast_entry*> out;
+    if (const std::vector<size_type>* positions = positions_of(name_))
+    {
+        out.reserve(positions->size());
+        for (size_type idx : *positions)
+            out.push_back(&_children[idx]);
+    }
+    return out;
+}
+
+ast_entry::size_type ast_entry::count(const std::string& name_) const
+{
+    const std::vector<size_type>* positions = positions_of(name_);
+    return positions ? positions->size() : 0;
+}
+
 const std::string& ast_entry::comment() const
 {
     check_kind({ ast_entry_kind::comment, ast_entry_kind::simple, ast_entry_kind::complex }, kind());
@@ -197,6 +499,7 @@ const std::string& ast_entry::name() const
 std::string& ast_entry::name()
 {
     check_kind({ ast_entry_kind::complex, ast_entry_kind::simple }, kind());
+    note_entry_change();
     return _name;
 }
 
@@ -205,11 +508,15 @@ std::string& ast_entry::name()
 
 bool ast_entry::operator==(const ast_entry& other) const
 {
+    load_children();
+    other.load_children();
     return NGINXCONFIG_AST_ENTRY_TIE_TUPLE(*this) == NGINXCONFIG_AST_ENTRY_TIE_TUPLE(other);
 }
 
 bool ast_entry::operator!=(const ast_entry& other) const
 {
+    load_children();
+    other.load_children();
     return NGINXCONFIG_AST_ENTRY_TIE_TUPLE(*this) != NGINXCONFIG_AST_ENTRY_TIE_TUPLE(other);
 }
 
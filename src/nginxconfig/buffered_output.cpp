@@ -0,0 +1,79 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/buffered_output.hpp>
+
+#include <ostream>
+
+namespace nginxconfig
+{
+
+constexpr buffered_output::size_type buffered_output::min_buffer_size;
+
+buffered_output::buffered_output(std::ostream& output, size_type buffer_size) :
+        _output(output),
+        _buffer(new char[buffer_size < min_buffer_size ? min_buffer_size : buffer_size]),
+        _end(_buffer.get()),
+        _limit(_buffer.get() + (buffer_size < min_buffer_size ? min_buffer_size : buffer_size))
+{ }
+
+buffered_output::~buffered_output() noexcept
+{
+    try
+    {
+        drain();
+    }
+    catch (...)
+    { }
+}
+
+void buffered_output::put_integer(unsigned long long value, bool negative)
+{
+    char  digits[24];
+    char* first = digits + sizeof digits;
+    do
+    {
+        *--first = char('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    if (negative)
+        *--first = '-';
+    put(first, size_type(digits + sizeof digits - first));
+}
+
+void buffered_output::put_slow(const char* text, size_type length)
+{
+    drain();
+    if (length < size_type(_limit - _end))
+    {
+        std::memcpy(_end, text, length);
+        _end += length;
+    }
+    else
+    {
+        // longer than the whole buffer, so copying it there first would not save anything
+        _output.write(text, std::streamsize(length));
+    }
+}
+
+void buffered_output::drain()
+{
+    if (_end != _buffer.get())
+        _output.write(_buffer.get(), _end - _buffer.get());
+    _end = _buffer.get();
+}
+
+void buffered_output::flush()
+{
+    drain();
+    _output.flush();
+}
+
+}
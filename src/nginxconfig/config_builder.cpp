@@ -0,0 +1,79 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/config_builder.hpp>
+
+#include <cassert>
+#include <exception>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+
+namespace nginxconfig
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// config_builder                                                                                                     //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+constexpr config_builder::size_type config_builder::default_buffer_size;
+
+config_builder::config_builder(std::ostream& output) :
+        config_builder(output, "  ")
+{ }
+
+config_builder::config_builder(std::ostream& output, std::string indent, size_type buffer_size) :
+        _out(output, buffer_size),
+        _indent(std::move(indent)),
+        _depth(0)
+{ }
+
+config_builder::~config_builder() noexcept
+{
+    assert((_depth == 0 || std::uncaught_exception()) && "config_builder destroyed with open blocks");
+}
+
+config_builder& config_builder::end()
+{
+    if (_depth == 0)
+        throw std::logic_error("config_builder::end called with no open block");
+    --_depth;
+    write_indent();
+    put("}\n", 2);
+    return *this;
+}
+
+config_builder& config_builder::blank_line()
+{
+    put('\n');
+    return *this;
+}
+
+void config_builder::flush()
+{
+    _out.flush();
+}
+
+void config_builder::finish()
+{
+    if (_depth != 0)
+        throw std::logic_error("config_builder::finish called with " + std::to_string(_depth) + " open blocks");
+    flush();
+    if (!_out.output())
+        throw std::ios_base::failure("Failed to write configuration");
+}
+
+void config_builder::write_indent()
+{
+    for (size_type x = 0; x < _depth; ++x)
+        put(_indent);
+}
+
+}
@@ -0,0 +1,181 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/ast.hpp>
+#include <nginxconfig/config_handle.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace nginxconfig
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// config_handle                                                                                                      //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// All operations on _current, _epoch and the slot epochs are sequentially consistent. The reader announces the epoch
+// it saw before loading _current and the writer replaces _current before advancing the epoch, so a reader which
+// loaded an old node is always pinned at or before the epoch that node was retired in.
+
+static void check_document(const config_handle::document_ptr& doc)
+{
+    if (!doc)
+        throw std::invalid_argument("Can not publish a null document");
+}
+
+config_handle::config_handle(document_ptr initial) :
+        _current(nullptr),
+        _epoch(1)
+{
+    check_document(initial);
+    _current.store(new node{ std::move(initial), 1, 0 });
+}
+
+config_handle::~config_handle() noexcept
+{
+    delete _current.load();
+    for (node* n : _retired)
+        delete n;
+}
+
+config_handle::epoch_type config_handle::publish(document_ptr next)
+{
+    check_document(next);
+
+    std::unique_lock<std::mutex> lock(_protect);
+    epoch_type generation_ = _current.load()->generation + 1;
+    node* old = _current.exchange(new node{ std::move(next), generation_, 0 });
+    old->retired = _epoch.fetch_add(1);
+    _retired.push_back(old);
+    reclaim_locked();
+    return generation_;
+}
+
+config_handle::document_ptr config_handle::load() const
+{
+    std::unique_lock<std::mutex> lock(_protect);
+    return _current.load()->document;
+}
+
+config_handle::epoch_type config_handle::generation() const
+{
+    std::unique_lock<std::mutex> lock(_protect);
+    return _current.load()->generation;
+}
+
+std::size_t config_handle::reclaim()
+{
+    std::unique_lock<std::mutex> lock(_protect);
+    return reclaim_locked();
+}
+
+std::size_t config_handle::reclaim_locked()
+{
+    if (_retired.empty())
+        return 0;
+
+    epoch_type oldest_pin = _epoch.load();
+    for (const slot& s : _slots)
+    {
+        epoch_type pinned = s.epoch.load();
+        if (pinned != 0)
+            oldest_pin = std::min(oldest_pin, pinned);
+    }
+
+    auto keep_end = std::partition(_retired.begin(), _retired.end(),
+                                   [oldest_pin] (const node* n) { return n->retired >= oldest_pin; }
+                                  );
+    for (auto iter = keep_end; iter != _retired.end(); ++iter)
+        delete *iter;
+    _retired.erase(keep_end, _retired.end());
+    return _retired.size();
+}
+
+config_handle::slot* config_handle::acquire_slot()
+{
+    std::unique_lock<std::mutex> lock(_protect);
+    for (slot& s : _slots)
+    {
+        if (!s.in_use)
+        {
+            s.in_use = true;
+            return &s;
+        }
+    }
+
+    _slots.emplace_back();
+    slot& s = _slots.back();
+    s.epoch.store(0);
+    s.in_use = true;
+    return &s;
+}
+
+void config_handle::release_slot(slot* s)
+{
+    std::unique_lock<std::mutex> lock(_protect);
+    s->epoch.store(0);
+    s->in_use = false;
+    reclaim_locked();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// config_handle::reader                                                                                              //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+config_handle::reader::reader(config_handle& handle) :
+        _handle(handle),
+        _slot(handle.acquire_slot()),
+        _pins(0)
+{ }
+
+config_handle::reader::~reader() noexcept
+{
+    _handle.release_slot(_slot);
+}
+
+config_handle::snapshot config_handle::reader::pin()
+{
+    // Nested pins keep the epoch of the outermost one, which still protects anything retired after it
+    if (_pins++ == 0)
+        _slot->epoch.store(_handle._epoch.load());
+    return snapshot(*this, _handle._current.load());
+}
+
+void config_handle::reader::unpin() noexcept
+{
+    if (--_pins == 0)
+        _slot->epoch.store(0, std::memory_order_release);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// config_handle::snapshot                                                                                            //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+config_handle::snapshot::snapshot(reader& owner, const node* n) :
+        _owner(&owner),
+        _node(n)
+{ }
+
+config_handle::snapshot::snapshot(snapshot&& src) noexcept :
+        _owner(src._owner),
+        _node(src._node)
+{
+    src._owner = nullptr;
+    src._node  = nullptr;
+}
+
+config_handle::snapshot::~snapshot() noexcept
+{
+    if (_owner)
+        _owner->unpin();
+}
+
+}
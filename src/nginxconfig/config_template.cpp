@@ -0,0 +1,355 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/config_template.hpp>
+#include <nginxconfig/encode.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+namespace nginxconfig
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// parameter_table                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+parameter_table::parameter_table(size_type columns) :
+        _columns(columns),
+        _rows(0)
+{ }
+
+template <typename TIter>
+void parameter_table::add_row(TIter first, TIter last)
+{
+    if (size_type(std::distance(first, last)) != _columns)
+        throw std::invalid_argument("Expected " + std::to_string(_columns) + " values in a row of parameters");
+    _values.insert(_values.end(), first, last);
+    ++_rows;
+}
+
+void parameter_table::add_row(const std::vector<std::string>& values)
+{
+    add_row(values.begin(), values.end());
+}
+
+void parameter_table::add_row(std::initializer_list<std::string> values)
+{
+    add_row(values.begin(), values.end());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Compilation                                                                                                        //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+using size_type = config_template::size_type;
+
+static constexpr size_type no_parameter = size_type(-1);
+
+/** Part of an attribute: either literal text or the value of a parameter. **/
+struct piece
+{
+    std::string literal;
+    size_type   parameter;
+};
+
+/** An attribute with placeholders in it. **/
+struct attribute_slot
+{
+    size_type          index;
+    std::vector<piece> pieces;
+};
+
+/** How an entry of the pattern becomes part of an instance. **/
+struct template_node
+{
+    const ast_entry*                               pattern = nullptr;
+    /** Set if there is a placeholder in this entry or anywhere inside of it. **/
+    bool                                           varies  = false;
+    std::vector<attribute_slot>                    slots;
+    /** For a \c complex or \c document entry which \c varies, one for each child. **/
+    std::vector<template_node>                     children;
+    /** For a \c complex entry which does not vary, the loader all instances share for its children. **/
+    std::shared_ptr<const ast_entry::child_loader> shared;
+};
+
+/** Copies the children of an entry of the pattern. It keeps the whole pattern alive. **/
+class shared_children :
+        public ast_entry::child_loader
+{
+public:
+    explicit shared_children(std::shared_ptr<const ast_entry> pattern) :
+            _pattern(std::move(pattern))
+    { }
+
+    virtual ast_entry::child_list load(const ast_entry&) const override
+    {
+        return _pattern->children();
+    }
+
+private:
+    std::shared_ptr<const ast_entry> _pattern;
+};
+
+bool is_name_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+/** Split \a attribute into pieces, adding parameters not seen yet to \a parameters. Returns \c false if there are no
+ *  placeholders in it.
+**/
+bool split_attribute(const std::string& attribute, std::vector<std::string>& parameters, std::vector<piece>& out)
+{
+    bool        found   = false;
+    std::string literal;
+    for (size_type pos = 0; pos < attribute.size(); )
+    {
+        size_type end = attribute[pos] == '@' ? attribute.find('@', pos + 1) : std::string::npos;
+        if (end == std::string::npos
+         || end == pos + 1
+         || !std::all_of(attribute.begin() + pos + 1, attribute.begin() + end, is_name_char)
+           )
+        {
+            literal.push_back(attribute[pos++]);
+            continue;
+        }
+
+        std::string name = attribute.substr(pos + 1, end - pos - 1);
+        auto iter = std::find(parameters.begin(), parameters.end(), name);
+        if (iter == parameters.end())
+            iter = parameters.insert(parameters.end(), std::move(name));
+
+        if (!literal.empty())
+            out.push_back(piece{ std::move(literal), no_parameter });
+        literal.clear();
+        out.push_back(piece{ std::string(), size_type(iter - parameters.begin()) });
+        found = true;
+        pos   = end + 1;
+    }
+    if (!literal.empty())
+        out.push_back(piece{ std::move(literal), no_parameter });
+    return found;
+}
+
+void compile_node(const std::shared_ptr<const ast_entry>& root,
+                  const ast_entry&                        entry,
+                  std::vector<std::string>&               parameters,
+                  template_node&                          node
+                 )
+{
+    node.pattern = &entry;
+    if (entry.kind() == ast_entry_kind::simple || entry.kind() == ast_entry_kind::complex)
+    {
+        for (size_type idx = 0; idx < entry.attributes().size(); ++idx)
+        {
+            attribute_slot slot;
+            slot.index = idx;
+            if (split_attribute(entry.attributes()[idx], parameters, slot.pieces))
+                node.slots.push_back(std::move(slot));
+        }
+    }
+    node.varies = !node.slots.empty();
+
+    if (entry.kind() == ast_entry_kind::complex || entry.kind() == ast_entry_kind::document)
+    {
+        const ast_entry::child_list& children = entry.children();
+        node.children.resize(children.size());
+        for (size_type idx = 0; idx < children.size(); ++idx)
+        {
+            compile_node(root, children[idx], parameters, node.children[idx]);
+            node.varies = node.varies || node.children[idx].varies;
+        }
+
+        if (!node.varies)
+        {
+            node.children.clear();
+            if (entry.kind() == ast_entry_kind::complex)
+                node.shared = std::make_shared<shared_children>(std::shared_ptr<const ast_entry>(root, &entry));
+        }
+    }
+}
+
+void substitute(const attribute_slot& slot, const parameter_table& values, size_type row, std::string& out)
+{
+    out.clear();
+    for (const piece& part : slot.pieces)
+    {
+        if (part.parameter == no_parameter)
+            out += part.literal;
+        else
+            out += values.at(row, part.parameter);
+    }
+}
+
+ast_entry instantiate_node(const template_node& node, const parameter_table& values, size_type row)
+{
+    const ast_entry& pattern = *node.pattern;
+    if (!node.varies && !node.shared)
+        return pattern;
+
+    ast_entry out = pattern.kind() == ast_entry_kind::document ? ast_entry::make_document()
+                  : pattern.kind() == ast_entry_kind::simple   ? ast_entry::make_simple(pattern.name(),
+                                                                                        pattern.attributes(),
+                                                                                        pattern.comment()
+                                                                                       )
+                  :                                              ast_entry::make_complex(pattern.name(),
+                                                                                         pattern.attributes()
+                                                                                        );
+    if (pattern.kind() == ast_entry_kind::complex)
+        out.comment() = pattern.comment();
+    out.blank_lines_before() = pattern.blank_lines_before();
+
+    for (const attribute_slot& slot : node.slots)
+        substitute(slot, values, row, out.attributes()[slot.index]);
+
+    if (node.shared)
+    {
+        out.defer_children(node.shared);
+    }
+    else if (!node.children.empty())
+    {
+        ast_entry::child_list& children = out.children();
+        for (const template_node& child : node.children)
+            children.emplace_back(instantiate_node(child, values, row));
+    }
+    return out;
+}
+
+/** Find the attributes of \a entry (a copy of the pattern) which \a node says have placeholders. **/
+void collect_slots(const template_node&                                             node,
+                   ast_entry&                                                       entry,
+                   std::vector<std::pair<std::string*, const attribute_slot*>>& out
+                  )
+{
+    for (const attribute_slot& slot : node.slots)
+        out.emplace_back(&entry.attributes()[slot.index], &slot);
+    for (size_type idx = 0; idx < node.children.size(); ++idx)
+        collect_slots(node.children[idx], entry.children()[idx], out);
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// config_template                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class config_template::compiled
+{
+public:
+    std::shared_ptr<const ast_entry> pattern;
+    std::vector<std::string>         parameters;
+    template_node                    root;
+
+public:
+    void check_columns(const parameter_table& values) const
+    {
+        if (values.columns() != parameters.size())
+            throw std::invalid_argument("Template has " + std::to_string(parameters.size()) + " parameters, but the "
+                                        "table has " + std::to_string(values.columns()) + " columns"
+                                       );
+    }
+};
+
+config_template::config_template(ast_entry pattern_)
+{
+    if (pattern_.kind() == ast_entry_kind::simple || pattern_.kind() == ast_entry_kind::comment)
+        throw kind_error("A template must be a complex entry or a document");
+
+    std::shared_ptr<compiled> out = std::make_shared<compiled>();
+    out->pattern = std::make_shared<const ast_entry>(std::move(pattern_));
+    compile_node(out->pattern, *out->pattern, out->parameters, out->root);
+    _compiled = std::move(out);
+}
+
+config_template::~config_template() noexcept = default;
+
+const ast_entry& config_template::pattern() const
+{
+    return *_compiled->pattern;
+}
+
+const std::vector<std::string>& config_template::parameters() const
+{
+    return _compiled->parameters;
+}
+
+config_template::size_type config_template::parameter_index(const std::string& name) const
+{
+    const std::vector<std::string>& params = _compiled->parameters;
+    auto iter = std::find(params.begin(), params.end(), name);
+    if (iter == params.end())
+        throw std::out_of_range("Template has no parameter \"" + name + "\"");
+    return size_type(iter - params.begin());
+}
+
+ast_entry config_template::instantiate(const parameter_table& values, size_type row) const
+{
+    _compiled->check_columns(values);
+    if (row >= values.rows())
+        throw std::out_of_range("Row " + std::to_string(row) + " is not in the table");
+    return instantiate_node(_compiled->root, values, row);
+}
+
+ast_entry config_template::instantiate(const parameter_table& values) const
+{
+    _compiled->check_columns(values);
+    ast_entry out = ast_entry::make_document();
+    ast_entry::child_list& children = out.children();
+    for (size_type row = 0; row < values.rows(); ++row)
+    {
+        ast_entry instance = instantiate_node(_compiled->root, values, row);
+        if (instance.kind() == ast_entry_kind::document)
+        {
+            for (ast_entry& child : instance.children())
+                children.emplace_back(std::move(child));
+        }
+        else
+        {
+            children.emplace_back(std::move(instance));
+        }
+    }
+    return out;
+}
+
+void config_template::encode(const parameter_table& values, encoder& output) const
+{
+    _compiled->check_columns(values);
+
+    // a single copy of the pattern has its placeholders replaced for every row; it is written as a document so it is
+    // indented the same as the instances in the document instantiate creates
+    const ast_entry& pattern = *_compiled->pattern;
+    ast_entry scratch = pattern.kind() == ast_entry_kind::document ? pattern : ast_entry::make_document({ pattern });
+    std::vector<std::pair<std::string*, const attribute_slot*>> slots;
+    collect_slots(_compiled->root,
+                  pattern.kind() == ast_entry_kind::document ? scratch : scratch.children().front(),
+                  slots
+                 );
+
+    for (size_type row = 0; row < values.rows(); ++row)
+    {
+        for (const auto& slot : slots)
+            substitute(*slot.second, values, row, *slot.first);
+        output.encode(scratch);
+    }
+}
+
+void config_template::encode(const parameter_table& values, std::ostream& output) const
+{
+    ostream_encoder encoder(output);
+    encode(values, encoder);
+}
+
+}
@@ -0,0 +1,810 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/crossplane.hpp>
+#include <nginxconfig/fingerprint.hpp>
+#include <nginxconfig/parse.hpp>
+
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <utility>
+
+#if NGINXCONFIG_USE_SSE2
+#   include <emmintrin.h>
+#endif
+
+namespace nginxconfig
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// String Escaping                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+/** Must \a c be escaped in a JSON string? Everything else, including the bytes of UTF-8 sequences, is copied. **/
+inline bool needs_escape(char c)
+{
+    return static_cast<unsigned char>(c) < 0x20 || c == '"' || c == '\\';
+}
+
+#if NGINXCONFIG_USE_SSE2
+
+/** The index of the lowest set bit of \a mask, which must not be 0. **/
+inline unsigned lowest_bit(unsigned mask)
+{
+#   if defined(__GNUC__)
+    return unsigned(__builtin_ctz(mask));
+#   else
+    unsigned idx = 0;
+    while (!(mask & 1U))
+    {
+        mask >>= 1;
+        ++idx;
+    }
+    return idx;
+#   endif
+}
+
+/** Find the first character in [\a first, \a last) which \c needs_escape, 16 at a time. The rest of the string, which
+ *  is shorter than that, is left to the caller: this returns \a last if the answer is not in the part it looked at.
+**/
+inline const char* find_escape(const char* first, const char* last)
+{
+    const __m128i quote     = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control   = _mm_set1_epi8(0x1f);
+
+    for (; last - first >= 16; first += 16)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+        // there is no unsigned comparison, but c <= 0x1f exactly when min(c, 0x1f) == c
+        __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                     _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk)
+                                    );
+        unsigned mask = unsigned(_mm_movemask_epi8(found));
+        if (mask != 0)
+            return first + lowest_bit(mask);
+    }
+    return first;
+}
+
+#endif
+
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// crossplane_encoder                                                                                                 //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+constexpr crossplane_encoder::size_type crossplane_encoder::default_buffer_size;
+
+crossplane_encoder::crossplane_encoder(std::ostream& output) :
+        crossplane_encoder(output, "nginx.conf")
+{ }
+
+crossplane_encoder::crossplane_encoder(std::ostream& output, std::string file, size_type buffer_size) :
+        // escapes are at most 6 characters, which fit in even the smallest buffer after a drain
+        _out(output, buffer_size),
+        _file(std::move(file)),
+        _separate(false)
+{ }
+
+crossplane_encoder::~crossplane_encoder() noexcept = default;
+
+void crossplane_encoder::flush()
+{
+    _out.flush();
+    if (!_out.output())
+        throw std::ios_base::failure("Failed to write crossplane JSON");
+}
+
+void crossplane_encoder::write_document_begin(const context& cxt, const ast_entry&)
+{
+    // a document inside of another one is just more entries of the same file
+    if (!cxt.path().empty())
+        return;
+
+    _out.put_literal("{\"status\":\"ok\",\"errors\":[],\"config\":[{\"file\":");
+    write_string(_file);
+    _out.put_literal(",\"status\":\"ok\",\"errors\":[],\"parsed\":[");
+    _separate = false;
+}
+
+void crossplane_encoder::write_document_end(const context& cxt, const ast_entry&)
+{
+    if (!cxt.path().empty())
+        return;
+
+    _out.put_literal("]}]}");
+    _separate = false;
+}
+
+void crossplane_encoder::write_simple(const context& cxt, const ast_entry& ast)
+{
+    write_directive(cxt, ast);
+    _out.put('}');
+    _separate = true;
+    // by itself, a simple entry is a single object, so there is nowhere for its comment to go
+    if (!ast.comment().empty() && !cxt.path().empty())
+        write_comment_object(cxt, ast.comment(), ast.source().line);
+}
+
+void crossplane_encoder::write_complex_begin(const context& cxt, const ast_entry& ast)
+{
+    write_directive(cxt, ast);
+    _out.put_literal(",\"block\":[");
+    _separate = false;
+    if (!ast.comment().empty())
+        write_comment_object(cxt, ast.comment(), ast.source().line);
+}
+
+void crossplane_encoder::write_complex_end(const context&, const ast_entry&)
+{
+    _out.put_literal("]}");
+    _separate = true;
+}
+
+void crossplane_encoder::write_comment(const context& cxt, const ast_entry& ast)
+{
+    // blank lines have no place in crossplane output
+    if (!ast.comment().empty())
+        write_comment_object(cxt, ast.comment(), ast.source().line);
+}
+
+void crossplane_encoder::write_directive(const context& cxt, const ast_entry& ast)
+{
+    put_separator(cxt);
+    _out.put_literal("{\"directive\":");
+    write_string(ast.name());
+    _out.put_literal(",\"line\":");
+    _out.put_integer(ast.source().line);
+    _out.put_literal(",\"args\":[");
+
+    // crossplane leaves out the parentheses around the condition of an if
+    const ast_entry::attribute_list& attributes = ast.attributes();
+    bool condition = ast.name() == "if";
+    bool first     = true;
+    for (ast_entry::size_type idx = 0; idx < attributes.size(); ++idx)
+    {
+        _scratch.clear();
+        append_attribute_value(attributes[idx], _scratch);
+        const char* value_begin = _scratch.data();
+        const char* value_end   = _scratch.data() + _scratch.size();
+        if (condition && idx == 0 && value_begin != value_end && *value_begin == '(')
+        {
+            ++value_begin;
+            if (value_begin == value_end)
+                continue;
+        }
+        if (condition && idx + 1 == attributes.size() && value_begin != value_end && value_end[-1] == ')')
+        {
+            --value_end;
+            if (value_begin == value_end)
+                continue;
+        }
+
+        if (!first)
+            _out.put(',');
+        first = false;
+        _out.put('"');
+        write_string_part(value_begin, value_end);
+        _out.put('"');
+    }
+    _out.put(']');
+}
+
+void crossplane_encoder::write_comment_object(const context&          cxt,
+                                              const std::string&      text,
+                                              source_range::size_type line
+                                             )
+{
+    put_separator(cxt);
+    _out.put_literal("{\"directive\":\"#\",\"line\":");
+    _out.put_integer(line);
+    _out.put_literal(",\"args\":[],\"comment\":");
+    write_string(text);
+    _out.put('}');
+    _separate = true;
+}
+
+void crossplane_encoder::put_separator(const context& cxt)
+{
+    // an entry encoded by itself is a single object, not part of a list
+    if (_separate && !cxt.path().empty())
+        _out.put(',');
+}
+
+void crossplane_encoder::write_string(const std::string& text)
+{
+    _out.put('"');
+    write_string_part(text.data(), text.data() + text.size());
+    _out.put('"');
+}
+
+void crossplane_encoder::write_string_part(const char* first, const char* last)
+{
+    static const char hex_digits[] = "0123456789abcdef";
+
+    // [run, cur) is the text which does not need escaping and has not been written yet
+    const char* run = first;
+    const char* cur = first;
+    while (true)
+    {
+#if NGINXCONFIG_USE_SSE2
+        cur = find_escape(cur, last);
+#endif
+        while (cur != last && !needs_escape(*cur))
+            ++cur;
+        if (cur == last)
+            break;
+
+        _out.put(run, size_type(cur - run));
+        char c = *cur;
+        run = ++cur;
+        switch (c)
+        {
+        case '"':  _out.put_literal("\\\""); break;
+        case '\\': _out.put_literal("\\\\"); break;
+        case '\n': _out.put_literal("\\n");  break;
+        case '\r': _out.put_literal("\\r");  break;
+        case '\t': _out.put_literal("\\t");  break;
+        case '\b': _out.put_literal("\\b");  break;
+        case '\f': _out.put_literal("\\f");  break;
+        default:
+            {
+                char escape[] = { '\\', 'u', '0', '0', hex_digits[(c >> 4) & 0xf], hex_digits[c & 0xf] };
+                _out.put(escape, sizeof escape);
+            }
+            break;
+        }
+    }
+    _out.put(run, size_type(last - run));
+}
+
+
+void encode_crossplane(const ast_entry& ast, std::ostream& output)
+{
+    crossplane_encoder encoder(output);
+    encoder.encode(ast);
+    encoder.flush();
+}
+
+void encode_crossplane(const ast_entry& ast, std::ostream& output, const std::string& file)
+{
+    crossplane_encoder encoder(output, file);
+    encoder.encode(ast);
+    encoder.flush();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Decoding                                                                                                           //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+crossplane_file::crossplane_file() :
+        document(ast_entry::make_document())
+{ }
+
+namespace
+{
+
+/** Reads crossplane JSON a buffer at a time, putting what it finds directly into entries. Members which do not matter
+ *  are checked to be valid JSON and skipped.
+**/
+class crossplane_reader
+{
+public:
+    using size_type = std::size_t;
+    using traits    = std::char_traits<char>;
+
+public:
+    static constexpr size_type buffer_size = 64 * 1024;
+
+public:
+    explicit crossplane_reader(std::istream& input) :
+            _input(*input.rdbuf()),
+            _buffer(new char[buffer_size]),
+            _pos(_buffer.get()),
+            _end(_buffer.get()),
+            _buffer_offset(0),
+            _line(1),
+            _line_begin(0),
+            _depth(0)
+    { }
+
+    std::vector<crossplane_file> payload()
+    {
+        std::vector<crossplane_file> files;
+        skip_space();
+        if (peek() == '[')
+        {
+            files.emplace_back();
+            read_block(files.back().document.children());
+        }
+        else
+        {
+            expect('{');
+            bool first = true;
+            while (more(first, '}'))
+            {
+                read_key();
+                if (_key == "config")
+                {
+                    expect('[');
+                    bool first_file = true;
+                    while (more(first_file, ']'))
+                    {
+                        files.emplace_back();
+                        read_file(files.back());
+                    }
+                }
+                else
+                {
+                    skip_value();
+                }
+            }
+        }
+
+        skip_space();
+        if (peek() != traits::eof())
+            fail("Unexpected text after the end of the JSON");
+        return files;
+    }
+
+    NGINXCONFIG_NO_RETURN void fail(const std::string& message) const
+    {
+        size_type character = _buffer_offset + size_type(_pos - _buffer.get());
+        throw parse_error(_line, character - _line_begin, character, message);
+    }
+
+private:
+    /** Read the next piece of the input into the buffer. Returns \c false at the end of the input. **/
+    bool refill()
+    {
+        _buffer_offset += size_type(_end - _buffer.get());
+        std::streamsize count = _input.sgetn(_buffer.get(), std::streamsize(buffer_size));
+        _pos = _buffer.get();
+        _end = _buffer.get() + (count > 0 ? count : 0);
+        return _pos != _end;
+    }
+
+    int peek()
+    {
+        if (_pos == _end && !refill())
+            return traits::eof();
+        return traits::to_int_type(*_pos);
+    }
+
+    int next()
+    {
+        int c = peek();
+        if (c == traits::eof())
+            return c;
+        ++_pos;
+        if (c == '\n')
+        {
+            ++_line;
+            _line_begin = _buffer_offset + size_type(_pos - _buffer.get());
+        }
+        return c;
+    }
+
+    void skip_space()
+    {
+        for (int c = peek(); c == ' ' || c == '\n' || c == '\t' || c == '\r'; c = peek())
+            next();
+    }
+
+    void expect(char expected)
+    {
+        skip_space();
+        if (peek() != traits::to_int_type(expected))
+            fail(std::string("Expected '") + expected + "'");
+        next();
+    }
+
+    /** Move to the next value of an array or member of an object, whose opening bracket has been read. Returns
+     *  \c false (after reading it) if the \a close bracket comes first.
+    **/
+    bool more(bool& first, char close)
+    {
+        skip_space();
+        if (peek() == traits::to_int_type(close))
+        {
+            next();
+            return false;
+        }
+        if (!first)
+            expect(',');
+        first = false;
+        return true;
+    }
+
+    /** Read the name of an object member and the \c : after it into \c _key. **/
+    void read_key()
+    {
+        read_string(_key);
+        expect(':');
+    }
+
+    void read_string(std::string& out)
+    {
+        expect('"');
+        out.clear();
+        while (true)
+        {
+            if (_pos == _end && !refill())
+                fail("Unterminated string");
+
+            // the characters which end a run of plain text are the ones the encoder escapes
+            const char* run = _pos;
+#if NGINXCONFIG_USE_SSE2
+            _pos = find_escape(_pos, _end);
+#endif
+            while (_pos != _end && !needs_escape(*_pos))
+                ++_pos;
+            out.append(run, _pos);
+            if (_pos == _end)
+                continue;
+
+            char c = *_pos;
+            if (c == '"')
+            {
+                ++_pos;
+                return;
+            }
+            else if (c == '\\')
+            {
+                ++_pos;
+                read_escape(out);
+            }
+            else
+            {
+                fail("Control characters must be escaped in strings");
+            }
+        }
+    }
+
+    void read_escape(std::string& out)
+    {
+        int c = next();
+        switch (c)
+        {
+        case '"':
+        case '\\':
+        case '/': out.push_back(char(c)); return;
+        case 'b': out.push_back('\b');    return;
+        case 'f': out.push_back('\f');    return;
+        case 'n': out.push_back('\n');    return;
+        case 'r': out.push_back('\r');    return;
+        case 't': out.push_back('\t');    return;
+        case 'u': break;
+        default:  fail("Invalid escape in string");
+        }
+
+        unsigned long code = read_hex4();
+        if (code >= 0xdc00 && code <= 0xdfff)
+            fail("Unpaired surrogate in string");
+        if (code >= 0xd800 && code <= 0xdbff)
+        {
+            if (next() != '\\' || next() != 'u')
+                fail("Unpaired surrogate in string");
+            unsigned long low = read_hex4();
+            if (low < 0xdc00 || low > 0xdfff)
+                fail("Unpaired surrogate in string");
+            code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+        }
+
+        if (code < 0x80)
+        {
+            out.push_back(char(code));
+        }
+        else if (code < 0x800)
+        {
+            out.push_back(char(0xc0 | (code >> 6)));
+            out.push_back(char(0x80 | (code & 0x3f)));
+        }
+        else if (code < 0x10000)
+        {
+            out.push_back(char(0xe0 | (code >> 12)));
+            out.push_back(char(0x80 | ((code >> 6) & 0x3f)));
+            out.push_back(char(0x80 | (code & 0x3f)));
+        }
+        else
+        {
+            out.push_back(char(0xf0 | (code >> 18)));
+            out.push_back(char(0x80 | ((code >> 12) & 0x3f)));
+            out.push_back(char(0x80 | ((code >> 6) & 0x3f)));
+            out.push_back(char(0x80 | (code & 0x3f)));
+        }
+    }
+
+    unsigned long read_hex4()
+    {
+        unsigned long code = 0;
+        for (int idx = 0; idx < 4; ++idx)
+        {
+            int c = next();
+            code <<= 4;
+            if (c >= '0' && c <= '9')
+                code |= unsigned(c - '0');
+            else if (c >= 'a' && c <= 'f')
+                code |= unsigned(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F')
+                code |= unsigned(c - 'A' + 10);
+            else
+                fail("Invalid \\u escape in string");
+        }
+        return code;
+    }
+
+    source_range::size_type read_line_number()
+    {
+        skip_space();
+        source_range::size_type value  = 0;
+        size_type               digits = 0;
+        for (int c = peek(); c >= '0' && c <= '9'; c = peek())
+        {
+            if (++digits > 18)
+                fail("Line number is too large");
+            value = value * 10 + source_range::size_type(c - '0');
+            next();
+        }
+        if (digits == 0)
+            fail("Expected a line number");
+        return value;
+    }
+
+    void skip_value()
+    {
+        skip_space();
+        int c = peek();
+        if (c == '"')
+        {
+            read_string(_skipped);
+        }
+        else if (c == '{')
+        {
+            enter();
+            next();
+            bool first = true;
+            while (more(first, '}'))
+            {
+                read_string(_skipped);
+                expect(':');
+                skip_value();
+            }
+            leave();
+        }
+        else if (c == '[')
+        {
+            enter();
+            next();
+            bool first = true;
+            while (more(first, ']'))
+                skip_value();
+            leave();
+        }
+        else if (c == '-' || (c >= '0' && c <= '9'))
+        {
+            for (c = peek(); c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E' || (c >= '0' && c <= '9');
+                 c = peek()
+                )
+                next();
+        }
+        else
+        {
+            _skipped.clear();
+            for (c = peek(); c >= 'a' && c <= 'z'; c = peek())
+                _skipped.push_back(char(next()));
+            if (_skipped != "true" && _skipped != "false" && _skipped != "null")
+                fail("Expected a value");
+        }
+    }
+
+    void read_file(crossplane_file& out)
+    {
+        expect('{');
+        bool first = true;
+        while (more(first, '}'))
+        {
+            read_key();
+            if (_key == "file")
+                read_string(out.file);
+            else if (_key == "parsed")
+                read_block(out.document.children());
+            else
+                skip_value();
+        }
+    }
+
+    void read_block(ast_entry::child_list& out)
+    {
+        enter();
+        expect('[');
+        bool first = true;
+        while (more(first, ']'))
+            read_directive(out);
+        leave();
+    }
+
+    /** Skipped values and blocks are read recursively, so input can only nest as deep as the text parser allows by
+     *  default.
+    **/
+    void enter()
+    {
+        if (++_depth > parse_options::default_max_depth)
+            fail("Nesting exceeds the maximum depth of " + std::to_string(parse_options::default_max_depth));
+    }
+
+    void leave()
+    {
+        --_depth;
+    }
+
+    /** Read a directive object and add it to \a out. **/
+    void read_directive(ast_entry::child_list& out)
+    {
+        std::string               name;
+        bool                      named = false;
+        source_range::size_type   line  = 0;
+        ast_entry::attribute_list args;
+        std::string               comment;
+        // only made for a block, since even an empty child_list allocates
+        std::unique_ptr<ast_entry::child_list> children;
+
+        expect('{');
+        bool first = true;
+        while (more(first, '}'))
+        {
+            read_key();
+            if (_key == "directive")
+            {
+                read_string(name);
+                named = true;
+            }
+            else if (_key == "line")
+            {
+                line = read_line_number();
+            }
+            else if (_key == "args")
+            {
+                expect('[');
+                bool first_arg = true;
+                while (more(first_arg, ']'))
+                {
+                    args.emplace_back();
+                    read_string(args.back());
+                }
+            }
+            else if (_key == "block")
+            {
+                children.reset(new ast_entry::child_list());
+                read_block(*children);
+            }
+            else if (_key == "comment")
+            {
+                read_string(comment);
+            }
+            else
+            {
+                skip_value();
+            }
+        }
+        if (!named)
+            fail("Directive object has no \"directive\"");
+
+        if (name == "#")
+        {
+            // a comment on the line of the simple entry before it came after that entry's ;
+            if (line != 0 && !out.empty())
+            {
+                ast_entry& previous = out.back();
+                if (previous.kind() == ast_entry_kind::simple
+                 && previous.source().line == line
+                 && previous.comment().empty()
+                   )
+                {
+                    previous.comment() = std::move(comment);
+                    return;
+                }
+            }
+            out.emplace_back(ast_entry::make_comment(std::move(comment)));
+            out.back().source().line = line;
+            return;
+        }
+
+        for (std::string& arg : args)
+        {
+            // most values are spelled as they are, which saves copying them
+            if (arg.empty() || arg.find_first_of(" \t\r\n;{}\"'#\\") != std::string::npos)
+                arg = quote_attribute(arg);
+        }
+        if (name == "if" && !args.empty())
+            restore_condition(args);
+
+        if (children)
+        {
+            // likewise for a comment after the { of a complex entry
+            ast_entry::child_list::iterator front = children->begin();
+            bool commented = line != 0
+                          && front != children->end()
+                          && front->kind() == ast_entry_kind::comment
+                          && front->source().line == line;
+            if (commented)
+                comment = std::move(front->comment());
+            out.emplace_back(ast_entry::make_complex(std::move(name), std::move(args), std::move(*children)));
+            if (commented)
+            {
+                out.back().children().pop_front();
+                out.back().comment() = std::move(comment);
+            }
+        }
+        else
+        {
+            out.emplace_back(ast_entry::make_simple(std::move(name), std::move(args)));
+        }
+        out.back().source().line = line;
+    }
+
+    /** Put the parentheses crossplane took away back around the condition of an \c if. A quoted argument keeps its
+     *  quotes, so it gets one of its own.
+    **/
+    static void restore_condition(ast_entry::attribute_list& args)
+    {
+        if (args.front().front() == '"')
+            args.emplace_front("(");
+        else
+            args.front().insert(0, 1, '(');
+
+        if (args.back().front() == '"')
+            args.emplace_back(")");
+        else
+            args.back().push_back(')');
+    }
+
+private:
+    std::streambuf&         _input;
+    std::unique_ptr<char[]> _buffer;
+    const char*             _pos;
+    const char*             _end;
+    /** The offset in the whole input of the start of \c _buffer. **/
+    size_type               _buffer_offset;
+    size_type               _line;
+    /** The offset in the whole input of the start of the current line. **/
+    size_type               _line_begin;
+    std::string             _key;
+    std::string             _skipped;
+    /** How many blocks and skipped arrays and objects the reader is inside of. **/
+    size_type               _depth;
+};
+
+}
+
+std::vector<crossplane_file> decode_crossplane_payload(std::istream& input)
+{
+    crossplane_reader reader(input);
+    return reader.payload();
+}
+
+ast_entry decode_crossplane(std::istream& input)
+{
+    crossplane_reader reader(input);
+    std::vector<crossplane_file> files = reader.payload();
+    if (files.size() != 1)
+        reader.fail("Expected crossplane JSON with one file, but it has " + std::to_string(files.size()));
+    return std::move(files.front().document);
+}
+
+}
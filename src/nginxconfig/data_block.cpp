@@ -0,0 +1,650 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/ast.hpp>
+#include <nginxconfig/data_block.hpp>
+#include <nginxconfig/regex.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+
+namespace nginxconfig
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers                                                                                                            //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool is_quote(char c)
+{
+    return c == '"' || c == '\'';
+}
+
+static int compare_icase(const char* a, std::size_t a_len, const char* b, std::size_t b_len)
+{
+    std::size_t len = std::min(a_len, b_len);
+    for (std::size_t idx = 0; idx < len; ++idx)
+    {
+        int ca = std::tolower(static_cast<unsigned char>(a[idx]));
+        int cb = std::tolower(static_cast<unsigned char>(b[idx]));
+        if (ca != cb)
+            return ca < cb ? -1 : 1;
+    }
+    return a_len == b_len ? 0 : a_len < b_len ? -1 : 1;
+}
+
+bool is_data_block(const ast_entry& entry)
+{
+    return entry.kind() == ast_entry_kind::complex
+        && (entry.name() == "map" || entry.name() == "geo" || entry.name() == "split_clients");
+}
+
+std::vector<const ast_entry*> find_data_blocks(const ast_entry& document)
+{
+    std::vector<const ast_entry*> out;
+    std::vector<std::pair<const ast_entry*, std::size_t>> stack = { { &document, 0 } };
+    while (!stack.empty())
+    {
+        auto& top = stack.back();
+        if (top.second == top.first->children().size())
+        {
+            stack.pop_back();
+            continue;
+        }
+
+        const ast_entry& child = top.first->children()[top.second++];
+        if (is_data_block(child))
+            out.push_back(&child);
+        else if (child.kind() == ast_entry_kind::complex)
+            stack.emplace_back(&child, 0);
+    }
+    return out;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// packed_block                                                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+packed_block::packed_block(const ast_entry& block) :
+        _name(block.name()),
+        _attributes(block.attributes().begin(), block.attributes().end()),
+        _comment(block.comment())
+{
+    const auto& children = block.children();
+    _rows.reserve(children.size());
+
+    auto add = [this] (const std::string& s) -> span
+               {
+                   if (_pool.size() + s.size() > std::numeric_limits<std::uint32_t>::max())
+                       throw std::invalid_argument("Data block is too large to pack");
+                   span out = { static_cast<std::uint32_t>(_pool.size()), static_cast<std::uint32_t>(s.size()) };
+                   _pool.append(s);
+                   return out;
+               };
+
+    for (const ast_entry& child : children)
+    {
+        row r;
+        r.first_token = static_cast<std::uint32_t>(_tokens.size());
+        r.is_comment  = child.kind() == ast_entry_kind::comment;
+        r.named       = false;
+        if (child.kind() == ast_entry_kind::simple)
+        {
+            r.named = !child.name().empty();
+            if (r.named)
+                _tokens.push_back(add(child.name()));
+            for (const std::string& attr : child.attributes())
+                _tokens.push_back(add(attr));
+        }
+        else if (!r.is_comment)
+        {
+            throw std::invalid_argument("Data block \"" + _name + "\" can not contain nested blocks");
+        }
+        r.comment     = add(child.comment());
+        r.token_count = static_cast<std::uint32_t>(_tokens.size() - r.first_token);
+        _rows.push_back(r);
+    }
+
+    _pool.shrink_to_fit();
+    _tokens.shrink_to_fit();
+}
+
+packed_block::~packed_block() noexcept = default;
+
+std::string packed_block::token(const row& r, size_type idx) const
+{
+    const span& s = token_span(r, idx);
+    return std::string(data(s), s.length);
+}
+
+std::string packed_block::value(const row& r, size_type idx) const
+{
+    const span& s = token_span(r, idx);
+    const char* p = data(s);
+    if (s.length >= 2 && is_quote(p[0]) && p[s.length - 1] == p[0])
+        return std::string(p + 1, s.length - 2);
+    else
+        return std::string(p, s.length);
+}
+
+ast_entry packed_block::to_entry() const
+{
+    ast_entry::child_list children;
+    for (const row& r : _rows)
+    {
+        std::string comment(data(r.comment), r.comment.length);
+        if (r.is_comment)
+        {
+            children.emplace_back(ast_entry::make_comment(std::move(comment)));
+            continue;
+        }
+
+        size_type idx = 0;
+        std::string name;
+        if (r.named)
+            name = token(r, idx++);
+        ast_entry::attribute_list attributes;
+        for ( ; idx < r.token_count; ++idx)
+            attributes.emplace_back(token(r, idx));
+        children.emplace_back(ast_entry::make_simple(std::move(name), std::move(attributes), std::move(comment)));
+    }
+
+    ast_entry out = ast_entry::make_complex(_name,
+                                            ast_entry::attribute_list(_attributes.begin(), _attributes.end()),
+                                            std::move(children)
+                                           );
+    out.comment() = _comment;
+    return out;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// map_table                                                                                                          //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const std::uint32_t no_row = ~std::uint32_t(0);
+
+class map_table::regex_list
+{
+public:
+    struct entry
+    {
+        regex_impl::regex expression;
+        std::uint32_t     row;
+    };
+
+    std::vector<entry> entries;
+};
+
+map_table::map_table(const ast_entry& block) :
+        packed_block(block),
+        _hostnames(false),
+        _default_row(no_row)
+{
+    if (_name != "map" || _attributes.size() != 2)
+        throw std::invalid_argument("Not a map block");
+
+    auto regexes = std::make_shared<regex_list>();
+    for (std::uint32_t idx = 0; idx < _rows.size(); ++idx)
+    {
+        const row& r = _rows[idx];
+        if (r.is_comment)
+            continue;
+
+        span key = token_span(r, 0);
+        if (key.length >= 2 && is_quote(data(key)[0]) && data(key)[key.length - 1] == data(key)[0])
+            key = { key.offset + 1, key.length - 2 };
+        std::string key_text(data(key), key.length);
+
+        if (r.token_count == 1 && (key_text == "hostnames" || key_text == "volatile"))
+        {
+            _hostnames = _hostnames || key_text == "hostnames";
+            continue;
+        }
+        else if (r.token_count != 2)
+        {
+            throw std::invalid_argument("Invalid number of tokens in map entry \"" + key_text + "\"");
+        }
+        else if (key_text == "default")
+        {
+            _default_row = idx;
+            continue;
+        }
+        else if (key_text == "include")
+        {
+            continue;
+        }
+
+        if (key_text[0] == '~')
+        {
+            auto flags = regex_impl::regex_constants::ECMAScript;
+            std::size_t skip = 1;
+            if (key_text.size() > 1 && key_text[1] == '*')
+            {
+                flags = flags | regex_impl::regex_constants::icase;
+                skip  = 2;
+            }
+            try
+            {
+                std::string pattern = regex_impl::translate_pcre(key_text.substr(skip), flags);
+                regexes->entries.push_back({ regex_impl::regex(pattern, flags), idx });
+            }
+            catch (const regex_impl::regex_error& ex)
+            {
+                throw std::invalid_argument("Invalid regular expression in map entry \"" + key_text + "\": "
+                                            + ex.what()
+                                           );
+            }
+        }
+        else if (key_text[0] == '\\')
+        {
+            _exact.push_back({ { key.offset + 1, key.length - 1 }, idx, false });
+        }
+        else if (_hostnames && key_text.size() > 2 && key_text[0] == '*' && key_text[1] == '.')
+        {
+            _head_wildcards.push_back({ { key.offset + 1, key.length - 1 }, idx, false });
+        }
+        else if (_hostnames && key_text.size() > 1 && key_text[0] == '.')
+        {
+            _head_wildcards.push_back({ key, idx, true });
+        }
+        else if (_hostnames && key_text.size() > 2 && key_text[key_text.size() - 1] == '*'
+                 && key_text[key_text.size() - 2] == '.')
+        {
+            _tail_wildcards.push_back({ { key.offset, key.length - 1 }, idx, false });
+        }
+        else
+        {
+            _exact.push_back({ key, idx, false });
+        }
+    }
+
+    for (auto* keys : { &_exact, &_head_wildcards, &_tail_wildcards })
+    {
+        std::stable_sort(keys->begin(), keys->end(),
+                         [this] (const keyed_row& a, const keyed_row& b)
+                         {
+                             return compare_icase(data(a.key), a.key.length, data(b.key), b.key.length) < 0;
+                         }
+                        );
+        keys->shrink_to_fit();
+    }
+    _regexes = std::move(regexes);
+}
+
+map_table::~map_table() noexcept = default;
+
+const map_table::keyed_row* map_table::find_sorted(const std::vector<keyed_row>& sorted,
+                                                    const char*                   key,
+                                                    size_type                     length
+                                                   ) const
+{
+    auto iter = std::lower_bound(sorted.begin(), sorted.end(), 0,
+                                 [&] (const keyed_row& x, int)
+                                 {
+                                     return compare_icase(data(x.key), x.key.length, key, length) < 0;
+                                 }
+                                );
+    if (iter != sorted.end() && compare_icase(data(iter->key), iter->key.length, key, length) == 0)
+        return &*iter;
+    else
+        return nullptr;
+}
+
+std::string map_table::default_value() const
+{
+    return _default_row == no_row ? std::string() : value(_rows[_default_row], 1);
+}
+
+std::string map_table::lookup(const std::string& key) const
+{
+    if (const keyed_row* found = find_sorted(_exact, key.data(), key.size()))
+        return value(_rows[found->row], 1);
+
+    if (_hostnames)
+    {
+        // The .example.org form matches example.org itself, which is the longest possible match
+        std::string dotted = "." + key;
+        if (const keyed_row* found = find_sorted(_head_wildcards, dotted.data(), dotted.size()))
+            if (found->self)
+                return value(_rows[found->row], 1);
+
+        for (auto pos = key.find('.'); pos != std::string::npos; pos = key.find('.', pos + 1))
+        {
+            if (const keyed_row* found = find_sorted(_head_wildcards, key.data() + pos, key.size() - pos))
+                return value(_rows[found->row], 1);
+        }
+
+        for (auto pos = key.rfind('.'); pos != std::string::npos && pos > 0; pos = key.rfind('.', pos - 1))
+        {
+            if (const keyed_row* found = find_sorted(_tail_wildcards, key.data(), pos + 1))
+                return value(_rows[found->row], 1);
+        }
+    }
+
+    for (const auto& entry : _regexes->entries)
+    {
+        if (regex_impl::regex_search(key, entry.expression))
+            return value(_rows[entry.row], 1);
+    }
+
+    return default_value();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// geo_table                                                                                                          //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool parse_address(const std::string& text, unsigned char* out, std::size_t& bits)
+{
+    if (inet_pton(AF_INET, text.c_str(), out) == 1)
+    {
+        bits = 32;
+        return true;
+    }
+    else if (inet_pton(AF_INET6, text.c_str(), out) == 1)
+    {
+        bits = 128;
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+static std::uint32_t parse_ipv4(const std::string& text)
+{
+    unsigned char bytes[4];
+    if (inet_pton(AF_INET, text.c_str(), bytes) != 1)
+        throw std::invalid_argument("Invalid IPv4 address \"" + text + "\"");
+    return (std::uint32_t(bytes[0]) << 24) | (std::uint32_t(bytes[1]) << 16) | (std::uint32_t(bytes[2]) << 8) | bytes[3];
+}
+
+geo_table::geo_table(const ast_entry& block) :
+        packed_block(block),
+        _ranges(false),
+        _default_row(-1),
+        _nodes(2, radix_node{ { 0, 0 }, -1 }),
+        _root4(0),
+        _root6(1)
+{
+    if (_name != "geo" || _attributes.empty() || _attributes.size() > 2)
+        throw std::invalid_argument("Not a geo block");
+
+    // Ranges are flattened by tracking where the value changes; each key maps to the row in effect from that address
+    // until the next key
+    std::map<std::uint64_t, std::int32_t> boundaries = { { 0, -1 } };
+    auto apply_range = [&boundaries] (std::uint64_t first, std::uint64_t last, std::int32_t row_idx)
+                       {
+                           if (last < 0xffffffffULL && !boundaries.count(last + 1))
+                               boundaries[last + 1] = std::prev(boundaries.upper_bound(last + 1))->second;
+                           boundaries.erase(boundaries.upper_bound(first), boundaries.upper_bound(last));
+                           boundaries[first] = row_idx;
+                       };
+
+    for (std::size_t idx = 0; idx < _rows.size(); ++idx)
+    {
+        const row& r = _rows[idx];
+        if (r.is_comment)
+            continue;
+
+        std::string key = value(r, 0);
+        std::int32_t row_idx = static_cast<std::int32_t>(idx);
+        if (r.token_count == 1 && key == "ranges")
+        {
+            _ranges = true;
+            continue;
+        }
+        else if (r.token_count == 1 && key == "proxy_recursive")
+        {
+            continue;
+        }
+        else if (r.token_count != 2)
+        {
+            throw std::invalid_argument("Invalid number of tokens in geo entry \"" + key + "\"");
+        }
+        else if (key == "default")
+        {
+            _default_row = row_idx;
+            continue;
+        }
+        else if (key == "include" || key == "proxy")
+        {
+            continue;
+        }
+
+        bool is_delete = key == "delete";
+        std::string network = is_delete ? value(r, 1) : key;
+        if (is_delete)
+            row_idx = -1;
+
+        if (_ranges)
+        {
+            auto dash = network.find('-');
+            if (dash == std::string::npos)
+                throw std::invalid_argument("Invalid range \"" + network + "\"");
+            apply_range(parse_ipv4(network.substr(0, dash)), parse_ipv4(network.substr(dash + 1)), row_idx);
+        }
+        else
+        {
+            insert_network(network, row_idx);
+        }
+    }
+
+    for (const auto& boundary : boundaries)
+        _intervals.push_back({ static_cast<std::uint32_t>(boundary.first), boundary.second });
+    _intervals.shrink_to_fit();
+    _nodes.shrink_to_fit();
+}
+
+geo_table::~geo_table() noexcept = default;
+
+void geo_table::insert_network(const std::string& network, std::int32_t row_idx)
+{
+    auto slash = network.find('/');
+    unsigned char address[16];
+    std::size_t   bits;
+    if (!parse_address(network.substr(0, slash), address, bits))
+        throw std::invalid_argument("Invalid network \"" + network + "\"");
+
+    std::size_t prefix = bits;
+    if (slash != std::string::npos)
+    {
+        prefix = std::stoul(network.substr(slash + 1));
+        if (prefix > bits)
+            throw std::invalid_argument("Invalid prefix length in \"" + network + "\"");
+    }
+
+    std::uint32_t node = bits == 32 ? _root4 : _root6;
+    for (std::size_t bit = 0; bit < prefix; ++bit)
+    {
+        unsigned side = (address[bit / 8] >> (7 - bit % 8)) & 1U;
+        if (!_nodes[node].child[side])
+        {
+            _nodes.push_back(radix_node{ { 0, 0 }, -1 });
+            _nodes[node].child[side] = static_cast<std::uint32_t>(_nodes.size() - 1);
+        }
+        node = _nodes[node].child[side];
+    }
+    _nodes[node].row = row_idx;
+}
+
+std::int32_t geo_table::find_network(const unsigned char* address, size_type bits) const
+{
+    std::uint32_t node = bits == 32 ? _root4 : _root6;
+    std::int32_t  best = _nodes[node].row;
+    for (std::size_t bit = 0; bit < bits; ++bit)
+    {
+        node = _nodes[node].child[(address[bit / 8] >> (7 - bit % 8)) & 1U];
+        if (!node)
+            break;
+        if (_nodes[node].row >= 0)
+            best = _nodes[node].row;
+    }
+    return best;
+}
+
+std::string geo_table::default_value() const
+{
+    return _default_row < 0 ? std::string() : value(_rows[_default_row], 1);
+}
+
+std::string geo_table::lookup(const std::string& address) const
+{
+    unsigned char bytes[16];
+    std::size_t   bits;
+    if (!parse_address(address, bytes, bits))
+        throw std::invalid_argument("Invalid address \"" + address + "\"");
+
+    std::int32_t row_idx = -1;
+    if (_ranges)
+    {
+        if (bits == 32)
+        {
+            std::uint32_t key = parse_ipv4(address);
+            auto iter = std::upper_bound(_intervals.begin(), _intervals.end(), key,
+                                         [] (std::uint32_t k, const interval& x) { return k < x.first; }
+                                        );
+            row_idx = std::prev(iter)->row;
+        }
+    }
+    else
+    {
+        row_idx = find_network(bytes, bits);
+    }
+    return row_idx < 0 ? default_value() : value(_rows[row_idx], 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// split_clients_table                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/** Parse a percentage like nginx's \c ngx_atofp with two decimal places, so "0.5%" is 50. **/
+static std::uint32_t parse_percent(const std::string& text)
+{
+    if (text.size() < 2 || text.back() != '%')
+        throw std::invalid_argument("Invalid percentage \"" + text + "\"");
+
+    std::uint32_t value    = 0;
+    int           decimals = -1;
+    for (std::size_t idx = 0; idx + 1 < text.size(); ++idx)
+    {
+        char c = text[idx];
+        if (c == '.' && decimals < 0)
+        {
+            decimals = 0;
+        }
+        else if ('0' <= c && c <= '9' && decimals < 2)
+        {
+            value = value * 10 + static_cast<std::uint32_t>(c - '0');
+            if (decimals >= 0)
+                ++decimals;
+        }
+        else
+        {
+            throw std::invalid_argument("Invalid percentage \"" + text + "\"");
+        }
+    }
+    for (int idx = std::max(decimals, 0); idx < 2; ++idx)
+        value *= 10;
+    return value;
+}
+
+split_clients_table::split_clients_table(const ast_entry& block) :
+        packed_block(block)
+{
+    if (_name != "split_clients" || _attributes.size() != 2)
+        throw std::invalid_argument("Not a split_clients block");
+
+    std::uint32_t sum  = 0;
+    std::uint64_t last = 0;
+    for (std::uint32_t idx = 0; idx < _rows.size(); ++idx)
+    {
+        const row& r = _rows[idx];
+        if (r.is_comment)
+            continue;
+        if (r.token_count != 2)
+            throw std::invalid_argument("Invalid number of tokens in split_clients entry");
+
+        std::string key = value(r, 0);
+        if (key == "*")
+        {
+            sum = 10000;
+            _parts.push_back({ 0, idx, true });
+            continue;
+        }
+
+        std::uint32_t percent = parse_percent(key);
+        sum += percent;
+        if (sum > 10000)
+            throw std::invalid_argument("Percent total is greater than 100%");
+        last += percent * std::uint64_t(0xffffffff) / 10000;
+        _parts.push_back({ static_cast<std::uint32_t>(last), idx, false });
+    }
+}
+
+split_clients_table::~split_clients_table() noexcept = default;
+
+std::uint32_t split_clients_table::murmur_hash2(const char* data_, size_type length)
+{
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(data_);
+    std::uint32_t h = static_cast<std::uint32_t>(length);
+    while (length >= 4)
+    {
+        std::uint32_t k = data[0];
+        k |= std::uint32_t(data[1]) << 8;
+        k |= std::uint32_t(data[2]) << 16;
+        k |= std::uint32_t(data[3]) << 24;
+        k *= 0x5bd1e995;
+        k ^= k >> 24;
+        k *= 0x5bd1e995;
+        h *= 0x5bd1e995;
+        h ^= k;
+        data += 4;
+        length -= 4;
+    }
+
+    switch (length)
+    {
+    case 3:
+        h ^= std::uint32_t(data[2]) << 16;
+        // fall through
+    case 2:
+        h ^= std::uint32_t(data[1]) << 8;
+        // fall through
+    case 1:
+        h ^= data[0];
+        h *= 0x5bd1e995;
+    }
+
+    h ^= h >> 13;
+    h *= 0x5bd1e995;
+    h ^= h >> 15;
+    return h;
+}
+
+std::string split_clients_table::lookup(const std::string& key) const
+{
+    std::uint32_t hash = murmur_hash2(key.data(), key.size());
+    for (const part& p : _parts)
+    {
+        if (p.rest || hash < p.upper)
+            return value(_rows[p.row], 1);
+    }
+    return std::string();
+}
+
+}
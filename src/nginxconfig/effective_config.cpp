@@ -0,0 +1,254 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/ast.hpp>
+#include <nginxconfig/effective_config.hpp>
+
+#include <stdexcept>
+
+namespace nginxconfig
+{
+
+static bool is_block(const ast_entry& entry)
+{
+    return entry.kind() == ast_entry_kind::complex || entry.kind() == ast_entry_kind::document;
+}
+
+effective_config_resolver::effective_config_resolver(const ast_entry& document) :
+        effective_config_resolver(document, default_non_inherited())
+{ }
+
+effective_config_resolver::effective_config_resolver(const ast_entry& document, name_set non_inherited) :
+        _non_inherited(std::move(non_inherited))
+{
+    _parents.emplace(&document, nullptr);
+    index_blocks(document);
+}
+
+effective_config_resolver::~effective_config_resolver() noexcept = default;
+
+const effective_config_resolver::name_set& effective_config_resolver::default_non_inherited()
+{
+    static const name_set instance =
+    {
+        "alias",
+        "break",
+        "fastcgi_pass",
+        "grpc_pass",
+        "include",
+        "internal",
+        "listen",
+        "memcached_pass",
+        "proxy_pass",
+        "return",
+        "rewrite",
+        "scgi_pass",
+        "server",
+        "server_name",
+        "set",
+        "try_files",
+        "uwsgi_pass",
+    };
+    return instance;
+}
+
+void effective_config_resolver::index_blocks(const ast_entry& root)
+{
+    std::vector<const ast_entry*> pending = { &root };
+    while (!pending.empty())
+    {
+        const ast_entry* block = pending.back();
+        pending.pop_back();
+        for (const ast_entry& child : block->children())
+        {
+            if (is_block(child))
+            {
+                _parents[&child] = block;
+                _children[block].push_back(&child);
+                pending.push_back(&child);
+            }
+        }
+    }
+}
+
+void effective_config_resolver::forget_blocks(const ast_entry& root)
+{
+    // The old children may no longer exist, so the remembered links are the only safe way to find them
+    _levels.erase(&root);
+    std::vector<const ast_entry*> pending = { &root };
+    while (!pending.empty())
+    {
+        const ast_entry* block = pending.back();
+        pending.pop_back();
+        auto iter = _children.find(block);
+        if (iter == _children.end())
+            continue;
+        for (const ast_entry* child : iter->second)
+        {
+            _parents.erase(child);
+            _levels.erase(child);
+            pending.push_back(child);
+        }
+        _children.erase(iter);
+    }
+}
+
+void effective_config_resolver::invalidate(const ast_entry& block)
+{
+    if (!_parents.count(&block))
+        throw std::invalid_argument("Block is not a part of this document");
+
+    forget_blocks(block);
+    index_blocks(block);
+}
+
+const ast_entry* effective_config_resolver::parent(const ast_entry& block) const
+{
+    auto iter = _parents.find(&block);
+    return iter == _parents.end() ? nullptr : iter->second;
+}
+
+/** The directives a single block specifies, on top of those of \c parent (\c nullptr for none). **/
+struct effective_config_resolver::layer
+{
+    directive_map overrides;
+    layer_ptr     parent;
+    /** The whole chain merged into one map, built the first time \c resolve asks for it. **/
+    mutable directive_set flattened;
+};
+
+const effective_config_resolver::entry_list* effective_config_resolver::lookup(const layer_ptr&   top,
+                                                                              const std::string& name
+                                                                             )
+{
+    for (const layer* current = top.get(); current; current = current->parent.get())
+    {
+        auto iter = current->overrides.find(name);
+        if (iter != current->overrides.end())
+            return &iter->second;
+    }
+    return nullptr;
+}
+
+effective_config_resolver::directive_set effective_config_resolver::flatten(const layer_ptr& top)
+{
+    // Merge from the nearest layer which is already flattened (or nothing) back down to the top, memoizing each step
+    std::vector<const layer*> chain;
+    const layer* current = top.get();
+    for ( ; current && !current->flattened; current = current->parent.get())
+        chain.push_back(current);
+
+    static const directive_set empty_set = std::make_shared<directive_map>();
+    directive_set out = current ? current->flattened : empty_set;
+    for (auto iter = chain.rbegin(); iter != chain.rend(); ++iter)
+    {
+        auto merged = std::make_shared<directive_map>(*out);
+        for (const auto& entry : (*iter)->overrides)
+            (*merged)[entry.first] = entry.second;
+        (*iter)->flattened = merged;
+        out = std::move(merged);
+    }
+    return out;
+}
+
+effective_config_resolver::level effective_config_resolver::compute_level(const ast_entry&  block,
+                                                                          const level*      parent_level
+                                                                         ) const
+{
+    directive_map own_inherited;
+    directive_map own_local;
+    for (const ast_entry& child : block.children())
+    {
+        if (child.kind() != ast_entry_kind::simple)
+            continue;
+
+        if (_non_inherited.count(child.name()))
+            own_local[child.name()].push_back(&child);
+        else
+            own_inherited[child.name()].push_back(&child);
+    }
+
+    level out;
+    out.inherited = parent_level ? parent_level->inherited : nullptr;
+    if (!own_inherited.empty())
+    {
+        auto added = std::make_shared<layer>();
+        added->overrides = std::move(own_inherited);
+        added->parent    = std::move(out.inherited);
+        out.inherited    = std::move(added);
+    }
+
+    out.effective = out.inherited;
+    if (!own_local.empty())
+    {
+        auto added = std::make_shared<layer>();
+        added->overrides = std::move(own_local);
+        added->parent    = out.inherited;
+        out.effective    = std::move(added);
+    }
+    return out;
+}
+
+const effective_config_resolver::level& effective_config_resolver::resolve_level(const ast_entry& block)
+{
+    auto found = _levels.find(&block);
+    if (found != _levels.end())
+        return found->second;
+
+    // Walk up to the nearest memoized ancestor (or the document), then resolve back down
+    std::vector<const ast_entry*> path;
+    const level* parent_level = nullptr;
+    for (const ast_entry* current = &block; current; )
+    {
+        auto parent_iter = _parents.find(current);
+        if (parent_iter == _parents.end())
+            throw std::invalid_argument("Block is not a part of this document");
+
+        path.push_back(current);
+        current = parent_iter->second;
+        if (current)
+        {
+            auto level_iter = _levels.find(current);
+            if (level_iter != _levels.end())
+            {
+                parent_level = &level_iter->second;
+                break;
+            }
+        }
+    }
+
+    for (auto iter = path.rbegin(); iter != path.rend(); ++iter)
+    {
+        level computed = compute_level(**iter, parent_level);
+        parent_level = &(_levels[*iter] = std::move(computed));
+    }
+    return *parent_level;
+}
+
+effective_config_resolver::directive_set effective_config_resolver::resolve(const ast_entry& block)
+{
+    return flatten(resolve_level(block).effective);
+}
+
+const ast_entry* effective_config_resolver::find(const ast_entry& block, const std::string& name)
+{
+    const entry_list* entries = lookup(resolve_level(block).effective, name);
+    return !entries || entries->empty() ? nullptr : entries->back();
+}
+
+effective_config_resolver::entry_list effective_config_resolver::find_all(const ast_entry& block,
+                                                                         const std::string& name
+                                                                        )
+{
+    const entry_list* entries = lookup(resolve_level(block).effective, name);
+    return entries ? *entries : entry_list();
+}
+
+}
@@ -12,6 +12,7 @@
 #include <nginxconfig/encode.hpp>
 
 #include <cassert>
+#include <cstdint>
 #include <ostream>
 
 namespace nginxconfig
@@ -35,43 +36,81 @@ encoder::~encoder() noexcept = default;
 
 void encoder::encode(const ast_entry& ast)
 {
-    context cxt;
-    return encode_impl(cxt, ast);
+    if (!_context._path.empty())
+    {
+        // called from inside of one of the write functions
+        context cxt;
+        return encode_impl(cxt, ast);
+    }
+    
+    try
+    {
+        encode_impl(_context, ast);
+    }
+    catch (...)
+    {
+        _context._path.clear();
+        _context._positions.clear();
+        throw;
+    }
 }
 
 void encoder::encode_impl(encoder::context& cxt, const ast_entry& ast)
+{
+    if (!encode_begin(cxt, ast))
+        return;
+    
+    while (!cxt._path.empty())
+    {
+        const ast_entry::child_list& children = cxt._path.back()->children();
+        if (cxt._positions.back() == children.size())
+        {
+            encode_end(cxt);
+        }
+        else
+        {
+            auto idx = cxt._positions.back()++;
+            encode_begin(cxt, children[idx]);
+        }
+    }
+}
+
+bool encoder::encode_begin(encoder::context& cxt, const ast_entry& ast)
 {
     switch (ast.kind())
     {
         case ast_entry_kind::comment:
             write_comment(cxt, ast);
-            break;
-        case ast_entry_kind::complex:
-        case ast_entry_kind::document:
-            if (ast.kind() == ast_entry_kind::complex)
-                write_complex_begin(cxt, ast);
-            else
-                write_document_begin(cxt, ast);
-            
-            cxt._path.push_back(&ast);
-            for (const ast_entry& sub : ast.children())
-            {
-                encode_impl(cxt, sub);
-            }
-            cxt._path.pop_back();
-            
-            if (ast.kind() == ast_entry_kind::complex)
-                write_complex_end(cxt, ast);
-            else
-                write_document_end(cxt, ast);
-            break;
+            return false;
         case ast_entry_kind::simple:
             write_simple(cxt, ast);
+            return false;
+        case ast_entry_kind::complex:
+            write_complex_begin(cxt, ast);
+            break;
+        case ast_entry_kind::document:
+            write_document_begin(cxt, ast);
             break;
         default:
             assert(false && "Memory corruption?");
-            break;
+            return false;
     }
+    
+    cxt._path.push_back(&ast);
+    cxt._positions.push_back(0);
+    return true;
+}
+
+void encoder::encode_end(encoder::context& cxt)
+{
+    const ast_entry& ast = *cxt._path.back();
+    cxt._path.pop_back();
+    cxt._positions.pop_back();
+    
+    if (ast.kind() == ast_entry_kind::complex)
+        write_complex_end(cxt, ast);
+    else
+        write_document_end(cxt, ast);
 }
 
 void encoder::write_document_begin(const context&, const ast_entry&)
@@ -103,8 +142,15 @@ void ostream_encoder::write_attributes(const ast_entry& ast)
         _output << ' ' << attr;
 }
 
+void ostream_encoder::write_blank_lines(const ast_entry& ast)
+{
+    for (std::uint32_t x = 0; x < ast.blank_lines_before(); ++x)
+        _output << '\n';
+}
+
 void ostream_encoder::write_comment(const context& cxt, const ast_entry& ast)
 {
+    write_blank_lines(ast);
     write_indent(cxt);
     if (!ast.comment().empty())
         _output << '#' << ast.comment();
@@ -113,6 +159,7 @@ void ostream_encoder::write_comment(const context& cxt, const ast_entry& ast)
 
 void ostream_encoder::write_complex_begin(const context& cxt, const ast_entry& ast)
 {
+    write_blank_lines(ast);
     write_indent(cxt);
     _output << ast.name();
     write_attributes(ast);
@@ -137,6 +184,7 @@ void ostream_encoder::write_indent(const context& cxt)
 
 void ostream_encoder::write_simple(const encoder::context& cxt, const ast_entry& ast)
 {
+    write_blank_lines(ast);
     write_indent(cxt);
     _output << ast.name();
     write_attributes(ast);
@@ -0,0 +1,106 @@
+/** \file
+ *  Helpers for reading whole files into memory and parsing them from there.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_FILE_IO_HPP_INCLUDED__
+#define __NGINXCONFIG_FILE_IO_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+
+#include <cerrno>
+#include <fstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace nginxconfig
+{
+namespace io
+{
+
+/** A read-only stream buffer over memory owned by someone else. **/
+class memory_buffer :
+        public std::streambuf
+{
+public:
+    memory_buffer(const char* first, std::size_t length)
+    {
+        char* begin = const_cast<char*>(first);
+        setg(begin, begin, begin + length);
+    }
+};
+
+/** Get the directory part of \a path, which is \c "." for a path without any directory. **/
+inline std::string directory_of(const std::string& path)
+{
+    auto pos = path.find_last_of('/');
+    if (pos == std::string::npos)
+        return ".";
+    else if (pos == 0)
+        return "/";
+    else
+        return path.substr(0, pos);
+}
+
+/** Join \a name onto \a directory without doubling the \c / when \a directory is the root. **/
+inline std::string join_path(const std::string& directory, const std::string& name)
+{
+    return directory.empty() || directory.back() == '/' ? directory + name : directory + "/" + name;
+}
+
+/** Make \a path absolute by joining it onto the working directory if it is relative, dropping any leading \c ./ so
+ *  the same file is always spelled the same way.
+ *
+ *  \throws std::runtime_error if the working directory can not be found.
+**/
+inline std::string absolute_path(const std::string& path)
+{
+    if (!path.empty() && path[0] == '/')
+        return path;
+
+    std::string::size_type start = 0;
+    while (path.compare(start, 2, "./") == 0)
+        start += 2;
+
+    std::vector<char> buffer(256);
+    while (!::getcwd(buffer.data(), buffer.size()))
+    {
+        if (errno != ERANGE)
+            throw std::runtime_error("Could not get the working directory");
+        buffer.resize(buffer.size() * 2);
+    }
+    return join_path(buffer.data(), path.substr(start));
+}
+
+/** Read the entire contents of the file at \a path into \a out, reusing the capacity \a out already has.
+ *
+ *  \throws std::runtime_error if the file can not be opened or read.
+**/
+inline void read_file(const std::string& path, std::string& out)
+{
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file)
+        throw std::runtime_error("Could not open \"" + path + "\"");
+
+    file.seekg(0, std::ios::end);
+    std::streamoff length = file.tellg();
+    file.seekg(0, std::ios::beg);
+    out.resize(length < 0 ? 0 : static_cast<std::size_t>(length));
+    if (!out.empty() && !file.read(&out[0], out.size()))
+        throw std::runtime_error("Could not read \"" + path + "\"");
+}
+
+}
+}
+
+#endif/*__NGINXCONFIG_FILE_IO_HPP_INCLUDED__*/
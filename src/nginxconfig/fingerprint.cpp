@@ -0,0 +1,522 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/ast.hpp>
+#include <nginxconfig/fingerprint.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+namespace nginxconfig
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// fingerprint128                                                                                                     //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string fingerprint128::to_string() const
+{
+    static const char digits[] = "0123456789abcdef";
+
+    std::string out(32, '0');
+    for (std::size_t idx = 0; idx < 16; ++idx)
+    {
+        out[15 - idx] = digits[(high >> (idx * 4)) & 0xf];
+        out[31 - idx] = digits[(low >> (idx * 4)) & 0xf];
+    }
+    return out;
+}
+
+std::ostream& operator<<(std::ostream& os, const fingerprint128& value)
+{
+    return os << value.to_string();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// fingerprint_hasher                                                                                                 //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+const std::uint64_t c1 = 0x87c37b91114253d5ULL;
+const std::uint64_t c2 = 0x4cf5ad432745937fULL;
+
+inline std::uint64_t rotl64(std::uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline std::uint64_t fmix64(std::uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+/** Read 8 bytes as little-endian, whatever the platform is, so the hash is the same everywhere. **/
+inline std::uint64_t load_le64(const unsigned char* p)
+{
+    return  std::uint64_t(p[0])        | (std::uint64_t(p[1]) << 8)  | (std::uint64_t(p[2]) << 16)
+         | (std::uint64_t(p[3]) << 24) | (std::uint64_t(p[4]) << 32) | (std::uint64_t(p[5]) << 40)
+         | (std::uint64_t(p[6]) << 48) | (std::uint64_t(p[7]) << 56);
+}
+
+}
+
+fingerprint_hasher::fingerprint_hasher(std::uint32_t seed) :
+        _h1(seed),
+        _h2(seed),
+        _length(0)
+{ }
+
+void fingerprint_hasher::mix(const unsigned char* block)
+{
+    std::uint64_t k1 = load_le64(block);
+    std::uint64_t k2 = load_le64(block + 8);
+
+    k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; _h1 ^= k1;
+    _h1 = rotl64(_h1, 27); _h1 += _h2; _h1 = _h1 * 5 + 0x52dce729;
+
+    k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; _h2 ^= k2;
+    _h2 = rotl64(_h2, 31); _h2 += _h1; _h2 = _h2 * 5 + 0x38495ab5;
+}
+
+void fingerprint_hasher::update(const void* data, std::size_t length)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    std::size_t used = std::size_t(_length % 16);
+    _length += length;
+
+    if (used != 0)
+    {
+        std::size_t take = std::min(length, 16 - used);
+        std::memcpy(_tail + used, p, take);
+        p      += take;
+        length -= take;
+        if (used + take < 16)
+            return;
+        mix(_tail);
+    }
+
+    for (; length >= 16; p += 16, length -= 16)
+        mix(p);
+    std::memcpy(_tail, p, length);
+}
+
+fingerprint128 fingerprint_hasher::finish() const
+{
+    std::uint64_t h1 = _h1;
+    std::uint64_t h2 = _h2;
+    std::uint64_t k1 = 0;
+    std::uint64_t k2 = 0;
+    const unsigned char* tail = _tail;
+
+    switch (_length & 15)
+    {
+    case 15: k2 ^= std::uint64_t(tail[14]) << 48; // fall through
+    case 14: k2 ^= std::uint64_t(tail[13]) << 40; // fall through
+    case 13: k2 ^= std::uint64_t(tail[12]) << 32; // fall through
+    case 12: k2 ^= std::uint64_t(tail[11]) << 24; // fall through
+    case 11: k2 ^= std::uint64_t(tail[10]) << 16; // fall through
+    case 10: k2 ^= std::uint64_t(tail[ 9]) << 8;  // fall through
+    case  9: k2 ^= std::uint64_t(tail[ 8]);
+             k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+             // fall through
+    case  8: k1 ^= std::uint64_t(tail[ 7]) << 56; // fall through
+    case  7: k1 ^= std::uint64_t(tail[ 6]) << 48; // fall through
+    case  6: k1 ^= std::uint64_t(tail[ 5]) << 40; // fall through
+    case  5: k1 ^= std::uint64_t(tail[ 4]) << 32; // fall through
+    case  4: k1 ^= std::uint64_t(tail[ 3]) << 24; // fall through
+    case  3: k1 ^= std::uint64_t(tail[ 2]) << 16; // fall through
+    case  2: k1 ^= std::uint64_t(tail[ 1]) << 8;  // fall through
+    case  1: k1 ^= std::uint64_t(tail[ 0]);
+             k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+             break;
+    default:
+             break;
+    }
+
+    h1 ^= _length;
+    h2 ^= _length;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+
+    fingerprint128 out;
+    out.low  = h1;
+    out.high = h2;
+    return out;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Attributes                                                                                                         //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool is_quoted(const std::string& attribute)
+{
+    return attribute.size() >= 2
+        && (attribute.front() == '"' || attribute.front() == '\'')
+        && attribute.back() == attribute.front();
+}
+
+/** Does \a attribute have the value it is spelled with? Most do, which saves copying them. **/
+static bool is_plain(const std::string& attribute)
+{
+    return !is_quoted(attribute) && attribute.find('\\') == std::string::npos;
+}
+
+// these are the same escapes nginx replaces when it reads a word (see ngx_conf_read_token)
+void append_attribute_value(const std::string& attribute, std::string& out)
+{
+    std::size_t first = 0;
+    std::size_t last  = attribute.size();
+    if (is_quoted(attribute))
+    {
+        ++first;
+        --last;
+    }
+
+    for (std::size_t idx = first; idx < last; ++idx)
+    {
+        char ch = attribute[idx];
+        if (ch == '\\' && idx + 1 < last)
+        {
+            switch (attribute[idx + 1])
+            {
+            case '"':
+            case '\'':
+            case '\\': out.push_back(attribute[++idx]); continue;
+            case 't':  out.push_back('\t'); ++idx;     continue;
+            case 'r':  out.push_back('\r'); ++idx;     continue;
+            case 'n':  out.push_back('\n'); ++idx;     continue;
+            default:   break;
+            }
+        }
+        out.push_back(ch);
+    }
+}
+
+std::string attribute_value(const std::string& attribute)
+{
+    if (is_plain(attribute))
+        return attribute;
+
+    std::string out;
+    out.reserve(attribute.size());
+    append_attribute_value(attribute, out);
+    return out;
+}
+
+std::string quote_attribute(const std::string& value)
+{
+    bool quote = value.empty() || value.find_first_of(" \t\r\n;{}\"'#") != std::string::npos;
+
+    std::string out;
+    out.reserve(value.size() + 2);
+    if (quote)
+        out.push_back('"');
+    for (std::size_t idx = 0; idx < value.size(); ++idx)
+    {
+        char ch = value[idx];
+        if (ch == '"' || (ch == '\\' && (idx + 1 == value.size() || std::strchr("\"'\\trn", value[idx + 1]))))
+            out.push_back('\\');
+        out.push_back(ch);
+    }
+    if (quote)
+        out.push_back('"');
+    return out;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// fingerprint                                                                                                        //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+/** Is \a entry part of the canonical form? Blank lines are kept as empty comments, which never are. **/
+bool is_kept(const ast_entry& entry, const canonical_options& options)
+{
+    return entry.kind() != ast_entry_kind::comment || (!options.ignore_comments && !entry.comment().empty());
+}
+
+/** Put the values of the condition of an \c if in \a out the way crossplane sees them (see \c crossplane_encoder):
+ *  without the \c ( and \c ) around it and without the attributes which were nothing but one of them. That way,
+ *  <tt>if ( $x )</tt> and <tt>if ($x)</tt> have the same values.
+**/
+void condition_values(const ast_entry::attribute_list& attributes, std::vector<std::string>& out)
+{
+    out.clear();
+    for (ast_entry::size_type idx = 0; idx < attributes.size(); ++idx)
+    {
+        std::string value = attribute_value(attributes[idx]);
+        bool stripped = false;
+        if (idx == 0 && !value.empty() && value.front() == '(')
+        {
+            value.erase(0, 1);
+            stripped = true;
+        }
+        if (idx + 1 == attributes.size() && !value.empty() && value.back() == ')')
+        {
+            value.pop_back();
+            stripped = true;
+        }
+        if (!stripped || !value.empty())
+            out.push_back(std::move(value));
+    }
+}
+
+/** Feeds the canonical form of a tree to a \c fingerprint_hasher. This is the format, which must not change:
+ *
+ *   - a string is its length as 4 little-endian bytes, then its bytes
+ *   - a \c document is \c 'D', its children, then \c 'E'
+ *   - a \c simple entry is \c 'S', its name, the number of attributes as 4 little-endian bytes, the value (see
+ *     \c attribute_value) of each attribute and, if comments are kept, its comment; for an \c if, the attributes are
+ *     the values of its condition (see \c condition_values) instead
+ *   - a \c complex entry starts like a \c simple one with \c 'C' instead of \c 'S', then has its children and \c 'E';
+ *     if its children are sorted, they are \c 'U', their number as 4 little-endian bytes and the fingerprints (each
+ *     computed by itself, \c low then \c high, each as 8 little-endian bytes) of the children in increasing order
+ *   - a \c comment (if they are kept and it is not empty) is \c '#' and its text
+**/
+class canonical_hasher
+{
+public:
+    explicit canonical_hasher(const canonical_options& options) :
+            _options(options)
+    { }
+
+    void entry(fingerprint_hasher& out, const ast_entry& entry)
+    {
+        switch (entry.kind())
+        {
+        case ast_entry_kind::document:
+            tag(out, 'D');
+            children(out, entry);
+            tag(out, 'E');
+            break;
+        case ast_entry_kind::simple:
+            tag(out, 'S');
+            header(out, entry);
+            break;
+        case ast_entry_kind::complex:
+            tag(out, 'C');
+            header(out, entry);
+            if (sorts(entry))
+                sorted_children(out, entry);
+            else
+                children(out, entry);
+            tag(out, 'E');
+            break;
+        case ast_entry_kind::comment:
+            if (is_kept(entry, _options))
+            {
+                tag(out, '#');
+                text(out, entry.comment());
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    fingerprint128 digest(const ast_entry& entry)
+    {
+        fingerprint_hasher out;
+        this->entry(out, entry);
+        return out.finish();
+    }
+
+    /** Are the children of \a entry sorted? **/
+    bool sorts(const ast_entry& entry) const
+    {
+        return _options.sort_unordered
+            && std::find(_options.unordered_blocks.begin(), _options.unordered_blocks.end(), entry.name())
+               != _options.unordered_blocks.end();
+    }
+
+private:
+    static void tag(fingerprint_hasher& out, char value)
+    {
+        out.update(&value, 1);
+    }
+
+    static void number(fingerprint_hasher& out, std::uint64_t value, std::size_t bytes)
+    {
+        unsigned char buffer[8];
+        for (std::size_t idx = 0; idx < bytes; ++idx)
+            buffer[idx] = static_cast<unsigned char>(value >> (idx * 8));
+        out.update(buffer, bytes);
+    }
+
+    static void text(fingerprint_hasher& out, const std::string& value)
+    {
+        number(out, value.size(), 4);
+        out.update(value.data(), value.size());
+    }
+
+    void header(fingerprint_hasher& out, const ast_entry& entry)
+    {
+        text(out, entry.name());
+        const ast_entry::attribute_list& attributes = entry.attributes();
+        if (entry.name() == "if")
+        {
+            condition_values(attributes, _values);
+            number(out, _values.size(), 4);
+            for (const std::string& value : _values)
+                text(out, value);
+            if (!_options.ignore_comments)
+                text(out, entry.comment());
+            return;
+        }
+
+        number(out, attributes.size(), 4);
+        for (const std::string& attribute : attributes)
+        {
+            if (is_plain(attribute))
+            {
+                text(out, attribute);
+            }
+            else
+            {
+                _scratch.clear();
+                append_attribute_value(attribute, _scratch);
+                text(out, _scratch);
+            }
+        }
+        if (!_options.ignore_comments)
+            text(out, entry.comment());
+    }
+
+    void children(fingerprint_hasher& out, const ast_entry& owner)
+    {
+        for (const ast_entry& child : owner.children())
+            entry(out, child);
+    }
+
+    void sorted_children(fingerprint_hasher& out, const ast_entry& owner)
+    {
+        std::vector<fingerprint128> digests;
+        for (const ast_entry& child : owner.children())
+        {
+            if (is_kept(child, _options))
+                digests.push_back(digest(child));
+        }
+        std::sort(digests.begin(), digests.end());
+
+        tag(out, 'U');
+        number(out, digests.size(), 4);
+        for (const fingerprint128& value : digests)
+        {
+            number(out, value.low, 8);
+            number(out, value.high, 8);
+        }
+    }
+
+private:
+    const canonical_options& _options;
+    std::string              _scratch;
+    std::vector<std::string> _values;
+};
+
+ast_entry canonical_copy(canonical_hasher& hasher, const ast_entry& entry, const canonical_options& options)
+{
+    ast_entry out = entry.kind() == ast_entry_kind::document ? ast_entry::make_document()
+                  : entry.kind() == ast_entry_kind::comment  ? ast_entry::make_comment(entry.comment())
+                  : entry.kind() == ast_entry_kind::simple   ? ast_entry::make_simple(entry.name())
+                  :                                            ast_entry::make_complex(entry.name());
+    if (entry.kind() == ast_entry_kind::simple || entry.kind() == ast_entry_kind::complex)
+    {
+        ast_entry::attribute_list& attributes = out.attributes();
+        if (entry.name() == "if")
+        {
+            // spelled the way decode_crossplane puts the parentheses back: a quoted value gets its own
+            std::vector<std::string> values;
+            condition_values(entry.attributes(), values);
+            for (const std::string& value : values)
+                attributes.push_back(quote_attribute(value));
+            if (!attributes.empty())
+            {
+                if (attributes.front().front() == '"')
+                    attributes.emplace_front("(");
+                else
+                    attributes.front().insert(0, 1, '(');
+                if (attributes.back().front() == '"')
+                    attributes.emplace_back(")");
+                else
+                    attributes.back().push_back(')');
+            }
+        }
+        else
+        {
+            for (const std::string& attribute : entry.attributes())
+                attributes.push_back(quote_attribute(attribute_value(attribute)));
+        }
+        if (!options.ignore_comments)
+            out.comment() = entry.comment();
+    }
+
+    if (entry.kind() == ast_entry_kind::document || entry.kind() == ast_entry_kind::complex)
+    {
+        ast_entry::child_list& children = out.children();
+        for (const ast_entry& child : entry.children())
+        {
+            if (is_kept(child, options))
+                children.push_back(canonical_copy(hasher, child, options));
+        }
+
+        if (entry.kind() == ast_entry_kind::complex && hasher.sorts(entry))
+        {
+            std::vector<std::pair<fingerprint128, ast_entry*>> order;
+            order.reserve(children.size());
+            for (ast_entry& child : children)
+                order.emplace_back(hasher.digest(child), &child);
+            std::stable_sort(order.begin(), order.end(),
+                             [] (const std::pair<fingerprint128, ast_entry*>& a,
+                                 const std::pair<fingerprint128, ast_entry*>& b
+                                )
+                             {
+                                 return a.first < b.first;
+                             }
+                            );
+
+            ast_entry::child_list sorted;
+            for (const auto& item : order)
+                sorted.emplace_back(std::move(*item.second));
+            children = std::move(sorted);
+        }
+    }
+    return out;
+}
+
+}
+
+ast_entry canonicalize(const ast_entry& root, const canonical_options& options)
+{
+    canonical_hasher hasher(options);
+    return canonical_copy(hasher, root, options);
+}
+
+fingerprint128 fingerprint(const ast_entry& root, const canonical_options& options)
+{
+    canonical_hasher hasher(options);
+    return hasher.digest(root);
+}
+
+}
@@ -0,0 +1,219 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/include_watcher.hpp>
+
+#if defined(__linux__)
+
+#include <nginxconfig/file_io.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <set>
+#include <system_error>
+
+#include <fnmatch.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace nginxconfig
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// include_watcher                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Everything which can change what a directory entry refers to or what the file contains
+static const std::uint32_t watch_mask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE
+                                      | IN_MOVED_FROM | IN_MOVED_TO;
+
+/** A marker candidate meaning events were lost and everything must be checked. **/
+static const std::string overflow_marker;
+
+include_watcher::include_watcher(const std::string& root, parse_cache& cache) :
+        _cache(cache),
+        _tree(parse_include_tree(root, cache)),
+        _fd(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+    if (_fd < 0)
+        throw std::system_error(errno, std::system_category(), "inotify_init1");
+
+    try
+    {
+        update_watches();
+    }
+    catch (...)
+    {
+        ::close(_fd);
+        throw;
+    }
+}
+
+include_watcher::~include_watcher() noexcept
+{
+    ::close(_fd);
+}
+
+void include_watcher::update_watches()
+{
+    std::set<std::string> directories;
+    for (const auto& doc : _tree.documents())
+        directories.insert(io::directory_of(doc.first));
+    for (const auto& pattern : _tree.patterns())
+    {
+        std::string directory = io::directory_of(_tree.pattern_path(pattern.first));
+        if (directory.find_first_of("*?[") == std::string::npos)
+            directories.insert(directory);
+    }
+
+    for (const std::string& directory : directories)
+    {
+        bool watched = std::any_of(_watches.begin(), _watches.end(),
+                                   [&] (const std::pair<const int, std::string>& w) { return w.second == directory; }
+                                  );
+        if (watched)
+            continue;
+
+        // A directory which does not exist yet (an include pattern with no matches) is simply not watched
+        int wd = ::inotify_add_watch(_fd, directory.c_str(), watch_mask);
+        if (wd >= 0)
+            _watches[wd] = directory;
+        else if (errno != ENOENT && errno != ENOTDIR)
+            throw std::system_error(errno, std::system_category(), "inotify_add_watch(" + directory + ")");
+    }
+}
+
+bool include_watcher::read_events(path_list& candidates)
+{
+    alignas(struct inotify_event) char buffer[16 * 1024];
+    bool any = false;
+    while (true)
+    {
+        ssize_t length = ::read(_fd, buffer, sizeof buffer);
+        if (length < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return any;
+            throw std::system_error(errno, std::system_category(), "read(inotify)");
+        }
+
+        for (char* pos = buffer; pos < buffer + length; )
+        {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(pos);
+            pos += sizeof(struct inotify_event) + event->len;
+            any = true;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                candidates.push_back(overflow_marker);
+                continue;
+            }
+            if (event->mask & IN_IGNORED)
+            {
+                _watches.erase(event->wd);
+                continue;
+            }
+
+            auto watch = _watches.find(event->wd);
+            if (watch == _watches.end() || event->len == 0)
+                continue;
+            candidates.push_back(io::join_path(watch->second, event->name));
+        }
+    }
+}
+
+bool include_watcher::is_relevant(const std::string& path) const
+{
+    if (_tree.documents().count(path))
+        return true;
+
+    for (const auto& pattern : _tree.patterns())
+    {
+        if (::fnmatch(_tree.pattern_path(pattern.first).c_str(), path.c_str(), FNM_PATHNAME) == 0)
+            return true;
+    }
+    return false;
+}
+
+include_watcher::path_list include_watcher::wait(int timeout_ms)
+{
+    struct pollfd request = { _fd, POLLIN, 0 };
+    int rc;
+    do
+    {
+        rc = ::poll(&request, 1, timeout_ms);
+    } while (rc < 0 && errno == EINTR);
+    if (rc < 0)
+        throw std::system_error(errno, std::system_category(), "poll(inotify)");
+
+    path_list candidates;
+    if (rc > 0)
+        read_events(candidates);
+
+    path_list changed = _unresolved;
+    if (std::find(candidates.begin(), candidates.end(), overflow_marker) != candidates.end())
+    {
+        // Events were lost, so every file has to be checked; the cache makes this a stat per unchanged file
+        for (const auto& doc : _tree.documents())
+            changed.push_back(doc.first);
+    }
+    bool patterns_affected = false;
+    for (const std::string& path : candidates)
+    {
+        if (path.empty() || !is_relevant(path))
+            continue;
+        if (_tree.documents().count(path))
+            changed.push_back(path);
+        else
+            patterns_affected = true;
+    }
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    if (changed.empty() && !patterns_affected)
+        return {};
+
+    include_tree next;
+    try
+    {
+        next = parse_include_tree(_tree, changed, _cache);
+    }
+    catch (...)
+    {
+        _unresolved = changed;
+        throw;
+    }
+    _unresolved.clear();
+
+    // Report what actually differs between the trees, not just what had events
+    path_list out;
+    for (const auto& doc : next.documents())
+    {
+        auto old = _tree.documents().find(doc.first);
+        if (old == _tree.documents().end() || old->second != doc.second)
+            out.push_back(doc.first);
+    }
+    for (const auto& doc : _tree.documents())
+    {
+        if (!next.documents().count(doc.first))
+            out.push_back(doc.first);
+    }
+    std::sort(out.begin(), out.end());
+
+    _tree = std::move(next);
+    update_watches();
+    return out;
+}
+
+}
+
+#endif
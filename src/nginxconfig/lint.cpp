@@ -0,0 +1,449 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/ast.hpp>
+#include <nginxconfig/lint.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <deque>
+#include <exception>
+#include <ostream>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+namespace nginxconfig
+{
+
+std::ostream& operator<<(std::ostream& os, const lint_severity& severity)
+{
+    switch (severity)
+    {
+    case lint_severity::warning: return os << "warning";
+    case lint_severity::error:   return os << "error";
+    default:                     return os << "???";
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// lint_context                                                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void lint_context::report(std::string message)
+{
+    report(*_entry, std::move(message));
+}
+
+void lint_context::report(const ast_entry& entry, std::string message)
+{
+    _out.push_back(lint_diagnostic{ &entry, _rule->name(), _rule->severity(), std::move(message) });
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// lint_rule                                                                                                          //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+lint_rule::lint_rule(std::string              name,
+                     std::vector<std::string> directives,
+                     unsigned int             contexts,
+                     lint_severity            severity
+                    ) :
+        _name(std::move(name)),
+        _directives(std::move(directives)),
+        _contexts(contexts),
+        _severity(severity)
+{ }
+
+lint_rule::~lint_rule() noexcept = default;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// linter                                                                                                             //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+constexpr linter::size_type linter::default_split_depth;
+
+static bool has_children(const ast_entry& entry)
+{
+    return entry.kind() == ast_entry_kind::complex || entry.kind() == ast_entry_kind::document;
+}
+
+linter::linter(const schema_registry& schema) :
+        _schema(&schema),
+        _split_depth(default_split_depth)
+{ }
+
+linter::~linter() noexcept = default;
+
+void linter::add(std::shared_ptr<const lint_rule> rule)
+{
+    size_type idx = _rules.size();
+    if (rule->directives().empty())
+    {
+        _dispatch.add_any(idx);
+    }
+    else
+    {
+        for (const std::string& name : rule->directives())
+            _dispatch.add(idx, name);
+    }
+    _rules.emplace_back(std::move(rule));
+}
+
+void linter::dispatch(lint_context& cxt) const
+{
+    _dispatch.for_each(cxt._entry->name(), [&] (size_type idx)
+    {
+        const lint_rule& rule = *_rules[idx];
+        if (rule.contexts() & cxt._context)
+        {
+            cxt._rule = &rule;
+            rule.check(cxt);
+        }
+        return true;
+    });
+}
+
+unsigned int linter::child_context(const ast_entry& entry, unsigned int context) const
+{
+    if (entry.kind() == ast_entry_kind::document)
+        return context;
+
+    const directive_schema* schema = _schema->find(entry.name(), context);
+    return schema && (schema->args & args_block) ? schema->block_context : context_opaque;
+}
+
+void linter::check_subtree(lint_context& cxt, const ast_entry& entry, unsigned int context) const
+{
+    if (entry.kind() != ast_entry_kind::document)
+    {
+        cxt._entry   = &entry;
+        cxt._context = context;
+        dispatch(cxt);
+    }
+
+    if (has_children(entry))
+    {
+        unsigned int inner = child_context(entry, context);
+        cxt._path.push_back(&entry);
+        for (const ast_entry& child : entry.children())
+        {
+            if (child.kind() != ast_entry_kind::comment)
+                check_subtree(cxt, child, inner);
+        }
+        cxt._path.pop_back();
+    }
+}
+
+void linter::check_unit(lint_context&                  cxt,
+                        const ast_entry&               entry,
+                        const lint_context::path_type& path,
+                        unsigned int                   context,
+                        bool                           whole
+                       ) const
+{
+    cxt._path = path;
+    if (whole)
+    {
+        check_subtree(cxt, entry, context);
+    }
+    else if (entry.kind() != ast_entry_kind::document)
+    {
+        cxt._entry   = &entry;
+        cxt._context = context;
+        dispatch(cxt);
+    }
+}
+
+class linter::job
+{
+public:
+    /** Part of the tree which can be checked independently of the rest. **/
+    struct unit
+    {
+        const ast_entry*                 entry;
+        const lint_context::path_type*   path;
+        unsigned int                     context;
+        /** Check everything inside of \c entry too? If not, its children are units of their own. **/
+        bool                             whole;
+    };
+
+    /** The diagnostics of a unit are <tt>[begin, end)</tt> in the list of the thread which checked it. **/
+    struct unit_result
+    {
+        size_type thread;
+        size_type begin;
+        size_type end;
+    };
+
+public:
+    job(const linter& owner, const ast_entry& root, unsigned int context) :
+            _owner(owner),
+            _next(0),
+            _failed(false)
+    {
+        _paths.emplace_back(1, &root);
+        split(root, _paths.back(), context, 1);
+        _results.resize(_units.size());
+    }
+
+    size_type units() const { return _units.size(); }
+
+    void run(size_type threads)
+    {
+        _outputs.resize(threads);
+        _errors.resize(threads);
+
+        // The calling thread is worker 0. Units are taken from a shared counter, so if a thread can not be started the
+        // others simply check more of them.
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+        for (size_type worker = 1; worker < threads; ++worker)
+        {
+            try
+            {
+                workers.emplace_back([this, worker] { work(worker); });
+            }
+            catch (const std::system_error&)
+            {
+                break;
+            }
+        }
+        work(0);
+        for (std::thread& t : workers)
+            t.join();
+
+        // each worker stops at its first failure, so the one with the earliest unit is what a single thread would throw
+        const std::pair<size_type, std::exception_ptr>* first_error = nullptr;
+        for (const auto& error : _errors)
+        {
+            if (error.second && (!first_error || error.first < first_error->first))
+                first_error = &error;
+        }
+        if (first_error)
+            std::rethrow_exception(first_error->second);
+    }
+
+    lint_diagnostic_list take_diagnostics()
+    {
+        size_type count = 0;
+        for (const lint_diagnostic_list& output : _outputs)
+            count += output.size();
+
+        lint_diagnostic_list out;
+        out.reserve(count);
+        for (const unit_result& result : _results)
+        {
+            lint_diagnostic_list& output = _outputs[result.thread];
+            for (size_type idx = result.begin; idx < result.end; ++idx)
+                out.emplace_back(std::move(output[idx]));
+        }
+        return out;
+    }
+
+private:
+    void split(const ast_entry& owner, const lint_context::path_type& path, unsigned int context, size_type depth)
+    {
+        for (const ast_entry& child : owner.children())
+        {
+            if (child.kind() == ast_entry_kind::comment)
+                continue;
+
+            bool expand = has_children(child) && depth < _owner._split_depth;
+            _units.push_back(unit{ &child, &path, context, !expand });
+            if (expand)
+            {
+                _paths.push_back(path);
+                _paths.back().push_back(&child);
+                split(child, _paths.back(), _owner.child_context(child, context), depth + 1);
+            }
+        }
+    }
+
+    void work(size_type worker)
+    {
+        lint_diagnostic_list& output = _outputs[worker];
+        lint_context cxt = _owner.make_context(output);
+        while (!_failed.load(std::memory_order_relaxed))
+        {
+            size_type idx = _next.fetch_add(1, std::memory_order_relaxed);
+            if (idx >= _units.size())
+                break;
+
+            const unit& item = _units[idx];
+            unit_result& result = _results[idx];
+            result.thread = worker;
+            result.begin  = output.size();
+            try
+            {
+                _owner.check_unit(cxt, *item.entry, *item.path, item.context, item.whole);
+            }
+            catch (...)
+            {
+                _errors[worker] = std::make_pair(idx, std::current_exception());
+                _failed.store(true, std::memory_order_relaxed);
+            }
+            result.end = output.size();
+        }
+    }
+
+private:
+    const linter&                                         _owner;
+    std::vector<unit>                                     _units;
+    /** The paths of the units; a deque so adding one does not move the others. **/
+    std::deque<lint_context::path_type>                   _paths;
+    std::vector<unit_result>                              _results;
+    std::vector<lint_diagnostic_list>                     _outputs;
+    std::vector<std::pair<size_type, std::exception_ptr>> _errors;
+    std::atomic<size_type>                                _next;
+    std::atomic<bool>                                     _failed;
+};
+
+lint_diagnostic_list linter::run(const ast_entry& root, size_type threads, unsigned int context) const
+{
+    if (!has_children(root))
+        throw kind_error("Can only lint a complex entry or a document");
+
+    job work(*this, root, context);
+
+    if (threads == 0)
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    threads = std::max<size_type>(1, std::min(threads, work.units()));
+
+    work.run(threads);
+    return work.take_diagnostics();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Standard Rules                                                                                                     //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+bool equals_ignore_case(const std::string& a, const char* b)
+{
+    std::size_t idx = 0;
+    for (; idx < a.size() && b[idx]; ++idx)
+    {
+        if (std::tolower(static_cast<unsigned char>(a[idx])) != std::tolower(static_cast<unsigned char>(b[idx])))
+            return false;
+    }
+    return idx == a.size() && !b[idx];
+}
+
+bool is_directive(const ast_entry& entry)
+{
+    return entry.kind() == ast_entry_kind::simple || entry.kind() == ast_entry_kind::complex;
+}
+
+class alias_traversal_rule :
+        public lint_rule
+{
+public:
+    alias_traversal_rule() :
+            lint_rule("alias_traversal", { "alias" }, context_http_location, lint_severity::error)
+    { }
+
+    virtual void check(lint_context& cxt) const override
+    {
+        const ast_entry& location = cxt.parent();
+        const ast_entry::attribute_list& args = location.attributes();
+        const ast_entry::attribute_list& alias = cxt.entry().attributes();
+        if (location.kind() != ast_entry_kind::complex || args.empty() || alias.empty())
+            return;
+
+        // only prefix locations: "location /path" and "location ^~ /path"
+        if (args.size() == 2 && args[0] != "^~")
+            return;
+        const std::string& path = args.back();
+        if (path.empty() || path[0] != '/' || path.back() == '/' || alias.front().back() != '/')
+            return;
+
+        cxt.report("location \"" + path + "\" does not end in \"/\" but its alias \"" + alias.front() + "\" does, "
+                   "which allows requests to leave the aliased directory"
+                  );
+    }
+};
+
+class proxy_host_header_rule :
+        public lint_rule
+{
+public:
+    proxy_host_header_rule() :
+            lint_rule("proxy_host_header",
+                      { "proxy_pass" },
+                      context_http_location | context_http_location_if | context_limit_except
+                     )
+    { }
+
+    virtual void check(lint_context& cxt) const override
+    {
+        // proxy_set_header is inherited from the enclosing block only if a block sets no headers of its own
+        const lint_context::path_type& path = cxt.path();
+        for (auto iter = path.rbegin(); iter != path.rend(); ++iter)
+        {
+            bool sets_headers = false;
+            for (const ast_entry& sibling : (*iter)->children())
+            {
+                if (sibling.kind() != ast_entry_kind::simple || sibling.name() != "proxy_set_header")
+                    continue;
+                if (!sibling.attributes().empty() && equals_ignore_case(sibling.attributes().front(), "Host"))
+                    return;
+                sets_headers = true;
+            }
+            if (sets_headers)
+                break;
+        }
+        cxt.report("proxy_pass without \"proxy_set_header Host\" sends the name of the upstream as the Host header");
+    }
+};
+
+class duplicate_directive_rule :
+        public lint_rule
+{
+public:
+    duplicate_directive_rule() :
+            lint_rule("duplicate_directive",
+                      { "alias", "client_max_body_size", "fastcgi_pass", "grpc_pass", "proxy_pass", "root",
+                        "try_files", "uwsgi_pass", "worker_processes",
+                      },
+                      context_any,
+                      lint_severity::error
+                     )
+    { }
+
+    virtual void check(lint_context& cxt) const override
+    {
+        const ast_entry& entry = cxt.entry();
+        for (const ast_entry& sibling : cxt.parent().children())
+        {
+            if (&sibling == &entry)
+                break;
+            if (is_directive(sibling) && sibling.name() == entry.name())
+            {
+                cxt.report("\"" + entry.name() + "\" directive is duplicate");
+                break;
+            }
+        }
+    }
+};
+
+}
+
+void add_standard_lint_rules(linter& out)
+{
+    out.add(std::make_shared<alias_traversal_rule>());
+    out.add(std::make_shared<proxy_host_header_rule>());
+    out.add(std::make_shared<duplicate_directive_rule>());
+}
+
+}
@@ -0,0 +1,172 @@
+/** \file
+ *  
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/memory_usage.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <ostream>
+#include <vector>
+
+namespace nginxconfig
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers                                                                                                            //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+using size_type = memory_breakdown::size_type;
+
+#if NGINXCONFIG_USE_LIBSTDCXX_INTERNALS
+
+/** libstdc++ keeps the map of a deque in a protected member of its (protected) base class. A pointer to the member
+ *  formed through a derived class can be used on any instance of the base, and a C-style cast is allowed to reach an
+ *  inaccessible base, so the real sizes can be read instead of guessing at the history of pushes and pops. None of these
+ *  names are an interface, which is why \c NGINXCONFIG_USE_LIBSTDCXX_INTERNALS can turn this off.
+**/
+template <typename T>
+struct deque_internals :
+        std::_Deque_base<T, std::allocator<T>>
+{
+    using base_type = std::_Deque_base<T, std::allocator<T>>;
+    
+    static size_type allocated_bytes(const std::deque<T>& container)
+    {
+        const auto& impl = ((const base_type&) container).*(&deque_internals::_M_impl);
+        size_type blocks = size_type(impl._M_finish._M_node - impl._M_start._M_node) + 1;
+        return impl._M_map_size * sizeof(T*) + blocks * std::__deque_buf_size(sizeof(T)) * sizeof(T);
+    }
+};
+
+template <typename T>
+size_type deque_bytes(const std::deque<T>& container)
+{
+    return deque_internals<T>::allocated_bytes(container);
+}
+
+#else
+
+/** Without the internals, the blocks in use are counted where the addresses of neighboring elements stop being next to
+ *  each other, which works for any deque. Their size and the size of the map are not visible, so they are estimated
+ *  with the choices of libstdc++: blocks of 512 bytes (or a single element) and a map of at least 8 pointers with room
+ *  to grow on either side. The map is often larger than that after many pushes, so this is a lower bound.
+**/
+template <typename T>
+size_type deque_bytes(const std::deque<T>& container)
+{
+    size_type per_block = sizeof(T) < 512 ? 512 / sizeof(T) : 1;
+    size_type blocks    = 1;
+    for (size_type idx = 1; idx < container.size(); ++idx)
+    {
+        if (&container[idx] != &container[idx - 1] + 1)
+            ++blocks;
+    }
+    return std::max<size_type>(8, blocks + 2) * sizeof(T*) + blocks * per_block * sizeof(T);
+}
+
+#endif
+
+template <typename T>
+void add_container(memory_breakdown& out, const std::deque<T>& container)
+{
+    size_type bytes = deque_bytes(container);
+    out.container_bytes          += bytes;
+    out.container_overhead_bytes += bytes - container.size() * sizeof(T);
+}
+
+void add_string(memory_breakdown& out, const std::string& s)
+{
+    // a string keeps short text inside of itself
+    const char* text = s.data();
+    const char* self = reinterpret_cast<const char*>(&s);
+    if (text < self || text >= self + sizeof s)
+    {
+        ++out.heap_strings;
+        out.heap_string_bytes += s.capacity() + 1;
+    }
+    else if (!s.empty())
+    {
+        ++out.inline_strings;
+        out.inline_string_bytes += s.size();
+    }
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// memory_usage                                                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::ostream& operator<<(std::ostream& os, const memory_breakdown& usage)
+{
+    return os << "{nodes=" << usage.nodes()
+              << " (simple=" << usage.simple_nodes
+              << " complex=" << usage.complex_nodes
+              << " document=" << usage.document_nodes
+              << " comment=" << usage.comment_nodes
+              << " deferred=" << usage.deferred_nodes
+              << ") strings=" << usage.inline_strings << " inline/" << usage.inline_string_bytes << "B "
+              << usage.heap_strings << " heap/" << usage.heap_string_bytes << "B"
+              << " containers=" << usage.container_bytes << "B (overhead " << usage.container_overhead_bytes << "B)"
+              << " indexes=" << usage.index_bytes << "B"
+              << " total=" << usage.total_bytes << "B}";
+}
+
+memory_breakdown memory_usage(const ast_entry& root)
+{
+    static const ast_entry::child_list empty_children;
+    
+    memory_breakdown out;
+    std::vector<const ast_entry*> pending = { &root };
+    while (!pending.empty())
+    {
+        const ast_entry& entry = *pending.back();
+        pending.pop_back();
+        
+        switch (entry._kind)
+        {
+            case ast_entry_kind::simple:   ++out.simple_nodes;   break;
+            case ast_entry_kind::complex:  ++out.complex_nodes;  break;
+            case ast_entry_kind::document: ++out.document_nodes; break;
+            case ast_entry_kind::comment:  ++out.comment_nodes;  break;
+        }
+        bool loaded = entry.children_loaded();
+        if (!loaded)
+            ++out.deferred_nodes;
+        
+        // every member is there whatever the kind, so the unused ones are counted, too
+        add_string(out, entry._name);
+        add_string(out, entry._comment);
+        add_container(out, entry._attributes);
+        for (const std::string& attribute : entry._attributes)
+            add_string(out, attribute);
+        out.index_bytes += entry.index_bytes();
+        
+        if (loaded)
+        {
+            add_container(out, entry._children);
+            for (const ast_entry& child : entry._children)
+                pending.push_back(&child);
+        }
+        else
+        {
+            // deferred children are not loaded just to measure them and another thread might be loading them right now,
+            // so the container is taken to be as it was left: empty
+            add_container(out, empty_children);
+        }
+    }
+    out.total_bytes = out.heap_string_bytes + out.container_bytes + out.index_bytes;
+    return out;
+}
+
+}
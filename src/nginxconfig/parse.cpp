@@ -14,32 +14,21 @@
 #   define NGINXCONFIG_DEBUG 0
 #endif
 
-/** \def NGINXCONFIG_USE_BOOST_REGEX
- *  Should the parser use the regex implementation from Boost instead of the C++ Standard Library? GCC versions below
- *  4.8 will happy compile regular expressions, but will fail at runtime, so this must be set if you are using GCC under
- *  4.9!
-**/
-#ifndef NGINXCONFIG_USE_BOOST_REGEX
-#   define NGINXCONFIG_USE_BOOST_REGEX 0
-#endif
-
-/** \def NGINXCONFIG_CHECK_REGEX_IMPLEMENTATION
- *  Should we check the regex implementation? If set to \c 1 (default), this file will fail to compile if it does not
- *  believe your standard library implementation has a working regular expression engine. Set this value to \c 0 to
- *  disable this check if you know your standard library implementation works fine.
-**/
-#ifndef NGINXCONFIG_CHECK_REGEX_IMPLEMENTATION
-#   define NGINXCONFIG_CHECK_REGEX_IMPLEMENTATION 1
-#endif
-
 #include <nginxconfig/ast.hpp>
+#include <nginxconfig/file_io.hpp>
 #include <nginxconfig/parse.hpp>
 #include <nginxconfig/parse_types.hpp>
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <fstream>
+#include <iterator>
+#include <limits>
 #include <sstream>
+#include <vector>
 
 #if NGINXCONFIG_DEBUG
 #   include <iostream>
@@ -48,19 +37,6 @@
 #   define NGINXCONFIG_DEBUG_PRINT(x)
 #endif
 
-#if NGINXCONFIG_USE_BOOST_REGEX
-#   include <boost/regex.hpp>
-#else
-#   if NGINXCONFIG_CHECK_REGEX_IMPLEMENTATION
-#       ifdef __GNUC__
-#           if (__GNUC__ == 4) && (__GNUC_MINOR__ < 9)
-#               error "Cannot use Standard Library regex implementation with GCC < 4.9! Please compile with NGINXCONFIG_USE_BOOST_REGEX=1 (or disable this check with NGINXCONFIG_CHECK_REGEX_IMPLEMENTATION=0)."
-#           endif
-#       endif
-#   endif
-#   include <regex>
-#endif
-
 namespace nginxconfig
 {
 
@@ -94,6 +70,38 @@ parse_error::parse_error(size_type line_, size_type column_, size_type character
 
 parse_error::~parse_error() noexcept = default;
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// parse_hooks                                                                                                        //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+constexpr bool parse_stats::enabled;
+
+parse_hooks::~parse_hooks() noexcept = default;
+
+void parse_hooks::parse_begin()
+{ }
+
+void parse_hooks::entry_added(const ast_entry&, size_type)
+{ }
+
+void parse_hooks::parse_end(const parse_stats&)
+{ }
+
+#if NGINXCONFIG_PARSE_STATS
+static thread_local std::uint64_t thread_allocation_count = 0;
+static thread_local std::uint64_t thread_allocation_bytes = 0;
+#endif
+
+void note_allocation(std::size_t bytes) noexcept
+{
+    #if NGINXCONFIG_PARSE_STATS
+    ++thread_allocation_count;
+    thread_allocation_bytes += bytes;
+    #else
+    (void) bytes;
+    #endif
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Parser Implementation                                                                                              //
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -101,150 +109,803 @@ parse_error::~parse_error() noexcept = default;
 namespace parser
 {
 
-bool context::next()
+constexpr std::size_t context::buffer_size;
+constexpr int         context::eof;
+
+static bool is_space(int ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+bool context::refill()
 {
-    character_no = character_no_next;
-    if (std::getline(input, current))
+    if (!_input)
+        return false;
+    
+    std::chrono::steady_clock::time_point start;
+    if (time_reads)
+        start = std::chrono::steady_clock::now();
+    std::streamsize count = _input->sgetn(_buffer, buffer_size);
+    if (time_reads)
+        read_ns += std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()
+                                                                                      - start
+                                                                                     ).count()
+                                );
+    _pos = _buffer;
+    _end = _buffer + (count > 0 ? count : 0);
+    return _pos != _end;
+}
+
+void context::next(token& out)
+{
+    out.text.clear();
+    while (true)
     {
-        NGINXCONFIG_DEBUG_PRINT("LINE:\t" << current);
-        character_no_next = character_no + current.size();
-        ++line_no;
-        return true;
+        int ch = peek();
+        if (ch == eof)
+        {
+            // whitespace at the very end is a blank line of its own; the end of a part of a larger source is not
+            if (_at_source_end && !_line_has_content && character_no_next > _line_start)
+            {
+                out.kind  = token_kind::blank_line;
+                out.begin = _line_start;
+                out.end   = character_no_next;
+                out.line  = _line;
+                _line_has_content = true;
+                break;
+            }
+            out.kind = token_kind::end;
+            out.begin = out.end = character_no_next;
+            out.line  = _line;
+            break;
+        }
+        else if (ch == '\n')
+        {
+            bool blank = !_line_has_content;
+            size_type line       = _line;
+            size_type line_start = _line_start;
+            size_type line_end   = character_no_next;
+            advance(ch);
+            if (blank)
+            {
+                out.kind  = token_kind::blank_line;
+                out.begin = line_start;
+                out.end   = line_end;
+                out.line  = line;
+                break;
+            }
+        }
+        else if (is_space(ch))
+        {
+            advance(ch);
+        }
+        else
+        {
+            _line_has_content = true;
+            out.begin = character_no_next;
+            out.line  = _line;
+            if (ch == ';' || ch == '{' || ch == '}')
+            {
+                out.kind = ch == ';' ? token_kind::semicolon
+                         : ch == '{' ? token_kind::block_start
+                         :             token_kind::block_end;
+                advance(ch);
+            }
+            else if (ch == '#')
+            {
+                out.kind = token_kind::comment;
+                advance(ch);
+                for (ch = peek(); ch != eof && ch != '\n'; ch = peek())
+                {
+                    out.text.push_back(char(ch));
+                    advance(ch);
+                }
+            }
+            else
+            {
+                out.kind = token_kind::word;
+                character_no = out.begin;
+                line_no      = out.line;
+                if (ch == '"' || ch == '\'')
+                    read_quoted(out, ch);
+                else
+                    read_unquoted(out);
+            }
+            out.end = character_no_next;
+            break;
+        }
     }
-    else
+    character_no = out.begin;
+    line_no      = out.line;
+}
+
+bool context::read_trailing_comment(token& out)
+{
+    int ch = peek();
+    while (ch == ' ' || ch == '\t' || ch == '\r')
     {
+        advance(ch);
+        ch = peek();
+    }
+    if (ch != '#')
         return false;
+    
+    out.kind = token_kind::comment;
+    out.text.clear();
+    out.begin = character_no_next;
+    out.line  = _line;
+    advance(ch);
+    for (ch = peek(); ch != eof && ch != '\n'; ch = peek())
+    {
+        out.text.push_back(char(ch));
+        advance(ch);
     }
+    out.end      = character_no_next;
+    character_no = out.begin;
+    line_no      = out.line;
+    return true;
 }
 
-ast_entry::attribute_list split_attributes(const std::string& attrs)
+void context::skip_block(token& out, size_type max_nested)
 {
-    ast_entry::attribute_list out;
-    std::string::size_type pos = 0;
-    while ((pos = attrs.find_first_not_of(" \t", pos)) != std::string::npos)
+    size_type depth      = 0;
+    bool      word_start = true;
+    while (true)
     {
-        auto pos_end = attrs.find_first_of(" \t", pos);
-        out.emplace_back(attrs.substr(pos, pos_end - pos));
-        pos = pos_end;
+        int ch = peek();
+        if (ch == eof)
+            throw create_parse_error(parse_error::no_column, "EOF reached while inside nested entry");
+        
+        if (is_space(ch))
+        {
+            advance(ch);
+            word_start = true;
+            continue;
+        }
+        
+        _line_has_content = true;
+        if (word_start && (ch == '"' || ch == '\''))
+        {
+            int quote = ch;
+            advance(ch);
+            for (ch = peek(); ch != quote; ch = peek())
+            {
+                if (ch == eof)
+                    throw create_parse_error(parse_error::no_column, "EOF reached inside of a quoted string");
+                advance(ch);
+                if (ch == '\\' && (ch = peek()) != eof)
+                    advance(ch);
+            }
+            advance(ch);
+            word_start = false;
+        }
+        else if (word_start && ch == '#')
+        {
+            for (; ch != eof && ch != '\n'; ch = peek())
+                advance(ch);
+        }
+        else if (word_start && ch == '}')
+        {
+            if (depth == 0)
+            {
+                out.kind  = token_kind::block_end;
+                out.text.clear();
+                out.begin = character_no_next;
+                out.line  = _line;
+                advance(ch);
+                out.end      = character_no_next;
+                character_no = out.begin;
+                line_no      = out.line;
+                return;
+            }
+            --depth;
+            advance(ch);
+        }
+        else if (ch == '{' || ch == ';')
+        {
+            if (ch == '{' && ++depth > max_nested)
+            {
+                character_no = character_no_next;
+                line_no      = _line;
+                throw create_parse_error(column(), "Nested entries exceed the maximum depth");
+            }
+            advance(ch);
+            word_start = true;
+        }
+        else
+        {
+            // the same rules as read_unquoted, without keeping the text
+            advance(ch);
+            word_start = false;
+            if (ch == '\\' && (ch = peek()) != eof)
+            {
+                advance(ch);
+            }
+            else if (ch == '$' && peek() == '{')
+            {
+                for (ch = peek(); ch != eof; ch = peek())
+                {
+                    advance(ch);
+                    if (ch == '}')
+                        break;
+                }
+            }
+        }
     }
-    return out;
 }
 
-line_components line_components::create_from_line(const std::string& line)
+void context::read_quoted(token& out, int quote)
 {
-    #if NGINXCONFIG_USE_BOOST_REGEX
-    using regex = boost::regex;
-    using smatch = boost::smatch;
-    using boost::regex_match;
-    namespace regex_constants = boost::regex_constants;
-    #else
-    using regex = std::regex;
-    using smatch = std::smatch;
-    using std::regex_match;
-    namespace regex_constants = std::regex_constants;
-    #endif
+    out.text.push_back(char(quote));
+    advance(quote);
+    while (true)
+    {
+        int ch = peek();
+        if (ch == eof)
+            throw create_parse_error(parse_error::no_column, "EOF reached inside of a quoted string");
+        out.text.push_back(char(ch));
+        advance(ch);
+        if (ch == '\\')
+        {
+            ch = peek();
+            if (ch == eof)
+                throw create_parse_error(parse_error::no_column, "EOF reached inside of a quoted string");
+            out.text.push_back(char(ch));
+            advance(ch);
+        }
+        else if (ch == quote)
+        {
+            break;
+        }
+    }
     
-    // All lines follow the same basic format:
-    //  0) whole match
-    //  1) name
-    //  2) attributes
-    //  3) either {, } or ;
-    //  4) comment including #
-    //  5) comment not including #
-    static const regex line_regex(R"([ \t]*([A-Za-z_][A-Za-z0-9_]*)?[ \t]*([^{};#]*)([{};]?)[ \t]*(#(.*))?)",
-                                  regex_constants::syntax_option_type(regex_constants::ECMAScript | regex_constants::optimize)
-                                 );
-    
-    smatch results;
+    // like nginx, a quoted string must be followed by something which ends it (a ")" is allowed for "if")
+    int ch = peek();
+    if (ch != eof && !is_space(ch) && ch != ';' && ch != '{' && ch != ')')
+        throw create_parse_error(column(), "Unexpected \"", char(ch), "\" after a quoted string");
+}
+
+void context::read_unquoted(token& out)
+{
+    for (int ch = peek(); ch != eof && !is_space(ch) && ch != ';' && ch != '{'; ch = peek())
+    {
+        out.text.push_back(char(ch));
+        advance(ch);
+        if (ch == '\\')
+        {
+            ch = peek();
+            if (ch == eof)
+                break;
+            out.text.push_back(char(ch));
+            advance(ch);
+        }
+        else if (ch == '$' && peek() == '{')
+        {
+            // ${name} keeps its braces as part of the word
+            for (ch = peek(); ch != eof; ch = peek())
+            {
+                out.text.push_back(char(ch));
+                advance(ch);
+                if (ch == '}')
+                    break;
+            }
+        }
+    }
+}
+
+line_components line_components::create_from_line(const std::string& line)
+{
+    std::istringstream input(line);
+    context cxt(input);
+    token tok;
     line_components out;
-    if (regex_match(line, results, line_regex))
-    {
-        #if NGINXCONFIG_DEBUG
-        NGINXCONFIG_DEBUG_PRINT("REGEX MATCH sz=" << results.size());
-        for (const auto& x : results)
-        {
-            NGINXCONFIG_DEBUG_PRINT("\t|" << x << '|');
-        }
-        #endif
-        assert(results.size() == 6);
-        out.name = results[1];
-        out.attributes = split_attributes(results[2]);
-        const std::string& tok = results[3];
-        out.category = tok.size() == 0 ? line_kind::comment
-                     : tok[0] == '{'    ? line_kind::complex_start
-                     : tok[0] == '}'    ? line_kind::complex_end
-                     : tok[0] == ';'    ? line_kind::simple
-                     :                    line_kind::unknown;
-        out.comment = results[5];
-        NGINXCONFIG_DEBUG_PRINT(out.comment);
+    bool has_name = false;
+    while (true)
+    {
+        try
+        {
+            cxt.next(tok);
+        }
+        catch (const parse_error&)
+        {
+            return line_components();
+        }
+        if (tok.kind == token_kind::end)
+            break;
+        
+        switch (tok.kind)
+        {
+            case token_kind::word:
+                if (out.category != line_kind::unknown)
+                    return line_components();
+                if (has_name)
+                    out.attributes.emplace_back(std::move(tok.text));
+                else
+                    out.name = std::move(tok.text);
+                has_name = true;
+                break;
+            case token_kind::semicolon:
+            case token_kind::block_start:
+            case token_kind::block_end:
+                if (out.category != line_kind::unknown || has_name != (tok.kind != token_kind::block_end))
+                    return line_components();
+                out.category = tok.kind == token_kind::semicolon   ? line_kind::simple
+                             : tok.kind == token_kind::block_start ? line_kind::complex_start
+                             :                                       line_kind::complex_end;
+                break;
+            case token_kind::comment:
+                out.comment = std::move(tok.text);
+                break;
+            default:
+                break;
+        }
     }
+    if (out.category == line_kind::unknown && !has_name)
+        out.category = line_kind::comment;
     return out;
 }
 
-bool parse_generic(context& cxt, ast_entry& owner)
+#if NGINXCONFIG_PARSE_STATS
+
+/** Collects the \c parse_stats and calls the \c parse_hooks of a single parse. When neither is wanted, every member
+ *  function is a single branch.
+**/
+class instrumentation
 {
-    while (cxt.next())
+public:
+    using clock     = std::chrono::steady_clock;
+    using size_type = parse_stats::size_type;
+    
+    enum class phase
+    {
+        none,
+        tokenize,
+        build,
+    };
+    
+public:
+    instrumentation(parse_stats* out, parse_hooks* hooks, context& cxt) :
+            _out(out),
+            _hooks(hooks),
+            _active(out || hooks),
+            _phase(phase::none)
     {
-        line_components components = line_components::create_from_line(cxt.current);
-        switch (components.category)
+        if (!_active)
+            return;
+        
+        cxt.time_reads     = true;
+        _first_character   = cxt.character_no_next;
+        _read_ns           = cxt.read_ns;
+        _allocation_count  = thread_allocation_count;
+        _allocation_bytes  = thread_allocation_bytes;
+        if (_hooks)
+            _hooks->parse_begin();
+        _start = _phase_start = clock::now();
+    }
+    
+    /** Charge the time since the last call to the current phase and start \a next. **/
+    void enter(phase next)
+    {
+        if (!_active)
+            return;
+        
+        clock::time_point now = clock::now();
+        charge(now);
+        _phase       = next;
+        _phase_start = now;
+    }
+    
+    void entry_added(const ast_entry& entry, size_type depth)
+    {
+        if (!_active)
+            return;
+        
+        switch (entry.kind())
         {
-            case line_kind::comment:
-                owner.children().emplace_back(ast_entry::make_comment(std::move(components.comment)));
+            case ast_entry_kind::simple:
+                ++_stats.simple_nodes;
                 break;
-            case line_kind::simple:
-                owner.children().emplace_back(ast_entry::make_simple(std::move(components.name),
-                                                                     std::move(components.attributes),
-                                                                     std::move(components.comment)
-                                                                    )
-                                             );
+            case ast_entry_kind::complex:
+                ++_stats.complex_nodes;
+                _stats.max_depth = std::max(_stats.max_depth, depth + 1);
                 break;
-            case line_kind::complex_start:
-            {
-                ast_entry child = ast_entry::make_complex(std::move(components.name),
-                                                          std::move(components.attributes)
-                                                         );
-                while (parse_generic(cxt, child))
+            default:
+                ++_stats.comment_nodes;
+                break;
+        }
+        if (_hooks)
+            _hooks->entry_added(entry, depth);
+    }
+    
+    void finish(const context& cxt)
+    {
+        if (!_active)
+            return;
+        
+        clock::time_point now = clock::now();
+        charge(now);
+        // reading happens inside of the tokenizer
+        _stats.read_ns          = cxt.read_ns - _read_ns;
+        _stats.tokenize_ns     -= std::min(_stats.tokenize_ns, _stats.read_ns);
+        _stats.total_ns         = nanoseconds(now - _start);
+        _stats.bytes            = cxt.character_no_next - _first_character;
+        _stats.lines            = cxt.line_count();
+        _stats.allocations      = thread_allocation_count - _allocation_count;
+        _stats.allocated_bytes  = thread_allocation_bytes - _allocation_bytes;
+        if (_out)
+            *_out = _stats;
+        if (_hooks)
+            _hooks->parse_end(_stats);
+    }
+    
+private:
+    static std::uint64_t nanoseconds(clock::duration duration)
+    {
+        return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+    
+    void charge(clock::time_point now)
+    {
+        std::uint64_t elapsed = nanoseconds(now - _phase_start);
+        switch (_phase)
+        {
+            case phase::tokenize: _stats.tokenize_ns += elapsed; break;
+            case phase::build:    _stats.build_ns    += elapsed; break;
+            default:                                             break;
+        }
+    }
+    
+private:
+    parse_stats*      _out;
+    parse_hooks*      _hooks;
+    bool              _active;
+    parse_stats       _stats;
+    phase             _phase;
+    clock::time_point _start;
+    clock::time_point _phase_start;
+    size_type         _first_character;
+    std::uint64_t     _read_ns;
+    std::uint64_t     _allocation_count;
+    std::uint64_t     _allocation_bytes;
+};
+
+#   define NGINXCONFIG_PARSE_PROBE(action_) probe.action_
+#else
+#   define NGINXCONFIG_PARSE_PROBE(action_)
+#endif
+
+/** Parses the body of a block skipped with \c parse_options::lazy_blocks. **/
+class block_loader :
+        public ast_entry::child_loader
+{
+public:
+    block_loader(std::shared_ptr<const std::string> source, const parse_options& options) :
+            _source(std::move(source)),
+            _options(options)
+    {
+        // the depth was checked when skipping the block and the hooks were only promised to live through the parse
+        _options.max_depth = std::numeric_limits<parse_options::size_type>::max();
+        _options.hooks     = nullptr;
+    }
+    
+    virtual ast_entry::child_list load(const ast_entry& owner) const override
+    {
+        const source_range& range = owner.source();
+        const char*         text  = _source->data();
+        io::memory_buffer buffer(text + range.body_begin, range.body_end - range.body_begin);
+        std::istream input(&buffer);
+        context cxt(input,
+                    range.body_begin,
+                    range.line + std::count(text + range.begin, text + range.body_begin, '\n'),
+                    false,
+                    false
+                   );
+        cxt.source = _source;
+        
+        ast_entry body = ast_entry::make_document({});
+        parse_generic(cxt, body, _options);
+        
+        // a comment right after the { was attached to the block itself when it was skipped
+        ast_entry::child_list& children = body.children();
+        if (_options.trivia == trivia_mode::keep
+         && !children.empty()
+         && children.front().kind() == ast_entry_kind::comment
+         && children.front().source().begin < _source->find('\n', range.body_begin)
+           )
+        {
+            children.pop_front();
+        }
+        return std::move(children);
+    }
+    
+private:
+    std::shared_ptr<const std::string> _source;
+    parse_options                      _options;
+};
+
+/** Lends \c parse_generic the stack for the chain of entries it is filling. Stacks are kept per thread and keep their
+ *  capacity, so parsing again on the same thread does not allocate one. Loading a lazy block (say, from a
+ *  \c parse_hooks callback) starts another parse on the same thread while the first is still running, so stacks are
+ *  handed out by how deeply the parses are nested and a nested parse never shares the stack of the one it is inside.
+**/
+class frame_stack
+{
+public:
+    frame_stack() :
+            _stack(lend())
+    { }
+    
+    ~frame_stack() noexcept
+    {
+        _stack.clear();
+        --nesting();
+    }
+    
+    frame_stack(const frame_stack&) = delete;
+    frame_stack& operator=(const frame_stack&) = delete;
+    
+    std::vector<ast_entry*>& get() { return _stack; }
+    
+private:
+    static std::size_t& nesting()
+    {
+        static thread_local std::size_t value = 0;
+        return value;
+    }
+    
+    static std::vector<ast_entry*>& lend()
+    {
+        // a deque never moves existing elements on emplace_back, so the stacks lent to outer parses stay put
+        static thread_local std::deque<std::vector<ast_entry*>> stacks;
+        if (stacks.size() == nesting())
+            stacks.emplace_back();
+        return stacks[nesting()++];
+    }
+    
+private:
+    std::vector<ast_entry*>& _stack;
+};
+
+void parse_generic(context& cxt, ast_entry& document, const parse_options& options, parse_stats* stats)
+{
+    // Children are built in place inside of their owner (a deque never moves existing elements on emplace_back), so
+    // the frames are plain pointers.
+    frame_stack frames_lease;
+    std::vector<ast_entry*>& frames = frames_lease.get();
+    frames.push_back(&document);
+    
+    source_range& document_source = document.source();
+    document_source.begin      = cxt.character_no_next;
+    document_source.body_begin = cxt.character_no_next;
+    document_source.line       = cxt.line_no;
+    
+    #if NGINXCONFIG_PARSE_STATS
+    instrumentation probe(stats, options.hooks, cxt);
+    #else
+    (void) stats;
+    #endif
+    
+    // The directive being read: its words arrive one at a time until a ; or { finishes it
+    token                     tok;
+    bool                      has_name = false;
+    std::string               name;
+    ast_entry::attribute_list attributes;
+    token::size_type          entry_begin = 0;
+    token::size_type          entry_line  = 0;
+    // The last entry finished, so a comment following it on the same line can be attached to it
+    ast_entry*                last_entry = nullptr;
+    token::size_type          last_line  = 0;
+    // Blank lines since the last entry, for trivia_mode::count
+    std::uint32_t             blank_lines = 0;
+    const bool                keep_trivia = options.trivia == trivia_mode::keep;
+    // Set when the bodies of blocks are skipped instead of parsed
+    std::shared_ptr<const ast_entry::child_loader> loader;
+    if (options.lazy_blocks && cxt.source)
+        loader = std::make_shared<block_loader>(cxt.source, options);
+    
+    while (true)
+    {
+        NGINXCONFIG_PARSE_PROBE(enter(instrumentation::phase::tokenize));
+        cxt.next(tok);
+        if (tok.kind == token_kind::end)
+            break;
+        
+        NGINXCONFIG_PARSE_PROBE(enter(instrumentation::phase::build));
+        ast_entry& owner = *frames.back();
+        ast_entry* added = nullptr;
+        switch (tok.kind)
+        {
+            case token_kind::word:
+                if (has_name)
+                {
+                    attributes.emplace_back(std::move(tok.text));
+                }
+                else
                 {
-                    // do nothing
+                    has_name    = true;
+                    name        = std::move(tok.text);
+                    entry_begin = tok.begin;
+                    entry_line  = tok.line;
                 }
-                owner.children().emplace_back(std::move(child));
+                continue;
+            case token_kind::comment:
+                if (!keep_trivia)
+                    continue;
+                if (!has_name && last_entry && last_line == tok.line && last_entry->comment().empty())
+                {
+                    last_entry->comment() = std::move(tok.text);
+                    if (last_entry->kind() == ast_entry_kind::simple)
+                        last_entry->source().end = tok.end;
+                    continue;
+                }
+                owner.children().emplace_back(ast_entry::make_comment(std::move(tok.text)));
+                added = &owner.children().back();
+                break;
+            case token_kind::blank_line:
+                // whitespace inside of a directive split over several lines is just whitespace
+                if (has_name)
+                    continue;
+                if (!keep_trivia)
+                {
+                    if (options.trivia == trivia_mode::count && blank_lines < UINT32_MAX)
+                        ++blank_lines;
+                    continue;
+                }
+                owner.children().emplace_back(ast_entry::make_comment(std::string()));
+                added = &owner.children().back();
+                break;
+            case token_kind::semicolon:
+                if (!has_name)
+                    throw cxt.create_parse_error(cxt.column(), "Unexpected \";\"");
+                owner.children().emplace_back(ast_entry::make_simple(std::move(name), std::move(attributes)));
+                added = &owner.children().back();
                 break;
+            case token_kind::block_start:
+                if (!has_name)
+                    throw cxt.create_parse_error(cxt.column(), "Unexpected \"{\"");
+                if (frames.size() > options.max_depth)
+                    throw cxt.create_parse_error(cxt.column(),
+                                                 "Nested entries exceed the maximum depth of ", options.max_depth
+                                                );
+                owner.children().emplace_back(ast_entry::make_complex(std::move(name), std::move(attributes)));
+                added = &owner.children().back();
+                if (!loader)
+                    frames.push_back(added);
+                added->source().body_begin = tok.end;
+                break;
+            case token_kind::block_end:
+            {
+                if (has_name)
+                    throw cxt.create_parse_error(cxt.column(), "Unexpected \"}\": \"", name, "\" is missing a \";\"");
+                if (frames.size() == 1)
+                    throw cxt.create_parse_error(cxt.column(), "Unmatched end of nested entry");
+                source_range& closed = frames.back()->source();
+                closed.body_end = tok.begin;
+                closed.end      = tok.end;
+                frames.pop_back();
+                // a comment after a } goes on its own and blank lines before it are not kept
+                last_entry  = nullptr;
+                blank_lines = 0;
+                continue;
             }
-            case line_kind::complex_end:
-                if (owner.kind() == ast_entry_kind::document)
-                    throw cxt.create_parse_error(parse_error::no_column, "Unmatched end of nested entry");
-                else
-                    return false;
-            case line_kind::unknown:
             default:
-                throw cxt.create_parse_error(parse_error::no_column, "Indecipherable line: \"", cxt.current, '\"');
+                throw cxt.create_parse_error(cxt.column(), "Unexpected token");
+        }
+        
+        source_range& range = added->source();
+        if (has_name)
+        {
+            range.begin = entry_begin;
+            range.line  = entry_line;
+            has_name    = false;
+            added->blank_lines_before() = blank_lines;
+            blank_lines = 0;
+            name.clear();
+            attributes.clear();
+            last_entry  = added;
+            last_line   = tok.line;
+        }
+        else
+        {
+            range.begin = tok.begin;
+            range.line  = tok.line;
+        }
+        range.end = tok.end;
+        // a complex entry was pushed onto frames, but it does not enclose itself
+        NGINXCONFIG_PARSE_PROBE(entry_added(*added, frames.size() - (frames.back() == added ? 2 : 1)));
+        
+        if (tok.kind == token_kind::block_start && loader)
+        {
+            // only find where the body ends; it is parsed when someone asks for the children
+            NGINXCONFIG_PARSE_PROBE(enter(instrumentation::phase::tokenize));
+            if (cxt.read_trailing_comment(tok) && keep_trivia)
+                added->comment() = std::move(tok.text);
+            cxt.skip_block(tok, options.max_depth - frames.size());
+            range.body_end = tok.begin;
+            range.end      = tok.end;
+            added->defer_children(loader);
+            last_entry  = nullptr;
+            blank_lines = 0;
         }
     }
-    if (owner.kind() == ast_entry_kind::complex)
+    if (has_name)
+        throw cxt.create_parse_error(parse_error::no_column, "EOF reached while reading \"", name, "\"");
+    if (frames.size() > 1)
         throw cxt.create_parse_error(parse_error::no_column, "EOF reached while inside nested entry");
-    else
-        return false;
+    
+    document_source.body_end = cxt.character_no_next;
+    document_source.end      = cxt.character_no_next;
+    NGINXCONFIG_PARSE_PROBE(finish(cxt));
 }
 
+#undef NGINXCONFIG_PARSE_PROBE
+
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Entry Points                                                                                                       //
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-ast_entry parse(std::istream& input)
+constexpr parse_options::size_type parse_options::default_max_depth;
+
+/** Read all of \a input into memory for \c parse_options::lazy_blocks, so skipped blocks can be parsed later. **/
+static ast_entry parse_lazily(std::istream& input, const parse_options& options, parse_stats* stats)
+{
+    std::shared_ptr<const std::string> source = std::make_shared<const std::string>(std::istreambuf_iterator<char>(input),
+                                                                                    std::istreambuf_iterator<char>()
+                                                                                   );
+    io::memory_buffer buffer(source->data(), source->size());
+    std::istream memory_input(&buffer);
+    parser::context cxt(memory_input);
+    cxt.source = std::move(source);
+    auto out = ast_entry::make_document({});
+    parser::parse_generic(cxt, out, options, stats);
+    return out;
+}
+
+ast_entry parse(std::istream& input, const parse_options& options)
+{
+    if (options.lazy_blocks)
+        return parse_lazily(input, options, nullptr);
+    
+    parser::context cxt(input);
+    auto out = ast_entry::make_document({});
+    parser::parse_generic(cxt, out, options);
+    return out;
+}
+
+ast_entry parse(std::istream& input, const parse_options& options, parse_stats& stats)
 {
+    stats = parse_stats();
+    if (options.lazy_blocks)
+        return parse_lazily(input, options, &stats);
     parser::context cxt(input);
     auto out = ast_entry::make_document({});
-    parser::parse_generic(cxt, out);
+    parser::parse_generic(cxt, out, options, &stats);
     return out;
 }
 
+ast_entry parse(std::istream& input)
+{
+    return parse(input, parse_options());
+}
+
+ast_entry parse_file(const std::string& filename, const parse_options& options)
+{
+    std::ifstream file(filename.c_str());
+    return parse(file, options);
+}
+
+ast_entry parse_file(const std::string& filename, const parse_options& options, parse_stats& stats)
+{
+    std::ifstream file(filename.c_str());
+    return parse(file, options, stats);
+}
+
 /** Convenience function to parse a given file. **/
 ast_entry parse_file(const std::string& filename)
 {
-    std::ifstream file(filename.c_str());
-    return parse(file);
+    return parse_file(filename, parse_options());
 }
 
 }
@@ -0,0 +1,728 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/ast.hpp>
+#include <nginxconfig/file_io.hpp>
+#include <nginxconfig/memory_usage.hpp>
+#include <nginxconfig/parse_cache.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <istream>
+#include <stdexcept>
+
+#include <glob.h>
+#include <sys/stat.h>
+
+namespace nginxconfig
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers                                                                                                            //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+using size_type = parse_cache::size_type;
+
+/** The heap memory used by \a root and everything inside of it, including the root itself (which is allocated along
+ *  with the shared pointer).
+**/
+size_type estimate_cost(const ast_entry& root)
+{
+    return sizeof(ast_entry) + memory_usage(root).total_bytes;
+}
+
+/** The memory used by the record of \a path: the path is both its key and in the list of its document. **/
+size_type path_cost(const std::string& path)
+{
+    return 2 * (sizeof(std::string) + path.size()) + 5 * sizeof(std::uint64_t);
+}
+
+std::string strip_quotes(const std::string& s)
+{
+    if (s.size() >= 2 && (s.front() == '"' || s.front() == '\'') && s.back() == s.front())
+        return s.substr(1, s.size() - 2);
+    else
+        return s;
+}
+
+bool is_include(const ast_entry& entry)
+{
+    return entry.kind() == ast_entry_kind::simple && entry.name() == "include" && entry.attributes().size() == 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Binary Form                                                                                                        //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The saved form is a magic string followed by the documents (each with its content hash and its text) and then the
+// path records.
+// Integers are written in native byte order, since a saved cache is only meaningful on the machine which wrote it.
+// Entries are written in pre-order: the kind, then the fields that kind has, then the number of children.
+
+const char saved_magic[8] = { 'N', 'G', 'X', 'C', 'A', 'C', 'H', '3' };
+
+class binary_writer
+{
+public:
+    explicit binary_writer(std::ostream& output) :
+            _output(output)
+    { }
+
+    void write_u64(std::uint64_t x)
+    {
+        _output.write(reinterpret_cast<const char*>(&x), sizeof x);
+    }
+
+    void write_string(const std::string& s)
+    {
+        write_u64(s.size());
+        _output.write(s.data(), s.size());
+    }
+
+    void write_document(const ast_entry& root)
+    {
+        std::vector<const ast_entry*> pending = { &root };
+        while (!pending.empty())
+        {
+            const ast_entry& entry = *pending.back();
+            pending.pop_back();
+
+            write_u64(static_cast<std::uint64_t>(entry.kind()));
+            if (entry.kind() == ast_entry_kind::simple || entry.kind() == ast_entry_kind::complex)
+            {
+                write_string(entry.name());
+                write_u64(entry.attributes().size());
+                for (const std::string& attr : entry.attributes())
+                    write_string(attr);
+            }
+            if (entry.kind() != ast_entry_kind::document)
+            {
+                write_string(entry.comment());
+                write_u64(entry.blank_lines_before());
+            }
+            if (entry.kind() == ast_entry_kind::complex || entry.kind() == ast_entry_kind::document)
+            {
+                write_u64(entry.children().size());
+                for (auto iter = entry.children().rbegin(); iter != entry.children().rend(); ++iter)
+                    pending.push_back(&*iter);
+            }
+        }
+    }
+
+private:
+    std::ostream& _output;
+};
+
+class binary_reader
+{
+public:
+    explicit binary_reader(std::istream& input) :
+            _input(input)
+    { }
+
+    std::uint64_t read_u64()
+    {
+        std::uint64_t x;
+        if (!_input.read(reinterpret_cast<char*>(&x), sizeof x))
+            fail();
+        return x;
+    }
+
+    std::string read_string()
+    {
+        std::uint64_t length = read_u64();
+        std::string out;
+        // Read in bounded pieces so a corrupt length fails at EOF instead of allocating something enormous
+        while (out.size() < length)
+        {
+            std::size_t piece = static_cast<std::size_t>(std::min<std::uint64_t>(length - out.size(), 4096));
+            std::size_t start = out.size();
+            out.resize(start + piece);
+            if (!_input.read(&out[start], piece))
+                fail();
+        }
+        return out;
+    }
+
+    ast_entry read_document()
+    {
+        if (read_u64() != static_cast<std::uint64_t>(ast_entry_kind::document))
+            fail();
+        ast_entry out = ast_entry::make_document({});
+
+        // (owner, children left to read)
+        std::vector<std::pair<ast_entry*, std::uint64_t>> frames = { { &out, read_u64() } };
+        while (!frames.empty())
+        {
+            if (frames.back().second == 0)
+            {
+                frames.pop_back();
+                continue;
+            }
+            --frames.back().second;
+            ast_entry::child_list& siblings = frames.back().first->children();
+
+            std::uint64_t kind = read_u64();
+            if (kind == static_cast<std::uint64_t>(ast_entry_kind::comment))
+            {
+                siblings.emplace_back(ast_entry::make_comment(read_string()));
+                siblings.back().blank_lines_before() = read_blank_lines();
+            }
+            else if (kind == static_cast<std::uint64_t>(ast_entry_kind::simple)
+                  || kind == static_cast<std::uint64_t>(ast_entry_kind::complex)
+                    )
+            {
+                std::string name = read_string();
+                ast_entry::attribute_list attributes(read_u64_bounded());
+                for (std::string& attr : attributes)
+                    attr = read_string();
+                std::string comment = read_string();
+                std::uint32_t blank_lines = read_blank_lines();
+
+                if (kind == static_cast<std::uint64_t>(ast_entry_kind::simple))
+                {
+                    siblings.emplace_back(ast_entry::make_simple(std::move(name),
+                                                                 std::move(attributes),
+                                                                 std::move(comment)
+                                                                )
+                                         );
+                    siblings.back().blank_lines_before() = blank_lines;
+                }
+                else
+                {
+                    siblings.emplace_back(ast_entry::make_complex(std::move(name), std::move(attributes)));
+                    siblings.back().comment() = std::move(comment);
+                    siblings.back().blank_lines_before() = blank_lines;
+                    frames.emplace_back(&siblings.back(), read_u64());
+                }
+            }
+            else
+            {
+                fail();
+            }
+        }
+        return out;
+    }
+
+    NGINXCONFIG_NO_RETURN void fail()
+    {
+        throw std::runtime_error("Saved parse cache is truncated or corrupt");
+    }
+
+private:
+    std::uint32_t read_blank_lines()
+    {
+        std::uint64_t x = read_u64();
+        if (x > UINT32_MAX)
+            fail();
+        return static_cast<std::uint32_t>(x);
+    }
+
+    std::uint64_t read_u64_bounded()
+    {
+        std::uint64_t x = read_u64();
+        if (x > (std::uint64_t(1) << 24))
+            fail();
+        return x;
+    }
+
+private:
+    std::istream& _input;
+};
+
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// parse_cache                                                                                                        //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+constexpr parse_cache::size_type parse_cache::default_memory_budget;
+
+bool parse_cache::file_identity::operator==(const file_identity& other) const
+{
+    return device == other.device
+        && inode == other.inode
+        && size == other.size
+        && mtime_ns == other.mtime_ns;
+}
+
+parse_cache::parse_cache(size_type memory_budget_, parse_options options_) :
+        _memory_budget(memory_budget_),
+        _options(options_),
+        _memory_usage(0)
+{ }
+
+parse_cache::~parse_cache() noexcept = default;
+
+std::uint64_t parse_cache::content_hash(const char* data, size_type length)
+{
+    // Eight bytes at a time with a multiply-xorshift mix per word; the tail is folded in byte by byte.
+    const std::uint64_t multiplier = 0x9E3779B97F4A7C15ULL;
+    std::uint64_t hash = 0xCBF29CE484222325ULL ^ (length * multiplier);
+    size_type pos = 0;
+    for (; pos + 8 <= length; pos += 8)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, data + pos, sizeof word);
+        word *= multiplier;
+        word ^= word >> 29;
+        hash = (hash ^ word) * 0xBF58476D1CE4E5B9ULL;
+    }
+    for (; pos < length; ++pos)
+        hash = (hash ^ static_cast<unsigned char>(data[pos])) * 0x100000001B3ULL;
+
+    hash ^= hash >> 31;
+    hash *= 0x94D049BB133111EBULL;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+parse_cache::document_ptr parse_cache::find_content(std::uint64_t hash, const std::string* source)
+{
+    auto iter = _contents.find(hash);
+    if (iter == _contents.end() || (source && iter->second.source != *source))
+        return nullptr;
+
+    _lru.splice(_lru.begin(), _lru, iter->second.lru_position);
+    return iter->second.document;
+}
+
+void parse_cache::link_path(const std::string& path, const file_identity& identity, std::uint64_t hash)
+{
+    auto iter = _paths.find(path);
+    if (iter != _paths.end() && iter->second.hash == hash)
+    {
+        iter->second.identity = identity;
+        return;
+    }
+
+    unlink_path(path);
+    _paths.emplace(path, path_record{ identity, hash });
+    content_record& record = _contents.at(hash);
+    record.paths.push_back(path);
+    record.cost   += path_cost(path);
+    _memory_usage += path_cost(path);
+}
+
+void parse_cache::unlink_path(const std::string& path)
+{
+    auto iter = _paths.find(path);
+    if (iter == _paths.end())
+        return;
+
+    content_record& record = _contents.at(iter->second.hash);
+    record.paths.erase(std::find(record.paths.begin(), record.paths.end(), path));
+    record.cost   -= path_cost(path);
+    _memory_usage -= path_cost(path);
+    _paths.erase(iter);
+}
+
+void parse_cache::insert(const std::string&   path,
+                         const file_identity& identity,
+                         std::uint64_t        hash,
+                         std::string          source,
+                         document_ptr         doc
+                        )
+{
+    auto iter = _contents.find(hash);
+    if (iter != _contents.end())
+    {
+        // Either another thread parsed the same text first, or this is a different text with the same hash. The
+        // second one is not cached, so it is parsed every time it is asked for.
+        if (iter->second.source == source)
+            link_path(path, identity, hash);
+        else
+            unlink_path(path);
+        return;
+    }
+
+    size_type cost = estimate_cost(*doc) + source.capacity();
+    _lru.push_front(hash);
+    _contents.emplace(hash, content_record{ std::move(doc), std::move(source), {}, cost, _lru.begin() });
+    _memory_usage += cost;
+    link_path(path, identity, hash);
+
+    // Never evict the document which was just added, even if it alone is over budget
+    evict(1);
+}
+
+void parse_cache::evict(size_type keep)
+{
+    while (_memory_usage > _memory_budget && _lru.size() > keep)
+    {
+        auto victim = _contents.find(_lru.back());
+        for (const std::string& path : victim->second.paths)
+            _paths.erase(path);
+        _memory_usage -= victim->second.cost;
+        _contents.erase(victim);
+        _lru.pop_back();
+        ++_stats.evictions;
+    }
+}
+
+parse_cache::document_ptr parse_cache::parse_file(const std::string& path)
+{
+    return lookup(path, true);
+}
+
+parse_cache::document_ptr parse_cache::reload_file(const std::string& path)
+{
+    return lookup(path, false);
+}
+
+parse_cache::document_ptr parse_cache::lookup(const std::string& path, bool trust_identity)
+{
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0)
+        throw std::runtime_error("Could not stat \"" + path + "\"");
+
+    file_identity identity;
+    identity.device   = info.st_dev;
+    identity.inode    = info.st_ino;
+    identity.size     = info.st_size;
+    identity.mtime_ns = std::uint64_t(info.st_mtim.tv_sec) * 1000000000ULL + info.st_mtim.tv_nsec;
+
+    if (trust_identity)
+    {
+        std::unique_lock<std::mutex> lock(_protect);
+        auto iter = _paths.find(path);
+        if (iter != _paths.end() && iter->second.identity == identity)
+        {
+            if (document_ptr doc = find_content(iter->second.hash, nullptr))
+            {
+                ++_stats.identity_hits;
+                return doc;
+            }
+        }
+    }
+
+    std::string contents;
+    io::read_file(path, contents);
+    std::uint64_t hash = content_hash(contents.data(), contents.size());
+    {
+        std::unique_lock<std::mutex> lock(_protect);
+        if (document_ptr doc = find_content(hash, &contents))
+        {
+            ++_stats.content_hits;
+            link_path(path, identity, hash);
+            evict(1);
+            return doc;
+        }
+    }
+
+    io::memory_buffer source(contents.data(), contents.size());
+    std::istream input(&source);
+    document_ptr doc = std::make_shared<const ast_entry>(parse(input, _options));
+
+    std::unique_lock<std::mutex> lock(_protect);
+    ++_stats.misses;
+    insert(path, identity, hash, std::move(contents), doc);
+    return doc;
+}
+
+parse_cache::size_type parse_cache::size() const
+{
+    std::unique_lock<std::mutex> lock(_protect);
+    return _contents.size();
+}
+
+parse_cache::size_type parse_cache::memory_usage() const
+{
+    std::unique_lock<std::mutex> lock(_protect);
+    return _memory_usage;
+}
+
+parse_cache::statistics parse_cache::stats() const
+{
+    std::unique_lock<std::mutex> lock(_protect);
+    return _stats;
+}
+
+void parse_cache::clear()
+{
+    std::unique_lock<std::mutex> lock(_protect);
+    _paths.clear();
+    _contents.clear();
+    _lru.clear();
+    _memory_usage = 0;
+}
+
+void parse_cache::save(const std::string& path) const
+{
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file)
+        throw std::runtime_error("Could not open \"" + path + "\" for writing");
+
+    binary_writer writer(file);
+    file.write(saved_magic, sizeof saved_magic);
+
+    std::unique_lock<std::mutex> lock(_protect);
+    // Least recently used first, so loading them in order rebuilds the same recency
+    writer.write_u64(_lru.size());
+    for (auto iter = _lru.rbegin(); iter != _lru.rend(); ++iter)
+    {
+        const content_record& record = _contents.at(*iter);
+        writer.write_u64(*iter);
+        writer.write_string(record.source);
+        writer.write_document(*record.document);
+    }
+
+    writer.write_u64(_paths.size());
+    for (const auto& record : _paths)
+    {
+        writer.write_string(record.first);
+        writer.write_u64(record.second.identity.device);
+        writer.write_u64(record.second.identity.inode);
+        writer.write_u64(record.second.identity.size);
+        writer.write_u64(record.second.identity.mtime_ns);
+        writer.write_u64(record.second.hash);
+    }
+
+    if (!file.flush())
+        throw std::runtime_error("Could not write \"" + path + "\"");
+}
+
+void parse_cache::load(const std::string& path)
+{
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file)
+        throw std::runtime_error("Could not open \"" + path + "\"");
+
+    binary_reader reader(file);
+    char magic[sizeof saved_magic];
+    if (!file.read(magic, sizeof magic) || !std::equal(magic, magic + sizeof magic, saved_magic))
+        throw std::runtime_error("\"" + path + "\" is not a saved parse cache");
+
+    // Read everything before touching the cache, so a corrupt file leaves it unchanged
+    std::vector<std::pair<std::uint64_t, content_record>> documents;
+    for (std::uint64_t count = reader.read_u64(); count > 0; --count)
+    {
+        std::uint64_t  hash = reader.read_u64();
+        content_record record;
+        record.source   = reader.read_string();
+        record.document = std::make_shared<const ast_entry>(reader.read_document());
+        if (content_hash(record.source.data(), record.source.size()) != hash)
+            reader.fail();
+        documents.emplace_back(hash, std::move(record));
+    }
+
+    std::vector<std::pair<std::string, path_record>> paths;
+    for (std::uint64_t count = reader.read_u64(); count > 0; --count)
+    {
+        std::string file_path = reader.read_string();
+        path_record record;
+        record.identity.device   = reader.read_u64();
+        record.identity.inode    = reader.read_u64();
+        record.identity.size     = reader.read_u64();
+        record.identity.mtime_ns = reader.read_u64();
+        record.hash              = reader.read_u64();
+        paths.emplace_back(std::move(file_path), record);
+    }
+
+    std::unique_lock<std::mutex> lock(_protect);
+    for (auto& doc : documents)
+    {
+        if (!find_content(doc.first, nullptr))
+        {
+            content_record& record = doc.second;
+            record.cost = estimate_cost(*record.document) + record.source.capacity();
+            _lru.push_front(doc.first);
+            record.lru_position = _lru.begin();
+            _memory_usage += record.cost;
+            _contents.emplace(doc.first, std::move(record));
+        }
+    }
+    for (auto& record : paths)
+    {
+        if (_contents.count(record.second.hash))
+            link_path(record.first, record.second.identity, record.second.hash);
+    }
+
+    evict(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// include_tree                                                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+include_tree::include_tree() = default;
+include_tree::include_tree(const include_tree&) = default;
+include_tree::include_tree(include_tree&&) = default;
+include_tree& include_tree::operator=(const include_tree&) = default;
+include_tree& include_tree::operator=(include_tree&&) = default;
+include_tree::~include_tree() noexcept = default;
+
+const include_tree::document_ptr& include_tree::document(const std::string& path) const
+{
+    return _documents.at(io::absolute_path(path));
+}
+
+const include_tree::path_list& include_tree::resolve(const std::string& pattern) const
+{
+    return _patterns.at(pattern);
+}
+
+namespace
+{
+
+void append_flattened(const include_tree& tree, const ast_entry& source, ast_entry& dest, std::vector<std::string>& stack)
+{
+    for (const ast_entry& child : source.children())
+    {
+        if (is_include(child))
+        {
+            for (const std::string& path : tree.resolve(strip_quotes(child.attributes().front())))
+            {
+                if (std::find(stack.begin(), stack.end(), path) != stack.end())
+                    throw std::runtime_error("Include cycle through \"" + path + "\"");
+                stack.push_back(path);
+                append_flattened(tree, *tree.document(path), dest, stack);
+                stack.pop_back();
+            }
+        }
+        else if (child.kind() == ast_entry_kind::complex)
+        {
+            dest.children().emplace_back(ast_entry::make_complex(child.name(), child.attributes()));
+            ast_entry& copy = dest.children().back();
+            copy.comment()            = child.comment();
+            copy.blank_lines_before() = child.blank_lines_before();
+            copy.source()             = child.source();
+            append_flattened(tree, child, copy, stack);
+        }
+        else
+        {
+            dest.children().emplace_back(child);
+        }
+    }
+}
+
+include_tree::path_list resolve_pattern(const std::string& full)
+{
+    if (full.find_first_of("*?[") == std::string::npos)
+    {
+        struct stat info;
+        if (::stat(full.c_str(), &info) != 0)
+            throw std::runtime_error("Included file \"" + full + "\" does not exist");
+        return { full };
+    }
+
+    include_tree::path_list out;
+    glob_t matches;
+    int rc = ::glob(full.c_str(), 0, nullptr, &matches);
+    if (rc == 0)
+    {
+        for (std::size_t idx = 0; idx < matches.gl_pathc; ++idx)
+            out.emplace_back(matches.gl_pathv[idx]);
+    }
+    ::globfree(&matches);
+    if (rc != 0 && rc != GLOB_NOMATCH)
+        throw std::runtime_error("Could not expand include pattern \"" + full + "\"");
+    return out;
+}
+
+}
+
+std::string include_tree::pattern_path(const std::string& pattern) const
+{
+    return pattern.empty() || pattern[0] == '/' ? pattern : io::join_path(_base_directory, pattern);
+}
+
+ast_entry include_tree::flatten() const
+{
+    ast_entry out = ast_entry::make_document({});
+    std::vector<std::string> stack = { _root };
+    append_flattened(*this, *document(_root), out, stack);
+    return out;
+}
+
+include_tree include_tree::build(const std::string&  path,
+                                  parse_cache&        cache,
+                                  const include_tree* previous,
+                                  const path_list&    changed
+                                 )
+{
+    // Paths are kept absolute so each file has one spelling, whatever the working directory or the root looked like
+    include_tree tree;
+    tree._root           = io::absolute_path(path);
+    tree._base_directory = io::directory_of(tree._root);
+
+    path_list changed_paths;
+    changed_paths.reserve(changed.size());
+    for (const std::string& changed_path : changed)
+        changed_paths.push_back(io::absolute_path(changed_path));
+
+    std::deque<std::string> pending = { tree._root };
+    while (!pending.empty())
+    {
+        std::string current = std::move(pending.front());
+        pending.pop_front();
+        if (tree._documents.count(current))
+            continue;
+
+        document_ptr doc;
+        bool is_changed = std::find(changed_paths.begin(), changed_paths.end(), current) != changed_paths.end();
+        if (previous && !is_changed)
+        {
+            auto iter = previous->_documents.find(current);
+            if (iter != previous->_documents.end())
+                doc = iter->second;
+        }
+        if (!doc)
+            doc = is_changed ? cache.reload_file(current) : cache.parse_file(current);
+        tree._documents.emplace(current, doc);
+
+        std::vector<const ast_entry*> blocks = { doc.get() };
+        while (!blocks.empty())
+        {
+            const ast_entry& block = *blocks.back();
+            blocks.pop_back();
+            for (const ast_entry& child : block.children())
+            {
+                if (child.kind() == ast_entry_kind::complex)
+                {
+                    blocks.push_back(&child);
+                }
+                else if (is_include(child))
+                {
+                    std::string pattern = strip_quotes(child.attributes().front());
+                    auto iter = tree._patterns.find(pattern);
+                    if (iter == tree._patterns.end())
+                        iter = tree._patterns.emplace(pattern, resolve_pattern(tree.pattern_path(pattern))).first;
+                    pending.insert(pending.end(), iter->second.begin(), iter->second.end());
+                }
+            }
+        }
+    }
+    return tree;
+}
+
+include_tree parse_include_tree(const std::string& path, parse_cache& cache)
+{
+    return include_tree::build(path, cache, nullptr, {});
+}
+
+include_tree parse_include_tree(const include_tree& previous, const include_tree::path_list& changed, parse_cache& cache)
+{
+    return include_tree::build(previous.root(), cache, &previous, changed);
+}
+
+include_tree parse_include_tree(const std::string& path, const parse_options& options)
+{
+    parse_cache cache(~parse_cache::size_type(0), options);
+    return parse_include_tree(path, cache);
+}
+
+}
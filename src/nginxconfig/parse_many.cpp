@@ -0,0 +1,194 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/file_io.hpp>
+#include <nginxconfig/parse_many.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#include <sys/stat.h>
+
+namespace nginxconfig
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// parse_result                                                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+parse_result::~parse_result() noexcept = default;
+
+const ast_entry& parse_result::document() const
+{
+    if (_error)
+        std::rethrow_exception(_error);
+    return _document;
+}
+
+ast_entry& parse_result::document()
+{
+    if (_error)
+        std::rethrow_exception(_error);
+    return _document;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// parse_many                                                                                                         //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+/** The files assigned to one worker. The owner takes from the front (the largest files) while thieves take from the
+ *  back, so the two only meet when the queue is nearly empty.
+**/
+struct work_queue
+{
+    std::mutex              protect;
+    std::deque<std::size_t> items;
+
+    bool pop_front(std::size_t& out)
+    {
+        std::unique_lock<std::mutex> lock(protect);
+        if (items.empty())
+            return false;
+        out = items.front();
+        items.pop_front();
+        return true;
+    }
+
+    bool pop_back(std::size_t& out)
+    {
+        std::unique_lock<std::mutex> lock(protect);
+        if (items.empty())
+            return false;
+        out = items.back();
+        items.pop_back();
+        return true;
+    }
+};
+
+}
+
+class parse_many_job
+{
+public:
+    parse_many_job(const std::vector<std::string>& paths, const parse_options& options, std::size_t workers) :
+            _options(options),
+            _queues(workers),
+            _results(paths.size())
+    {
+        std::vector<std::pair<off_t, std::size_t>> by_size;
+        by_size.reserve(paths.size());
+        for (std::size_t idx = 0; idx < paths.size(); ++idx)
+        {
+            _results[idx]._path = paths[idx];
+            struct stat info;
+            by_size.emplace_back(::stat(paths[idx].c_str(), &info) == 0 ? info.st_size : 0, idx);
+        }
+        std::stable_sort(by_size.begin(), by_size.end(),
+                         [] (const std::pair<off_t, std::size_t>& a, const std::pair<off_t, std::size_t>& b)
+                         {
+                             return a.first > b.first;
+                         }
+                        );
+
+        // Deal the files out round-robin so every queue starts with a similar share of large files
+        for (std::size_t pos = 0; pos < by_size.size(); ++pos)
+            _queues[pos % workers].items.push_back(by_size[pos].second);
+    }
+
+    void run(std::size_t worker)
+    {
+        std::size_t idx;
+        while (_queues[worker].pop_front(idx))
+            parse_one(_results[idx]);
+
+        for (std::size_t offset = 1; offset < _queues.size(); ++offset)
+        {
+            work_queue& victim = _queues[(worker + offset) % _queues.size()];
+            while (victim.pop_back(idx))
+                parse_one(_results[idx]);
+        }
+    }
+
+    std::vector<parse_result> take_results()
+    {
+        return std::move(_results);
+    }
+
+private:
+    void parse_one(parse_result& result)
+    {
+        // The contents are read into a per-thread buffer which keeps its capacity from file to file. A buffer grown by
+        // an unusually large file is released afterwards, so the calling thread does not hold on to it forever.
+        static thread_local std::string buffer;
+        static const std::size_t max_kept_capacity = std::size_t(1) << 20;
+
+        try
+        {
+            io::read_file(result._path, buffer);
+            io::memory_buffer source(buffer.data(), buffer.size());
+            std::istream input(&source);
+            result._document = parse(input, _options);
+        }
+        catch (...)
+        {
+            result._error = std::current_exception();
+        }
+
+        if (buffer.capacity() > max_kept_capacity)
+            std::string().swap(buffer);
+    }
+
+private:
+    const parse_options&      _options;
+    std::deque<work_queue>    _queues;
+    std::vector<parse_result> _results;
+};
+
+std::vector<parse_result> parse_many(const std::vector<std::string>& paths,
+                                     const parse_options&            options,
+                                     std::size_t                     threads
+                                    )
+{
+    if (threads == 0)
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    threads = std::max<std::size_t>(1, std::min(threads, paths.size()));
+
+    parse_many_job job(paths, options, threads);
+
+    // The calling thread is worker 0. If a thread can not be started, the ones already running (and this one, which
+    // goes through every queue) share its files.
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (std::size_t worker = 1; worker < threads; ++worker)
+    {
+        try
+        {
+            workers.emplace_back([&job, worker] { job.run(worker); });
+        }
+        catch (const std::system_error&)
+        {
+            break;
+        }
+    }
+    job.run(0);
+    for (std::thread& t : workers)
+        t.join();
+
+    return job.take_results();
+}
+
+}
@@ -13,31 +13,115 @@
 #define __NGINXCONFIG_PARSE_TYPES_HPP_INCLUDED__
 
 #include <nginxconfig/config.hpp>
+#include <nginxconfig/ast.hpp>
 #include <nginxconfig/parse.hpp>
 
+#include <cstdint>
+#include <memory>
 #include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
 
 namespace nginxconfig
 {
 namespace parser
 {
 
+enum class token_kind
+{
+    /** A name or attribute, kept exactly as written (including quotes and escapes). **/
+    word,
+    semicolon,
+    block_start,
+    block_end,
+    /** A \c # and the rest of its line; the text is what follows the \c #. **/
+    comment,
+    /** A line with nothing but whitespace on it. **/
+    blank_line,
+    end,
+};
+
+struct token
+{
+    using size_type = std::string::size_type;
+    
+    token_kind  kind  = token_kind::end;
+    std::string text;
+    size_type   begin = 0;
+    size_type   end   = 0;
+    size_type   line  = 0;
+};
+
+/** Splits input into tokens following the rules nginx uses for its configuration files: tokens are separated by
+ *  whitespace (including newlines, so a directive can span lines), \c ; and \c { end a word, quoted strings can contain
+ *  anything, a backslash escapes the next character and \c ${name} keeps its braces.
+**/
 struct context
 {
 public:
     using size_type = std::string::size_type;
     
-    std::istream& input;
+    /** The line the last token started on, counting from 1. **/
     size_type     line_no           = 0;
+    /** The offset of the first byte of the last token. **/
     size_type     character_no      = 0;
+    /** The offset of the next byte to be read. **/
     size_type     character_no_next = 0;
-    std::string   current;
+    /** If set, the wall time spent reading from the input is added to \c read_ns. **/
+    bool          time_reads        = false;
+    std::uint64_t read_ns           = 0;
+    /** The whole source the input is part of, if it is in memory. Blocks can only be deferred with
+     *  \c parse_options::lazy_blocks when this is set; otherwise they are parsed right away.
+    **/
+    std::shared_ptr<const std::string> source;
     
     explicit context(std::istream& input) :
-            input(input)
+            context(input, 0, 1, true, true)
     { }
     
-    bool next();
+    /** Create a context for input which starts at \a character_no of some larger source, on line \a first_line. When
+     *  \a at_line_start is \c false, the input starts in the middle of a line which already had something on it. When
+     *  \a at_source_end is \c false, the input ends in the middle of a line which has more on it.
+    **/
+    context(std::istream& input,
+            size_type     character_no,
+            size_type     first_line,
+            bool          at_line_start = true,
+            bool          at_source_end = true
+           ) :
+            line_no(first_line),
+            character_no(character_no),
+            character_no_next(character_no),
+            _input(input.rdbuf()),
+            _pos(_buffer),
+            _end(_buffer),
+            _first_line(first_line),
+            _line(first_line),
+            _line_start(character_no),
+            _line_has_content(!at_line_start),
+            _at_source_end(at_source_end)
+    { }
+    
+    context(const context&) = delete;
+    context& operator=(const context&) = delete;
+    
+    /** Read the next token into \a out. At the end of input, the token kind is \c token_kind::end.
+     *
+     *  \throws parse_error if a quoted string is not closed or is not followed by a separator.
+    **/
+    void next(token& out);
+    
+    /** If the rest of the current line is a comment, read it into \a out and return \c true. **/
+    bool read_trailing_comment(token& out);
+    
+    /** Skip to the \c } closing the block whose \c { was just read, reading it into \a out. This only follows braces,
+     *  quotes, escapes and comments, so anything else wrong with the text in between is not noticed.
+     *
+     *  \throws parse_error if the block is not closed, a quoted string in it is not closed or it has blocks nested
+     *   more than \a max_nested deep.
+    **/
+    void skip_block(token& out, size_type max_nested);
     
     template <typename... T>
     parse_error create_parse_error(size_type column, T&&... message)
@@ -46,10 +130,54 @@ public:
         return create_parse_error_impl(stream, column, std::forward<T>(message)...);
     }
     
+    /** The number of lines read so far, including a last one without a newline. **/
+    size_type line_count() const
+    {
+        return _line - _first_line + (character_no_next > _line_start ? 1 : 0);
+    }
+    
+    /** The column of the last token on its line. **/
+    size_type column() const
+    {
+        return character_no - _line_start;
+    }
+    
 private:
+    static constexpr std::size_t buffer_size = 16 * 1024;
+    
+    static constexpr int eof = std::char_traits<char>::eof();
+    
+    int peek()
+    {
+        if (_pos == _end && !refill())
+            return eof;
+        return static_cast<unsigned char>(*_pos);
+    }
+    
+    /** Read the next chunk of input into the buffer, returning \c false at the end of input. **/
+    bool refill();
+    
+    /** Consume the byte \c peek returned, keeping track of lines. **/
+    void advance(int ch)
+    {
+        ++_pos;
+        ++character_no_next;
+        if (ch == '\n')
+        {
+            ++_line;
+            _line_start       = character_no_next;
+            _line_has_content = false;
+        }
+    }
+    
+    void read_quoted(token& out, int quote);
+    
+    void read_unquoted(token& out);
+    
     parse_error create_parse_error_impl(std::ostringstream& stream, size_type column)
     {
-        size_type real_char_no = character_no + (column == nginxconfig::parse_error::no_column ? 0 : column);
+        // a column counts from the start of the line, not from the last token
+        size_type real_char_no = column == nginxconfig::parse_error::no_column ? character_no : _line_start + column;
         return parse_error(line_no, column, real_char_no, stream.str());
     }
     
@@ -59,6 +187,17 @@ private:
         stream << std::forward<T>(current);
         return create_parse_error_impl(stream, column, std::forward<TRest>(rest)...);
     }
+    
+private:
+    std::streambuf* _input;
+    char*           _pos;
+    char*           _end;
+    size_type       _first_line;
+    size_type       _line;
+    size_type       _line_start;
+    bool            _line_has_content;
+    bool            _at_source_end;
+    char            _buffer[buffer_size];
 };
 
 enum class line_kind
@@ -70,6 +209,9 @@ enum class line_kind
     unknown,
 };
 
+/** The parts of a single line holding at most one entry. The parser itself works on tokens, but this is a convenient
+ *  way to look at how a line is tokenized.
+**/
 struct line_components
 {
     using attribute_list = ast_entry::attribute_list;
@@ -82,6 +224,11 @@ struct line_components
     std::string    comment;
 };
 
+/** Parse everything \a cxt reads into the \c document entry \a document, recording the source range of every entry. If
+ *  \a stats is not null, it receives the measurements of the parse.
+**/
+void parse_generic(context& cxt, ast_entry& document, const parse_options& options, parse_stats* stats = nullptr);
+
 }
 }
 
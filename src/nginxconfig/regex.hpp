@@ -0,0 +1,150 @@
+/** \file
+ *  Selection of the regular expression implementation used throughout the library.
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#ifndef __NGINXCONFIG_REGEX_HPP_INCLUDED__
+#define __NGINXCONFIG_REGEX_HPP_INCLUDED__
+
+#include <nginxconfig/config.hpp>
+
+#include <string>
+
+/** \def NGINXCONFIG_USE_BOOST_REGEX
+ *  Should the parser use the regex implementation from Boost instead of the C++ Standard Library? GCC versions below
+ *  4.8 will happy compile regular expressions, but will fail at runtime, so this must be set if you are using GCC under
+ *  4.9!
+**/
+#ifndef NGINXCONFIG_USE_BOOST_REGEX
+#   define NGINXCONFIG_USE_BOOST_REGEX 0
+#endif
+
+/** \def NGINXCONFIG_CHECK_REGEX_IMPLEMENTATION
+ *  Should we check the regex implementation? If set to \c 1 (default), this file will fail to compile if it does not
+ *  believe your standard library implementation has a working regular expression engine. Set this value to \c 0 to
+ *  disable this check if you know your standard library implementation works fine.
+**/
+#ifndef NGINXCONFIG_CHECK_REGEX_IMPLEMENTATION
+#   define NGINXCONFIG_CHECK_REGEX_IMPLEMENTATION 1
+#endif
+
+#if NGINXCONFIG_USE_BOOST_REGEX
+#   include <boost/regex.hpp>
+#else
+#   if NGINXCONFIG_CHECK_REGEX_IMPLEMENTATION
+#       ifdef __GNUC__
+#           if (__GNUC__ == 4) && (__GNUC_MINOR__ < 9)
+#               error "Cannot use Standard Library regex implementation with GCC < 4.9! Please compile with NGINXCONFIG_USE_BOOST_REGEX=1 (or disable this check with NGINXCONFIG_CHECK_REGEX_IMPLEMENTATION=0)."
+#           endif
+#       endif
+#   endif
+#   include <regex>
+#endif
+
+namespace nginxconfig
+{
+namespace regex_impl
+{
+
+#if NGINXCONFIG_USE_BOOST_REGEX
+using regex = boost::regex;
+using smatch = boost::smatch;
+using regex_error = boost::regex_error;
+using boost::regex_match;
+using boost::regex_search;
+namespace regex_constants = boost::regex_constants;
+#else
+using regex = std::regex;
+using smatch = std::smatch;
+using regex_error = std::regex_error;
+using std::regex_match;
+using std::regex_search;
+namespace regex_constants = std::regex_constants;
+#endif
+
+/** Translate the PCRE extensions common in nginx configurations into syntax the ECMAScript grammar accepts. Named
+ *  groups (\c (?<name>...), \c (?P<name>...) and \c (?'name'...)) become plain capturing groups, which keeps the
+ *  capture numbering intact. A leading \c (?i) is removed and turns on \c icase in \a flags. Anything else is left
+ *  alone, so a pattern using other PCRE features still fails to compile with a \c regex_error.
+**/
+inline std::string translate_pcre(const std::string& pattern, regex_constants::syntax_option_type& flags)
+{
+    std::string out;
+    out.reserve(pattern.size());
+
+    std::size_t idx = 0;
+    if (pattern.compare(0, 4, "(?i)") == 0)
+    {
+        flags = flags | regex_constants::icase;
+        idx   = 4;
+    }
+
+    bool in_class = false;
+    while (idx < pattern.size())
+    {
+        char c = pattern[idx];
+        if (c == '\\' && idx + 1 < pattern.size())
+        {
+            out.append(pattern, idx, 2);
+            idx += 2;
+            continue;
+        }
+        else if (in_class)
+        {
+            in_class = c != ']';
+        }
+        else if (c == '[')
+        {
+            in_class = true;
+            out += c;
+            ++idx;
+            // a ']' directly after the opening (or a negating '^') is a literal member of the class
+            if (idx < pattern.size() && pattern[idx] == '^')
+                out += pattern[idx++];
+            if (idx < pattern.size() && pattern[idx] == ']')
+                out += pattern[idx++];
+            continue;
+        }
+        else if (c == '(' && pattern.compare(idx, 2, "(?") == 0)
+        {
+            std::size_t name_start = std::string::npos;
+            char        name_close = '>';
+            if (pattern.compare(idx, 4, "(?P<") == 0)
+            {
+                name_start = idx + 4;
+            }
+            else if (pattern.compare(idx, 3, "(?'") == 0)
+            {
+                name_start = idx + 3;
+                name_close = '\'';
+            }
+            else if (pattern.compare(idx, 3, "(?<") == 0 && pattern.compare(idx, 4, "(?<=") != 0
+                     && pattern.compare(idx, 4, "(?<!") != 0)
+            {
+                name_start = idx + 3;
+            }
+
+            std::size_t name_end = name_start == std::string::npos ? name_start : pattern.find(name_close, name_start);
+            if (name_end != std::string::npos)
+            {
+                out += '(';
+                idx = name_end + 1;
+                continue;
+            }
+        }
+        out += c;
+        ++idx;
+    }
+    return out;
+}
+
+}
+}
+
+#endif/*__NGINXCONFIG_REGEX_HPP_INCLUDED__*/
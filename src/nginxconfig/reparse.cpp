@@ -0,0 +1,275 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/file_io.hpp>
+#include <nginxconfig/parse_types.hpp>
+#include <nginxconfig/reparse.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <istream>
+#include <stdexcept>
+
+namespace nginxconfig
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers                                                                                                            //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+using size_type = reparse_result::size_type;
+
+bool has_body(const ast_entry& entry)
+{
+    return entry.kind() == ast_entry_kind::complex || entry.kind() == ast_entry_kind::document;
+}
+
+void shift(size_type& x, std::ptrdiff_t delta)
+{
+    x = static_cast<size_type>(static_cast<std::ptrdiff_t>(x) + delta);
+}
+
+/** Move the source ranges of \a root and everything inside of it by \a delta bytes and \a line_delta lines.
+ *
+ *  Deferred children are loaded first: their loader reads the previous source at the range of their block, which only
+ *  holds them before it is shifted.
+**/
+void shift_subtree(ast_entry& root, std::ptrdiff_t delta, std::ptrdiff_t line_delta)
+{
+    if (delta == 0 && line_delta == 0)
+        return;
+
+    std::vector<ast_entry*> pending = { &root };
+    while (!pending.empty())
+    {
+        ast_entry& entry = *pending.back();
+        pending.pop_back();
+
+        ast_entry::child_list* children = has_body(entry) ? &entry.children() : nullptr;
+        source_range& range = entry.source();
+        shift(range.begin, delta);
+        shift(range.end, delta);
+        shift(range.line, line_delta);
+        if (children)
+        {
+            shift(range.body_begin, delta);
+            shift(range.body_end, delta);
+            for (ast_entry& child : *children)
+                pending.push_back(&child);
+        }
+    }
+}
+
+/** Find the \c complex child of \a block whose body contains all of <tt>[first, last)</tt>. **/
+ast_entry* find_enclosing_child(ast_entry& block, size_type first, size_type last, size_type& index)
+{
+    ast_entry::child_list& children = block.children();
+    // Children are in source order, so only the last child starting at or before first can contain it
+    auto iter = std::upper_bound(children.begin(), children.end(), first,
+                                 [] (size_type offset, const ast_entry& child) { return offset < child.source().begin; }
+                                );
+    if (iter == children.begin())
+        return nullptr;
+    --iter;
+
+    const source_range& range = iter->source();
+    if (iter->kind() != ast_entry_kind::complex || first < range.body_begin || range.body_end < last)
+        return nullptr;
+    index = static_cast<size_type>(iter - children.begin());
+    return &*iter;
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// reparse                                                                                                            //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+const ast_entry& reparse_result::block() const
+{
+    const ast_entry* out = &document;
+    for (size_type idx : block_path)
+        out = &out->children().at(idx);
+    return *out;
+}
+
+reparse_result reparse(ast_entry&&          previous,
+                       const std::string&   source,
+                       const text_edit&     edit,
+                       const parse_options& options
+                      )
+{
+    if (edit.offset > source.size() || edit.old_length > source.size() - edit.offset)
+        throw std::out_of_range("Edit is outside of the source");
+
+    const size_type edit_end = edit.offset + edit.old_length;
+    const std::ptrdiff_t delta = static_cast<std::ptrdiff_t>(edit.new_text.size())
+                               - static_cast<std::ptrdiff_t>(edit.old_length);
+    const std::ptrdiff_t line_delta = std::count(edit.new_text.begin(), edit.new_text.end(), '\n')
+                                    - std::count(source.begin() + edit.offset, source.begin() + edit_end, '\n');
+
+    reparse_result out;
+    out.source.reserve(source.size() + edit.new_text.size());
+    out.source.append(source, 0, edit.offset);
+    out.source.append(edit.new_text);
+    out.source.append(source, edit_end, std::string::npos);
+
+    // The parser works in whole lines, so everything on the lines the edit touches (in the old source) is affected. Text
+    // following the edit on its last line joins whatever precedes it, unless the edit ends at the start of a line and
+    // what precedes it in the new source is the end of a line.
+    const size_type touched_begin = edit.offset == 0 ? 0 : source.rfind('\n', edit.offset - 1) + 1;
+    const bool ends_at_line_start   = edit_end == 0 || source[edit_end - 1] == '\n';
+    const bool precedes_line_start  = edit.new_text.empty()
+                                    ? edit.offset == 0 || source[edit.offset - 1] == '\n'
+                                    : edit.new_text.back() == '\n';
+    size_type touched_end;
+    if (ends_at_line_start && precedes_line_start)
+    {
+        touched_end = edit_end;
+    }
+    else
+    {
+        touched_end = source.find('\n', edit_end);
+        touched_end = touched_end == std::string::npos ? source.size() : touched_end + 1;
+    }
+
+    // The chain of blocks from the document down to the smallest one with all touched lines inside its body
+    std::vector<ast_entry*> chain = { &previous };
+    std::vector<size_type>  path;
+    size_type               index;
+    while (ast_entry* child = find_enclosing_child(*chain.back(), touched_begin, touched_end, index))
+    {
+        chain.push_back(child);
+        path.push_back(index);
+    }
+
+    // Parse the body of the innermost block; if the edit unbalanced it, move out a level and try again
+    ast_entry parsed = ast_entry::make_document({});
+    size_type depth = path.size();
+    bool      at_line_start = true;
+    while (true)
+    {
+        const ast_entry&    block = *chain[depth];
+        const source_range& range = block.source();
+        size_type body_line = range.line + std::count(source.begin() + range.begin,
+                                                      source.begin() + range.body_begin,
+                                                      '\n'
+                                                     );
+        at_line_start = range.body_begin == 0 || source[range.body_begin - 1] == '\n';
+
+        size_type length = range.body_end + delta - range.body_begin;
+        io::memory_buffer buffer(out.source.data() + range.body_begin, length);
+        std::istream input(&buffer);
+        parser::context cxt(input,
+                            range.body_begin,
+                            body_line,
+                            at_line_start,
+                            block.kind() == ast_entry_kind::document
+                           );
+
+        parse_options body_options = options;
+        body_options.max_depth = options.max_depth > depth ? options.max_depth - depth : 0;
+        try
+        {
+            parsed = ast_entry::make_document({});
+            parser::parse_generic(cxt, parsed, body_options);
+            break;
+        }
+        catch (const parse_error&)
+        {
+            if (depth == 0)
+                throw;
+            --depth;
+        }
+    }
+    chain.resize(depth + 1);
+    path.resize(depth);
+
+    // A comment right after the { was attached to the block itself, so it is not one of the children
+    ast_entry::child_list& parsed_children = parsed.children();
+    if (!at_line_start && !parsed_children.empty() && parsed_children.front().kind() == ast_entry_kind::comment)
+    {
+        size_type body_begin = chain.back()->source().body_begin;
+        size_type line_end   = out.source.find('\n', body_begin);
+        if (parsed_children.front().source().begin < line_end)
+            parsed_children.pop_front();
+    }
+
+    // Keep the children of the block before and after the touched lines, taking the newly parsed ones in between
+    ast_entry&             block        = *chain.back();
+    ast_entry::child_list& old_children = block.children();
+    ast_entry::child_list& new_children = parsed.children();
+
+    size_type prefix = 0;
+    while (prefix < old_children.size()
+        && prefix < new_children.size()
+        && old_children[prefix].source().end <= touched_begin
+        && old_children[prefix].source().begin == new_children[prefix].source().begin
+        && old_children[prefix].source().end == new_children[prefix].source().end
+        && old_children[prefix].blank_lines_before() == new_children[prefix].blank_lines_before()
+          )
+    {
+        ++prefix;
+    }
+
+    size_type suffix = 0;
+    while (suffix < old_children.size() - prefix && suffix < new_children.size() - prefix)
+    {
+        const source_range& old_range = old_children[old_children.size() - 1 - suffix].source();
+        const source_range& new_range = new_children[new_children.size() - 1 - suffix].source();
+        if (old_range.begin < touched_end
+         || static_cast<std::ptrdiff_t>(old_range.begin) + delta != static_cast<std::ptrdiff_t>(new_range.begin)
+         || static_cast<std::ptrdiff_t>(old_range.end) + delta != static_cast<std::ptrdiff_t>(new_range.end)
+         || old_children[old_children.size() - 1 - suffix].blank_lines_before()
+                != new_children[new_children.size() - 1 - suffix].blank_lines_before()
+           )
+        {
+            break;
+        }
+        ++suffix;
+    }
+
+    ast_entry::child_list merged;
+    for (size_type idx = 0; idx < prefix; ++idx)
+        merged.emplace_back(std::move(old_children[idx]));
+    for (size_type idx = prefix; idx < new_children.size() - suffix; ++idx)
+        merged.emplace_back(std::move(new_children[idx]));
+    for (size_type idx = old_children.size() - suffix; idx < old_children.size(); ++idx)
+    {
+        merged.emplace_back(std::move(old_children[idx]));
+        shift_subtree(merged.back(), delta, line_delta);
+    }
+    old_children = std::move(merged);
+
+    // Everything enclosing the block grows or shrinks and everything after it moves
+    for (size_type level = depth + 1; level-- > 0; )
+    {
+        source_range& range = chain[level]->source();
+        shift(range.body_end, delta);
+        shift(range.end, delta);
+        if (level < depth)
+        {
+            ast_entry::child_list& siblings = chain[level]->children();
+            for (size_type idx = path[level] + 1; idx < siblings.size(); ++idx)
+                shift_subtree(siblings[idx], delta, line_delta);
+        }
+    }
+
+    out.document      = std::move(previous);
+    out.block_path    = std::move(path);
+    out.first_changed = prefix;
+    out.last_changed  = new_children.size() - suffix;
+    return out;
+}
+
+}
@@ -0,0 +1,236 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/rewrite.hpp>
+
+#include <utility>
+
+namespace nginxconfig
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// rewrite_pattern                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool rewrite_pattern::matches(const ast_entry& entry, const ast_entry& owner) const
+{
+    if (!name.empty() && entry.name() != name)
+        return false;
+
+    if (!parent.empty() && (owner.kind() != ast_entry_kind::complex || owner.name() != parent))
+        return false;
+
+    if (!attributes.empty())
+    {
+        const ast_entry::attribute_list& actual = entry.attributes();
+        if (actual.size() != attributes.size())
+            return false;
+        for (std::size_t idx = 0; idx < attributes.size(); ++idx)
+        {
+            if (attributes[idx] != "*" && attributes[idx] != actual[idx])
+                return false;
+        }
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// rewrite_context                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void rewrite_context::remove()
+{
+    _removed = true;
+}
+
+void rewrite_context::replace(ast_entry replacement)
+{
+    _removed = true;
+    _after.emplace_back(std::move(replacement));
+}
+
+void rewrite_context::insert_before(ast_entry added)
+{
+    _before.emplace_back(std::move(added));
+}
+
+void rewrite_context::insert_after(ast_entry added)
+{
+    _after.emplace_back(std::move(added));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// rewrite_action                                                                                                     //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+rewrite_action::~rewrite_action() noexcept = default;
+
+namespace
+{
+
+class remove_action :
+        public rewrite_action
+{
+public:
+    virtual void rewrite(rewrite_context& cxt) const override
+    {
+        cxt.remove();
+    }
+};
+
+class replace_action :
+        public rewrite_action
+{
+public:
+    explicit replace_action(ast_entry replacement) :
+            _replacement(std::move(replacement))
+    { }
+
+    virtual void rewrite(rewrite_context& cxt) const override
+    {
+        cxt.replace(_replacement);
+    }
+
+private:
+    ast_entry _replacement;
+};
+
+/** The changes rules made to one child of a block, to be made when the block is rebuilt. **/
+struct child_change
+{
+    ast_entry::size_type   index;
+    bool                   removed;
+    std::vector<ast_entry> before;
+    std::vector<ast_entry> after;
+};
+
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// rewriter                                                                                                           //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+rewriter::rewriter() = default;
+
+rewriter::~rewriter() noexcept = default;
+
+void rewriter::add(rewrite_pattern pattern, std::shared_ptr<const rewrite_action> action)
+{
+    size_type idx = _rules.size();
+    if (pattern.name.empty())
+        _dispatch.add_any(idx);
+    else
+        _dispatch.add(idx, pattern.name);
+    _rules.push_back(rule{ std::move(pattern), std::move(action) });
+}
+
+void rewriter::remove(rewrite_pattern pattern)
+{
+    add(std::move(pattern), std::make_shared<remove_action>());
+}
+
+void rewriter::replace(rewrite_pattern pattern, ast_entry replacement)
+{
+    add(std::move(pattern), std::make_shared<replace_action>(std::move(replacement)));
+}
+
+rewriter::size_type rewriter::dispatch(rewrite_context& cxt, const ast_entry& owner) const
+{
+    const ast_entry& entry   = *cxt._entry;
+    size_type        applied = 0;
+    if (cxt._removed)
+        return applied;
+
+    // once a rule removes the entry, there is nothing left for the rest to match
+    _dispatch.for_each(entry.name(), [&] (size_type idx)
+    {
+        const rule& current = _rules[idx];
+        if (current.pattern.matches(entry, owner))
+        {
+            current.action->rewrite(cxt);
+            ++applied;
+        }
+        return !cxt._removed;
+    });
+    return applied;
+}
+
+rewriter::size_type rewriter::apply_children(rewrite_context& cxt, ast_entry& owner) const
+{
+    size_type                 applied = 0;
+    std::vector<child_change> changes;
+    ast_entry::child_list&    children = owner.children();
+
+    for (ast_entry::size_type idx = 0; idx < children.size(); ++idx)
+    {
+        ast_entry& child = children[idx];
+        if (child.kind() == ast_entry_kind::comment)
+            continue;
+
+        if (child.kind() != ast_entry_kind::document)
+        {
+            cxt._entry   = &child;
+            cxt._removed = false;
+            applied += dispatch(cxt, owner);
+            if (cxt._removed || !cxt._before.empty() || !cxt._after.empty())
+            {
+                changes.push_back(child_change{ idx, cxt._removed, std::move(cxt._before), std::move(cxt._after) });
+                cxt._before.clear();
+                cxt._after.clear();
+            }
+        }
+
+        // siblings may still look at this entry, so it stays where it is until the whole block is done
+        if (!cxt._removed && child.kind() != ast_entry_kind::simple)
+        {
+            cxt._path.push_back(&child);
+            applied += apply_children(cxt, child);
+            cxt._path.pop_back();
+        }
+        cxt._removed = false;
+    }
+
+    if (!changes.empty())
+    {
+        ast_entry::child_list rebuilt;
+        auto change = changes.begin();
+        for (ast_entry::size_type idx = 0; idx < children.size(); ++idx)
+        {
+            if (change == changes.end() || change->index != idx)
+            {
+                rebuilt.emplace_back(std::move(children[idx]));
+                continue;
+            }
+
+            for (ast_entry& added : change->before)
+                rebuilt.emplace_back(std::move(added));
+            if (!change->removed)
+                rebuilt.emplace_back(std::move(children[idx]));
+            for (ast_entry& added : change->after)
+                rebuilt.emplace_back(std::move(added));
+            ++change;
+        }
+        // rules may have looked things up in the owner since the reference was taken, which built its index again
+        owner.children() = std::move(rebuilt);
+    }
+    return applied;
+}
+
+rewriter::size_type rewriter::apply(ast_entry& root) const
+{
+    if (root.kind() != ast_entry_kind::complex && root.kind() != ast_entry_kind::document)
+        throw kind_error("Can only rewrite the children of a complex entry or a document");
+
+    rewrite_context cxt;
+    cxt._path.push_back(&root);
+    return apply_children(cxt, root);
+}
+
+}
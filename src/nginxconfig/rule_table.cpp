@@ -0,0 +1,36 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/rule_table.hpp>
+
+namespace nginxconfig
+{
+
+void rule_table::add(size_type idx, const std::string& name)
+{
+    std::vector<size_type>& rules = _by_name[name];
+    if (rules.empty() || rules.back() != idx)
+        rules.push_back(idx);
+}
+
+void rule_table::add_any(size_type idx)
+{
+    _any_name.push_back(idx);
+}
+
+const std::vector<rule_table::size_type>& rule_table::find(const std::string& name) const
+{
+    static const std::vector<size_type> no_rules;
+
+    auto iter = _by_name.find(name);
+    return iter == _by_name.end() ? no_rules : iter->second;
+}
+
+}
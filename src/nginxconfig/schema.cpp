@@ -0,0 +1,572 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/ast.hpp>
+#include <nginxconfig/fingerprint.hpp>
+#include <nginxconfig/schema.hpp>
+
+#include <strings.h>
+
+namespace nginxconfig
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Standard Modules                                                                                                   //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+constexpr unsigned int main_    = context_main;
+constexpr unsigned int events   = context_events;
+constexpr unsigned int http     = context_http;
+constexpr unsigned int srv      = context_http_server;
+constexpr unsigned int loc      = context_http_location;
+constexpr unsigned int ups      = context_http_upstream;
+constexpr unsigned int sif      = context_http_server_if;
+constexpr unsigned int lif      = context_http_location_if;
+constexpr unsigned int lmt      = context_limit_except;
+constexpr unsigned int mail     = context_mail;
+constexpr unsigned int mail_srv = context_mail_server;
+constexpr unsigned int strm     = context_stream;
+constexpr unsigned int strm_srv = context_stream_server;
+constexpr unsigned int strm_ups = context_stream_upstream;
+constexpr unsigned int opaque   = context_opaque;
+
+constexpr unsigned int http_hs  = http | srv;
+constexpr unsigned int http_hsl = http | srv | loc;
+constexpr unsigned int rewrite  = srv | sif | loc | lif;
+constexpr unsigned int ssl_all  = http | srv | mail | mail_srv | strm | strm_srv;
+
+constexpr unsigned int block    = args_block;
+
+constexpr directive_schema core_module[] =
+{
+    { "daemon",                    main_,                 args_flag,                     0 },
+    { "debug_points",              main_,                 args_take1,                    0 },
+    { "env",                       main_,                 args_take1,                    0 },
+    { "error_log",                 main_ | http_hsl | mail | mail_srv | strm | strm_srv,
+                                                          args_1more,                    0 },
+    { "events",                    main_,                 block | args_none,             events },
+    { "include",                   context_any,           args_take1,                    0 },
+    { "load_module",               main_,                 args_take1,                    0 },
+    { "lock_file",                 main_,                 args_take1,                    0 },
+    { "master_process",            main_,                 args_flag,                     0 },
+    { "pcre_jit",                  main_,                 args_flag,                     0 },
+    { "pid",                       main_,                 args_take1,                    0 },
+    { "ssl_engine",                main_,                 args_take1,                    0 },
+    { "thread_pool",               main_,                 args_take23,                   0 },
+    { "timer_resolution",          main_,                 args_take1,                    0 },
+    { "user",                      main_,                 args_take12,                   0 },
+    { "worker_cpu_affinity",       main_,                 args_1more,                    0 },
+    { "worker_priority",           main_,                 args_take1,                    0 },
+    { "worker_processes",          main_,                 args_take1,                    0 },
+    { "worker_rlimit_core",        main_,                 args_take1,                    0 },
+    { "worker_rlimit_nofile",      main_,                 args_take1,                    0 },
+    { "worker_shutdown_timeout",   main_,                 args_take1,                    0 },
+    { "working_directory",         main_,                 args_take1,                    0 },
+};
+
+constexpr directive_schema events_module[] =
+{
+    { "accept_mutex",              events,                args_flag,                     0 },
+    { "accept_mutex_delay",        events,                args_take1,                    0 },
+    { "debug_connection",          events,                args_take1,                    0 },
+    { "multi_accept",              events,                args_flag,                     0 },
+    { "use",                       events,                args_take1,                    0 },
+    { "worker_aio_requests",       events,                args_take1,                    0 },
+    { "worker_connections",        events,                args_take1,                    0 },
+};
+
+constexpr directive_schema http_core_module[] =
+{
+    { "http",                      main_,                 block | args_none,             http },
+    { "server",                    http,                  block | args_none,             srv },
+    { "location",                  srv | loc,             block | args_take12,           loc },
+    { "limit_except",              loc,                   block | args_1more,            lmt },
+    { "types",                     http_hsl,              block | args_none,             opaque },
+    { "absolute_redirect",         http_hsl,              args_flag,                     0 },
+    { "aio",                       http_hsl,              args_take1,                    0 },
+    { "alias",                     loc,                   args_take1,                    0 },
+    { "chunked_transfer_encoding", http_hsl,              args_flag,                     0 },
+    { "client_body_buffer_size",   http_hsl,              args_take1,                    0 },
+    { "client_body_in_file_only",  http_hsl,              args_take1,                    0 },
+    { "client_body_in_single_buffer", http_hsl,           args_flag,                     0 },
+    { "client_body_temp_path",     http_hsl,              args_take1234,                 0 },
+    { "client_body_timeout",       http_hsl,              args_take1,                    0 },
+    { "client_header_buffer_size", http_hs,               args_take1,                    0 },
+    { "client_header_timeout",     http_hs,               args_take1,                    0 },
+    { "client_max_body_size",      http_hsl,              args_take1,                    0 },
+    { "connection_pool_size",      http_hs,               args_take1,                    0 },
+    { "default_type",              http_hsl,              args_take1,                    0 },
+    { "directio",                  http_hsl,              args_take1,                    0 },
+    { "disable_symlinks",          http_hsl,              args_take12,                   0 },
+    { "error_page",                http_hsl | lif,        args_2more,                    0 },
+    { "etag",                      http_hsl,              args_flag,                     0 },
+    { "if_modified_since",         http_hsl,              args_take1,                    0 },
+    { "ignore_invalid_headers",    http_hs,               args_flag,                     0 },
+    { "internal",                  loc,                   args_none,                     0 },
+    { "keepalive_disable",         http_hsl,              args_take12,                   0 },
+    { "keepalive_requests",        http_hsl | ups,        args_take1,                    0 },
+    { "keepalive_timeout",         http_hsl | ups,        args_take12,                   0 },
+    { "large_client_header_buffers", http_hs,             args_take2,                    0 },
+    { "limit_rate",                http_hsl | lif,        args_take1,                    0 },
+    { "limit_rate_after",          http_hsl | lif,        args_take1,                    0 },
+    { "lingering_close",           http_hsl,              args_take1,                    0 },
+    { "lingering_time",            http_hsl,              args_take1,                    0 },
+    { "lingering_timeout",         http_hsl,              args_take1,                    0 },
+    { "listen",                    srv,                   args_1more,                    0 },
+    { "log_not_found",             http_hsl,              args_flag,                     0 },
+    { "log_subrequest",            http_hsl,              args_flag,                     0 },
+    { "max_ranges",                http_hsl,              args_take1,                    0 },
+    { "merge_slashes",             http_hs,               args_flag,                     0 },
+    { "msie_padding",              http_hsl,              args_flag,                     0 },
+    { "open_file_cache",           http_hsl,              args_take12,                   0 },
+    { "open_file_cache_errors",    http_hsl,              args_flag,                     0 },
+    { "open_file_cache_min_uses",  http_hsl,              args_take1,                    0 },
+    { "open_file_cache_valid",     http_hsl,              args_take1,                    0 },
+    { "output_buffers",            http_hsl,              args_take2,                    0 },
+    { "port_in_redirect",          http_hsl,              args_flag,                     0 },
+    { "postpone_output",           http_hsl,              args_take1,                    0 },
+    { "recursive_error_pages",     http_hsl,              args_flag,                     0 },
+    { "request_pool_size",         http_hs,               args_take1,                    0 },
+    { "reset_timedout_connection", http_hsl,              args_flag,                     0 },
+    { "resolver",                  http_hsl,              args_1more,                    0 },
+    { "resolver_timeout",          http_hsl,              args_take1,                    0 },
+    { "root",                      http_hsl | lif,        args_take1,                    0 },
+    { "satisfy",                   http_hsl,              args_take1,                    0 },
+    { "send_lowat",                http_hsl,              args_take1,                    0 },
+    { "send_timeout",              http_hsl,              args_take1,                    0 },
+    { "sendfile",                  http_hsl | lif,        args_flag,                     0 },
+    { "sendfile_max_chunk",        http_hsl,              args_take1,                    0 },
+    { "server_name",               srv,                   args_1more,                    0 },
+    { "server_name_in_redirect",   http_hsl,              args_flag,                     0 },
+    { "server_names_hash_bucket_size", http,              args_take1,                    0 },
+    { "server_names_hash_max_size", http,                 args_take1,                    0 },
+    { "server_tokens",             http_hsl,              args_take1,                    0 },
+    { "subrequest_output_buffer_size", http_hsl,          args_take1,                    0 },
+    { "tcp_nodelay",               http_hsl,              args_flag,                     0 },
+    { "tcp_nopush",                http_hsl,              args_flag,                     0 },
+    { "try_files",                 srv | loc,             args_2more,                    0 },
+    { "types_hash_bucket_size",    http_hsl,              args_take1,                    0 },
+    { "types_hash_max_size",       http_hsl,              args_take1,                    0 },
+    { "underscores_in_headers",    http_hs,               args_flag,                     0 },
+    { "variables_hash_bucket_size", http,                 args_take1,                    0 },
+    { "variables_hash_max_size",   http,                  args_take1,                    0 },
+};
+
+constexpr directive_schema http_modules[] =
+{
+    // ngx_http_access_module, ngx_http_auth_basic_module, ngx_http_auth_request_module
+    { "allow",                     http_hsl | lmt,        args_take1,                    0 },
+    { "deny",                      http_hsl | lmt,        args_take1,                    0 },
+    { "auth_basic",                http_hsl | lmt,        args_take1,                    0 },
+    { "auth_basic_user_file",      http_hsl | lmt,        args_take1,                    0 },
+    { "auth_request",              srv | loc,             args_take1,                    0 },
+    { "auth_request_set",          srv | loc,             args_take2,                    0 },
+    // ngx_http_autoindex_module, ngx_http_index_module, ngx_http_stub_status_module
+    { "autoindex",                 http_hsl,              args_flag,                     0 },
+    { "autoindex_exact_size",      http_hsl,              args_flag,                     0 },
+    { "autoindex_format",          http_hsl,              args_take1,                    0 },
+    { "autoindex_localtime",       http_hsl,              args_flag,                     0 },
+    { "index",                     http_hsl,              args_1more,                    0 },
+    { "stub_status",               srv | loc,             args_none | args_take1,        0 },
+    // ngx_http_charset_module
+    { "charset",                   http_hsl | lif,        args_take1,                    0 },
+    { "charset_map",               http,                  block | args_take2,            opaque },
+    { "source_charset",            http_hsl | lif,        args_take1,                    0 },
+    // ngx_http_gzip_module, ngx_http_gzip_static_module
+    { "gzip",                      http_hsl | lif,        args_flag,                     0 },
+    { "gzip_buffers",              http_hsl,              args_take2,                    0 },
+    { "gzip_comp_level",           http_hsl,              args_take1,                    0 },
+    { "gzip_disable",              http_hsl,              args_1more,                    0 },
+    { "gzip_http_version",         http_hsl,              args_take1,                    0 },
+    { "gzip_min_length",           http_hsl,              args_take1,                    0 },
+    { "gzip_proxied",              http_hsl,              args_1more,                    0 },
+    { "gzip_static",               http_hsl,              args_take1,                    0 },
+    { "gzip_types",                http_hsl,              args_1more,                    0 },
+    { "gzip_vary",                 http_hsl,              args_flag,                     0 },
+    // ngx_http_headers_module
+    { "add_header",                http_hsl | lif,        args_take23,                   0 },
+    { "add_trailer",               http_hsl | lif,        args_take23,                   0 },
+    { "expires",                   http_hsl | lif,        args_take12,                   0 },
+    // ngx_http_log_module
+    { "access_log",                http_hsl | lif | lmt,  args_1more,                    0 },
+    { "log_format",                http,                  args_2more,                    0 },
+    { "open_log_file_cache",       http_hsl,              args_take1234,                 0 },
+    // ngx_http_limit_conn_module, ngx_http_limit_req_module
+    { "limit_conn",                http_hsl,              args_take2,                    0 },
+    { "limit_conn_log_level",      http_hsl,              args_take1,                    0 },
+    { "limit_conn_status",         http_hsl,              args_take1,                    0 },
+    { "limit_conn_zone",           http,                  args_take2,                    0 },
+    { "limit_req",                 http_hsl,              args_take123,                  0 },
+    { "limit_req_log_level",       http_hsl,              args_take1,                    0 },
+    { "limit_req_status",          http_hsl,              args_take1,                    0 },
+    { "limit_req_zone",            http,                  args_take34,                   0 },
+    // ngx_http_map_module, ngx_http_geo_module, ngx_http_split_clients_module
+    { "geo",                       http,                  block | args_take12,           opaque },
+    { "map",                       http,                  block | args_take2,            opaque },
+    { "map_hash_bucket_size",      http,                  args_take1,                    0 },
+    { "map_hash_max_size",         http,                  args_take1,                    0 },
+    { "split_clients",             http,                  block | args_take2,            opaque },
+    // ngx_http_mirror_module, ngx_http_realip_module, ngx_http_ssi_module, ngx_http_sub_module
+    { "mirror",                    http_hsl,              args_take1,                    0 },
+    { "real_ip_header",            http_hsl,              args_take1,                    0 },
+    { "real_ip_recursive",         http_hsl,              args_flag,                     0 },
+    { "set_real_ip_from",          http_hsl,              args_take1,                    0 },
+    { "ssi",                       http_hsl | lif,        args_flag,                     0 },
+    { "sub_filter",                http_hsl,              args_take2,                    0 },
+    { "sub_filter_once",           http_hsl,              args_flag,                     0 },
+    { "sub_filter_types",          http_hsl,              args_1more,                    0 },
+    // ngx_http_rewrite_module
+    { "if",                        srv,                   block | args_1more,            sif },
+    { "if",                        loc,                   block | args_1more,            lif },
+    { "break",                     rewrite,               args_none,                     0 },
+    { "return",                    rewrite,               args_take12,                   0 },
+    { "rewrite",                   rewrite,               args_take23,                   0 },
+    { "rewrite_log",               http | rewrite,        args_flag,                     0 },
+    { "set",                       rewrite,               args_take2,                    0 },
+    { "uninitialized_variable_warn", http | rewrite,      args_flag,                     0 },
+    // ngx_http_upstream_module
+    { "upstream",                  http,                  block | args_take1,            ups },
+    { "server",                    ups,                   args_1more,                    0 },
+    { "hash",                      ups,                   args_take12,                   0 },
+    { "ip_hash",                   ups,                   args_none,                     0 },
+    { "keepalive",                 ups,                   args_take1,                    0 },
+    { "least_conn",                ups,                   args_none,                     0 },
+    { "random",                    ups,                   args_none | args_take12,       0 },
+    { "zone",                      ups,                   args_take12,                   0 },
+};
+
+constexpr directive_schema http_proxy_modules[] =
+{
+    // ngx_http_proxy_module
+    { "proxy_bind",                http_hsl,              args_take12,                   0 },
+    { "proxy_buffer_size",         http_hsl,              args_take1,                    0 },
+    { "proxy_buffering",           http_hsl,              args_flag,                     0 },
+    { "proxy_buffers",             http_hsl,              args_take2,                    0 },
+    { "proxy_busy_buffers_size",   http_hsl,              args_take1,                    0 },
+    { "proxy_cache",               http_hsl,              args_take1,                    0 },
+    { "proxy_cache_bypass",        http_hsl,              args_1more,                    0 },
+    { "proxy_cache_key",           http_hsl,              args_take1,                    0 },
+    { "proxy_cache_lock",          http_hsl,              args_flag,                     0 },
+    { "proxy_cache_methods",       http_hsl,              args_1more,                    0 },
+    { "proxy_cache_path",          http,                  args_2more,                    0 },
+    { "proxy_cache_use_stale",     http_hsl,              args_1more,                    0 },
+    { "proxy_cache_valid",         http_hsl,              args_1more,                    0 },
+    { "proxy_connect_timeout",     http_hsl,              args_take1,                    0 },
+    { "proxy_cookie_domain",       http_hsl,              args_take12,                   0 },
+    { "proxy_cookie_path",         http_hsl,              args_take12,                   0 },
+    { "proxy_headers_hash_bucket_size", http_hsl,         args_take1,                    0 },
+    { "proxy_headers_hash_max_size", http_hsl,            args_take1,                    0 },
+    { "proxy_hide_header",         http_hsl,              args_take1,                    0 },
+    { "proxy_http_version",        http_hsl,              args_take1,                    0 },
+    { "proxy_ignore_headers",      http_hsl,              args_1more,                    0 },
+    { "proxy_intercept_errors",    http_hsl,              args_flag,                     0 },
+    { "proxy_limit_rate",          http_hsl,              args_take1,                    0 },
+    { "proxy_max_temp_file_size",  http_hsl,              args_take1,                    0 },
+    { "proxy_method",              http_hsl,              args_take1,                    0 },
+    { "proxy_next_upstream",       http_hsl,              args_1more,                    0 },
+    { "proxy_next_upstream_timeout", http_hsl,            args_take1,                    0 },
+    { "proxy_next_upstream_tries", http_hsl,              args_take1,                    0 },
+    { "proxy_no_cache",            http_hsl,              args_1more,                    0 },
+    { "proxy_pass",                loc | lif | lmt,       args_take1,                    0 },
+    { "proxy_pass_header",         http_hsl,              args_take1,                    0 },
+    { "proxy_pass_request_body",   http_hsl,              args_flag,                     0 },
+    { "proxy_pass_request_headers", http_hsl,             args_flag,                     0 },
+    { "proxy_read_timeout",        http_hsl,              args_take1,                    0 },
+    { "proxy_redirect",            http_hsl,              args_take12,                   0 },
+    { "proxy_request_buffering",   http_hsl,              args_flag,                     0 },
+    { "proxy_send_timeout",        http_hsl,              args_take1,                    0 },
+    { "proxy_set_body",            http_hsl,              args_take1,                    0 },
+    { "proxy_set_header",          http_hsl,              args_take2,                    0 },
+    { "proxy_socket_keepalive",    http_hsl,              args_flag,                     0 },
+    { "proxy_ssl_certificate",     http_hsl,              args_take1,                    0 },
+    { "proxy_ssl_certificate_key", http_hsl,              args_take1,                    0 },
+    { "proxy_ssl_ciphers",         http_hsl,              args_take1,                    0 },
+    { "proxy_ssl_name",            http_hsl,              args_take1,                    0 },
+    { "proxy_ssl_protocols",       http_hsl,              args_1more,                    0 },
+    { "proxy_ssl_server_name",     http_hsl,              args_flag,                     0 },
+    { "proxy_ssl_session_reuse",   http_hsl,              args_flag,                     0 },
+    { "proxy_ssl_trusted_certificate", http_hsl,          args_take1,                    0 },
+    { "proxy_ssl_verify",          http_hsl,              args_flag,                     0 },
+    { "proxy_store",               http_hsl,              args_take1,                    0 },
+    { "proxy_temp_path",           http_hsl,              args_take1234,                 0 },
+    // ngx_http_fastcgi_module
+    { "fastcgi_buffer_size",       http_hsl,              args_take1,                    0 },
+    { "fastcgi_buffering",         http_hsl,              args_flag,                     0 },
+    { "fastcgi_buffers",           http_hsl,              args_take2,                    0 },
+    { "fastcgi_cache",             http_hsl,              args_take1,                    0 },
+    { "fastcgi_cache_key",         http_hsl,              args_take1,                    0 },
+    { "fastcgi_cache_path",        http,                  args_2more,                    0 },
+    { "fastcgi_cache_valid",       http_hsl,              args_1more,                    0 },
+    { "fastcgi_connect_timeout",   http_hsl,              args_take1,                    0 },
+    { "fastcgi_hide_header",       http_hsl,              args_take1,                    0 },
+    { "fastcgi_ignore_headers",    http_hsl,              args_1more,                    0 },
+    { "fastcgi_index",             http_hsl,              args_take1,                    0 },
+    { "fastcgi_intercept_errors",  http_hsl,              args_flag,                     0 },
+    { "fastcgi_keep_conn",         http_hsl,              args_flag,                     0 },
+    { "fastcgi_next_upstream",     http_hsl,              args_1more,                    0 },
+    { "fastcgi_param",             http_hsl,              args_take23,                   0 },
+    { "fastcgi_pass",              loc | lif,             args_take1,                    0 },
+    { "fastcgi_pass_header",       http_hsl,              args_take1,                    0 },
+    { "fastcgi_read_timeout",      http_hsl,              args_take1,                    0 },
+    { "fastcgi_send_timeout",      http_hsl,              args_take1,                    0 },
+    { "fastcgi_split_path_info",   loc,                   args_take1,                    0 },
+    { "fastcgi_temp_path",         http_hsl,              args_take1234,                 0 },
+    // ngx_http_grpc_module, ngx_http_memcached_module, ngx_http_scgi_module, ngx_http_uwsgi_module
+    { "grpc_pass",                 loc | lif,             args_take1,                    0 },
+    { "grpc_read_timeout",         http_hsl,              args_take1,                    0 },
+    { "grpc_set_header",           http_hsl,              args_take2,                    0 },
+    { "memcached_pass",            loc | lif,             args_take1,                    0 },
+    { "scgi_param",                http_hsl,              args_take23,                   0 },
+    { "scgi_pass",                 loc | lif,             args_take1,                    0 },
+    { "uwsgi_param",               http_hsl,              args_take23,                   0 },
+    { "uwsgi_pass",                loc | lif,             args_take1,                    0 },
+};
+
+constexpr directive_schema ssl_modules[] =
+{
+    // ngx_http_ssl_module, ngx_mail_ssl_module, ngx_stream_ssl_module
+    { "ssl",                       http_hs | mail | mail_srv, args_flag,                 0 },
+    { "ssl_buffer_size",           http_hs,               args_take1,                    0 },
+    { "ssl_certificate",           ssl_all,               args_take1,                    0 },
+    { "ssl_certificate_key",       ssl_all,               args_take1,                    0 },
+    { "ssl_ciphers",               ssl_all,               args_take1,                    0 },
+    { "ssl_client_certificate",    ssl_all,               args_take1,                    0 },
+    { "ssl_dhparam",               ssl_all,               args_take1,                    0 },
+    { "ssl_early_data",            http_hs,               args_flag,                     0 },
+    { "ssl_ecdh_curve",            ssl_all,               args_take1,                    0 },
+    { "ssl_password_file",         ssl_all,               args_take1,                    0 },
+    { "ssl_prefer_server_ciphers", ssl_all,               args_flag,                     0 },
+    { "ssl_protocols",             ssl_all,               args_1more,                    0 },
+    { "ssl_session_cache",         ssl_all,               args_take12,                   0 },
+    { "ssl_session_ticket_key",    ssl_all,               args_take1,                    0 },
+    { "ssl_session_tickets",       ssl_all,               args_flag,                     0 },
+    { "ssl_session_timeout",       ssl_all,               args_take1,                    0 },
+    { "ssl_stapling",              http_hs,               args_flag,                     0 },
+    { "ssl_stapling_verify",       http_hs,               args_flag,                     0 },
+    { "ssl_trusted_certificate",   ssl_all,               args_take1,                    0 },
+    { "ssl_verify_client",         ssl_all,               args_take1,                    0 },
+    { "ssl_verify_depth",          ssl_all,               args_take1,                    0 },
+};
+
+constexpr directive_schema stream_modules[] =
+{
+    { "stream",                    main_,                 block | args_none,             strm },
+    { "server",                    strm,                  block | args_none,             strm_srv },
+    { "upstream",                  strm,                  block | args_take1,            strm_ups },
+    { "server",                    strm_ups,              args_1more,                    0 },
+    { "hash",                      strm_ups,              args_take12,                   0 },
+    { "least_conn",                strm_ups,              args_none,                     0 },
+    { "random",                    strm_ups,              args_none | args_take12,       0 },
+    { "zone",                      strm_ups,              args_take12,                   0 },
+    { "map",                       strm,                  block | args_take2,            opaque },
+    { "allow",                     strm | strm_srv,       args_take1,                    0 },
+    { "deny",                      strm | strm_srv,       args_take1,                    0 },
+    { "access_log",                strm | strm_srv,       args_1more,                    0 },
+    { "log_format",                strm,                  args_2more,                    0 },
+    { "listen",                    strm_srv,              args_1more,                    0 },
+    { "proxy_connect_timeout",     strm | strm_srv,       args_take1,                    0 },
+    { "proxy_pass",                strm_srv,              args_take1,                    0 },
+    { "proxy_protocol",            strm | strm_srv,       args_flag,                     0 },
+    { "proxy_timeout",             strm | strm_srv,       args_take1,                    0 },
+    { "resolver",                  strm | strm_srv,       args_1more,                    0 },
+    { "return",                    strm_srv,              args_take1,                    0 },
+    { "ssl_preread",               strm | strm_srv,       args_flag,                     0 },
+};
+
+constexpr directive_schema mail_modules[] =
+{
+    { "mail",                      main_,                 block | args_none,             mail },
+    { "server",                    mail,                  block | args_none,             mail_srv },
+    { "auth_http",                 mail | mail_srv,       args_take1,                    0 },
+    { "imap_capabilities",         mail | mail_srv,       args_1more,                    0 },
+    { "listen",                    mail_srv,              args_1more,                    0 },
+    { "pop3_capabilities",         mail | mail_srv,       args_1more,                    0 },
+    { "protocol",                  mail_srv,              args_take1,                    0 },
+    { "proxy_pass_error_message",  mail | mail_srv,       args_flag,                     0 },
+    { "server_name",               mail | mail_srv,       args_take1,                    0 },
+    { "smtp_auth",                 mail | mail_srv,       args_1more,                    0 },
+    { "starttls",                  mail | mail_srv,       args_take1,                    0 },
+    { "xclient",                   mail | mail_srv,       args_flag,                     0 },
+};
+
+schema_registry create_standard_registry()
+{
+    schema_registry out;
+    out.add_module("core",       core_module);
+    out.add_module("events",     events_module);
+    out.add_module("http_core",  http_core_module);
+    out.add_module("http",       http_modules);
+    out.add_module("http_proxy", http_proxy_modules);
+    out.add_module("ssl",        ssl_modules);
+    out.add_module("stream",     stream_modules);
+    out.add_module("mail",       mail_modules);
+    return out;
+}
+
+bool arity_matches(unsigned int args, const ast_entry::attribute_list& attributes)
+{
+    auto count = attributes.size();
+    if (args & args_any)
+        return true;
+    else if (args & args_flag)
+        return count == 1;
+    else if ((args & args_1more) && count >= 1)
+        return true;
+    else if ((args & args_2more) && count >= 2)
+        return true;
+    else
+        return count <= 7 && (args & (1U << count));
+}
+
+/** Is \a attribute a value nginx takes for a flag? Like \c ngx_conf_set_flag_slot, this ignores case. **/
+bool is_flag_value(const std::string& attribute)
+{
+    std::string value = attribute_value(attribute);
+    return ::strcasecmp(value.c_str(), "on") == 0 || ::strcasecmp(value.c_str(), "off") == 0;
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// schema_registry                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+schema_registry::schema_registry() = default;
+
+schema_registry::schema_registry(const schema_registry& src) :
+        _directives(src._directives),
+        _modules(src._modules)
+{
+    reset_names();
+}
+
+schema_registry& schema_registry::operator=(const schema_registry& src)
+{
+    _directives = src._directives;
+    _modules    = src._modules;
+    reset_names();
+    return *this;
+}
+
+schema_registry::~schema_registry() noexcept = default;
+
+const schema_registry& schema_registry::standard()
+{
+    static const schema_registry instance = create_standard_registry();
+    return instance;
+}
+
+void schema_registry::reset_names()
+{
+    // The schemas point at the key they are stored under, which moves when the map is copied
+    for (auto& entry : _directives)
+        for (directive_schema& schema : entry.second)
+            schema.name = entry.first.c_str();
+}
+
+void schema_registry::add_module(const std::string& module_name, const directive_schema* first, const directive_schema* last)
+{
+    for ( ; first != last; ++first)
+    {
+        auto iter = _directives.find(first->name);
+        if (iter == _directives.end())
+            iter = _directives.emplace(first->name, std::vector<directive_schema>()).first;
+        directive_schema schema = *first;
+        schema.name = iter->first.c_str();
+        iter->second.push_back(schema);
+    }
+    _modules.push_back(module_name);
+}
+
+const std::vector<std::string>& schema_registry::modules() const
+{
+    return _modules;
+}
+
+bool schema_registry::contains(const std::string& name) const
+{
+    return _directives.count(name) != 0;
+}
+
+const directive_schema* schema_registry::find(const std::string& name, unsigned int context) const
+{
+    auto iter = _directives.find(name);
+    if (iter == _directives.end())
+        return nullptr;
+
+    for (const directive_schema& schema : iter->second)
+    {
+        if (schema.contexts & context)
+            return &schema;
+    }
+    return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Validation                                                                                                         //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void validate_impl(const ast_entry&       owner,
+                          const schema_registry& schema,
+                          unsigned int           context,
+                          schema_violation_list& out
+                         )
+{
+    for (const ast_entry& entry : owner.children())
+    {
+        if (entry.kind() == ast_entry_kind::comment)
+            continue;
+
+        const std::string& name = entry.name();
+        const directive_schema* directive = schema.find(name, context);
+        if (!directive)
+        {
+            if (schema.contains(name))
+                out.push_back({ &entry, "\"" + name + "\" directive is not allowed here" });
+            else
+                out.push_back({ &entry, "unknown directive \"" + name + "\"" });
+            continue;
+        }
+
+        bool is_block = entry.kind() == ast_entry_kind::complex;
+        if (is_block && !(directive->args & args_block))
+            out.push_back({ &entry, "directive \"" + name + "\" is not a block" });
+        else if (!is_block && (directive->args & args_block))
+            out.push_back({ &entry, "directive \"" + name + "\" has no opening \"{\"" });
+
+        if (!arity_matches(directive->args, entry.attributes()))
+        {
+            out.push_back({ &entry, "invalid number of arguments in \"" + name + "\" directive" });
+        }
+        else if ((directive->args & args_flag) && !is_flag_value(entry.attributes().front()))
+        {
+            out.push_back({ &entry,
+                            "invalid value \"" + entry.attributes().front() + "\" in \"" + name + "\" directive, "
+                            "it must be \"on\" or \"off\""
+                          }
+                         );
+        }
+
+        if (is_block && (directive->args & args_block) && directive->block_context != context_opaque)
+            validate_impl(entry, schema, directive->block_context, out);
+    }
+}
+
+schema_violation_list validate(const ast_entry& root, const schema_registry& schema, unsigned int context)
+{
+    schema_violation_list out;
+    validate_impl(root, schema, context, out);
+    return out;
+}
+
+}
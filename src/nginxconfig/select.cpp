@@ -0,0 +1,361 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/ast.hpp>
+#include <nginxconfig/select.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace nginxconfig
+{
+
+static bool is_named(const ast_entry& entry)
+{
+    return entry.kind() == ast_entry_kind::simple || entry.kind() == ast_entry_kind::complex;
+}
+
+static bool has_children(const ast_entry& entry)
+{
+    return entry.kind() == ast_entry_kind::complex || entry.kind() == ast_entry_kind::document;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// selector_error                                                                                                     //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static std::string selector_error_what(selector_error::size_type position, const std::string& message)
+{
+    std::ostringstream stream;
+    stream << "At char " << position << ": " << message;
+    return stream.str();
+}
+
+selector_error::selector_error(size_type position_, const std::string& message) :
+        std::invalid_argument(selector_error_what(position_, message)),
+        _position(position_)
+{ }
+
+selector_error::~selector_error() noexcept = default;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// document_index                                                                                                     //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+document_index::document_index(const ast_entry& document) :
+        _document(&document)
+{
+    // Walk in pre-order so every list ends up in document order
+    std::vector<std::pair<const ast_entry*, std::size_t>> stack = { { &document, 0 } };
+    while (!stack.empty())
+    {
+        auto& top = stack.back();
+        if (top.second == top.first->children().size())
+        {
+            stack.pop_back();
+            continue;
+        }
+
+        const ast_entry* owner = top.first;
+        const ast_entry& child = owner->children()[top.second++];
+        if (!is_named(child))
+            continue;
+
+        _all.push_back(&child);
+        _by_name[child.name()].push_back(&child);
+        _parents.emplace(&child, owner);
+        if (has_children(child))
+            stack.emplace_back(&child, 0);
+    }
+}
+
+document_index::~document_index() noexcept = default;
+
+const document_index::entry_list& document_index::find(const std::string& name) const
+{
+    static const entry_list empty;
+    auto iter = _by_name.find(name);
+    return iter == _by_name.end() ? empty : iter->second;
+}
+
+const ast_entry* document_index::parent(const ast_entry& entry) const
+{
+    auto iter = _parents.find(&entry);
+    return iter == _parents.end() ? nullptr : iter->second;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// selector                                                                                                           //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+/** A hand-written recursive descent parser for selector expressions. **/
+class selector_parser
+{
+public:
+    explicit selector_parser(const std::string& expression) :
+            _text(expression),
+            _pos(0)
+    { }
+
+    bool at_end() const { return _pos == _text.size(); }
+
+    char peek() const { return at_end() ? '\0' : _text[_pos]; }
+
+    std::size_t position() const { return _pos; }
+
+    /** Skip whitespace and report if any was skipped. **/
+    bool skip_space()
+    {
+        std::size_t start = _pos;
+        while (!at_end() && (peek() == ' ' || peek() == '\t'))
+            ++_pos;
+        return _pos != start;
+    }
+
+    bool consume(char c)
+    {
+        if (peek() != c)
+            return false;
+        ++_pos;
+        return true;
+    }
+
+    void expect(char c)
+    {
+        if (!consume(c))
+            fail(std::string("Expected '") + c + "'");
+    }
+
+    /** Read a bare identifier, stopping at whitespace and syntax characters. **/
+    std::string identifier(const char* stop_chars)
+    {
+        std::size_t start = _pos;
+        while (!at_end() && peek() != ' ' && peek() != '\t' && !std::strchr(stop_chars, peek()))
+            ++_pos;
+        return _text.substr(start, _pos - start);
+    }
+
+    /** Read a value, which can be quoted or bare. **/
+    std::string value()
+    {
+        char quote = peek();
+        if (quote != '"' && quote != '\'')
+            return identifier("]");
+
+        ++_pos;
+        auto end = _text.find(quote, _pos);
+        if (end == std::string::npos)
+            fail("Unterminated quoted value");
+        std::string out = _text.substr(_pos, end - _pos);
+        _pos = end + 1;
+        return out;
+    }
+
+    NGINXCONFIG_NO_RETURN void fail(const std::string& message) const
+    {
+        throw selector_error(_pos, message);
+    }
+
+private:
+    const std::string& _text;
+    std::size_t        _pos;
+};
+
+}
+
+selector::selector(const std::string& expression) :
+        _expression(expression),
+        _anchored(false)
+{
+    selector_parser parser(_expression);
+    parser.skip_space();
+    if (parser.consume('>'))
+    {
+        _anchored = true;
+        parser.skip_space();
+    }
+
+    bool direct_child = false;
+    while (true)
+    {
+        step s;
+        s.direct_child = direct_child;
+        if (!parser.consume('*'))
+        {
+            s.name = parser.identifier("[]>*=");
+            if (s.name.empty())
+                parser.fail("Expected a name or '*'");
+        }
+
+        while (parser.consume('['))
+        {
+            predicate p;
+            p.child     = parser.identifier("[]>=");
+            p.has_value = parser.consume('=');
+            if (p.has_value)
+                p.value = parser.value();
+            else if (p.child.empty())
+                parser.fail("Expected a name or '='");
+            parser.expect(']');
+            s.predicates.emplace_back(std::move(p));
+        }
+        _steps.emplace_back(std::move(s));
+
+        bool had_space = parser.skip_space();
+        if (parser.at_end())
+            break;
+        direct_child = parser.consume('>');
+        if (!direct_child && !had_space)
+            parser.fail("Unexpected character");
+        parser.skip_space();
+    }
+}
+
+selector::~selector() noexcept = default;
+
+bool selector::step_matches(const step& s, const ast_entry& entry) const
+{
+    if (!is_named(entry))
+        return false;
+    if (!s.name.empty() && entry.name() != s.name)
+        return false;
+
+    for (const predicate& p : s.predicates)
+    {
+        auto has_value = [&p] (const ast_entry& x)
+                         {
+                             const auto& attrs = x.attributes();
+                             return !p.has_value || std::find(attrs.begin(), attrs.end(), p.value) != attrs.end();
+                         };
+
+        if (p.child.empty())
+        {
+            if (!has_value(entry))
+                return false;
+        }
+        else
+        {
+            if (!has_children(entry))
+                return false;
+            const auto& children = entry.children();
+            bool found = std::any_of(children.begin(), children.end(),
+                                     [&] (const ast_entry& child)
+                                     {
+                                         return is_named(child) && child.name() == p.child && has_value(child);
+                                     }
+                                    );
+            if (!found)
+                return false;
+        }
+    }
+    return true;
+}
+
+bool selector::path_matches(const entry_list&          path,
+                            std::size_t                step_idx,
+                            std::size_t                path_idx,
+                            std::vector<unsigned char>& memo
+                           ) const
+{
+    // path[0] is always the document, which no step can match
+    if (path_idx == 0)
+        return false;
+
+    // 0 is not known yet, 1 is no and 2 is yes
+    unsigned char& known = memo[step_idx * path.size() + path_idx];
+    if (known != 0)
+        return known == 2;
+
+    const step& s = _steps[step_idx];
+    bool matches = false;
+    if (step_matches(s, *path[path_idx]))
+    {
+        if (step_idx == 0)
+            matches = !_anchored || path_idx == 1;
+        else if (s.direct_child)
+            matches = path_matches(path, step_idx - 1, path_idx - 1, memo);
+        else
+        {
+            for (std::size_t ancestor = path_idx - 1; ancestor > 0 && !matches; --ancestor)
+                matches = path_matches(path, step_idx - 1, ancestor, memo);
+        }
+    }
+
+    known = matches ? 2 : 1;
+    return matches;
+}
+
+bool selector::path_matches(const entry_list& path, std::vector<unsigned char>& memo) const
+{
+    memo.assign(_steps.size() * path.size(), 0);
+    return path_matches(path, _steps.size() - 1, path.size() - 1, memo);
+}
+
+selector::entry_list selector::select(const ast_entry& document) const
+{
+    entry_list out;
+    entry_list path = { &document };
+    std::vector<std::size_t> positions = { 0 };
+    std::vector<unsigned char> memo;
+    while (!path.empty())
+    {
+        const ast_entry* owner = path.back();
+        if (positions.back() == owner->children().size())
+        {
+            path.pop_back();
+            positions.pop_back();
+            continue;
+        }
+
+        const ast_entry& child = owner->children()[positions.back()++];
+        if (!is_named(child))
+            continue;
+
+        path.push_back(&child);
+        if (path_matches(path, memo))
+            out.push_back(&child);
+
+        if (has_children(child))
+            positions.push_back(0);
+        else
+            path.pop_back();
+    }
+    return out;
+}
+
+selector::entry_list selector::select(const document_index& index) const
+{
+    const step& last = _steps.back();
+    const entry_list& candidates = last.name.empty() ? index.all() : index.find(last.name);
+
+    entry_list out;
+    entry_list path;
+    std::vector<unsigned char> memo;
+    for (const ast_entry* candidate : candidates)
+    {
+        if (!step_matches(last, *candidate))
+            continue;
+
+        path.clear();
+        for (const ast_entry* x = candidate; x; x = index.parent(*x))
+            path.push_back(x);
+        std::reverse(path.begin(), path.end());
+
+        if (path_matches(path, memo))
+            out.push_back(candidate);
+    }
+    return out;
+}
+
+}
@@ -0,0 +1,533 @@
+/** \file
+ *
+ *  Copyright (c) 2014 by Travis Gockel. All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify it under the terms of the Apache License
+ *  as published by the Apache Software Foundation, either version 2 of the License, or (at your option) any later
+ *  version.
+ *
+ *  \author Travis Gockel (travis@gockelhut.com)
+**/
+#include <nginxconfig/ast.hpp>
+#include <nginxconfig/regex.hpp>
+#include <nginxconfig/server_name_index.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+namespace nginxconfig
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers                                                                                                            //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+using size_type = server_name_index::size_type;
+
+static const size_type npos = ~size_type(0);
+
+std::uint64_t hash_name(const std::string& name)
+{
+    // FNV-1a
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (char c : name)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string to_lower(std::string s)
+{
+    for (char& c : s)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return s;
+}
+
+std::string strip_quotes(const std::string& s)
+{
+    if (s.size() >= 2 && (s.front() == '"' || s.front() == '\'') && s.back() == s.front())
+        return s.substr(1, s.size() - 2);
+    else
+        return s;
+}
+
+std::vector<std::string> split_labels(const std::string& name)
+{
+    std::vector<std::string> out;
+    std::string::size_type pos = 0;
+    while (true)
+    {
+        auto pos_end = name.find('.', pos);
+        out.emplace_back(name.substr(pos, pos_end - pos));
+        if (pos_end == std::string::npos)
+            break;
+        pos = pos_end + 1;
+    }
+    return out;
+}
+
+bool is_all_digits(const std::string& s)
+{
+    return !s.empty() && std::all_of(s.begin(), s.end(), [] (char c) { return '0' <= c && c <= '9'; });
+}
+
+/** A hash table of exact names using open addressing with linear probing. **/
+class exact_table
+{
+public:
+    /** Insert \a name as belonging to \a server.
+     *
+     *  \returns \c nullptr on success or the server which already owned the name.
+    **/
+    const ast_entry* insert(const std::string& name, const ast_entry* server)
+    {
+        if ((_entries.size() + 1) * 2 > _slots.size())
+            rehash(std::max<size_type>(16, _slots.size() * 2));
+
+        std::uint64_t hash = hash_name(name);
+        size_type     mask = _slots.size() - 1;
+        for (size_type idx = hash & mask; ; idx = (idx + 1) & mask)
+        {
+            slot& s = _slots[idx];
+            if (s.index == npos)
+            {
+                s.hash  = hash;
+                s.index = _entries.size();
+                _entries.emplace_back(name, server);
+                return nullptr;
+            }
+            else if (s.hash == hash && _entries[s.index].first == name)
+            {
+                return _entries[s.index].second;
+            }
+        }
+    }
+
+    const ast_entry* find(const std::string& name) const
+    {
+        if (_slots.empty())
+            return nullptr;
+
+        std::uint64_t hash = hash_name(name);
+        size_type     mask = _slots.size() - 1;
+        for (size_type idx = hash & mask; ; idx = (idx + 1) & mask)
+        {
+            const slot& s = _slots[idx];
+            if (s.index == npos)
+                return nullptr;
+            else if (s.hash == hash && _entries[s.index].first == name)
+                return _entries[s.index].second;
+        }
+    }
+
+private:
+    struct slot
+    {
+        std::uint64_t hash  = 0;
+        size_type     index = npos;
+    };
+
+    void rehash(size_type capacity)
+    {
+        std::vector<slot> slots(capacity);
+        size_type mask = capacity - 1;
+        for (const slot& s : _slots)
+        {
+            if (s.index == npos)
+                continue;
+            size_type idx = s.hash & mask;
+            while (slots[idx].index != npos)
+                idx = (idx + 1) & mask;
+            slots[idx] = s;
+        }
+        _slots.swap(slots);
+    }
+
+private:
+    std::vector<slot>                                   _slots;
+    std::vector<std::pair<std::string, const ast_entry*>> _entries;
+};
+
+/** A trie over the labels of wildcard names. Leading wildcards are inserted with their labels reversed, so that
+ *  \c *.example.org becomes the path \c org -> \c example.
+**/
+class wildcard_trie
+{
+public:
+    wildcard_trie() :
+            _nodes(1)
+    { }
+
+    /** Insert the \a labels path. If \a include_self is set, the name matches the path itself as well as any name with
+     *  more labels (the \c .example.org form).
+     *
+     *  \returns \c nullptr on success or the server which already owned the name.
+    **/
+    const ast_entry* insert(const std::vector<std::string>& labels, bool include_self, const ast_entry* server)
+    {
+        size_type idx = 0;
+        for (const std::string& label : labels)
+        {
+            auto iter = _nodes[idx].children.find(label);
+            if (iter == _nodes[idx].children.end())
+            {
+                _nodes.emplace_back();
+                iter = _nodes[idx].children.emplace(label, _nodes.size() - 1).first;
+            }
+            idx = iter->second;
+        }
+
+        node& target = _nodes[idx];
+        if (target.subdomains)
+            return target.subdomains;
+        if (include_self && target.self)
+            return target.self;
+        target.subdomains = server;
+        if (include_self)
+            target.self = server;
+        return nullptr;
+    }
+
+    /** Find the longest match for \a labels, which must be in the same order used for \c insert. **/
+    template <typename FIter>
+    const ast_entry* find(FIter first, FIter last) const
+    {
+        const ast_entry* best = nullptr;
+        size_type idx = 0;
+        for (; first != last; ++first)
+        {
+            if (_nodes[idx].subdomains)
+                best = _nodes[idx].subdomains;
+
+            auto iter = _nodes[idx].children.find(*first);
+            if (iter == _nodes[idx].children.end())
+                return best;
+            idx = iter->second;
+        }
+        return _nodes[idx].self ? _nodes[idx].self : best;
+    }
+
+private:
+    struct node
+    {
+        std::map<std::string, size_type> children;
+        const ast_entry*                 subdomains = nullptr;
+        const ast_entry*                 self       = nullptr;
+    };
+
+    std::vector<node> _nodes;
+};
+
+struct regex_name
+{
+    std::shared_ptr<const regex_impl::regex> expression;
+    const ast_entry*                         server;
+};
+
+/** All the names for a single listen group. **/
+class name_group
+{
+public:
+    explicit name_group(std::string listen_) :
+            listen(std::move(listen_))
+    { }
+
+    /** Add a plain (non-regex) \a name, which must already be normalized.
+     *
+     *  \returns \c nullptr on success or the server which already owned the name.
+    **/
+    const ast_entry* add(const std::string& name, const ast_entry* server)
+    {
+        if (name.size() > 2 && name[0] == '*' && name[1] == '.')
+        {
+            auto labels = split_labels(name.substr(2));
+            std::reverse(labels.begin(), labels.end());
+            return head.insert(labels, false, server);
+        }
+        else if (name.size() > 1 && name[0] == '.')
+        {
+            auto labels = split_labels(name.substr(1));
+            std::reverse(labels.begin(), labels.end());
+            return head.insert(labels, true, server);
+        }
+        else if (name.size() > 2 && name[name.size() - 1] == '*' && name[name.size() - 2] == '.')
+        {
+            return tail.insert(split_labels(name.substr(0, name.size() - 2)), false, server);
+        }
+        else if (name.find('*') != std::string::npos)
+        {
+            // nginx rejects wildcards in the middle of a name, so it can never match anything
+            return nullptr;
+        }
+        else
+        {
+            return exact.insert(name, server);
+        }
+    }
+
+    const ast_entry* find(const std::string& host) const
+    {
+        if (const ast_entry* server = exact.find(host))
+            return server;
+
+        auto labels = split_labels(host);
+        if (const ast_entry* server = head.find(labels.rbegin(), labels.rend()))
+            return server;
+        if (const ast_entry* server = tail.find(labels.begin(), labels.end()))
+            return server;
+
+        for (const regex_name& name : regexes)
+        {
+            if (regex_impl::regex_search(host, *name.expression))
+                return name.server;
+        }
+        return nullptr;
+    }
+
+public:
+    std::string             listen;
+    const ast_entry*        default_server   = nullptr;
+    bool                    explicit_default = false;
+    exact_table             exact;
+    wildcard_trie           head;
+    wildcard_trie           tail;
+    std::vector<regex_name> regexes;
+};
+
+std::string normalize_host(const std::string& host)
+{
+    std::string out = to_lower(host);
+    if (!out.empty() && out.back() == '.')
+        out.pop_back();
+    return out;
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// server_name_index::impl                                                                                            //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class server_name_index::impl
+{
+public:
+    explicit impl(const ast_entry& document);
+
+    name_group& group_for(const std::string& listen);
+
+    const name_group* find_group(const std::string& listen) const;
+
+    void add_server(const ast_entry& server);
+
+public:
+    name_group                                 any;
+    std::vector<name_group>                    groups;
+    std::unordered_map<std::string, size_type> group_indices;
+    conflict_list                              conflicts;
+    unindexable_list                           unindexables;
+};
+
+server_name_index::impl::impl(const ast_entry& document) :
+        any("")
+{
+    for (const ast_entry& http : document.children())
+    {
+        if (http.kind() != ast_entry_kind::complex || http.name() != "http")
+            continue;
+
+        for (const ast_entry& server : http.children())
+        {
+            if (server.kind() == ast_entry_kind::complex && server.name() == "server")
+                add_server(server);
+        }
+    }
+}
+
+name_group& server_name_index::impl::group_for(const std::string& listen)
+{
+    auto iter = group_indices.find(listen);
+    if (iter == group_indices.end())
+    {
+        iter = group_indices.emplace(listen, groups.size()).first;
+        groups.emplace_back(listen);
+    }
+    return groups[iter->second];
+}
+
+const name_group* server_name_index::impl::find_group(const std::string& listen) const
+{
+    auto iter = group_indices.find(listen);
+    return iter == group_indices.end() ? nullptr : &groups[iter->second];
+}
+
+void server_name_index::impl::add_server(const ast_entry& server)
+{
+    std::vector<std::pair<std::string, bool>> listens;
+    std::vector<std::string>                  names;
+    for (const ast_entry& child : server.children())
+    {
+        if (child.kind() != ast_entry_kind::simple)
+            continue;
+
+        if (child.name() == "listen")
+        {
+            const auto& attrs = child.attributes();
+            bool is_default = std::any_of(attrs.begin(), attrs.end(),
+                                          [] (const std::string& x) { return x == "default_server" || x == "default"; }
+                                         );
+            listens.emplace_back(normalize_listen(child), is_default);
+        }
+        else if (child.name() == "server_name")
+        {
+            for (const std::string& attr : child.attributes())
+                names.emplace_back(strip_quotes(attr));
+        }
+    }
+    if (listens.empty())
+        listens.emplace_back("*:80", false);
+
+    // Regular expressions are compiled once and shared between all the groups the server is in
+    std::vector<regex_name> regexes;
+    for (const std::string& name : names)
+    {
+        if (!name.empty() && name[0] == '~')
+        {
+            auto flags = regex_impl::regex_constants::ECMAScript | regex_impl::regex_constants::icase;
+            try
+            {
+                std::string pattern = regex_impl::translate_pcre(name.substr(1), flags);
+                regexes.push_back({ std::make_shared<regex_impl::regex>(pattern, flags), &server });
+            }
+            catch (const regex_impl::regex_error& ex)
+            {
+                unindexables.push_back({ name, &server, ex.what() });
+            }
+        }
+    }
+
+    for (const auto& listen : listens)
+    {
+        name_group& group = group_for(listen.first);
+        if (listen.second && !group.explicit_default)
+        {
+            group.default_server   = &server;
+            group.explicit_default = true;
+        }
+        else if (!group.default_server)
+        {
+            group.default_server = &server;
+        }
+
+        for (const std::string& name : names)
+        {
+            if (!name.empty() && name[0] == '~')
+                continue;
+
+            std::string normalized = normalize_host(name);
+            if (const ast_entry* existing = group.add(normalized, &server))
+                conflicts.push_back({ group.listen, normalized, existing, &server });
+        }
+        group.regexes.insert(group.regexes.end(), regexes.begin(), regexes.end());
+    }
+
+    for (const std::string& name : names)
+    {
+        if (name.empty() || name[0] != '~')
+            any.add(normalize_host(name), &server);
+    }
+    any.regexes.insert(any.regexes.end(), regexes.begin(), regexes.end());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// server_name_index                                                                                                  //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+server_name_index::server_name_index(const ast_entry& document) :
+        _impl(new impl(document))
+{ }
+
+server_name_index::server_name_index(server_name_index&&) noexcept = default;
+server_name_index& server_name_index::operator=(server_name_index&&) noexcept = default;
+
+server_name_index::~server_name_index() noexcept = default;
+
+const ast_entry* server_name_index::find(const std::string& host) const
+{
+    return _impl->any.find(normalize_host(host));
+}
+
+const ast_entry* server_name_index::find(const std::string& listen, const std::string& host) const
+{
+    const name_group* group = _impl->find_group(listen);
+    return group ? group->find(normalize_host(host)) : nullptr;
+}
+
+const ast_entry* server_name_index::default_server(const std::string& listen) const
+{
+    const name_group* group = _impl->find_group(listen);
+    return group ? group->default_server : nullptr;
+}
+
+std::vector<std::string> server_name_index::listen_groups() const
+{
+    std::vector<std::string> out;
+    out.reserve(_impl->groups.size());
+    for (const name_group& group : _impl->groups)
+        out.push_back(group.listen);
+    return out;
+}
+
+const server_name_index::conflict_list& server_name_index::conflicts() const
+{
+    return _impl->conflicts;
+}
+
+const server_name_index::unindexable_list& server_name_index::unindexables() const
+{
+    return _impl->unindexables;
+}
+
+std::string server_name_index::normalize_listen(const ast_entry& listen_directive)
+{
+    const auto& attrs = listen_directive.attributes();
+    if (attrs.empty())
+        return "*:80";
+
+    const std::string& addr = attrs.front();
+    if (addr.compare(0, 5, "unix:") == 0)
+    {
+        return addr;
+    }
+    else if (is_all_digits(addr))
+    {
+        return "*:" + addr;
+    }
+    else if (addr[0] == '[')
+    {
+        // IPv6 addresses always have their port after the closing bracket
+        auto close = addr.find(']');
+        if (close == std::string::npos || close + 1 == addr.size())
+            return to_lower(addr) + ":80";
+        else
+            return to_lower(addr);
+    }
+    else if (addr.find(':') == std::string::npos)
+    {
+        return to_lower(addr) + ":80";
+    }
+    else
+    {
+        return to_lower(addr);
+    }
+}
+
+}